@@ -22,9 +22,17 @@ bool SerializeDB(const CChainParams &chainParams, Stream &stream,
                  const Data &data) {
     // Write and commit header, data
     try {
+        // Serialize the data once, in memory: for the address manager this is
+        // the only part done under its lock, and the file write and checksum
+        // below no longer hold it up.
+        CDataStream ssData(SER_DISK, CLIENT_VERSION);
+        ssData << data;
+
         CHashWriter hasher(SER_DISK, CLIENT_VERSION);
-        stream << chainParams.DiskMagic() << data;
-        hasher << chainParams.DiskMagic() << data;
+        stream << chainParams.DiskMagic();
+        hasher << chainParams.DiskMagic();
+        stream.write(ssData.data(), ssData.size());
+        hasher.write(ssData.data(), ssData.size());
         stream << hasher.GetHash();
     } catch (const std::exception &e) {
         return error("%s: Serialize or I/O error - %s", __func__, e.what());
@@ -109,6 +109,7 @@ CAddrInfo *CAddrMan::Create(const CAddress &addr, const CNetAddr &addrSource,
     mapAddr[addr] = nId;
     mapInfo[nId].nRandomPos = vRandom.size();
     vRandom.push_back(nId);
+    m_size = vRandom.size();
     if (pnId) {
         *pnId = nId;
     }
@@ -143,6 +144,7 @@ void CAddrMan::Delete(int nId) {
 
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     vRandom.pop_back();
+    m_size = vRandom.size();
     mapAddr.erase(info);
     mapInfo.erase(nId);
     nNew--;
@@ -289,7 +291,7 @@ void CAddrMan::Good_(const CService &addr, bool test_before_evict,
 }
 
 bool CAddrMan::Add_(const CAddress &addr, const CNetAddr &source,
-                    int64_t nTimePenalty) {
+                    int64_t nTimePenalty, const NewPosition *pos) {
     if (!addr.IsRoutable()) {
         return false;
     }
@@ -349,8 +351,17 @@ bool CAddrMan::Add_(const CAddress &addr, const CNetAddr &source,
         fNew = true;
     }
 
-    int nUBucket = pinfo->GetNewBucket(nKey, source);
-    int nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    // The bucket only depends on the network address, but the position
+    // within it also depends on the port of the entry we have.
+    int nUBucket;
+    int nUBucketPos;
+    if (pos && static_cast<const CService &>(*pinfo) == addr) {
+        nUBucket = pos->nBucket;
+        nUBucketPos = pos->nBucketPos;
+    } else {
+        nUBucket = pinfo->GetNewBucket(nKey, source);
+        nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
+    }
     if (vvNew[nUBucket][nUBucketPos] != nId) {
         bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
         if (!fInsert) {
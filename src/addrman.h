@@ -13,6 +13,7 @@
 #include <timedata.h>
 #include <util/system.h>
 
+#include <atomic>
 #include <cstdint>
 #include <map>
 #include <set>
@@ -224,7 +225,16 @@ private:
     //! entries. Test-before-evict discipline used to resolve these collisions.
     std::set<int> m_tried_collisions;
 
+    //! vRandom.size(), readable without taking cs
+    std::atomic<size_t> m_size{0};
+
 protected:
+    //! Position of an address in the "new" table, hashed ahead of Add_
+    struct NewPosition {
+        int nBucket;
+        int nBucketPos;
+    };
+
     //! secret key to randomize bucket select with
     uint256 nKey;
 
@@ -258,9 +268,11 @@ protected:
     void Good_(const CService &addr, bool test_before_evict, int64_t time)
         EXCLUSIVE_LOCKS_REQUIRED(cs);
 
-    //! Add an entry to the "new" table.
+    //! Add an entry to the "new" table. If given, pos must have been computed
+    //! with the current nKey for addr and source.
     bool Add_(const CAddress &addr, const CNetAddr &source,
-              int64_t nTimePenalty) EXCLUSIVE_LOCKS_REQUIRED(cs);
+              int64_t nTimePenalty, const NewPosition *pos = nullptr)
+        EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     //! Mark an entry as attempted to connect.
     void Attempt_(const CService &addr, bool fCountFailure, int64_t nTime)
@@ -326,51 +338,63 @@ public:
      * deserialization code has very little in common.
      */
     template <typename Stream> void Serialize(Stream &s) const {
-        LOCK(cs);
+        // Copy the tables under the lock, and serialize the copy without it,
+        // so that writing peers.dat does not hold up Add and Select.
+        uint256 nKeyCopy;
+        std::vector<CAddrInfo> vNewInfos;
+        std::vector<CAddrInfo> vTriedInfos;
+        //! For each "new" bucket, the number of entries, then their indexes
+        //! in vNewInfos.
+        std::vector<int> vBuckets;
+        {
+            LOCK(cs);
+            nKeyCopy = nKey;
+            vNewInfos.reserve(nNew);
+            vTriedInfos.reserve(nTried);
+            std::map<int, int> mapUnkIds;
+            for (const auto &entry : mapInfo) {
+                mapUnkIds[entry.first] = vNewInfos.size();
+                const CAddrInfo &info = entry.second;
+                if (info.nRefCount) {
+                    // this means nNew was wrong, oh ow
+                    assert(int(vNewInfos.size()) != nNew);
+                    vNewInfos.push_back(info);
+                }
+                if (info.fInTried) {
+                    // this means nTried was wrong, oh ow
+                    assert(int(vTriedInfos.size()) != nTried);
+                    vTriedInfos.push_back(info);
+                }
+            }
+            for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
+                const size_t nSizePos = vBuckets.size();
+                vBuckets.push_back(0);
+                for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+                    if (vvNew[bucket][i] != -1) {
+                        vBuckets[nSizePos]++;
+                        vBuckets.push_back(mapUnkIds[vvNew[bucket][i]]);
+                    }
+                }
+            }
+        }
 
         uint8_t nVersion = 1;
         s << nVersion;
         s << uint8_t(32);
-        s << nKey;
-        s << nNew;
-        s << nTried;
+        s << nKeyCopy;
+        s << int(vNewInfos.size());
+        s << int(vTriedInfos.size());
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
-        int nIds = 0;
-        for (const auto &entry : mapInfo) {
-            mapUnkIds[entry.first] = nIds;
-            const CAddrInfo &info = entry.second;
-            if (info.nRefCount) {
-                // this means nNew was wrong, oh ow
-                assert(nIds != nNew);
-                s << info;
-                nIds++;
-            }
+        for (const CAddrInfo &info : vNewInfos) {
+            s << info;
         }
-        nIds = 0;
-        for (const auto &entry : mapInfo) {
-            const CAddrInfo &info = entry.second;
-            if (info.fInTried) {
-                // this means nTried was wrong, oh ow
-                assert(nIds != nTried);
-                s << info;
-                nIds++;
-            }
+        for (const CAddrInfo &info : vTriedInfos) {
+            s << info;
         }
-        for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
-            int nSize = 0;
-            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
-                if (vvNew[bucket][i] != -1) nSize++;
-            }
-            s << nSize;
-            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
-                if (vvNew[bucket][i] != -1) {
-                    int nIndex = mapUnkIds[vvNew[bucket][i]];
-                    s << nIndex;
-                }
-            }
+        for (const int n : vBuckets) {
+            s << n;
         }
     }
 
@@ -414,6 +438,7 @@ public:
             mapAddr[info] = n;
             info.nRandomPos = vRandom.size();
             vRandom.push_back(n);
+            m_size = vRandom.size();
             if (nVersion != 1 || nUBuckets != ADDRMAN_NEW_BUCKET_COUNT) {
                 // In case the new table data cannot be used (nVersion unknown,
                 // or bucket count wrong), immediately try to give them a
@@ -439,6 +464,7 @@ public:
                 info.nRandomPos = vRandom.size();
                 info.fInTried = true;
                 vRandom.push_back(nIdCount);
+                m_size = vRandom.size();
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
                 vvTried[nKBucket][nKBucketPos] = nIdCount;
@@ -515,6 +541,7 @@ public:
         nLastGood = 1;
         mapInfo.clear();
         mapAddr.clear();
+        m_size = 0;
     }
 
     CAddrMan() { Clear(); }
@@ -522,11 +549,7 @@ public:
     ~CAddrMan() { nKey.SetNull(); }
 
     //! Return the number of (unique) addresses in all tables.
-    size_t size() const {
-        // TODO: Cache this in an atomic to avoid this overhead
-        LOCK(cs);
-        return vRandom.size();
-    }
+    size_t size() const { return m_size; }
 
     //! Consistency check
     void Check() {
@@ -559,11 +582,32 @@ public:
     //! Add multiple addresses.
     bool Add(const std::vector<CAddress> &vAddr, const CNetAddr &source,
              int64_t nTimePenalty = 0) {
+        // Hashing the bucket positions is most of the work for a large addr
+        // message, so do it before taking the lock.
+        uint256 key;
+        {
+            LOCK(cs);
+            key = nKey;
+        }
+        std::vector<NewPosition> positions;
+        positions.reserve(vAddr.size());
+        for (const CAddress &a : vAddr) {
+            const CAddrInfo info(a, source);
+            const int nBucket = info.GetNewBucket(key, source);
+            positions.push_back(
+                {nBucket, info.GetBucketPosition(key, true, nBucket)});
+        }
+
         LOCK(cs);
+        // The key only changes when the table is cleared.
+        const bool fKeyChanged = key != nKey;
         int nAdd = 0;
         Check();
-        for (const CAddress &a : vAddr) {
-            nAdd += Add_(a, source, nTimePenalty) ? 1 : 0;
+        for (size_t i = 0; i < vAddr.size(); ++i) {
+            nAdd += Add_(vAddr[i], source, nTimePenalty,
+                         fKeyChanged ? nullptr : &positions[i])
+                        ? 1
+                        : 0;
         }
         Check();
         if (nAdd) {
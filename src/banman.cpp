@@ -10,6 +10,8 @@
 #include <util/system.h>
 #include <util/time.h>
 
+#include <algorithm>
+
 BanMan::BanMan(fs::path ban_file, const CChainParams &chainparams,
                CClientUIInterface *client_interface, int64_t default_ban_time)
     : m_client_interface(client_interface),
@@ -70,6 +72,7 @@ void BanMan::ClearBanned() {
     {
         LOCK(m_cs_banned);
         m_banned.clear();
+        RebuildSubNetIndex();
         m_is_dirty = true;
     }
     // store banlist to disk
@@ -92,12 +95,14 @@ bool BanMan::IsBanned(const CNetAddr &net_addr) const
     auto foundAddr = m_banned.addresses.find(net_addr);
     if (foundAddr != m_banned.addresses.end() && current_time < foundAddr->second.nBanUntil)
         return true;
-    // fall back to scanning for subnet bans
-    for (const auto &it : m_banned.subNets) {
-        const CSubNet &sub_net = it.first;
-        const CBanEntry &ban_entry = it.second;
-
-        if (current_time < ban_entry.nBanUntil && sub_net.Match(net_addr)) {
+    if (m_subnet_trie.Match(net_addr, current_time)) {
+        return true;
+    }
+    // fall back to scanning the subnets the trie can't hold
+    for (const CSubNet &sub_net : m_irregular_subnets) {
+        auto it = m_banned.subNets.find(sub_net);
+        if (it != m_banned.subNets.end() &&
+            current_time < it->second.nBanUntil && sub_net.Match(net_addr)) {
             return true;
         }
     }
@@ -177,6 +182,7 @@ void BanMan::Ban(const CSubNet &sub_net, int64_t ban_time_offset, bool since_uni
         if (m_banned.subNets[sub_net].nBanUntil < ban_entry.nBanUntil) {
             // new entry or overwrite existing entry because ban was extended
             m_banned.subNets[sub_net] = ban_entry;
+            IndexSubNet(sub_net, ban_entry.nBanUntil);
             m_is_dirty = true;
         } else {
             return;
@@ -192,6 +198,44 @@ void BanMan::Ban(const CSubNet &sub_net, int64_t ban_time_offset, bool since_uni
     }
 }
 
+size_t BanMan::BanMany(const std::vector<CSubNet> &sub_nets,
+                       int64_t ban_time_offset, bool since_unix_epoch) {
+    const CBanEntry ban_entry =
+        CreateBanEntry(ban_time_offset, since_unix_epoch);
+    size_t n_banned = 0;
+    {
+        LOCK(m_cs_banned);
+        for (const CSubNet &sub_net : sub_nets) {
+            if (!sub_net.IsValid()) {
+                continue;
+            }
+            // same tables as the single entry Ban() above
+            CBanEntry &entry = sub_net.IsSingleIP()
+                                   ? m_banned.addresses[sub_net.Network()]
+                                   : m_banned.subNets[sub_net];
+            if (entry.nBanUntil >= ban_entry.nBanUntil) {
+                continue;
+            }
+            entry = ban_entry;
+            if (!sub_net.IsSingleIP()) {
+                IndexSubNet(sub_net, ban_entry.nBanUntil);
+            }
+            ++n_banned;
+        }
+        if (n_banned == 0) {
+            return 0;
+        }
+        m_is_dirty = true;
+    }
+    if (m_client_interface) {
+        m_client_interface->BannedListChanged();
+    }
+
+    // store banlist to disk once for the whole batch
+    DumpBanlist();
+    return n_banned;
+}
+
 void BanMan::Discourage(const CNetAddr &net_addr)
 {
     LOCK(m_cs_banned);
@@ -223,6 +267,7 @@ bool BanMan::Unban(const CSubNet &sub_net) {
         if (m_banned.subNets.erase(sub_net) == 0) {
             return false;
         }
+        RebuildSubNetIndex();
         m_is_dirty = true;
     }
     UnbanCommon();
@@ -250,9 +295,28 @@ void BanMan::GetBanned(BanTables &banmap) {
 void BanMan::SetBanned(const BanTables &banmap) {
     LOCK(m_cs_banned);
     m_banned = banmap;
+    RebuildSubNetIndex();
     m_is_dirty = true;
 }
 
+void BanMan::IndexSubNet(const CSubNet &sub_net, int64_t ban_until) {
+    if (m_subnet_trie.Insert(sub_net, ban_until) || !sub_net.IsValid()) {
+        return;
+    }
+    if (std::find(m_irregular_subnets.begin(), m_irregular_subnets.end(),
+                  sub_net) == m_irregular_subnets.end()) {
+        m_irregular_subnets.push_back(sub_net);
+    }
+}
+
+void BanMan::RebuildSubNetIndex() {
+    m_subnet_trie.clear();
+    m_irregular_subnets.clear();
+    for (const auto &it : m_banned.subNets) {
+        IndexSubNet(it.first, it.second.nBanUntil);
+    }
+}
+
 void BanMan::SweepBanned() {
     const int64_t now = GetTime();
     bool notify_ui = false;
@@ -277,6 +341,9 @@ void BanMan::SweepBanned() {
                 }
             }
         }
+        if (notify_ui) {
+            RebuildSubNetIndex();
+        }
         {
             // sweep addresses
             auto it = m_banned.addresses.begin();
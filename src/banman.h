@@ -8,10 +8,12 @@
 #include <addrdb.h>
 #include <bloom.h>
 #include <fs.h>
+#include <subnettrie.h>
 #include <sync.h>
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 // Default 24-hour ban on manual bans. Automatic bans for misbehavior are always
 // "discouraged" until restart and/or ClearDiscouraged() is called.
@@ -61,6 +63,10 @@ public:
              bool since_unix_epoch = false, bool save_to_disk = true);
     void Ban(const CSubNet &sub_net, int64_t ban_time_offset = 0,
              bool since_unix_epoch = false, bool save_to_disk = true);
+    //! Ban many IPs/subnets at once (e.g. a blocklist), storing the banlist
+    //! to disk only once. Returns the number of new or extended bans.
+    size_t BanMany(const std::vector<CSubNet> &sub_nets,
+                   int64_t ban_time_offset = 0, bool since_unix_epoch = false);
     void Discourage(const CNetAddr &net_addr);
 
     //! Clears all the ban tables (but not the discouraged set)
@@ -70,11 +76,10 @@ public:
     //! Clears both the ban tables and the discouraged set.
     void ClearAll() { ClearDiscouraged(); ClearBanned(); }
 
-    //! Return whether net_addr is banned (complexity: constant or linear)
-    //  If net_addr is banned on a per-address level, the complexity here is
-    //  a constant-time lookup. If net_addr is not banned by address or is
-    //  banned by subnet, then the complexity of this check is linear to the
-    //  size of the subnet ban table.
+    //! Return whether net_addr is banned (complexity: constant)
+    //  Address bans are a hash table lookup and subnet bans a walk down a
+    //  prefix trie, neither of which depends on the number of bans. Only
+    //  subnets with a non-contiguous netmask are scanned linearly.
     bool IsBanned(const CNetAddr &net_addr) const;
 
     //! Return whether sub_net is exactly banned (complexity: constant)
@@ -103,10 +108,19 @@ private:
 
     CBanEntry CreateBanEntry(int64_t ban_time_offset, bool since_unix_epoch) const;
     void UnbanCommon();
+    //! Add or update sub_net in the subnet lookup structures
+    void IndexSubNet(const CSubNet &sub_net, int64_t ban_until)
+        EXCLUSIVE_LOCKS_REQUIRED(m_cs_banned);
+    //! Rebuild the subnet lookup structures from m_banned.subNets
+    void RebuildSubNetIndex() EXCLUSIVE_LOCKS_REQUIRED(m_cs_banned);
 
     mutable RecursiveMutex m_cs_banned;
     BanTables m_banned GUARDED_BY(m_cs_banned);
     bool m_is_dirty GUARDED_BY(m_cs_banned);
+    //! Index of the CIDR subnets in m_banned.subNets
+    SubNetTrie m_subnet_trie GUARDED_BY(m_cs_banned);
+    //! Banned subnets with a non-contiguous netmask, which the trie can't hold
+    std::vector<CSubNet> m_irregular_subnets GUARDED_BY(m_cs_banned);
     CClientUIInterface *m_client_interface = nullptr;
     CBanDB m_ban_db;
     const int64_t m_default_ban_time;
@@ -22,32 +22,44 @@ void benchmark::ConsolePrinter::header() {
               << std::endl;
 }
 
-void benchmark::ConsolePrinter::result(const State &state) {
+namespace {
+struct Summary {
+    double total = 0;
+    double min = 0;
+    double max = 0;
+    double median = 0;
+};
+
+Summary Summarize(const benchmark::State &state) {
     auto results = state.m_elapsed_results;
     std::sort(results.begin(), results.end());
 
-    double total = state.m_num_iters *
-                   std::accumulate(results.begin(), results.end(), 0.0);
-
-    double front = 0;
-    double back = 0;
-    double median = 0;
+    Summary summary;
+    summary.total = state.m_num_iters *
+                    std::accumulate(results.begin(), results.end(), 0.0);
 
     if (!results.empty()) {
-        front = results.front();
-        back = results.back();
+        summary.min = results.front();
+        summary.max = results.back();
 
         size_t mid = results.size() / 2;
-        median = results[mid];
+        summary.median = results[mid];
         if (0 == results.size() % 2) {
-            median = (results[mid] + results[mid + 1]) / 2;
+            summary.median = (results[mid - 1] + results[mid]) / 2;
         }
     }
+    return summary;
+}
+} // namespace
+
+void benchmark::ConsolePrinter::result(const State &state) {
+    const Summary summary = Summarize(state);
 
     std::cout << std::setprecision(6);
     std::cout << state.m_name << ", " << state.m_num_evals << ", "
-              << state.m_num_iters << ", " << total << ", " << front << ", "
-              << back << ", " << median << std::endl;
+              << state.m_num_iters << ", " << summary.total << ", "
+              << summary.min << ", " << summary.max << ", " << summary.median
+              << std::endl;
 }
 
 void benchmark::ConsolePrinter::footer() {}
@@ -86,6 +98,51 @@ void benchmark::PlotlyPrinter::footer() {
               << "</script></body></html>";
 }
 
+void benchmark::CsvPrinter::header() {
+    std::cout << "name,evals,iterations,total,min,max,median" << std::endl;
+}
+
+void benchmark::CsvPrinter::result(const State &state) {
+    const Summary summary = Summarize(state);
+
+    std::cout << std::setprecision(6);
+    std::cout << state.m_name << "," << state.m_num_evals << ","
+              << state.m_num_iters << "," << summary.total << ","
+              << summary.min << "," << summary.max << "," << summary.median
+              << std::endl;
+}
+
+void benchmark::CsvPrinter::footer() {}
+
+void benchmark::JsonPrinter::header() {
+    std::cout << "{\"benchmarks\": [" << std::endl;
+}
+
+void benchmark::JsonPrinter::result(const State &state) {
+    const Summary summary = Summarize(state);
+
+    // Benchmark names are C++ identifiers, so they never need escaping.
+    std::cout << std::setprecision(6);
+    std::cout << (m_first ? "" : ",\n") << "{\"name\": \"" << state.m_name
+              << "\", \"evals\": " << state.m_num_evals
+              << ", \"iterations\": " << state.m_num_iters
+              << ", \"total\": " << summary.total
+              << ", \"min\": " << summary.min << ", \"max\": " << summary.max
+              << ", \"median\": " << summary.median << ", \"results\": [";
+
+    const char *prefix = "";
+    for (const auto &e : state.m_elapsed_results) {
+        std::cout << prefix << e;
+        prefix = ", ";
+    }
+    std::cout << "]}";
+    m_first = false;
+}
+
+void benchmark::JsonPrinter::footer() {
+    std::cout << (m_first ? "" : "\n") << "]}" << std::endl;
+}
+
 benchmark::BenchRunner::BenchmarkMap &benchmark::BenchRunner::benchmarks() {
     static std::map<std::string, Bench> benchmarks_map;
     return benchmarks_map;
@@ -129,6 +129,25 @@ private:
     int64_t m_width;
     int64_t m_height;
 };
+
+//! Plain CSV (one header row, one row per benchmark) for regression tracking.
+class CsvPrinter : public Printer {
+public:
+    void header() override;
+    void result(const State &state) override;
+    void footer() override;
+};
+
+//! A single JSON document including every individual evaluation.
+class JsonPrinter : public Printer {
+public:
+    void header() override;
+    void result(const State &state) override;
+    void footer() override;
+
+private:
+    bool m_first{true};
+};
 } // namespace benchmark
 
 // BENCHMARK(foo, num_iters_for_one_second) expands to:  benchmark::BenchRunner
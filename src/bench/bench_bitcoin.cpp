@@ -43,9 +43,10 @@ static void SetupBenchArgs() {
                   DEFAULT_BENCH_SCALING),
         false, OptionsCategory::OPTIONS);
     gArgs.AddArg(
-        "-printer=(console|plot)",
+        "-printer=(console|plot|csv|json)",
         strprintf("Choose printer format. console: print data to console. "
-                  "plot: Print results as HTML graph (default: %s)",
+                  "plot: Print results as HTML graph. csv, json: print "
+                  "machine-readable results to console (default: %s)",
                   DEFAULT_BENCH_PRINTER),
         false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-plot-plotlyurl=<uri>",
@@ -96,6 +97,10 @@ int main(int argc, char **argv) {
             gArgs.GetArg("-plot-plotlyurl", DEFAULT_PLOT_PLOTLYURL),
             gArgs.GetArg("-plot-width", DEFAULT_PLOT_WIDTH),
             gArgs.GetArg("-plot-height", DEFAULT_PLOT_HEIGHT)));
+    } else if ("csv" == printer_arg) {
+        printer.reset(new benchmark::CsvPrinter());
+    } else if ("json" == printer_arg) {
+        printer.reset(new benchmark::JsonPrinter());
     }
 
     benchmark::BenchRunner::RunAll(*printer, evaluations, scaling_factor,
@@ -0,0 +1,52 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/synthetic_chain.h>
+
+#include <chainparams.h>
+#include <config.h>
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <miner.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <cassert>
+
+// The work behind a fresh getblocktemplate: selecting an 8MB template out of
+// a mempool of 100k transactions (about 19MB) and validating it with
+// TestBlockValidity.
+static void CreateBlockTemplateLargeMempool(benchmark::State &state) {
+    const Config &config = GetConfig();
+
+    const auto txs = benchmark::CreateSyntheticSpends(100000);
+    {
+        LOCK(cs_main);
+        for (const auto &tx : txs) {
+            CValidationState vstate;
+            bool accepted{::AcceptToMemoryPool(
+                config, ::g_mempool, vstate, tx, nullptr /* pfMissingInputs */,
+                false /* bypass_limits */, /* nAbsurdFee */ Amount::zero())};
+            assert(accepted);
+        }
+    }
+
+    BlockAssembler::Options options;
+    options.nExcessiveBlockSize = config.GetExcessiveBlockSize();
+    options.nMaxGeneratedBlockSize = 8 * ONE_MEGABYTE;
+    const CScript scriptPubKey = CScript() << OP_TRUE;
+
+    while (state.KeepRunning()) {
+        auto blocktemplate =
+            BlockAssembler(config.GetChainParams(), ::g_mempool, options)
+                .CreateNewBlock(scriptPubKey);
+        assert(blocktemplate);
+    }
+
+    // Don't leave the transactions to the benchmarks that run next.
+    ::g_mempool.clear();
+}
+
+BENCHMARK(CreateBlockTemplateLargeMempool, 3);
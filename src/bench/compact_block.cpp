@@ -0,0 +1,70 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/synthetic_chain.h>
+
+#include <blockencodings.h>
+#include <config.h>
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <cassert>
+
+// Reconstruction of an 8MB compact block from the mempool, as done when a
+// cmpctblock message arrives. Every missing_every-th transaction is withheld
+// from the mempool and supplied as if it came in a blocktxn message instead.
+static void CompactBlockReconstructTest(size_t missing_every,
+                                        benchmark::State &state) {
+    const Config &config = GetConfig();
+
+    const auto txs = benchmark::CreateSyntheticSpends(
+        benchmark::SyntheticSpendsForSize(8 * ONE_MEGABYTE));
+    const auto block = benchmark::CreateSyntheticBlock(config, txs);
+
+    std::vector<CTransactionRef> missing;
+    {
+        LOCK(cs_main);
+        for (size_t i = 1; i < block->vtx.size(); ++i) {
+            if (missing_every && i % missing_every == 0) {
+                missing.push_back(block->vtx[i]);
+                continue;
+            }
+            CValidationState vstate;
+            bool accepted{::AcceptToMemoryPool(
+                config, ::g_mempool, vstate, block->vtx[i],
+                nullptr /* pfMissingInputs */, false /* bypass_limits */,
+                /* nAbsurdFee */ Amount::zero())};
+            assert(accepted);
+        }
+    }
+
+    const CBlockHeaderAndShortTxIDs cmpctblock(*block);
+    const std::vector<std::pair<TxHash, CTransactionRef>> extra_txn;
+
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partialBlock(config, &::g_mempool);
+        ReadStatus status = partialBlock.InitData(cmpctblock, extra_txn);
+        assert(status == READ_STATUS_OK);
+
+        CBlock reconstructed;
+        status = partialBlock.FillBlock(reconstructed, missing);
+        assert(status == READ_STATUS_OK);
+    }
+
+    // Don't leave the transactions to the benchmarks that run next.
+    ::g_mempool.clear();
+}
+
+static void CompactBlockReconstruct(benchmark::State &state) {
+    CompactBlockReconstructTest(0, state);
+}
+static void CompactBlockReconstructMissing(benchmark::State &state) {
+    CompactBlockReconstructTest(10, state);
+}
+
+BENCHMARK(CompactBlockReconstruct, 40);
+BENCHMARK(CompactBlockReconstructMissing, 30);
@@ -0,0 +1,52 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/synthetic_chain.h>
+
+#include <chainparams.h>
+#include <config.h>
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <validation.h>
+
+#include <cassert>
+
+// Full validation of a block on top of the tip: CheckBlock,
+// ContextualCheckBlock and ConnectBlock against the coins cache, without
+// writing anything to disk. This is the same path getblocktemplate and
+// proposal mode use. The validation caches are disabled so that every
+// iteration verifies the signatures again.
+static void ConnectBlockTest(uint64_t block_size, benchmark::State &state) {
+    const Config &config = GetConfig();
+    const CChainParams &params = config.GetChainParams();
+
+    const auto txs = benchmark::CreateSyntheticSpends(
+        benchmark::SyntheticSpendsForSize(block_size));
+    const auto block = benchmark::CreateSyntheticBlock(config, txs);
+    const BlockValidationOptions options =
+        BlockValidationOptions(config).withCheckPoW(false);
+    const benchmark::ScopedNoValidationCaches no_caches;
+
+    LOCK(cs_main);
+    CBlockIndex *tip = ::ChainActive().Tip();
+    while (state.KeepRunning()) {
+        // CBlock caches its checked state.
+        block->fChecked = false;
+        CValidationState validationState;
+        bool connected = TestBlockValidity(validationState, params, *block,
+                                           tip, options);
+        assert(connected);
+    }
+}
+
+static void ConnectBlockTest_8MB(benchmark::State &state) {
+    ConnectBlockTest(8 * ONE_MEGABYTE, state);
+}
+static void ConnectBlockTest_32MB(benchmark::State &state) {
+    ConnectBlockTest(DEFAULT_EXCESSIVE_BLOCK_SIZE, state);
+}
+
+BENCHMARK(ConnectBlockTest_8MB, 2);
+BENCHMARK(ConnectBlockTest_32MB, 1);
@@ -0,0 +1,37 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/synthetic_chain.h>
+
+#include <config.h>
+#include <consensus/validation.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <cassert>
+
+// AcceptToMemoryPool throughput for a batch of independent signed
+// transactions spending confirmed coins. The pool is emptied after each
+// batch, and the validation caches are disabled so that every batch verifies
+// its signatures again.
+static void MempoolAcceptBatch(benchmark::State &state) {
+    const Config &config = GetConfig();
+    const auto txs = benchmark::CreateSyntheticSpends(1000);
+    const benchmark::ScopedNoValidationCaches no_caches;
+
+    LOCK(cs_main);
+    while (state.KeepRunning()) {
+        for (const auto &tx : txs) {
+            CValidationState vstate;
+            bool accepted{::AcceptToMemoryPool(
+                config, ::g_mempool, vstate, tx, nullptr /* pfMissingInputs */,
+                false /* bypass_limits */, /* nAbsurdFee */ Amount::zero())};
+            assert(accepted);
+        }
+        ::g_mempool.clear();
+    }
+}
+
+BENCHMARK(MempoolAcceptBatch, 5);
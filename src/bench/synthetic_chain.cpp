@@ -0,0 +1,140 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/synthetic_chain.h>
+
+#include <arith_uint256.h>
+#include <coins.h>
+#include <consensus/merkle.h>
+#include <key.h>
+#include <primitives/block.h>
+#include <script/interpreter.h>
+#include <script/scriptcache.h>
+#include <script/sigcache.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <test/util.h>
+#include <util/system.h>
+#include <validation.h>
+#include <version.h>
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+
+namespace {
+constexpr Amount COIN_VALUE = 10000 * FIXOSHI;
+constexpr Amount FEE = 1000 * FIXOSHI;
+
+//! Block header, coinbase and length prefixes.
+constexpr uint64_t BLOCK_OVERHEAD = 1000;
+//! Longest DER-encoded ECDSA signature, with its hash type byte.
+constexpr size_t MAX_SIG_SIZE = 73;
+
+//! Key of the synthetic coins. Built on first use, after ECC_Start().
+const CKey &GetKey() {
+    static const CKey key = [] {
+        CKey k;
+        const std::vector<uint8_t> secret(32, 0x01);
+        k.Set(secret.begin(), secret.end(), true);
+        return k;
+    }();
+    return key;
+}
+
+const CPubKey &GetPubKey() {
+    static const CPubKey pubkey = GetKey().GetPubKey();
+    return pubkey;
+}
+
+const CScript &GetScriptPubKey() {
+    static const CScript script = GetScriptForDestination(GetPubKey().GetID());
+    return script;
+}
+
+CMutableTransaction MakeUnsignedSpend(const COutPoint &outpoint) {
+    CMutableTransaction tx;
+    tx.vin.emplace_back(outpoint);
+    tx.vout.emplace_back(COIN_VALUE - FEE, GetScriptPubKey());
+    return tx;
+}
+
+CTransactionRef MakeSpend(const COutPoint &outpoint) {
+    CMutableTransaction tx = MakeUnsignedSpend(outpoint);
+    const SigHashType sigHashType = SigHashType().withForkId();
+    const uint256 hash = SignatureHash(GetScriptPubKey(), CTransaction(tx), 0,
+                                       sigHashType, COIN_VALUE);
+    std::vector<uint8_t> sig;
+    bool signed_ok = GetKey().SignECDSA(hash, sig);
+    assert(signed_ok);
+    sig.push_back(uint8_t(sigHashType.getRawSigHashType()));
+    tx.vin[0].scriptSig = CScript() << sig << ToByteVector(GetPubKey());
+    return MakeTransactionRef(tx);
+}
+
+TxId NextFundingTxId() {
+    static uint64_t counter = 0;
+    return TxId(ArithToUint256(arith_uint256(++counter)));
+}
+} // namespace
+
+std::vector<CTransactionRef> benchmark::CreateSyntheticSpends(size_t count) {
+    const TxId funding = NextFundingTxId();
+
+    std::vector<CTransactionRef> txs;
+    txs.reserve(count);
+
+    LOCK(cs_main);
+    const int height = ::ChainActive().Height();
+    for (size_t i = 0; i < count; ++i) {
+        const COutPoint outpoint(funding, i);
+        pcoinsTip->AddCoin(outpoint,
+                           Coin(CTxOut(COIN_VALUE, GetScriptPubKey()), height,
+                                false),
+                           false);
+        txs.push_back(MakeSpend(outpoint));
+    }
+    return txs;
+}
+
+size_t benchmark::SyntheticSpendsForSize(uint64_t block_size) {
+    // Signature sizes vary, count the largest.
+    CMutableTransaction tx = MakeUnsignedSpend(COutPoint(TxId(), 0));
+    tx.vin[0].scriptSig = CScript()
+                          << std::vector<uint8_t>(MAX_SIG_SIZE, 0)
+                          << ToByteVector(GetPubKey());
+    const size_t tx_size = ::GetSerializeSize(tx, PROTOCOL_VERSION);
+    assert(block_size > BLOCK_OVERHEAD);
+    return (block_size - BLOCK_OVERHEAD) / tx_size;
+}
+
+std::shared_ptr<CBlock>
+benchmark::CreateSyntheticBlock(const Config &config,
+                                std::vector<CTransactionRef> txs) {
+    auto block = PrepareBlock(config, GetScriptPubKey());
+    std::sort(txs.begin(), txs.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+    block->vtx.insert(block->vtx.end(), txs.begin(), txs.end());
+    block->hashMerkleRoot = BlockMerkleRoot(*block);
+    return block;
+}
+
+benchmark::ScopedNoValidationCaches::ScopedNoValidationCaches() {
+    // A size of zero leaves room for a couple of entries only.
+    gArgs.ForceSetArg("-maxsigcachesize", "0");
+    gArgs.ForceSetArg("-maxscriptcachesize", "0");
+    InitSignatureCache();
+    InitScriptExecutionCache();
+}
+
+benchmark::ScopedNoValidationCaches::~ScopedNoValidationCaches() {
+    gArgs.ForceSetArg("-maxsigcachesize",
+                      std::to_string(DEFAULT_MAX_SIG_CACHE_SIZE));
+    gArgs.ForceSetArg("-maxscriptcachesize",
+                      std::to_string(DEFAULT_MAX_SCRIPT_CACHE_SIZE));
+    InitSignatureCache();
+    InitScriptExecutionCache();
+}
@@ -0,0 +1,51 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_SYNTHETIC_CHAIN_H
+#define BITCOIN_BENCH_SYNTHETIC_CHAIN_H
+
+#include <primitives/transaction.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class CBlock;
+class Config;
+
+namespace benchmark {
+
+/**
+ * Credit @p count fresh P2PKH coins to the active chainstate's coins cache
+ * and return one signed transaction spending each of them. The transactions
+ * are independent, standard and pay a fee, so they are accepted by
+ * AcceptToMemoryPool as well as ConnectBlock on top of the current tip.
+ */
+std::vector<CTransactionRef> CreateSyntheticSpends(size_t count);
+
+/** Number of synthetic spends that fill a block of about @p block_size bytes */
+size_t SyntheticSpendsForSize(uint64_t block_size);
+
+/**
+ * Build a block on top of the active tip that holds @p txs in canonical
+ * order. The proof of work is not solved.
+ */
+std::shared_ptr<CBlock>
+CreateSyntheticBlock(const Config &config, std::vector<CTransactionRef> txs);
+
+/**
+ * Shrink the signature and script execution caches to a couple of entries
+ * while in scope, so that validating the same transactions again measures
+ * their scripts rather than cache hits.
+ */
+class ScopedNoValidationCaches {
+public:
+    ScopedNoValidationCaches();
+    ~ScopedNoValidationCaches();
+};
+
+} // namespace benchmark
+
+#endif // BITCOIN_BENCH_SYNTHETIC_CHAIN_H
@@ -0,0 +1,89 @@
+// Copyright (c) 2016-2019 The Bitcoin Core developers
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <key.h>
+#include <policy/policy.h>
+#include <script/interpreter.h>
+#include <script/script.h>
+#include <script/standard.h>
+#include <test/lib/transaction_utils.h>
+
+#include <array>
+#include <cassert>
+
+// Microbenchmark for verification of a standard P2PKH script. Evaluation is
+// dominated by the signature check, the rest is stack manipulation.
+static void VerifyScriptP2PKH(benchmark::State &state) {
+    const uint32_t flags =
+        STANDARD_SCRIPT_VERIFY_FLAGS | SCRIPT_ENABLE_SIGHASH_FORKID;
+
+    // Key pair.
+    CKey key;
+    static const std::array<uint8_t, 32> vchKey = {
+        {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1}};
+    key.Set(vchKey.begin(), vchKey.end(), false);
+    CPubKey pubkey = key.GetPubKey();
+
+    // Script.
+    const Amount amount = Amount::fixoshi();
+    CScript scriptPubKey = GetScriptForDestination(pubkey.GetID());
+    const CMutableTransaction txCredit =
+        BuildCreditingTransaction(scriptPubKey, amount);
+    CMutableTransaction txSpend =
+        BuildSpendingTransaction(CScript(), CTransaction(txCredit));
+
+    // Sign spending transaction.
+    const SigHashType sigHashType = SigHashType().withForkId();
+    uint256 sighash = SignatureHash(scriptPubKey, CTransaction(txSpend), 0,
+                                    sigHashType, amount);
+    std::vector<uint8_t> vchSig;
+    bool ok = key.SignECDSA(sighash, vchSig);
+    assert(ok);
+    vchSig.push_back(uint8_t(sigHashType.getRawSigHashType()));
+    txSpend.vin[0].scriptSig << vchSig << ToByteVector(pubkey);
+
+    // Benchmark.
+    const MutableTransactionSignatureChecker checker(&txSpend, 0, amount);
+    while (state.KeepRunning()) {
+        ScriptError err;
+        ScriptExecutionMetrics metrics;
+        bool success = VerifyScript(txSpend.vin[0].scriptSig, scriptPubKey,
+                                    flags, checker, metrics, &err);
+        assert(err == ScriptError::OK);
+        assert(success);
+    }
+}
+
+// Script evaluation without any signature check, so that the cost of pushing,
+// copying and popping stack elements is what gets measured.
+static void EvalScriptStackOps(benchmark::State &state) {
+    const uint32_t flags = MANDATORY_SCRIPT_VERIFY_FLAGS;
+
+    // Each round duplicates a 32 byte element, splits the copy in half, swaps
+    // and concatenates the halves and drops the result.
+    CScript script;
+    script << std::vector<uint8_t>(32, 0x42);
+    for (int i = 0; i < 28; ++i) {
+        script << OP_DUP << OP_SIZE << OP_2 << OP_DIV << OP_SPLIT << OP_SWAP
+               << OP_CAT << OP_DROP;
+    }
+    script << OP_SIZE << OP_NIP;
+
+    const BaseSignatureChecker checker;
+    while (state.KeepRunning()) {
+        std::vector<std::vector<uint8_t>> stack;
+        ScriptError err;
+        ScriptExecutionMetrics metrics;
+        bool success = EvalScript(stack, script, flags, checker, metrics, &err);
+        assert(err == ScriptError::OK);
+        assert(success);
+        assert(stack.size() == 1);
+    }
+}
+
+BENCHMARK(VerifyScriptP2PKH, 5300);
+BENCHMARK(EvalScriptStackOps, 100000);
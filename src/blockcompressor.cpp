@@ -0,0 +1,177 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcompressor.h>
+
+#include <amount.h>
+#include <clientversion.h>
+#include <compressor.h>
+#include <primitives/block.h>
+#include <streams.h>
+
+#include <map>
+
+namespace BlockCompression {
+
+namespace {
+
+//! Script sizes below this are CompressScript() special cases.
+constexpr uint64_t SPECIAL_SCRIPTS = 6;
+
+template <typename Stream>
+void WriteScript(Stream &s, const CScript &script) {
+    std::vector<uint8_t> compr;
+    if (CompressScript(script, compr)) {
+        s << MakeSpan(compr);
+        return;
+    }
+    // Unlike CScriptCompressor, keep scripts above MAX_SCRIPT_SIZE intact.
+    uint64_t nSize = script.size() + SPECIAL_SCRIPTS;
+    s << VARINT(nSize);
+    s << MakeSpan(script);
+}
+
+void ReadScript(VectorReader &s, CScript &script) {
+    uint64_t nSize = 0;
+    s >> VARINT(nSize);
+    if (nSize < SPECIAL_SCRIPTS) {
+        std::vector<uint8_t> vch(GetSpecialScriptSize(nSize), 0x00);
+        s >> MakeSpan(vch);
+        if (!DecompressScript(script, nSize, vch)) {
+            throw std::ios_base::failure("invalid compressed script");
+        }
+        return;
+    }
+    nSize -= SPECIAL_SCRIPTS;
+    if (nSize > s.size()) {
+        throw std::ios_base::failure("script size too large");
+    }
+    script.resize(nSize);
+    s >> MakeSpan(script);
+}
+
+//! Read an element count, which can't exceed the bytes left to decode.
+uint64_t ReadCount(VectorReader &s) {
+    const uint64_t n = ReadCompactSize(s);
+    if (n > s.size()) {
+        throw std::ios_base::failure("element count too large");
+    }
+    return n;
+}
+
+} // namespace
+
+CMessageHeader::MessageMagic
+CompressedDiskMagic(const CMessageHeader::MessageMagic &disk_magic) {
+    CMessageHeader::MessageMagic magic = disk_magic;
+    // Keep the first byte, which is what -reindex scans for.
+    magic[CMessageHeader::MESSAGE_START_SIZE - 1] ^= 0xff;
+    return magic;
+}
+
+bool Compress(const CBlock &block, std::vector<uint8_t> &out) {
+    out.clear();
+    CVectorWriter s(SER_DISK, CLIENT_VERSION, out, 0);
+
+    s << FORMAT_VERSION;
+    s << static_cast<const CBlockHeader &>(block);
+    WriteCompactSize(s, block.vtx.size());
+
+    std::map<TxId, uint64_t> tx_index;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *block.vtx[i];
+
+        uint32_t nVersion = tx.nVersion;
+        uint32_t nLockTime = tx.nLockTime;
+        s << VARINT(nVersion) << VARINT(nLockTime);
+
+        WriteCompactSize(s, tx.vin.size());
+        for (const CTxIn &txin : tx.vin) {
+            auto it = tx_index.find(txin.prevout.GetTxId());
+            uint64_t ref = it == tx_index.end() ? 0 : it->second + 1;
+            s << VARINT(ref);
+            if (ref == 0) {
+                s << txin.prevout.GetTxId();
+            }
+            uint32_t n = txin.prevout.GetN();
+            // Final inputs are the common case, store them as 0.
+            uint32_t nSequenceInv = ~txin.nSequence;
+            s << VARINT(n) << txin.scriptSig << VARINT(nSequenceInv);
+        }
+
+        WriteCompactSize(s, tx.vout.size());
+        for (const CTxOut &txout : tx.vout) {
+            if (!MoneyRange(txout.nValue)) {
+                out.clear();
+                return false;
+            }
+            uint64_t nValue = CompressAmount(txout.nValue);
+            s << VARINT(nValue);
+            WriteScript(s, txout.scriptPubKey);
+        }
+
+        // Only earlier transactions can be referred to, as later ones are
+        // not known yet while decoding.
+        tx_index.emplace(tx.GetId(), i);
+    }
+    return true;
+}
+
+void Decompress(const std::vector<uint8_t> &in, CBlock &block) {
+    VectorReader s(SER_DISK, CLIENT_VERSION, in, 0);
+
+    uint8_t version;
+    s >> version;
+    if (version != FORMAT_VERSION) {
+        throw std::ios_base::failure("unknown compressed block version");
+    }
+
+    CBlockHeader header;
+    s >> header;
+    block = CBlock(header);
+
+    const uint64_t nTx = ReadCount(s);
+    block.vtx.reserve(nTx);
+    for (uint64_t i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        uint32_t nVersion = 0;
+        s >> VARINT(nVersion) >> VARINT(tx.nLockTime);
+        tx.nVersion = nVersion;
+
+        tx.vin.resize(ReadCount(s));
+        for (CTxIn &txin : tx.vin) {
+            uint64_t ref = 0;
+            s >> VARINT(ref);
+            TxId txid;
+            if (ref == 0) {
+                s >> txid;
+            } else if (ref <= i) {
+                txid = block.vtx[ref - 1]->GetId();
+            } else {
+                throw std::ios_base::failure("invalid transaction reference");
+            }
+            uint32_t n = 0;
+            uint32_t nSequenceInv = 0;
+            s >> VARINT(n) >> txin.scriptSig >> VARINT(nSequenceInv);
+            txin.prevout = COutPoint(txid, n);
+            txin.nSequence = ~nSequenceInv;
+        }
+
+        tx.vout.resize(ReadCount(s));
+        for (CTxOut &txout : tx.vout) {
+            uint64_t nValue = 0;
+            s >> VARINT(nValue);
+            txout.nValue = DecompressAmount(nValue);
+            ReadScript(s, txout.scriptPubKey);
+        }
+
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+
+    if (!s.empty()) {
+        throw std::ios_base::failure("trailing data in compressed block");
+    }
+}
+
+} // namespace BlockCompression
@@ -0,0 +1,52 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCOMPRESSOR_H
+#define BITCOIN_BLOCKCOMPRESSOR_H
+
+#include <protocol.h>
+
+#include <cstdint>
+#include <vector>
+
+class CBlock;
+
+/**
+ * Compressed block records in blk?????.dat.
+ *
+ * A compressed record has the same framing as a raw one, a 4 byte magic and
+ * the payload size, but uses the magic returned by CompressedDiskMagic(). The
+ * payload is lossless and encodes:
+ *  - a format version byte (0), the 80 byte header and the transaction count,
+ *  - per transaction, nVersion, nLockTime, input and output counts,
+ *  - per input, either the index of an earlier transaction of the block whose
+ *    outputs it spends or the full prevout txid, then the output index,
+ *    scriptSig and the complement of nSequence as VARINTs,
+ *  - per output, the amount as in CTxOutCompressor and the scriptPubKey as in
+ *    CScriptCompressor, except that long scripts are kept as they are.
+ */
+namespace BlockCompression {
+
+//! Format version byte at the start of each payload.
+static constexpr uint8_t FORMAT_VERSION = 0;
+
+//! Magic of compressed records for a network with the given disk magic.
+CMessageHeader::MessageMagic
+CompressedDiskMagic(const CMessageHeader::MessageMagic &disk_magic);
+
+/**
+ * Encode block into out. Fails, so that the block has to be stored raw, if
+ * any amount is outside of the money range.
+ */
+bool Compress(const CBlock &block, std::vector<uint8_t> &out);
+
+/**
+ * Decode a payload written by Compress().
+ * @throws std::ios_base::failure on truncated or malformed data.
+ */
+void Decompress(const std::vector<uint8_t> &in, CBlock &block);
+
+} // namespace BlockCompression
+
+#endif // BITCOIN_BLOCKCOMPRESSOR_H
@@ -0,0 +1,48 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockdownloadstats.h>
+
+#include <algorithm>
+
+void BlockDownloadStats::Smooth(int64_t &average, int64_t sample) {
+    sample = std::max<int64_t>(sample, 1);
+    if (average < 0) {
+        average = sample;
+    } else {
+        average += (sample - average) / 8;
+    }
+}
+
+void BlockDownloadStats::AddLatency(int64_t time) {
+    Smooth(m_latency, time);
+}
+
+void BlockDownloadStats::AddInterval(int64_t time, uint64_t size) {
+    Smooth(m_interval, time);
+    const double rate = size * 1e6 / std::max<int64_t>(time, 1);
+    if (m_bytes_per_second == 0) {
+        m_bytes_per_second = rate;
+    } else {
+        m_bytes_per_second += (rate - m_bytes_per_second) / 8;
+    }
+}
+
+unsigned int BlockDownloadStats::GetWindow(unsigned int default_window) const {
+    if (!HasLatency() || !HasInterval()) {
+        return default_window;
+    }
+    // One more than needed to cover the round trip, to absorb jitter.
+    const int64_t window = (m_latency + m_interval - 1) / m_interval + 1;
+    return std::max<int64_t>(
+        MIN_BLOCKS_IN_TRANSIT_PER_PEER,
+        std::min<int64_t>(window, MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER));
+}
+
+int64_t BlockDownloadStats::GetExpectedArrival(unsigned int queued) const {
+    if (!HasLatency()) {
+        return -1;
+    }
+    return m_latency + queued * GetInterval();
+}
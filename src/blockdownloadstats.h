@@ -0,0 +1,63 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKDOWNLOADSTATS_H
+#define BITCOIN_BLOCKDOWNLOADSTATS_H
+
+#include <cstdint>
+
+/** Fewest blocks kept in flight from a measured peer. */
+static constexpr unsigned int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+/** Most blocks kept in flight from a fast peer with a long round trip. */
+static constexpr unsigned int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 64;
+
+/**
+ * Block download performance of one peer, used to size the number of blocks
+ * requested from it at once.
+ *
+ * A peer serves our block requests one after the other. A block requested
+ * while nothing else was in flight measures the latency: the round trip plus
+ * the transfer of one block. A block that was queued behind another measures
+ * the block interval: the time between the arrival of consecutive blocks,
+ * i.e. the transfer time alone. Keeping latency / interval blocks in flight is
+ * enough for the peer to never wait for our next request, more only makes the
+ * blocks at the head of the download window wait longer on slow peers.
+ *
+ * All times are in microseconds and smoothed like TCP's round trip estimate.
+ */
+class BlockDownloadStats {
+public:
+    //! Record a block requested while nothing else was in flight.
+    void AddLatency(int64_t time);
+    //! Record a block that was queued behind another one.
+    void AddInterval(int64_t time, uint64_t size);
+
+    bool HasLatency() const { return m_latency >= 0; }
+    bool HasInterval() const { return m_interval >= 0; }
+    //! Zero when not measured yet.
+    int64_t GetLatency() const { return HasLatency() ? m_latency : 0; }
+    int64_t GetInterval() const { return HasInterval() ? m_interval : 0; }
+    double GetBytesPerSecond() const { return m_bytes_per_second; }
+
+    /**
+     * Number of blocks to keep in flight from the peer, or default_window
+     * until both the latency and the block interval are measured.
+     */
+    unsigned int GetWindow(unsigned int default_window) const;
+
+    /**
+     * Expected time for a block requested now to arrive, with queued blocks
+     * already in flight ahead of it, or -1 if not measured yet.
+     */
+    int64_t GetExpectedArrival(unsigned int queued) const;
+
+private:
+    int64_t m_latency{-1};
+    int64_t m_interval{-1};
+    double m_bytes_per_second{0};
+
+    static void Smooth(int64_t &average, int64_t sample);
+};
+
+#endif // BITCOIN_BLOCKDOWNLOADSTATS_H
@@ -31,6 +31,17 @@ CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block)
     }
 }
 
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlockView &block)
+    : nonce(GetRand(std::numeric_limits<uint64_t>::max())),
+      shorttxids(block.GetTxCount() - 1), prefilledtxn(1),
+      header(block.GetHeader()) {
+    FillShortTxIDSelector();
+    prefilledtxn[0] = {0, block.GetTransaction(0)};
+    for (size_t i = 1; i < block.GetTxCount(); i++) {
+        shorttxids[i - 1] = GetShortID(TxHash(block.GetTxId(i)));
+    }
+}
+
 void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     stream << header << nonce;
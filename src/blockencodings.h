@@ -6,6 +6,7 @@
 #define BITCOIN_BLOCKENCODINGS_H
 
 #include <primitives/block.h>
+#include <primitives/blockview.h>
 
 class Config;
 class CTxMemPool;
@@ -163,6 +164,8 @@ public:
     CBlockHeaderAndShortTxIDs() {}
 
     CBlockHeaderAndShortTxIDs(const CBlock &block);
+    //! Build from a serialized block, only materializing the coinbase.
+    CBlockHeaderAndShortTxIDs(const CBlockView &block);
 
     uint64_t GetShortID(const TxHash &txhash) const;
 
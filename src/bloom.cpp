@@ -201,6 +201,87 @@ bool CBloomFilter::MatchInputs(const CTransaction &tx) {
     return false;
 }
 
+static std::vector<std::vector<uint8_t>> GetScriptPushes(const CScript &script) {
+    std::vector<std::vector<uint8_t>> pushes;
+    CScript::const_iterator pc = script.begin();
+    std::vector<uint8_t> data;
+    while (pc < script.end()) {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data)) {
+            break;
+        }
+        if (data.size() != 0) {
+            pushes.push_back(data);
+        }
+    }
+    return pushes;
+}
+
+CBloomTxElements::CBloomTxElements(const CTransaction &tx) : txid(tx.GetId()) {
+    outputs.reserve(tx.vout.size());
+    for (const CTxOut &txout : tx.vout) {
+        std::vector<std::vector<uint8_t>> vSolutions;
+        txnouttype type = Solver(txout.scriptPubKey, vSolutions);
+        outputs.push_back({GetScriptPushes(txout.scriptPubKey),
+                           type == TX_PUBKEY || type == TX_MULTISIG});
+    }
+
+    inputs.reserve(tx.vin.size());
+    for (const CTxIn &txin : tx.vin) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << txin.prevout;
+        inputs.push_back({std::vector<uint8_t>(stream.begin(), stream.end()),
+                          GetScriptPushes(txin.scriptSig)});
+    }
+}
+
+bool CBloomFilter::MatchAndInsertOutputs(const CBloomTxElements &tx) {
+    if (isFull) {
+        return true;
+    }
+    if (isEmpty) {
+        return false;
+    }
+
+    bool fFound = contains(tx.txid);
+    for (size_t i = 0; i < tx.outputs.size(); i++) {
+        const CBloomTxElements::Output &output = tx.outputs[i];
+        for (const std::vector<uint8_t> &data : output.pushes) {
+            if (!contains(data)) {
+                continue;
+            }
+            fFound = true;
+            if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL ||
+                ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY &&
+                 output.isPubKeyOrMultisig)) {
+                insert(COutPoint(tx.txid, i));
+            }
+            break;
+        }
+    }
+
+    return fFound;
+}
+
+bool CBloomFilter::MatchInputs(const CBloomTxElements &tx) {
+    if (isEmpty) {
+        return false;
+    }
+
+    for (const CBloomTxElements::Input &input : tx.inputs) {
+        if (contains(input.prevout)) {
+            return true;
+        }
+        for (const std::vector<uint8_t> &data : input.pushes) {
+            if (contains(data)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
 void CBloomFilter::UpdateEmptyFull() {
     bool full = true;
     bool empty = true;
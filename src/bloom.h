@@ -5,6 +5,7 @@
 #ifndef BITCOIN_BLOOM_H
 #define BITCOIN_BLOOM_H
 
+#include <primitives/txid.h>
 #include <serialize.h>
 #include <uint256.h>
 
@@ -31,6 +32,33 @@ enum bloomflags {
     BLOOM_UPDATE_MASK = 3,
 };
 
+/**
+ * The data elements of a transaction that bloom filters look for, extracted
+ * once so that the transaction can be matched against many filters without
+ * parsing its scripts again for each of them.
+ */
+struct CBloomTxElements {
+    struct Output {
+        //! Non-empty data pushes of the scriptPubKey, up to the first invalid
+        //! opcode.
+        std::vector<std::vector<uint8_t>> pushes;
+        //! Whether BLOOM_UPDATE_P2PUBKEY_ONLY filters insert the outpoint.
+        bool isPubKeyOrMultisig;
+    };
+    struct Input {
+        //! The serialized outpoint spent.
+        std::vector<uint8_t> prevout;
+        //! Non-empty data pushes of the scriptSig.
+        std::vector<std::vector<uint8_t>> pushes;
+    };
+
+    TxId txid;
+    std::vector<Output> outputs;
+    std::vector<Input> inputs;
+
+    explicit CBloomTxElements(const CTransaction &tx);
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide so that we
  * can filter the transactions we send them.
@@ -106,6 +134,10 @@ public:
     //! scripts contain matching elements.
     bool MatchInputs(const CTransaction &tx);
 
+    //! Same as above, on elements extracted beforehand.
+    bool MatchAndInsertOutputs(const CBloomTxElements &tx);
+    bool MatchInputs(const CBloomTxElements &tx);
+
     //! Check if the transaction is relevant for any reason.
     //! Also adds any outputs which match the filter to the filter (to match
     //! their spending txes)
@@ -0,0 +1,70 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <fileremover.h>
+
+#include <logging.h>
+#include <util/system.h>
+
+#include <functional>
+
+FileRemover::FileRemover(const char *thread_name) {
+    m_thread = std::thread(
+        &TraceThread<std::function<void()>>, thread_name,
+        std::function<void()>(std::bind(&FileRemover::ThreadRemove, this)));
+}
+
+FileRemover::~FileRemover() {
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+void FileRemover::Remove(std::vector<fs::path> paths) {
+    {
+        LOCK(m_mutex);
+        for (fs::path &path : paths) {
+            m_queue.push_back(std::move(path));
+        }
+        m_queued += paths.size();
+    }
+    m_cond.notify_one();
+}
+
+void FileRemover::Sync() {
+    WAIT_LOCK(m_mutex, lock);
+    const uint64_t target = m_queued;
+    m_done_cond.wait(lock, [&] { return m_removed >= target; });
+}
+
+void FileRemover::ThreadRemove() {
+    while (true) {
+        fs::path path;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                break;
+            }
+            path = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        boost::system::error_code ec;
+        fs::remove(path, ec);
+        if (ec) {
+            LogPrintf("%s: failed to remove %s: %s\n", __func__, path.string(),
+                      ec.message());
+        }
+
+        {
+            LOCK(m_mutex);
+            m_removed++;
+        }
+        m_done_cond.notify_all();
+    }
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FILEREMOVER_H
+#define BITCOIN_FILEREMOVER_H
+
+#include <fs.h>
+#include <sync.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <vector>
+
+/**
+ * Deletes files on a dedicated thread, so that callers holding locks do not
+ * wait for the filesystem. Removing a large file can take a while on some
+ * filesystems, as all of its extents have to be released.
+ */
+class FileRemover {
+public:
+    explicit FileRemover(const char *thread_name);
+    //! Removes the files still queued before returning.
+    ~FileRemover();
+
+    FileRemover(const FileRemover &) = delete;
+    FileRemover &operator=(const FileRemover &) = delete;
+
+    //! Queue files to be removed. Missing files are ignored.
+    void Remove(std::vector<fs::path> paths);
+
+    //! Wait until the files queued so far have been removed.
+    void Sync();
+
+private:
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_done_cond;
+    std::deque<fs::path> m_queue GUARDED_BY(m_mutex);
+    //! Number of files queued and removed so far.
+    uint64_t m_queued GUARDED_BY(m_mutex){0};
+    uint64_t m_removed GUARDED_BY(m_mutex){0};
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+    std::thread m_thread;
+
+    void ThreadRemove();
+};
+
+#endif // BITCOIN_FILEREMOVER_H
@@ -0,0 +1,83 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <filteredblockserver.h>
+
+#include <util/system.h>
+
+#include <algorithm>
+
+FilteredBlockServer::FilteredBlockServer(int nThreads) {
+    for (int i = 0; i < nThreads; i++) {
+        m_threads.emplace_back(&TraceThread<std::function<void()>>, "filtblk",
+                               std::function<void()>(std::bind(
+                                   &FilteredBlockServer::ThreadWorker, this)));
+    }
+}
+
+FilteredBlockServer::~FilteredBlockServer() {
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void FilteredBlockServer::Submit(std::shared_ptr<const CBlock> block, Job job) {
+    {
+        LOCK(m_mutex);
+        m_queue.emplace_back(std::move(block), std::move(job));
+    }
+    m_cond.notify_one();
+}
+
+std::shared_ptr<const FilteredBlockServer::BlockElements>
+FilteredBlockServer::GetElements(const CBlock &block) {
+    const BlockHash hash = block.GetHash();
+    // Other workers wait while the elements are extracted, which is what
+    // they would otherwise do for the same block.
+    LOCK(m_cache_mutex);
+    auto it = std::find_if(m_cache.begin(), m_cache.end(),
+                           [&hash](const auto &entry) {
+                               return entry.first == hash;
+                           });
+    if (it != m_cache.end()) {
+        auto entry = std::move(*it);
+        m_cache.erase(it);
+        m_cache.push_back(std::move(entry));
+        return m_cache.back().second;
+    }
+
+    auto elements = std::make_shared<BlockElements>();
+    elements->reserve(block.vtx.size());
+    for (const CTransactionRef &tx : block.vtx) {
+        elements->emplace_back(*tx);
+    }
+    if (m_cache.size() == MAX_CACHED_BLOCKS) {
+        m_cache.pop_front();
+    }
+    m_cache.emplace_back(hash, elements);
+    return elements;
+}
+
+void FilteredBlockServer::ThreadWorker() {
+    while (true) {
+        std::pair<std::shared_ptr<const CBlock>, Job> item;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                return;
+            }
+            item = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        const std::shared_ptr<const BlockElements> elements =
+            GetElements(*item.first);
+        item.second(*item.first, *elements);
+    }
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FILTEREDBLOCKSERVER_H
+#define BITCOIN_FILTEREDBLOCKSERVER_H
+
+#include <bloom.h>
+#include <primitives/block.h>
+#include <sync.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** Default for -filteredblockthreads */
+static constexpr int DEFAULT_FILTERED_BLOCK_THREADS = 2;
+/** Maximum number of filtered block threads */
+static constexpr int MAX_FILTERED_BLOCK_THREADS = 16;
+
+/**
+ * Builds BIP37 filtered blocks on worker threads, off the message handler.
+ *
+ * When a block is announced, many SPV peers ask for it filtered at about the
+ * same time. The data elements of its transactions are extracted once and kept
+ * for the last few blocks, so each request only has to test them against its
+ * peer's filter.
+ */
+class FilteredBlockServer {
+public:
+    using BlockElements = std::vector<CBloomTxElements>;
+    using Job = std::function<void(const CBlock &, const BlockElements &)>;
+
+    //! Number of blocks whose elements are kept.
+    static constexpr size_t MAX_CACHED_BLOCKS = 4;
+
+    explicit FilteredBlockServer(int nThreads);
+    //! Runs the jobs still queued before returning.
+    ~FilteredBlockServer();
+
+    FilteredBlockServer(const FilteredBlockServer &) = delete;
+    FilteredBlockServer &operator=(const FilteredBlockServer &) = delete;
+
+    //! Run job on a worker thread, with the elements of block.
+    void Submit(std::shared_ptr<const CBlock> block, Job job);
+
+    //! Elements of the transactions of block, extracted at most once while
+    //! the block is cached.
+    std::shared_ptr<const BlockElements> GetElements(const CBlock &block);
+
+private:
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::pair<std::shared_ptr<const CBlock>, Job>>
+        m_queue GUARDED_BY(m_mutex);
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::vector<std::thread> m_threads;
+
+    Mutex m_cache_mutex;
+    //! Most recently used last.
+    std::deque<std::pair<BlockHash, std::shared_ptr<const BlockElements>>>
+        m_cache GUARDED_BY(m_cache_mutex);
+
+    void ThreadWorker();
+};
+
+#endif // BITCOIN_FILTEREDBLOCKSERVER_H
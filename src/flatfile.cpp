@@ -50,17 +50,24 @@ FILE *FlatFileSeq::Open(const FlatFilePos &pos, bool read_only) {
     return file;
 }
 
+size_t FlatFileSeq::GetAllocationSize(const FlatFilePos &pos,
+                                      size_t add_size) const {
+    unsigned int n_old_chunks = (pos.nPos + m_chunk_size - 1) / m_chunk_size;
+    unsigned int n_new_chunks =
+        (pos.nPos + add_size + m_chunk_size - 1) / m_chunk_size;
+    if (n_new_chunks <= n_old_chunks) {
+        return 0;
+    }
+    return n_new_chunks * m_chunk_size - pos.nPos;
+}
+
 size_t FlatFileSeq::Allocate(const FlatFilePos &pos, size_t add_size,
                              bool &out_of_space) {
     out_of_space = false;
 
-    unsigned int n_old_chunks = (pos.nPos + m_chunk_size - 1) / m_chunk_size;
-    unsigned int n_new_chunks =
-        (pos.nPos + add_size + m_chunk_size - 1) / m_chunk_size;
-    if (n_new_chunks > n_old_chunks) {
-        size_t old_size = pos.nPos;
-        size_t new_size = n_new_chunks * m_chunk_size;
-        size_t inc_size = new_size - old_size;
+    size_t inc_size = GetAllocationSize(pos, add_size);
+    if (inc_size > 0) {
+        size_t new_size = pos.nPos + inc_size;
 
         if (CheckDiskSpace(m_dir, inc_size)) {
             FILE *file = Open(pos);
@@ -66,6 +66,9 @@ public:
      */
     FlatFileSeq(fs::path dir, const char *prefix, size_t chunk_size);
 
+    /** Get the directory all files live in. */
+    const fs::path &GetDir() const { return m_dir; }
+
     /** Get the name of the file at the given position. */
     fs::path FileName(const FlatFilePos &pos) const;
 
@@ -86,6 +89,12 @@ public:
     size_t Allocate(const FlatFilePos &pos, size_t add_size,
                     bool &out_of_space);
 
+    /**
+     * Number of bytes Allocate() would add after the given position, i.e. the
+     * chunks needed to fit add_size more bytes that are not allocated yet.
+     */
+    size_t GetAllocationSize(const FlatFilePos &pos, size_t add_size) const;
+
     /**
      * Commit a file to disk, and optionally truncate off extra pre-allocated
      * bytes if final.
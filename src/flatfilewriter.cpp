@@ -0,0 +1,275 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <flatfilewriter.h>
+
+#include <logging.h>
+#include <util/system.h>
+
+#include <functional>
+
+FlatFileWriter::FlatFileWriter(FlatFileSeq seq, const char *thread_name,
+                               size_t max_queued_bytes)
+    : m_seq(std::move(seq)), m_max_queued_bytes(max_queued_bytes) {
+    m_thread = std::thread(
+        &TraceThread<std::function<void()>>, thread_name,
+        std::function<void()>(std::bind(&FlatFileWriter::ThreadWriter, this)));
+}
+
+FlatFileWriter::~FlatFileWriter() {
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+uint64_t FlatFileWriter::Queue(Task &&task) {
+    uint64_t seq;
+    {
+        WAIT_LOCK(m_mutex, lock);
+        if (task.op == Op::WRITE) {
+            // Data larger than the limit is still queued once the queue is
+            // empty.
+            m_done_cond.wait(lock, [&] {
+                return m_queued_bytes == 0 ||
+                       m_queued_bytes + task.data.size() <= m_max_queued_bytes;
+            });
+            m_queued_bytes += task.data.size();
+        }
+        seq = task.seq = m_next_seq++;
+        if (task.op == Op::WRITE) {
+            m_last_write[task.pos.nFile] = seq;
+        }
+        m_queue.push_back(std::move(task));
+    }
+    m_cond.notify_one();
+    return seq;
+}
+
+void FlatFileWriter::WaitFor(uint64_t seq) {
+    WAIT_LOCK(m_mutex, lock);
+    m_done_cond.wait(lock, [&] { return m_done_seq >= seq; });
+}
+
+void FlatFileWriter::Write(const FlatFilePos &pos, std::vector<uint8_t> data) {
+    Task task;
+    task.op = Op::WRITE;
+    task.pos = pos;
+    task.data = std::move(data);
+    Queue(std::move(task));
+}
+
+size_t FlatFileWriter::Allocate(const FlatFilePos &pos, size_t add_size,
+                                bool &out_of_space) {
+    out_of_space = false;
+    const size_t inc_size = m_seq.GetAllocationSize(pos, add_size);
+    if (inc_size == 0) {
+        return 0;
+    }
+    if (!CheckDiskSpace(m_seq.GetDir(), inc_size)) {
+        out_of_space = true;
+        return 0;
+    }
+    Task task;
+    task.op = Op::ALLOCATE;
+    task.pos = pos;
+    task.size = inc_size;
+    Queue(std::move(task));
+    return inc_size;
+}
+
+void FlatFileWriter::Flush(const FlatFilePos &pos, bool finalize) {
+    Task task;
+    task.op = finalize ? Op::FINALIZE : Op::FLUSH;
+    task.pos = pos;
+    Queue(std::move(task));
+}
+
+void FlatFileWriter::WaitForFile(int nFile) {
+    uint64_t seq;
+    {
+        LOCK(m_mutex);
+        auto it = m_last_write.find(nFile);
+        if (it == m_last_write.end()) {
+            return;
+        }
+        seq = it->second;
+    }
+    WaitFor(seq);
+}
+
+void FlatFileWriter::CloseFiles() {
+    Task task;
+    task.op = Op::CLOSE;
+    WaitFor(Queue(std::move(task)));
+}
+
+bool FlatFileWriter::Sync() {
+    uint64_t seq;
+    {
+        LOCK(m_mutex);
+        seq = m_next_seq - 1;
+    }
+    WaitFor(seq);
+    LOCK(m_mutex);
+    const bool failed = m_failed;
+    m_failed = false;
+    return !failed;
+}
+
+bool FlatFileWriter::HasFailed() {
+    LOCK(m_mutex);
+    return m_failed;
+}
+
+FlatFileWriter::OpenFile *FlatFileWriter::GetFile(int nFile) {
+    auto it = m_files.find(nFile);
+    if (it != m_files.end()) {
+        return &it->second;
+    }
+    if (m_files.size() >= MAX_OPEN_FILES) {
+        // Writes go to the newest files, except for undo data of blocks that
+        // were stored in an older file.
+        CloseFile(m_files.begin()->first);
+    }
+
+    FILE *file = m_seq.Open(FlatFilePos(nFile, 0));
+    if (!file) {
+        return nullptr;
+    }
+    OpenFile &open_file = m_files[nFile];
+    open_file.file = file;
+    open_file.offset = 0;
+    open_file.buffer.resize(WRITE_BUFFER_SIZE);
+    setvbuf(file, open_file.buffer.data(), _IOFBF, open_file.buffer.size());
+    return &open_file;
+}
+
+bool FlatFileWriter::CloseFile(int nFile) {
+    auto it = m_files.find(nFile);
+    if (it == m_files.end()) {
+        return true;
+    }
+    const bool ok = fclose(it->second.file) == 0;
+    m_files.erase(it);
+    if (!ok) {
+        return error("%s: failed to close file %d", __func__, nFile);
+    }
+    return true;
+}
+
+bool FlatFileWriter::Run(Task &task) {
+    if (task.op == Op::CLOSE) {
+        bool ok = true;
+        while (!m_files.empty()) {
+            ok &= CloseFile(m_files.begin()->first);
+        }
+        return ok;
+    }
+
+    OpenFile *open_file = GetFile(task.pos.nFile);
+    if (!open_file) {
+        return error("%s: failed to open file %d", __func__,
+                     task.pos.nFile);
+    }
+    FILE *file = open_file->file;
+
+    switch (task.op) {
+        case Op::WRITE:
+            if (open_file->offset != int64_t(task.pos.nPos) &&
+                fseek(file, task.pos.nPos, SEEK_SET)) {
+                open_file->offset = -1;
+                return error("%s: failed to seek to %s", __func__,
+                             task.pos.ToString());
+            }
+            if (fwrite(task.data.data(), 1, task.data.size(), file) !=
+                task.data.size()) {
+                open_file->offset = -1;
+                return error("%s: failed to write %u bytes at %s", __func__,
+                             task.data.size(), task.pos.ToString());
+            }
+            open_file->offset = task.pos.nPos + task.data.size();
+            return true;
+        case Op::ALLOCATE:
+            LogPrintf("Pre-allocating up to position 0x%x in %s\n",
+                      task.pos.nPos + task.size,
+                      m_seq.FileName(task.pos).filename().string());
+            fflush(file);
+            AllocateFileRange(file, task.pos.nPos, task.size);
+            open_file->offset = -1;
+            return true;
+        case Op::FINALIZE:
+            fflush(file);
+            if (!TruncateFile(file, task.pos.nPos)) {
+                CloseFile(task.pos.nFile);
+                return error("%s: failed to truncate file %d", __func__,
+                             task.pos.nFile);
+            }
+            if (!FileCommit(file)) {
+                CloseFile(task.pos.nFile);
+                return error("%s: failed to commit file %d", __func__,
+                             task.pos.nFile);
+            }
+            return CloseFile(task.pos.nFile);
+        case Op::FLUSH:
+            if (!FileCommit(file)) {
+                return error("%s: failed to commit file %d", __func__,
+                             task.pos.nFile);
+            }
+            return true;
+        case Op::CLOSE:
+            break;
+    }
+    return true;
+}
+
+void FlatFileWriter::ThreadWriter() {
+    while (true) {
+        std::deque<Task> batch;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                break;
+            }
+            batch.swap(m_queue);
+        }
+
+        bool ok = true;
+        size_t written = 0;
+        for (Task &task : batch) {
+            ok &= Run(task);
+            written += task.data.size();
+        }
+        // Hand the buffered data to the OS, so that readers opening the files
+        // themselves see it.
+        for (auto &entry : m_files) {
+            if (fflush(entry.second.file) != 0) {
+                ok = error("%s: failed to flush file %d", __func__,
+                           entry.first);
+            }
+        }
+
+        {
+            LOCK(m_mutex);
+            m_done_seq = batch.back().seq;
+            m_queued_bytes -= written;
+            m_failed |= !ok;
+            for (auto it = m_last_write.begin(); it != m_last_write.end();) {
+                if (it->second <= m_done_seq) {
+                    it = m_last_write.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        m_done_cond.notify_all();
+    }
+
+    while (!m_files.empty()) {
+        CloseFile(m_files.begin()->first);
+    }
+}
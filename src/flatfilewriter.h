@@ -0,0 +1,136 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATFILEWRITER_H
+#define BITCOIN_FLATFILEWRITER_H
+
+#include <flatfile.h>
+#include <sync.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <thread>
+#include <vector>
+
+/**
+ * Writes to a FlatFileSeq on a dedicated I/O thread.
+ *
+ * Callers reserve positions in the files themselves, as they do for direct
+ * writes, and hand over the serialized bytes. The thread keeps the files it
+ * writes to open with a large stdio buffer, so consecutive blocks end up in a
+ * few large writes. Data is only committed to disk when Flush() or Sync() ask
+ * for it, which lets one fdatasync cover many blocks.
+ *
+ * Operations run in the order they were queued. An I/O error is logged and
+ * reported by the next Sync(); the operations queued after it still run.
+ *
+ * At most max_queued_bytes of data wait to be written: Write() blocks until
+ * the thread has caught up when more is queued, so that slow or stalled
+ * storage cannot make the queue grow without bound.
+ */
+class FlatFileWriter {
+public:
+    //! Size of the stdio buffer of each open file.
+    static constexpr size_t WRITE_BUFFER_SIZE = 4 << 20;
+    //! Number of files the thread keeps open.
+    static constexpr size_t MAX_OPEN_FILES = 4;
+    //! Default limit of the data waiting to be written.
+    static constexpr size_t DEFAULT_MAX_QUEUED_BYTES = 64 << 20;
+
+    FlatFileWriter(FlatFileSeq seq, const char *thread_name,
+                   size_t max_queued_bytes = DEFAULT_MAX_QUEUED_BYTES);
+    //! Runs the operations still queued before returning.
+    ~FlatFileWriter();
+
+    FlatFileWriter(const FlatFileWriter &) = delete;
+    FlatFileWriter &operator=(const FlatFileWriter &) = delete;
+
+    const FlatFileSeq &GetSeq() const { return m_seq; }
+
+    //! Queue data to be written at pos, waiting for room in the queue.
+    void Write(const FlatFilePos &pos, std::vector<uint8_t> data);
+
+    /**
+     * Queue the pre-allocation of space after pos. Same contract as
+     * FlatFileSeq::Allocate(), except that only the free disk space is
+     * checked before returning.
+     */
+    size_t Allocate(const FlatFilePos &pos, size_t add_size,
+                    bool &out_of_space);
+
+    /**
+     * Queue a commit of file pos.nFile, truncated to pos.nPos and closed if
+     * finalize is set. Same contract as FlatFileSeq::Flush().
+     */
+    void Flush(const FlatFilePos &pos, bool finalize = false);
+
+    //! Wait until the data queued for file nFile is visible to readers.
+    void WaitForFile(int nFile);
+
+    //! Close all open files, e.g. before some of them are deleted.
+    void CloseFiles();
+
+    /**
+     * Wait until everything queued so far has been done.
+     * @return false if an operation failed since the last call.
+     */
+    bool Sync();
+
+    //! Whether an operation failed since the last Sync().
+    bool HasFailed();
+
+private:
+    enum class Op { WRITE, ALLOCATE, FLUSH, FINALIZE, CLOSE };
+
+    struct Task {
+        Op op;
+        FlatFilePos pos;
+        //! Bytes to write, or the size to allocate
+        std::vector<uint8_t> data;
+        size_t size{0};
+        uint64_t seq{0};
+    };
+
+    struct OpenFile {
+        FILE *file{nullptr};
+        //! Where the stdio stream points to, -1 if unknown.
+        int64_t offset{-1};
+        std::vector<char> buffer;
+    };
+
+    FlatFileSeq m_seq;
+    const size_t m_max_queued_bytes;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_done_cond;
+    std::deque<Task> m_queue GUARDED_BY(m_mutex);
+    uint64_t m_next_seq GUARDED_BY(m_mutex){1};
+    //! Every task up to this one has been done.
+    uint64_t m_done_seq GUARDED_BY(m_mutex){0};
+    //! Bytes of the write tasks not done yet.
+    size_t m_queued_bytes GUARDED_BY(m_mutex){0};
+    //! Last task that writes to each file.
+    std::map<int, uint64_t> m_last_write GUARDED_BY(m_mutex);
+    bool m_failed GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+    //! Only used by the writer thread.
+    std::map<int, OpenFile> m_files;
+
+    std::thread m_thread;
+
+    uint64_t Queue(Task &&task);
+    void WaitFor(uint64_t seq);
+
+    void ThreadWriter();
+    bool Run(Task &task);
+    OpenFile *GetFile(int nFile);
+    bool CloseFile(int nFile);
+};
+
+#endif // BITCOIN_FLATFILEWRITER_H
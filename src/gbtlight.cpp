@@ -3,13 +3,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <gbtlight.h>
+#include <gbtlightstore.h>
 #include <logging.h>
 #include <scheduler.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 
 #include <atomic>
+#include <cassert>
 #include <limits>
+#include <memory>
 
 namespace gbtl {
 
@@ -23,12 +26,13 @@ namespace {
 /// Config data based on args cached for performance (since calling gArgs.GetArg() is slow).
 /// This should be initialized before RPC server startup via GBTLight::Initialize().
 struct Config {
-    fs::path storeDir, trashDir;
+    fs::path storeDir, trashDir, txDir;
     int64_t jobDataExpirySecs{};
     int cacheSize{};
 };
 Config config;
 std::atomic_uint initCt;
+std::unique_ptr<JobStore> jobStore;
 void CleanJobDataDir();
 } // namespace
 
@@ -51,6 +55,8 @@ void Initialize(CScheduler &scheduler) {
     TryCreateDirectories(config.storeDir); // may throw
     config.trashDir = config.storeDir / "trash";
     TryCreateDirectories(config.trashDir); // may throw
+    config.txDir = config.storeDir / "txs";
+    TryCreateDirectories(config.txDir); // may throw
     // parse -gbtstoretime
     config.jobDataExpirySecs = gArgs.GetArg("-gbtstoretime", DEFAULT_JOB_DATA_EXPIRY_SECS);
     if (config.jobDataExpirySecs < 0) {
@@ -58,6 +64,9 @@ void Initialize(CScheduler &scheduler) {
                   DEFAULT_JOB_DATA_EXPIRY_SECS);
         config.jobDataExpirySecs = DEFAULT_JOB_DATA_EXPIRY_SECS;
     }
+    // (re)start the job store; a previous one writes what it still has queued first
+    jobStore.reset();
+    jobStore = std::make_unique<JobStore>(config.storeDir, config.txDir, config.jobDataExpirySecs, "gbtstore");
     // create background task to clean the -gbtstoredir; runs every -gbtstoretime/2 secs
     if (config.jobDataExpirySecs > 0) {
         // schedule cleanup task every config.jobDataExpirySecs/2 seconds
@@ -77,17 +86,28 @@ void Initialize(CScheduler &scheduler) {
                         return true;
                     },
                     // Task interval in milliseconds. This will always be at least 500ms, default is 1,800,000 (30 mins)
-                    (config.jobDataExpirySecs * 1000L) / 2L
+                    (config.jobDataExpirySecs * 1000L) / 2L,
+                    "gbtlcleanup"
         );
         // We run the cleanup task once "soon" if this is the first time Initialize() was called, to clean any stale
         // files immediately at startup.
         if (invocationId == 1 && config.jobDataExpirySecs > 2)
-            scheduler.scheduleFromNow([]{CleanJobDataDir();}, 100);
+            scheduler.scheduleFromNow([]{CleanJobDataDir();}, 100, "gbtlcleanup");
     }
 }
 
+void Shutdown() {
+    jobStore.reset();
+}
+
+JobStore &GetJobStore() {
+    assert(jobStore);
+    return *jobStore;
+}
+
 const fs::path &GetJobDataDir() { return config.storeDir; }
 const fs::path &GetJobDataTrashDir() { return config.trashDir; }
+const fs::path &GetJobTxDir() { return config.txDir; }
 size_t GetJobCacheSize() { return size_t(config.cacheSize); }
 int64_t GetJobDataExpiry() { return config.jobDataExpirySecs; }
 
@@ -160,6 +180,11 @@ void CleanJobDataDir() {
         // newer than absolute cutoff, older than trash cutoff -- move to trash for "purgatory"
         MV(path, trashDir / path.filename());
     }
+    // process gbt/txs/ dir -- the job store refreshes a tx file at most every jobDataExpirySecs/2 while jobs refer
+    // to it, so a tx file older than this is no longer referenced by any job that was kept above
+    if (jobStore) {
+        count += jobStore->CleanTxDir(cutoff - config.jobDataExpirySecs/2L);
+    }
     if (count) {
         LogPrint(BCLog::RPC, "%s cleaned or moved %u out of %u item(s) in %f secs\n", pfx, count, total,
                  (GetTimeMicros()-t0)/1e6);
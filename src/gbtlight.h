@@ -16,6 +16,7 @@ class CScheduler;
 /// getblocktemplatelight and submitblocklight related config variables and functions
 namespace gbtl {
 using JobId = uint160;
+class JobStore;
 /// Called once at app init if -server=true to set up some internal variables and create the subdirectory that the
 /// GBTLight subsystem uses.  Also creates a scheduler task for cleaning up old gbt light data files periodically
 /// (every hour).
@@ -23,11 +24,21 @@ using JobId = uint160;
 /// May throw a std::exception subclass if it fails to create the gbt/ subdirectory.  Calling code should catch this
 /// and shutdown the app in that case.
 void Initialize(CScheduler &scheduler);
+/// Called at app shutdown, after the RPC server and the scheduler have stopped, to write out the job data that is
+/// still queued and stop the job store thread.
+void Shutdown();
+
+/// Returns the job store that writes job data to GetJobDataDir() in the background. Only valid between Initialize()
+/// and Shutdown().
+JobStore &GetJobStore();
 
 /// Returns the "gbt" directory path. From arg -gbtstoredir=<dir> (default: <datadir>/gbt).
 const fs::path &GetJobDataDir();
 /// Returns the "gbt trash" directory path. This is always GetJobDataDir() / "trash".
 const fs::path &GetJobDataTrashDir();
+/// Returns the directory holding the transactions referenced by job data files. This is always
+/// GetJobDataDir() / "txs".
+const fs::path &GetJobTxDir();
 /// Returns the size of the in-memory jobId cache we should use. From arg -gbtcachesize=<n>
 size_t GetJobCacheSize();
 /// Returns the job data dir file expiry time in seconds.  From arg -gbtstoretime=<n>
@@ -0,0 +1,355 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <gbtlightstore.h>
+
+#include <logging.h>
+#include <span.h>
+#include <streams.h>
+#include <util/strencodings.h>
+#include <util/system.h>
+#include <util/time.h>
+#include <version.h>
+
+#include <cstring>
+#include <functional>
+#include <ios>
+#include <iterator>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gbtl {
+namespace {
+/// Header and footer of job files holding the transactions themselves, as
+/// written by older versions.
+const std::string kFullJobMagic = "GBT";
+/// Header and footer of job files referring to transaction files by txid.
+const std::string kTxIdJobMagic = "GBI";
+static_assert(sizeof("GBT") == sizeof("GBI"), "magic must be the same size");
+
+/// A whole file, mapped into memory read-only where mmap is available.
+class FileView {
+public:
+    explicit FileView(const fs::path &path) {
+#ifndef WIN32
+        const int fd = ::open(path.string().c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::ios_base::failure("cannot open " + path.string());
+        }
+        struct stat st;
+        const bool ok = ::fstat(fd, &st) == 0;
+        if (ok && st.st_size > 0) {
+            void *const map = ::mmap(nullptr, size_t(st.st_size), PROT_READ,
+                                     MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                m_map = map;
+                m_size = size_t(st.st_size);
+            }
+        }
+        // The mapping stays valid after the file is closed.
+        ::close(fd);
+        if (!ok || (st.st_size > 0 && !m_map)) {
+            throw std::ios_base::failure("cannot map " + path.string());
+        }
+#else
+        fs::ifstream file(path, std::ios_base::binary);
+        if (!file.is_open()) {
+            throw std::ios_base::failure("cannot open " + path.string());
+        }
+        m_buf.assign(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+#endif
+    }
+
+    ~FileView() {
+#ifndef WIN32
+        if (m_map) {
+            ::munmap(m_map, m_size);
+        }
+#endif
+    }
+
+    FileView(const FileView &) = delete;
+    FileView &operator=(const FileView &) = delete;
+
+    Span<const uint8_t> data() const {
+#ifndef WIN32
+        return {static_cast<const uint8_t *>(m_map), m_size};
+#else
+        return MakeSpan(m_buf);
+#endif
+    }
+
+private:
+#ifndef WIN32
+    void *m_map{nullptr};
+    size_t m_size{0};
+#else
+    std::vector<uint8_t> m_buf;
+#endif
+};
+
+/// Write data to a temporary file and move it in place, so that readers never
+/// see a partial file.
+void WriteFile(const fs::path &path, const CDataStream &data) {
+    fs::path tmpPath = path;
+    tmpPath += tmpExt;
+    bool ok;
+    {
+        fs::ofstream file(tmpPath, std::ios_base::binary | std::ios_base::out |
+                                       std::ios_base::trunc);
+        ok = file.is_open() &&
+             file.write(data.data(), std::streamsize(data.size()));
+    }
+    if (!ok) {
+        boost::system::error_code ec;
+        fs::remove(tmpPath, ec);
+        throw std::ios_base::failure("cannot write " + tmpPath.string());
+    }
+    fs::rename(tmpPath, path);
+}
+
+CTransactionRef ReadTxFile(const fs::path &path, const TxId &txid) {
+    const FileView view(path);
+    CMutableTransaction mtx;
+    SpanReader(SER_NETWORK, PROTOCOL_VERSION, view.data()) >> mtx;
+    CTransactionRef tx = MakeTransactionRef(std::move(mtx));
+    if (tx->GetId() != txid) {
+        throw std::ios_base::failure(path.string() + " does not match its txid");
+    }
+    return tx;
+}
+} // namespace
+
+JobStore::JobStore(fs::path jobDir, fs::path txDir, int64_t expirySecs,
+                   const char *thread_name)
+    : m_job_dir(std::move(jobDir)), m_tx_dir(std::move(txDir)),
+      m_expiry_secs(expirySecs) {
+    m_thread = std::thread(
+        &TraceThread<std::function<void()>>, thread_name,
+        std::function<void()>(std::bind(&JobStore::ThreadWrite, this)));
+}
+
+JobStore::~JobStore() {
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+void JobStore::Store(const JobId &jobId, std::vector<CTransactionRef> txs) {
+    {
+        LOCK(m_mutex);
+        m_queue.emplace_back(jobId, std::move(txs));
+        m_queued++;
+    }
+    m_cond.notify_one();
+}
+
+bool JobStore::GetQueued(const JobId &jobId,
+                         std::vector<CTransactionRef> &txs) {
+    LOCK(m_mutex);
+    for (const auto &job : m_queue) {
+        if (job.first == jobId) {
+            txs.insert(txs.end(), job.second.begin(), job.second.end());
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobStore::ReadJobFile(const fs::path &path,
+                           std::vector<CTransactionRef> &txs,
+                           const CTxMemPool *mempool) const {
+    const FileView view(path);
+    const Span<const uint8_t> data = view.data();
+    const size_t magicLen = kTxIdJobMagic.size();
+    if (data.size() < magicLen * 2 + 1) {
+        return false;
+    }
+    const auto HasMagic = [&data, magicLen](const std::string &magic) {
+        return std::memcmp(data.data(), magic.data(), magicLen) == 0 &&
+               std::memcmp(data.last(magicLen).data(), magic.data(),
+                           magicLen) == 0;
+    };
+    SpanReader reader(SER_NETWORK, PROTOCOL_VERSION,
+                      data.subspan(magicLen, data.size() - magicLen * 2));
+    uint32_t txCount = 0;
+    if (HasMagic(kTxIdJobMagic)) {
+        reader >> txCount;
+        if (uint64_t(txCount) * sizeof(uint256) != reader.size()) {
+            throw std::ios_base::failure("job file has an invalid size");
+        }
+        txs.reserve(txs.size() + txCount);
+        for (uint32_t i = 0; i < txCount; ++i) {
+            uint256 hash;
+            reader >> hash;
+            const TxId txid(hash);
+            CTransactionRef tx = mempool ? mempool->get(txid) : nullptr;
+            if (!tx) {
+                tx = ReadTxFile(m_tx_dir / txid.GetHex(), txid);
+            }
+            txs.push_back(std::move(tx));
+        }
+    } else if (HasMagic(kFullJobMagic)) {
+        reader >> txCount;
+        for (uint32_t i = 0; i < txCount; ++i) {
+            CMutableTransaction mtx;
+            reader >> mtx;
+            txs.push_back(MakeTransactionRef(std::move(mtx)));
+        }
+    } else {
+        throw std::ios_base::failure("job file has an unknown format");
+    }
+    return true;
+}
+
+bool JobStore::Sync() {
+    WAIT_LOCK(m_mutex, lock);
+    const uint64_t target = m_queued;
+    m_done_cond.wait(lock, [&] { return m_written >= target; });
+    return !std::exchange(m_failed, false);
+}
+
+bool JobStore::HasFailed() {
+    LOCK(m_mutex);
+    return std::exchange(m_failed, false);
+}
+
+unsigned JobStore::CleanTxDir(int64_t cutoff) {
+    unsigned count = 0;
+    for (const auto &entry : fs::directory_iterator(m_tx_dir)) {
+        const fs::path &path = entry.path();
+        const std::string basename = path.filename().stem().string();
+        if (!fs::is_regular_file(path) ||
+            basename.size() != TxId::size() * 2 || !IsHex(basename)) {
+            continue;
+        }
+        const TxId txid(uint256S(basename));
+        // The writer does not touch the file while we decide.
+        LOCK(m_tx_mutex);
+        const auto it = m_tx_times.find(txid);
+        const bool isTmp = path.extension() == tmpExt;
+        const int64_t mtime = it != m_tx_times.end() && !isTmp
+                                  ? it->second
+                                  : int64_t(fs::last_write_time(path));
+        if (mtime >= cutoff) {
+            continue;
+        }
+        boost::system::error_code ec;
+        fs::remove(path, ec);
+        if (ec) {
+            LogPrintf("WARNING: %s failed to delete file %s: %s\n", __func__,
+                      path.string(), ec.message());
+            continue;
+        }
+        if (!isTmp && it != m_tx_times.end()) {
+            m_tx_times.erase(it);
+        }
+        ++count;
+    }
+    return count;
+}
+
+void JobStore::WriteTxs(const std::vector<CTransactionRef> &txs) {
+    const int64_t now = GetSystemTimeInSeconds();
+    // A transaction file written before this may be deleted before a job
+    // written now expires, see CleanJobDataDir().
+    const int64_t refreshTime = now - m_expiry_secs / 2;
+    LOCK(m_tx_mutex);
+    for (const auto &tx : txs) {
+        const TxId &txid = tx->GetId();
+        const fs::path path = m_tx_dir / txid.GetHex();
+        auto it = m_tx_times.find(txid);
+        if (it == m_tx_times.end() && fs::exists(path)) {
+            // Written before a restart
+            it = m_tx_times.emplace(txid, fs::last_write_time(path)).first;
+        }
+        if (it != m_tx_times.end()) {
+            if (m_expiry_secs == 0 || it->second >= refreshTime) {
+                continue;
+            }
+            boost::system::error_code ec;
+            fs::last_write_time(path, now, ec);
+            if (!ec) {
+                it->second = now;
+                continue;
+            }
+            // Deleted behind our back, write it again.
+        }
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << *tx;
+        WriteFile(path, stream);
+        m_tx_times[txid] = now;
+    }
+}
+
+void JobStore::WriteJob(const JobId &jobId,
+                        const std::vector<CTransactionRef> &txs) {
+    const fs::path path = m_job_dir / jobId.GetHex();
+    if (fs::exists(path)) {
+        return;
+    }
+    WriteTxs(txs);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream.reserve(kTxIdJobMagic.size() * 2 + sizeof(uint32_t) +
+                   txs.size() * sizeof(uint256));
+    stream.write(kTxIdJobMagic.data(), kTxIdJobMagic.size());
+    stream << uint32_t(txs.size());
+    for (const auto &tx : txs) {
+        stream << tx->GetId();
+    }
+    stream.write(kTxIdJobMagic.data(), kTxIdJobMagic.size());
+    WriteFile(path, stream);
+}
+
+void JobStore::ThreadWrite() {
+    while (true) {
+        const std::pair<JobId, std::vector<CTransactionRef>> *job;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                break;
+            }
+            // Only this thread removes jobs, and adding more to the deque
+            // leaves references to its elements valid.
+            job = &m_queue.front();
+        }
+
+        const int64_t t0 = GetTimeMicros();
+        bool ok = true;
+        try {
+            WriteJob(job->first, job->second);
+            LogPrint(BCLog::RPC,
+                     "getblocktemplatelight: job_id %s with %d txs stored in "
+                     "%f secs\n",
+                     job->first.GetHex(), job->second.size(),
+                     (GetTimeMicros() - t0) / 1e6);
+        } catch (const std::exception &e) {
+            LogPrintf("getblocktemplatelight: cannot store job_id %s: %s\n",
+                      job->first.GetHex(), e.what());
+            ok = false;
+        }
+
+        {
+            LOCK(m_mutex);
+            m_queue.pop_front();
+            m_written++;
+            if (!ok) {
+                m_failed = true;
+            }
+        }
+        m_done_cond.notify_all();
+    }
+}
+
+} // namespace gbtl
@@ -0,0 +1,128 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_GBTLIGHTSTORE_H
+#define BITCOIN_GBTLIGHTSTORE_H
+
+#include <fs.h>
+#include <gbtlight.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+#include <txmempool.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace gbtl {
+
+/**
+ * Writes the transactions of getblocktemplatelight jobs to disk on a
+ * dedicated thread, so that getblocktemplatelight does not do file I/O while
+ * holding cs_main.
+ *
+ * Consecutive templates mostly contain the same transactions, so each
+ * transaction is written once to a pool directory, in a file named after its
+ * txid. A job file only lists the txids of the job, in block order. A
+ * transaction file is kept as long as a job written within the last
+ * -gbtstoretime seconds may refer to it.
+ *
+ * Jobs run in the order they were queued. A write error is logged and
+ * reported by the next HasFailed() or Sync(); the jobs queued after it still
+ * run.
+ */
+class JobStore {
+public:
+    /**
+     * @param[in] jobDir       Where job files are written
+     * @param[in] txDir        Where transaction files are written
+     * @param[in] expirySecs   Retention time of job files, 0 if they are kept
+     *                         forever
+     */
+    JobStore(fs::path jobDir, fs::path txDir, int64_t expirySecs,
+             const char *thread_name);
+    //! Writes the jobs still queued before returning.
+    ~JobStore();
+
+    JobStore(const JobStore &) = delete;
+    JobStore &operator=(const JobStore &) = delete;
+
+    const fs::path &GetTxDir() const { return m_tx_dir; }
+
+    //! Queue the transactions of a job to be written. Jobs already on disk
+    //! are left as they are.
+    void Store(const JobId &jobId, std::vector<CTransactionRef> txs);
+
+    //! Get the transactions of a job that has not been written yet.
+    bool GetQueued(const JobId &jobId, std::vector<CTransactionRef> &txs);
+
+    /**
+     * Read the transactions of a job file. Transactions still in mempool (if
+     * not nullptr) are taken from there, the others are read from the pool
+     * directory. Files are memory mapped rather than read.
+     *
+     * @return false if the file is too short to contain a job
+     * @throws std::exception if the file cannot be read or is corrupt, or a
+     *         transaction is missing
+     */
+    bool ReadJobFile(const fs::path &path, std::vector<CTransactionRef> &txs,
+                     const CTxMemPool *mempool) const;
+
+    /**
+     * Wait until the jobs queued so far have been written.
+     * @return false if a write failed since the last call.
+     */
+    bool Sync();
+
+    //! Whether a write failed since the last call to this or Sync().
+    bool HasFailed();
+
+    /**
+     * Delete the transaction files that no job written after cutoff (a unix
+     * time) can refer to.
+     * @return the number of files deleted
+     */
+    unsigned CleanTxDir(int64_t cutoff);
+
+private:
+    const fs::path m_job_dir;
+    const fs::path m_tx_dir;
+    const int64_t m_expiry_secs;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_done_cond;
+    //! The front job stays here while it is written, for GetQueued().
+    std::deque<std::pair<JobId, std::vector<CTransactionRef>>>
+        m_queue GUARDED_BY(m_mutex);
+    uint64_t m_queued GUARDED_BY(m_mutex){0};
+    uint64_t m_written GUARDED_BY(m_mutex){0};
+    bool m_failed GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+    /**
+     * Modification time of the transaction files known to exist. The writer
+     * only touches a file again when it is about to expire, instead of once
+     * for every job.
+     */
+    Mutex m_tx_mutex;
+    std::unordered_map<TxId, int64_t, SaltedTxidHasher>
+        m_tx_times GUARDED_BY(m_tx_mutex);
+
+    std::thread m_thread;
+
+    //! Write the transaction files a job needs and refresh the old ones.
+    void WriteTxs(const std::vector<CTransactionRef> &txs);
+    void WriteJob(const JobId &jobId, const std::vector<CTransactionRef> &txs);
+
+    void ThreadWrite();
+};
+
+} // namespace gbtl
+
+#endif // BITCOIN_GBTLIGHTSTORE_H
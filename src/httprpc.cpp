@@ -87,6 +87,36 @@ static void JSONErrorReply(HTTPRequest* req, JSONRPCError&& error, UniValue&& id
     req->WriteReply(nStatus, strReply);
 }
 
+/** Reply of a request detached from its handler, see JSONRPCRequest::defer */
+class HTTPRPCDeferredReply final : public RPCDeferredReply {
+public:
+    HTTPRPCDeferredReply(std::unique_ptr<HTTPRequest> req, UniValue id)
+        : m_req(std::move(req)), m_id(std::move(id)) {}
+
+    void Complete(std::function<UniValue()> fn) override {
+        assert(m_req);
+        std::shared_ptr<HTTPRequest> req = std::move(m_req);
+        QueueHTTPWork([req, id = std::move(m_id), fn] {
+            std::string strReply;
+            try {
+                strReply = JSONRPCReply(fn(), UniValue(), UniValue(id));
+            } catch (JSONRPCError &error) {
+                JSONErrorReply(req.get(), std::move(error), UniValue(id));
+                return;
+            } catch (const std::exception &e) {
+                JSONErrorReply(req.get(), JSONRPCError(RPC_MISC_ERROR, e.what()), UniValue(id));
+                return;
+            }
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, strReply);
+        });
+    }
+
+private:
+    std::unique_ptr<HTTPRequest> m_req;
+    UniValue m_id;
+};
+
 /*
  * This function checks username and password against -rpcauth entries from
  * config file.
@@ -317,6 +347,7 @@ bool HTTPRPCRequestProcessor::ProcessHTTPRequest(HTTPRequest *req) {
         return false;
     }
 
+    std::shared_ptr<RPCDeferredReply> deferred;
     try {
         // Parse request
         UniValue valRequest;
@@ -331,10 +362,21 @@ bool HTTPRPCRequestProcessor::ProcessHTTPRequest(HTTPRequest *req) {
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(std::move(valRequest));
+            jreq.defer = [&deferred, &jreq, req] {
+                deferred = std::make_shared<HTTPRPCDeferredReply>(
+                    req->Detach(), UniValue(jreq.id));
+                return deferred;
+            };
+
+            UniValue result = rpcServer.ExecuteCommand(config, jreq);
+            if (deferred) {
+                // The handler answers later.
+                return true;
+            }
 
             // Send reply
             // (id is copied rather than moved, so it's still there for exception handlers below)
-            strReply = JSONRPCReply(rpcServer.ExecuteCommand(config, jreq), UniValue(), UniValue(jreq.id));
+            strReply = JSONRPCReply(std::move(result), UniValue(), UniValue(jreq.id));
         } else if (valRequest.isArray()) {
             // array of requests
             strReply = JSONRPCExecBatch(config, rpcServer, jreq, std::move(valRequest.get_array()));
@@ -345,9 +387,19 @@ bool HTTPRPCRequestProcessor::ProcessHTTPRequest(HTTPRequest *req) {
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strReply);
     } catch (JSONRPCError &error) {
+        if (deferred) {
+            // The handler failed after deferring its reply.
+            deferred->Complete([error]() -> UniValue { throw error; });
+            return false;
+        }
         JSONErrorReply(req, std::move(error), std::move(jreq.id));
         return false;
     } catch (const std::exception &e) {
+        if (deferred) {
+            const JSONRPCError error(RPC_PARSE_ERROR, e.what());
+            deferred->Complete([error]() -> UniValue { throw error; });
+            return false;
+        }
         JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), std::move(jreq.id));
         return false;
     }
@@ -69,6 +69,18 @@ private:
     Config *config;
 };
 
+/** Work item running a function, see QueueHTTPWork() */
+class HTTPFunctionItem final : public HTTPClosure {
+public:
+    explicit HTTPFunctionItem(std::function<void()> _func)
+        : func(std::move(_func)) {}
+
+    void operator()() override { func(); }
+
+private:
+    std::function<void()> func;
+};
+
 /**
  * Simple work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
@@ -89,10 +101,13 @@ public:
      */
     ~WorkQueue() {}
 
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem *item) {
+    /**
+     * Enqueue a work item. It is rejected when the queue is full, or if
+     * fForce, only once the queue is interrupted.
+     */
+    bool Enqueue(WorkItem *item, bool fForce = false) {
         LOCK(cs);
-        if (queue.size() >= maxDepth) {
+        if (fForce ? !running : queue.size() >= maxDepth) {
             return false;
         }
         queue.emplace_back(std::unique_ptr<WorkItem>(item));
@@ -517,6 +532,17 @@ struct event_base *EventBase() {
     return eventBase;
 }
 
+void QueueHTTPWork(std::function<void()> fn) {
+    auto item = std::make_unique<HTTPFunctionItem>(std::move(fn));
+    if (workQueue && workQueue->Enqueue(item.get(), true)) {
+        /* queue took ownership */
+        item.release();
+        return;
+    }
+    // Shutting down: run it here rather than drop the request it answers.
+    (*item)();
+}
+
 static void httpevent_callback_fn(evutil_socket_t, short, void *data) {
     // Static handler: simply call inner handler
     HTTPEvent *self = static_cast<HTTPEvent *>(data);
@@ -634,6 +660,15 @@ void HTTPRequest::WriteReply(int nStatus, const std::string &strReply) {
     req = nullptr;
 }
 
+std::unique_ptr<HTTPRequest> HTTPRequest::Detach() {
+    assert(!replySent && req);
+    auto detached = std::make_unique<HTTPRequest>(req);
+    // The new object is now responsible for the reply.
+    replySent = true;
+    req = nullptr;
+    return detached;
+}
+
 CService HTTPRequest::GetPeer() const {
     evhttp_connection *con = evhttp_request_get_connection(req);
     CService peer;
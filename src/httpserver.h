@@ -8,6 +8,7 @@
 
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <string>
 
 static const int DEFAULT_HTTP_THREADS = 4;
@@ -68,6 +69,13 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base *EventBase();
 
+/**
+ * Run fn on an HTTP worker thread, e.g. to answer a request detached from its
+ * handler. Unlike new requests, it is queued even when the work queue is full,
+ * and run on the calling thread once the workers are being stopped.
+ */
+void QueueHTTPWork(std::function<void()> fn);
+
 /**
  * In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
@@ -124,6 +132,14 @@ public:
      * this.
      */
     void WriteReply(int nStatus, const std::string &strReply = "");
+
+    /**
+     * Take over the request, so that it can be answered after the handler
+     * returned, from any thread. This object is left without a request, and
+     * the returned one answers with an error if it is destroyed without a
+     * reply.
+     */
+    std::unique_ptr<HTTPRequest> Detach();
 };
 
 /** Event handler closure */
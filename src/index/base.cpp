@@ -6,6 +6,7 @@
 #include <chainparams.h>
 #include <config.h>
 #include <index/base.h>
+#include <primitives/blockview.h>
 #include <shutdown.h>
 #include <tinyformat.h>
 #include <ui_interface.h>
@@ -87,6 +88,9 @@ void BaseIndex::ThreadSync() {
     const CBlockIndex *pindex = m_best_block_index.load();
     if (!m_synced) {
         auto &consensus_params = GetConfig().GetChainParams().GetConsensus();
+        auto &disk_magic = GetConfig().GetChainParams().DiskMagic();
+        // Reused across blocks to avoid reallocating the read buffer.
+        std::vector<uint8_t> block_data;
 
         int64_t last_log_time = 0;
         int64_t last_locator_write_time = 0;
@@ -129,13 +133,23 @@ void BaseIndex::ThreadSync() {
                 Commit();
             }
 
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            if (!ReadRawBlockFromDisk(block_data, pindex, consensus_params,
+                                      disk_magic)) {
                 FatalError("%s: Failed to read block %s from disk", __func__,
                            pindex->GetBlockHash().ToString());
                 return;
             }
-            if (!WriteBlock(block, pindex)) {
+            bool written;
+            try {
+                written = WriteBlockView(CBlockView(MakeSpan(block_data)),
+                                         pindex);
+            } catch (const std::ios_base::failure &e) {
+                FatalError("%s: Failed to parse block %s from disk: %s",
+                           __func__, pindex->GetBlockHash().ToString(),
+                           e.what());
+                return;
+            }
+            if (!written) {
                 FatalError("%s: Failed to write block %s to index database",
                            __func__, pindex->GetBlockHash().ToString());
                 return;
@@ -150,6 +164,13 @@ void BaseIndex::ThreadSync() {
     }
 }
 
+bool BaseIndex::WriteBlockView(const CBlockView &block,
+                               const CBlockIndex *pindex) {
+    CBlock materialized;
+    block.ToBlock(materialized);
+    return WriteBlock(materialized, pindex);
+}
+
 bool BaseIndex::Commit() {
     CDBBatch batch(GetDB());
     if (!CommitInternal(batch) || !GetDB().WriteBatch(batch)) {
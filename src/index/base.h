@@ -13,6 +13,7 @@
 #include <validationinterface.h>
 
 class CBlockIndex;
+class CBlockView;
 
 /**
  * Base class for indices of blockchain data. This implements
@@ -80,6 +81,13 @@ protected:
         return true;
     }
 
+    /// Write update index entries for a block read from disk during the
+    /// initial sync. Indexes that can work on the serialized block override
+    /// this to avoid deserializing it, by default the block is materialized
+    /// and passed to WriteBlock.
+    virtual bool WriteBlockView(const CBlockView &block,
+                                const CBlockIndex *pindex);
+
     /// Virtual method called internally by Commit that can be overridden to
     /// atomically commit more index state.
     virtual bool CommitInternal(CDBBatch &batch);
@@ -4,7 +4,10 @@
 
 #include <index/txindex.h>
 
+#include <blockcompressor.h>
 #include <chain.h>
+#include <chainparams.h>
+#include <primitives/blockview.h>
 #include <shutdown.h>
 #include <ui_interface.h>
 #include <util/system.h>
@@ -262,6 +265,29 @@ bool TxIndex::WriteBlock(const CBlock &block, const CBlockIndex *pindex) {
     return m_db->WriteTxs(vPos);
 }
 
+bool TxIndex::WriteBlockView(const CBlockView &block,
+                             const CBlockIndex *pindex) {
+    // Exclude genesis block transaction because outputs are not spendable.
+    if (pindex->nHeight == 0) {
+        return true;
+    }
+
+    // The view already knows where each transaction starts, so neither the
+    // transactions nor their sizes need to be computed.
+    const size_t header_size =
+        ::GetSerializeSize(block.GetHeader(), CLIENT_VERSION);
+    const uint8_t *const start = block.GetData().data();
+    std::vector<std::pair<TxId, CDiskTxPos>> vPos;
+    vPos.reserve(block.GetTxCount());
+    for (size_t i = 0; i < block.GetTxCount(); i++) {
+        const unsigned int offset = block.GetTxData(i).data() - start;
+        vPos.emplace_back(block.GetTxId(i),
+                          CDiskTxPos(pindex->GetBlockPos(),
+                                     offset - header_size));
+    }
+    return m_db->WriteTxs(vPos);
+}
+
 BaseIndex::DB &TxIndex::GetDB() const {
     return *m_db;
 }
@@ -273,12 +299,39 @@ bool TxIndex::FindTx(const TxId &txid, BlockHash &block_hash,
         return false;
     }
 
-    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (postx.nPos < 8) {
+        return error("%s: invalid block position", __func__);
+    }
+    // Start at the record header, which tells whether the block is stored
+    // compressed. The offset of the transaction only applies to raw blocks.
+    CAutoFile file(OpenBlockFile(FlatFilePos(postx.nFile, postx.nPos - 8), true),
+                   SER_DISK, CLIENT_VERSION);
     if (file.IsNull()) {
         return error("%s: OpenBlockFile failed", __func__);
     }
     CBlockHeader header;
     try {
+        CMessageHeader::MessageMagic magic;
+        unsigned int nSize;
+        file >> magic >> nSize;
+        if (magic ==
+            BlockCompression::CompressedDiskMagic(Params().DiskMagic())) {
+            if (nSize > MAX_BLOCKFILE_SIZE) {
+                return error("%s: invalid compressed block size", __func__);
+            }
+            std::vector<uint8_t> payload(nSize);
+            file >> MakeSpan(payload);
+            CBlock block;
+            BlockCompression::Decompress(payload, block);
+            for (const CTransactionRef &block_tx : block.vtx) {
+                if (block_tx->GetId() == txid) {
+                    tx = block_tx;
+                    block_hash = block.GetHash();
+                    return true;
+                }
+            }
+            return error("%s: txid not found in block", __func__);
+        }
         file >> header;
         if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
             return error("%s: fseek(...) failed", __func__);
@@ -28,6 +28,9 @@ protected:
 
     bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) override;
 
+    bool WriteBlockView(const CBlockView &block,
+                        const CBlockIndex *pindex) override;
+
     BaseIndex::DB &GetDB() const override;
 
     const char *GetName() const override { return "txindex"; }
@@ -20,6 +20,7 @@
 #include <config.h>
 #include <consensus/validation.h>
 #include <extversion.h>
+#include <filteredblockserver.h>
 #include <flatfile.h>
 #include <fs.h>
 #include <gbtlight.h>
@@ -36,6 +37,7 @@
 #include <policy/mempool.h>
 #include <policy/policy.h>
 #include <rpc/blockchain.h>
+#include <rpc/longpoll.h>
 #include <rpc/register.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
@@ -50,6 +52,7 @@
 #include <txdb.h>
 #include <txmempool.h>
 #include <ui_interface.h>
+#include <undocache.h>
 #include <util/moneystr.h>
 #include <util/system.h>
 #include <util/threadnames.h>
@@ -242,6 +245,15 @@ void Shutdown(InitInterfaces &interfaces) {
     threadGroup.interrupt_all();
     threadGroup.join_all();
 
+    for (const auto &task : scheduler.GetTaskStats()) {
+        const CScheduler::TaskStats &stats = task.second;
+        LogPrint(BCLog::BENCH,
+                 "Scheduler task %s: %u runs, %.2fms total, %.2fms max, "
+                 "started up to %.2fms late\n",
+                 task.first, stats.nRuns, stats.nTotalTime * 0.001,
+                 stats.nMaxTime * 0.001, stats.nMaxDelay * 0.001);
+    }
+
     // After the threads that potentially access these pointers have been
     // stopped, destruct and reset all to nullptr.
     peerLogic.reset();
@@ -280,6 +292,9 @@ void Shutdown(InitInterfaces &interfaces) {
         pcoinsdbview.reset();
         pblocktree.reset();
     }
+    gbtl::Shutdown();
+    StopBlockFileWriters();
+    StopBackgroundPruning();
     for (const auto &client : interfaces.chain_clients) {
         client->stop();
     }
@@ -308,6 +323,7 @@ void Shutdown(InitInterfaces &interfaces) {
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("%s: done\n", __func__);
+    LogInstance().StopAsyncWriter();
 }
 
 /**
@@ -349,6 +365,7 @@ static void OnRPCStopped() {
     uiInterface.NotifyBlockTip_disconnect(&RPCNotifyBlockChange);
     RPCNotifyBlockChange(false, nullptr);
     g_best_block_cv.notify_all();
+    longpoll::Stop();
     LogPrint(BCLog::RPC, "RPC stopped.\n");
 }
 
@@ -394,6 +411,19 @@ void SetupServerArgs() {
             defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(),
             testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()),
         true, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-asyncblockwrites",
+                 strprintf("Write block and undo files on dedicated I/O "
+                           "threads and commit them to disk in batches, "
+                           "instead of while validating each block "
+                           "(default: %d)",
+                           DEFAULT_ASYNC_BLOCK_WRITES),
+                 false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-asyncprune",
+                 strprintf("With -prune, start pruning ahead of the target "
+                           "size without flushing the chainstate, and delete "
+                           "the pruned files in the background (default: %d)",
+                           DEFAULT_ASYNC_PRUNE),
+                 false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-automaticunparking",
                  strprintf("If a new block is connected to a parked chain "
                            "with now much more proof-of-work than the active "
@@ -412,6 +442,13 @@ void SetupServerArgs() {
                  "Execute command when the best block changes (%s in cmd is "
                  "replaced by block hash)",
                  false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockcompression",
+                 strprintf("Store blocks in a compressed format. Blocks "
+                           "already on disk are converted in the background "
+                           "unless pruning or -txindex is enabled, and their "
+                           "space is freed on the next start (default: %d)",
+                           DEFAULT_BLOCK_COMPRESSION),
+                 false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockreconstructionextratxn=<n>",
                  strprintf("Extra transactions to keep in memory for compact "
                            "block reconstructions (default: %u)",
@@ -565,6 +602,12 @@ void SetupServerArgs() {
         "-reindex",
         "Rebuild chain state and block index from the blk*.dat files on disk",
         false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-schedulerthreads=<n>",
+                 strprintf("Number of threads running scheduled maintenance "
+                           "tasks, next to the one reserved for validation "
+                           "notifications (up to %d, default: %d)",
+                           MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS),
+                 false, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg(
         "-sysperms",
@@ -579,6 +622,13 @@ void SetupServerArgs() {
                            "getrawtransaction rpc call (default: %d)",
                            DEFAULT_TXINDEX),
                  false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-undocache=<n>",
+                 strprintf("Keep the undo data of recently connected blocks "
+                           "in up to <n> MiB of memory, to disconnect them "
+                           "without reading the disk (0 to disable, default: "
+                           "%d)",
+                           DEFAULT_UNDO_CACHE_SIZE),
+                 false, OptionsCategory::OPTIONS);
     gArgs.AddArg(
         "-usecashaddr",
         strprintf("Use CashAddr address format for destination encoding instead of the legacy base58 format (default: %d)",
@@ -589,6 +639,13 @@ void SetupServerArgs() {
                  "Add a node to connect to and attempt to keep the connection "
                  "open (see the `addnode` RPC command help for more info)",
                  false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-adaptiveblockdownload",
+                 strprintf("Keep as many blocks in flight from each peer as "
+                           "its measured latency and throughput call for, and "
+                           "request a late block holding back validation from "
+                           "a faster peer too (default: %d)",
+                           DEFAULT_ADAPTIVE_BLOCK_DOWNLOAD),
+                 false, OptionsCategory::CONNECTION);
     gArgs.AddArg(
         "-banscore=<n>",
         strprintf("Threshold for disconnecting and discouraging misbehaving peers (default: %u)",
@@ -627,6 +684,13 @@ void SetupServerArgs() {
 
     gArgs.AddArg("-externalip=<ip>", "Specify your own public address", false,
                  OptionsCategory::CONNECTION);
+    gArgs.AddArg(
+        "-filteredblockthreads=<n>",
+        strprintf("Number of threads building bloom filtered blocks, off the "
+                  "message handler thread (0 to build them on it, maximum: "
+                  "%d, default: %d)",
+                  MAX_FILTERED_BLOCK_THREADS, DEFAULT_FILTERED_BLOCK_THREADS),
+        false, OptionsCategory::CONNECTION);
     gArgs.AddArg(
         "-forcednsseed",
         strprintf(
@@ -743,7 +807,12 @@ void SetupServerArgs() {
                  "specified multiple times. "
                  "Whitelisted peers cannot be DoS banned and their "
                  "transactions are always relayed, even if they are already in "
-                 "the mempool, useful e.g. for a gateway",
+                 "the mempool, useful e.g. for a gateway. The "
+                 "fastblockrelay permission (e.g. fastblockrelay@1.2.3.4) "
+                 "sends new blocks to matching peers, including those we "
+                 "connect to, before connecting them to the chain. Such "
+                 "peers should grant us noban, as a block may still turn out "
+                 "to be invalid",
                  false, OptionsCategory::CONNECTION);
 
     gArgs.AddArg(
@@ -886,6 +955,20 @@ void SetupServerArgs() {
                            DEFAULT_LOGTIMESTAMPS),
                  false, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-logthreadnames", strprintf("Prepend debug output with name of the originating thread (only available on platforms supporting thread_local) (default: %u)", DEFAULT_LOGTHREADNAMES), false, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg(
+        "-logasync",
+        strprintf("Write debug output from a background thread so that "
+                  "logging does not block the calling thread. Messages still "
+                  "queued when the process crashes are lost (default: %d)",
+                  DEFAULT_LOGASYNC),
+        false, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg(
+        "-logasyncbuffer=<n>",
+        strprintf("Maximum number of queued debug messages per thread with "
+                  "-logasync, further messages are dropped and counted "
+                  "(default: %u)",
+                  DEFAULT_LOGASYNCBUFFER),
+        true, OptionsCategory::DEBUG_TEST);
 
     gArgs.AddArg(
         "-logtimemicros",
@@ -1037,6 +1120,11 @@ void SetupServerArgs() {
     gArgs.AddArg("-blockversion=<n>",
                  "Override block version to test forking scenarios", true,
                  OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-generatethreads=<n>",
+                 strprintf("Number of threads grinding nonces for "
+                           "generatetoaddress (0 = one per core, default: %d)",
+                           DEFAULT_GENERATE_THREADS),
+                 true, OptionsCategory::BLOCK_CREATION);
 
     gArgs.AddArg("-server", "Accept command line and JSON-RPC commands", false,
                  OptionsCategory::RPC);
@@ -1724,6 +1812,10 @@ bool AppInitParameterInteraction(Config &config) {
                                         chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled =
         gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fBlockCompression =
+        gArgs.GetBoolArg("-blockcompression", DEFAULT_BLOCK_COMPRESSION);
+    g_adaptive_block_download = gArgs.GetBoolArg(
+        "-adaptiveblockdownload", DEFAULT_ADAPTIVE_BLOCK_DOWNLOAD);
     if (fCheckpointsEnabled) {
         LogPrintf("Checkpoints will be verified.\n");
     } else {
@@ -2033,6 +2125,15 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         }
     }
 
+    if (gArgs.GetBoolArg("-logasync", DEFAULT_LOGASYNC)) {
+        const int64_t buffer_size =
+            gArgs.GetArg("-logasyncbuffer", DEFAULT_LOGASYNCBUFFER);
+        if (buffer_size <= 0) {
+            return InitError(_("-logasyncbuffer must be positive"));
+        }
+        logger.StartAsyncWriter(buffer_size);
+    }
+
     if (!logger.m_log_timestamps) {
         LogPrintf("Startup time: %s\n", FormatISO8601DateTime(GetTime()));
     }
@@ -2083,11 +2184,22 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         }
     }
 
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads, and one more running
+    // only high priority tasks such as validation interface callbacks.
+    const int nSchedulerThreads = std::max(
+        1, std::min<int>(gArgs.GetArg("-schedulerthreads",
+                                      DEFAULT_SCHEDULER_THREADS),
+                         MAX_SCHEDULER_THREADS));
     CScheduler::Function serviceLoop =
         std::bind(&CScheduler::serviceQueue, &scheduler);
+    for (int i = 0; i < nSchedulerThreads; i++) {
+        threadGroup.create_thread(std::bind(
+            &TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    }
+    CScheduler::Function serviceHighPriorityLoop =
+        std::bind(&CScheduler::serviceHighPriorityQueue, &scheduler);
     threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>,
-                                        "scheduler", serviceLoop));
+                                        "schedhigh", serviceHighPriorityLoop));
 
     GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
     GetMainSignals().RegisterWithMempoolSignals(g_mempool);
@@ -2342,6 +2454,19 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
               "unused mempool space)\n",
               nCoinCacheUsage * (1.0 / 1024 / 1024),
               nMempoolSizeMax * (1.0 / 1024 / 1024));
+    int64_t nUndoCacheSize = std::max<int64_t>(
+        gArgs.GetArg("-undocache", DEFAULT_UNDO_CACHE_SIZE) << 20, 0);
+    g_undo_cache.SetMaxUsage(nUndoCacheSize);
+    LogPrintf("* Using %.1fMiB for undo data of recent blocks\n",
+              nUndoCacheSize * (1.0 / 1024 / 1024));
+
+    if (gArgs.GetBoolArg("-asyncblockwrites", DEFAULT_ASYNC_BLOCK_WRITES)) {
+        StartBlockFileWriters();
+    }
+    if (fPruneMode &&
+        gArgs.GetBoolArg("-asyncprune", DEFAULT_ASYNC_PRUNE)) {
+        StartBackgroundPruning();
+    }
 
     int64_t nStart = 0;
     bool fLoaded = false;
@@ -2605,6 +2730,13 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
     threadGroup.create_thread(
         std::bind(&ThreadImport, std::ref(config), vImportFiles));
 
+    if (fBlockCompression) {
+        threadGroup.create_thread(std::bind(
+            &TraceThread<std::function<void()>>, "blkmigrate",
+            std::function<void()>(std::bind(&ThreadMigrateBlockFiles,
+                                            std::cref(chainparams)))));
+    }
+
     // Wait for genesis block to be processed
     {
         WAIT_LOCK(g_genesis_wait_mutex, lock);
@@ -2672,6 +2804,12 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
     connOptions.m_peer_connect_timeout = peer_connect_timeout;
+    if (nLocalServices & NODE_BLOOM) {
+        connOptions.nFilteredBlockThreads = std::max(
+            0, std::min<int>(gArgs.GetArg("-filteredblockthreads",
+                                          DEFAULT_FILTERED_BLOCK_THREADS),
+                             MAX_FILTERED_BLOCK_THREADS));
+    }
 
     for (const std::string &strBind : gArgs.GetArgs("-bind")) {
         CService addrBind;
@@ -2727,7 +2865,7 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
             g_banman->DumpBanlist();
             return true;
         },
-        DUMP_BANS_INTERVAL * 1000);
+        DUMP_BANS_INTERVAL * 1000, "dumpbanlist");
 
     return true;
 }
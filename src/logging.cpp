@@ -9,6 +9,8 @@
 #include <util/threadnames.h>
 #include <util/time.h>
 
+#include <algorithm>
+#include <chrono>
 #include <mutex>
 
 bool fLogIPs = DEFAULT_LOGIPS;
@@ -38,6 +40,88 @@ static int FileWriteStr(const std::string &str, FILE *fp) {
     return fwrite(str.data(), 1, str.size(), fp);
 }
 
+/** How long the asynchronous writer sleeps when it isn't woken up earlier */
+static constexpr std::chrono::milliseconds ASYNC_LOG_FLUSH_INTERVAL{100};
+
+namespace BCLog {
+
+/** A log message whose timestamp has not been formatted yet. */
+struct PendingLogMessage {
+    std::string str;
+    int64_t time_micros;
+    int64_t mocktime;
+    bool timestamped;
+};
+
+/**
+ * Bounded single-producer/single-consumer queue. The owning thread is the only
+ * producer and the logger's writer thread is the only consumer, so neither
+ * side ever takes a lock.
+ */
+class LogRingBuffer {
+private:
+    std::vector<PendingLogMessage> m_slots;
+    const size_t m_mask;
+    //! Next slot to read, only written by the consumer.
+    std::atomic<size_t> m_head{0};
+    //! Next slot to write, only written by the producer.
+    std::atomic<size_t> m_tail{0};
+    //! Consumer side: time of the last message read, used to keep this
+    //! thread's messages in order when merging with other threads.
+    int64_t m_last_time_micros = 0;
+
+public:
+    //! Logger::m_generation of the logger this buffer was created for.
+    const uint64_t m_owner_generation;
+
+    LogRingBuffer(uint64_t owner_generation, size_t capacity)
+        : m_slots(capacity), m_mask(capacity - 1),
+          m_owner_generation(owner_generation) {
+        assert(capacity > 0 && (capacity & m_mask) == 0);
+    }
+
+    size_t Capacity() const { return m_slots.size(); }
+
+    size_t Size() const {
+        return m_tail.load(std::memory_order_acquire) -
+               m_head.load(std::memory_order_acquire);
+    }
+
+    bool Push(PendingLogMessage &&msg) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == m_slots.size()) {
+            return false;
+        }
+        m_slots[tail & m_mask] = std::move(msg);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Move all queued messages to out; returns the number of messages. */
+    size_t PopAll(std::vector<PendingLogMessage> &out) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        const size_t count = tail - head;
+        for (; head != tail; ++head) {
+            PendingLogMessage &msg = m_slots[head & m_mask];
+            // The wall clock may step backwards; never let that reorder
+            // messages coming from a single thread.
+            m_last_time_micros = std::max(m_last_time_micros, msg.time_micros);
+            msg.time_micros = m_last_time_micros;
+            out.push_back(std::move(msg));
+            // Release the moved-from slot's memory now rather than keeping
+            // the largest message ever logged alive in every slot.
+            std::string().swap(m_slots[head & m_mask].str);
+        }
+        m_head.store(tail, std::memory_order_release);
+        return count;
+    }
+};
+
+} // namespace BCLog
+
+static thread_local std::shared_ptr<BCLog::LogRingBuffer> t_log_buffer;
+
 bool BCLog::Logger::OpenDebugLog() {
     std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
 
@@ -141,27 +225,37 @@ std::vector<CLogCategoryActive> ListActiveLogCategories() {
     return ret;
 }
 
+uint64_t BCLog::Logger::NextGeneration() {
+    static std::atomic<uint64_t> next_generation{0};
+    return ++next_generation;
+}
+
 BCLog::Logger::~Logger() {
+    StopAsyncWriter();
     if (m_fileout) {
         fclose(m_fileout);
     }
 }
 
-void BCLog::Logger::PrependTimestampStr(std::string &str) {
-    if (!m_log_timestamps || !m_started_new_line)
-        return;
-
-    const int64_t nTimeMicros = GetTimeMicros();
+std::string BCLog::Logger::LogTimestampStr(int64_t nTimeMicros,
+                                           int64_t mocktime) const {
     std::string tmpStr = FormatISO8601DateTime(nTimeMicros / 1000000);
     if (m_log_time_micros) {
         tmpStr.pop_back(); // pop off the trailing Z
         tmpStr += strprintf(".%06dZ", nTimeMicros % 1000000);
     }
-    const int64_t mocktime = GetMockTime();
     if (mocktime) {
         tmpStr +=
             " (mocktime: " + FormatISO8601DateTime(mocktime) + ")";
     }
+    return tmpStr;
+}
+
+void BCLog::Logger::PrependTimestampStr(std::string &str) {
+    if (!m_log_timestamps || !m_started_new_line)
+        return;
+
+    std::string tmpStr = LogTimestampStr(GetTimeMicros(), GetMockTime());
     // reserve space in tmp buffer for appending: ' ' + str
     tmpStr.reserve(tmpStr.size() + 1 + str.size());
     tmpStr += ' ';
@@ -188,6 +282,22 @@ void BCLog::Logger::LogPrintStr(std::string &&str)
 
     const bool hadNL = !str.empty() && str.back() == '\n';
 
+    // The synchronous path only pays a relaxed load. In asynchronous mode,
+    // announce this thread and check m_async again, so that
+    // StopAsyncWriter() waits for the message to be queued if it is.
+    if (m_async.load(std::memory_order_relaxed)) {
+        ++m_async_producers;
+        if (m_async.load()) {
+            // Timestamp formatting and I/O are deferred to the writer thread.
+            const bool timestamped = m_log_timestamps && m_started_new_line;
+            m_started_new_line = hadNL;
+            EnqueueAsync(std::move(str), timestamped);
+            --m_async_producers;
+            return;
+        }
+        --m_async_producers;
+    }
+
     PrependTimestampStr(str);
 
     m_started_new_line = hadNL;
@@ -200,24 +310,167 @@ void BCLog::Logger::LogPrintStr(std::string &&str)
     if (m_print_to_file) {
         std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
 
-        // Buffer if we haven't opened the log yet.
-        if (m_fileout == nullptr) {
-            m_msgs_before_open.emplace_back(std::move(str));
-        } else {
-            // Reopen the log file, if requested.
-            if (m_reopen_file) {
-                m_reopen_file = false;
-                FILE *new_fileout = fsbridge::fopen(m_file_path, "a");
-                if (new_fileout) {
-                    // unbuffered.
-                    setbuf(m_fileout, nullptr);
-                    fclose(m_fileout);
-                    m_fileout = new_fileout;
-                }
+        WriteToFile(str);
+    }
+}
+
+void BCLog::Logger::WriteToFile(const std::string &str) {
+    // Buffer if we haven't opened the log yet.
+    if (m_fileout == nullptr) {
+        m_msgs_before_open.emplace_back(str);
+        return;
+    }
+    // Reopen the log file, if requested.
+    if (m_reopen_file) {
+        m_reopen_file = false;
+        FILE *new_fileout = fsbridge::fopen(m_file_path, "a");
+        if (new_fileout) {
+            // unbuffered.
+            setbuf(m_fileout, nullptr);
+            fclose(m_fileout);
+            m_fileout = new_fileout;
+        }
+    }
+    FileWriteStr(str, m_fileout);
+}
+
+void BCLog::Logger::EnqueueAsync(std::string &&str, bool timestamped) {
+    if (!t_log_buffer || t_log_buffer->m_owner_generation != m_generation) {
+        t_log_buffer =
+            std::make_shared<LogRingBuffer>(m_generation, m_async_buffer_size);
+        std::lock_guard<std::mutex> lock(m_async_mutex);
+        m_async_buffers.push_back(t_log_buffer);
+    }
+
+    PendingLogMessage msg{std::move(str), GetTimeMicros(),
+                          timestamped ? GetMockTime() : 0, timestamped};
+    if (!t_log_buffer->Push(std::move(msg))) {
+        ++m_async_dropped;
+        m_async_cond.notify_one();
+        return;
+    }
+    // Only wake the writer early when the buffer is filling up; otherwise
+    // it picks the message up on its next periodic flush.
+    if (t_log_buffer->Size() >= t_log_buffer->Capacity() / 2) {
+        m_async_cond.notify_one();
+    }
+}
+
+size_t BCLog::Logger::DrainAsyncBuffers() {
+    std::vector<std::shared_ptr<LogRingBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(m_async_mutex);
+        // Forget buffers of threads that have exited once they are empty.
+        m_async_buffers.erase(
+            std::remove_if(m_async_buffers.begin(), m_async_buffers.end(),
+                           [](const std::shared_ptr<LogRingBuffer> &buf) {
+                               return buf.use_count() == 1 && buf->Size() == 0;
+                           }),
+            m_async_buffers.end());
+        buffers = m_async_buffers;
+    }
+
+    std::vector<PendingLogMessage> msgs;
+    for (const auto &buf : buffers) {
+        buf->PopAll(msgs);
+    }
+    buffers.clear();
+
+    // Interleave the threads' messages in time order. Each thread's own
+    // messages keep their relative order (see LogRingBuffer::PopAll).
+    std::stable_sort(msgs.begin(), msgs.end(),
+                     [](const PendingLogMessage &a, const PendingLogMessage &b) {
+                         return a.time_micros < b.time_micros;
+                     });
+
+    std::string batch;
+    for (const PendingLogMessage &msg : msgs) {
+        if (msg.timestamped) {
+            batch += LogTimestampStr(msg.time_micros, msg.mocktime);
+            batch += ' ';
+        }
+        batch += msg.str;
+    }
+
+    const uint64_t dropped = m_async_dropped.load();
+    if (dropped != m_async_dropped_reported) {
+        std::string notice = strprintf(
+            "Asynchronous logger dropped %u messages (%u total), consider "
+            "increasing -logasyncbuffer\n",
+            dropped - m_async_dropped_reported, dropped);
+        if (m_log_timestamps) {
+            notice = LogTimestampStr(GetTimeMicros(), GetMockTime()) + ' ' +
+                     notice;
+        }
+        batch += notice;
+        m_async_dropped_reported = dropped;
+    }
+
+    if (batch.empty()) {
+        return 0;
+    }
+    if (m_print_to_console) {
+        FileWriteStr(batch, stdout);
+        fflush(stdout);
+    }
+    if (m_print_to_file) {
+        std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
+        WriteToFile(batch);
+    }
+    return msgs.size();
+}
+
+void BCLog::Logger::AsyncWriterThread() {
+    util::ThreadRename("logger");
+    while (true) {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(m_async_mutex);
+            if (!m_async_stop) {
+                m_async_cond.wait_for(lock, ASYNC_LOG_FLUSH_INTERVAL);
             }
-            FileWriteStr(str, m_fileout);
+            stop = m_async_stop;
         }
+        DrainAsyncBuffers();
+        if (stop) {
+            return;
+        }
+    }
+}
+
+void BCLog::Logger::StartAsyncWriter(size_t buffer_size) {
+    if (m_async_thread.joinable()) {
+        return;
+    }
+    // Round up to a power of two so that ring indices can be masked.
+    size_t capacity = 1;
+    while (capacity < buffer_size) {
+        capacity <<= 1;
+    }
+    m_async_buffer_size = capacity;
+    m_async_stop = false;
+    m_async_thread = std::thread(&BCLog::Logger::AsyncWriterThread, this);
+    m_async.store(true, std::memory_order_release);
+}
+
+void BCLog::Logger::StopAsyncWriter() {
+    if (!m_async_thread.joinable()) {
+        return;
+    }
+    // New messages take the synchronous path from here on. Threads that
+    // still saw m_async set are waited for, so that the writer flushes their
+    // messages before it exits. Both sides use sequentially consistent
+    // accesses: a thread either sees m_async cleared, or is counted below.
+    m_async.store(false);
+    while (m_async_producers.load() != 0) {
+        std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_async_mutex);
+        m_async_stop = true;
     }
+    m_async_cond.notify_one();
+    m_async_thread.join();
 }
 
 void BCLog::Logger::ShrinkDebugFile() {
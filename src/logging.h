@@ -11,16 +11,23 @@
 #include <tinyformat.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
 static const bool DEFAULT_LOGTHREADNAMES = false;
+static const bool DEFAULT_LOGASYNC = false;
+/** Default number of pending messages per thread in asynchronous mode */
+static const size_t DEFAULT_LOGASYNCBUFFER = 4096;
 
 extern bool fLogIPs;
 extern const char *const DEFAULT_DEBUGLOGFILE;
@@ -60,12 +67,41 @@ enum LogFlags : uint32_t {
     ALL = ~uint32_t(0),
 };
 
+/**
+ * Single-producer/single-consumer ring of pending log messages, one per
+ * logging thread in asynchronous mode. Defined in logging.cpp.
+ */
+class LogRingBuffer;
+
 class Logger {
 private:
     FILE *m_fileout = nullptr;
     std::mutex m_file_mutex;
     std::list<std::string> m_msgs_before_open;
 
+    /**
+     * Asynchronous mode: messages are queued in per-thread lock-free ring
+     * buffers and written out in batches by a dedicated writer thread.
+     */
+    std::atomic_bool m_async{false};
+    //! Threads between checking m_async and queueing their message. Only
+    //! touched by threads that already saw m_async set.
+    std::atomic<int> m_async_producers{0};
+    //! Unique to this logger instance, so that a thread's ring buffer is not
+    //! mistaken for one of a later logger reusing the same address.
+    const uint64_t m_generation{NextGeneration()};
+    static uint64_t NextGeneration();
+    std::atomic<uint64_t> m_async_dropped{0};
+    //! Drop count already reported in the log, only used by the drainer.
+    uint64_t m_async_dropped_reported = 0;
+    size_t m_async_buffer_size = DEFAULT_LOGASYNCBUFFER;
+    //! Protects m_async_buffers and m_async_stop.
+    std::mutex m_async_mutex;
+    std::condition_variable m_async_cond;
+    std::vector<std::shared_ptr<LogRingBuffer>> m_async_buffers;
+    bool m_async_stop = false;
+    std::thread m_async_thread;
+
     /**
      * m_started_new_line is a state variable that will suppress printing of the
      * timestamp when multiple calls are made that don't end in a newline.
@@ -78,6 +114,16 @@ private:
     std::atomic<uint32_t> m_categories{0};
 
     void PrependTimestampStr(std::string &str);
+    std::string LogTimestampStr(int64_t nTimeMicros, int64_t mocktime) const;
+
+    /** Write a string to the debug log file, m_file_mutex must be held. */
+    void WriteToFile(const std::string &str);
+
+    /** Queue a message in this thread's ring buffer. */
+    void EnqueueAsync(std::string &&str, bool timestamped);
+    /** Write out everything currently queued, returns the number written. */
+    size_t DrainAsyncBuffers();
+    void AsyncWriterThread();
 
 public:
     bool m_print_to_console = false;
@@ -102,6 +148,19 @@ public:
     bool OpenDebugLog();
     void ShrinkDebugFile();
 
+    /**
+     * Switch to asynchronous mode: from now on LogPrintStr only queues the
+     * message and timestamp formatting and I/O happen on a writer thread.
+     * Messages that do not fit in the calling thread's buffer of
+     * buffer_size entries are dropped and counted.
+     */
+    void StartAsyncWriter(size_t buffer_size = DEFAULT_LOGASYNCBUFFER);
+    /** Flush all queued messages and return to synchronous mode. */
+    void StopAsyncWriter();
+    bool IsAsync() const { return m_async.load(std::memory_order_relaxed); }
+    /** Number of messages dropped because a thread's buffer was full. */
+    uint64_t GetAsyncDroppedCount() const { return m_async_dropped.load(); }
+
     uint32_t GetCategoryMask() const { return m_categories.load(); }
 
     void EnableCategory(LogFlags category);
@@ -45,6 +45,36 @@ CMerkleBlock::CMerkleBlock(const CBlock &block, CBloomFilter *filter,
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+CMerkleBlock::CMerkleBlock(const CBlock &block,
+                           const std::vector<CBloomTxElements> &elements,
+                           CBloomFilter &filter) {
+    assert(elements.size() == block.vtx.size());
+    header = block.GetBlockHeader();
+
+    std::vector<bool> vMatch;
+    std::vector<uint256> vHashes;
+
+    vMatch.reserve(elements.size());
+    vHashes.reserve(elements.size());
+
+    for (const CBloomTxElements &tx : elements) {
+        vMatch.push_back(filter.MatchAndInsertOutputs(tx));
+    }
+
+    for (size_t i = 0; i < elements.size(); i++) {
+        const TxId &txid = elements[i].txid;
+        if (!vMatch[i]) {
+            vMatch[i] = filter.MatchInputs(elements[i]);
+        }
+        if (vMatch[i]) {
+            vMatchedTxn.push_back(std::make_pair(i, txid));
+        }
+        vHashes.push_back(txid);
+    }
+
+    txn = CPartialMerkleTree(vHashes, vMatch);
+}
+
 uint256 CPartialMerkleTree::CalcHash(int height, size_t pos,
                                      const std::vector<uint256> &vTxid) {
     // we can never have zero txs in a merkle block, we always need the
@@ -178,6 +178,14 @@ public:
     CMerkleBlock(const CBlock &block, CBloomFilter &filter)
         : CMerkleBlock(block, &filter, nullptr) {}
 
+    /**
+     * Same as above, with the elements of the block's transactions extracted
+     * beforehand, so that they can be shared between many filters.
+     */
+    CMerkleBlock(const CBlock &block,
+                 const std::vector<CBloomTxElements> &elements,
+                 CBloomFilter &filter);
+
     /**
      * Create a Merkle proof for a set of transactions.
      */
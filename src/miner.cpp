@@ -15,21 +15,28 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
 #include <hash.h>
 #include <net.h>
 #include <policy/policy.h>
 #include <pow.h>
 #include <primitives/transaction.h>
 #include <script/standard.h>
+#include <streams.h>
 #include <timedata.h>
 #include <txmempool.h>
 #include <util/moneystr.h>
 #include <util/system.h>
 #include <validation.h>
 #include <validationinterface.h>
+#include <version.h>
 #include <pow.h>
 #include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <queue>
+#include <thread>
 #include <utility>
 
 // Unconfirmed transactions in the memory pool often depend on other
@@ -574,3 +581,144 @@ void IncrementExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev,
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+void UpdateEmptyBlock(CBlock *pblock, const CChainParams &chainparams,
+                      CBlockIndex *pindexPrev) {
+    assert(pblock->vtx.size() == 1);
+    const Consensus::Params &consensusParams = chainparams.GetConsensus();
+
+    pblock->nVersion = ComputeBlockVersion(pindexPrev, consensusParams);
+    if (chainparams.MineBlocksOnDemand()) {
+        pblock->nVersion = gArgs.GetArg("-blockversion", pblock->nVersion);
+    }
+    pblock->nTime = GetAdjustedTime();
+    pblock->nBits = GetNextWorkRequired(pindexPrev, pblock, consensusParams);
+
+    CMutableTransaction coinbaseTx(*pblock->vtx[0]);
+    coinbaseTx.vout[0].nValue =
+        GetBlockSubsidy(pindexPrev, pblock->nBits, pindexPrev->nHeight + 1,
+                        consensusParams);
+    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+
+    pblock->hashPrevBlock = pindexPrev->GetBlockHash();
+    UpdateTime(pblock, consensusParams, pindexPrev);
+    pblock->nNonce = 0;
+}
+
+namespace {
+/**
+ * Hashes block headers that only differ by their nonce. The SHA256 state after
+ * the first 64 bytes of the header is computed once, so that each nonce costs
+ * two compressions instead of three.
+ */
+class HeaderHasher {
+public:
+    explicit HeaderHasher(const CBlockHeader &header) {
+        CDataStream stream(SER_GETHASH, PROTOCOL_VERSION);
+        stream << header;
+        assert(stream.size() == sizeof(m_tail) + 64);
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(stream.data());
+        m_midstate.Write(data, 64);
+        std::memcpy(m_tail, data + 64, sizeof(m_tail));
+    }
+
+    BlockHash operator()(uint32_t nNonce) {
+        // The nonce is the last field of the header.
+        WriteLE32(m_tail + sizeof(m_tail) - 4, nNonce);
+        uint8_t buf[CSHA256::OUTPUT_SIZE];
+        CSHA256(m_midstate).Write(m_tail, sizeof(m_tail)).Finalize(buf);
+        uint256 hash;
+        CSHA256().Write(buf, sizeof(buf)).Finalize(hash.begin());
+        return BlockHash(hash);
+    }
+
+private:
+    CSHA256 m_midstate;
+    uint8_t m_tail[16];
+};
+
+/**
+ * Try the nonces in [nBegin, nEnd) until one solves the header or fStop is
+ * raised by another grinder.
+ * @return whether a nonce was found, in which case fStop is raised
+ */
+bool GrindNonceRange(HeaderHasher hasher, uint32_t nBits,
+                     const Consensus::Params &params, uint64_t nBegin,
+                     uint64_t nEnd, std::atomic<bool> &fStop, uint32_t &nNonce,
+                     uint64_t &nTries) {
+    for (uint64_t n = nBegin; n < nEnd; ++n) {
+        if (fStop.load(std::memory_order_relaxed)) {
+            break;
+        }
+        ++nTries;
+        if (CheckProofOfWork(hasher(uint32_t(n)), nBits, params)) {
+            nNonce = uint32_t(n);
+            fStop = true;
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace
+
+bool SolveBlockHeader(CBlockHeader *pblock, const Consensus::Params &params,
+                      uint64_t nNonceEnd, uint64_t &nMaxTries,
+                      unsigned int nThreads) {
+    // Easy targets, like on regtest, are solved in a few tries: only start
+    // threads when that fails.
+    static const uint64_t nSerialTries = 0x4000;
+
+    const HeaderHasher hasher(*pblock);
+    const uint64_t nBegin = pblock->nNonce;
+    if (nBegin >= nNonceEnd) {
+        return false;
+    }
+    const uint64_t nEnd = nBegin + std::min(nMaxTries, nNonceEnd - nBegin);
+    std::atomic<bool> fStop{false};
+
+    const uint64_t nSerialEnd =
+        nThreads > 1 ? std::min(nEnd, nBegin + nSerialTries) : nEnd;
+    uint64_t nTries = 0;
+    bool fFound = GrindNonceRange(hasher, pblock->nBits, params, nBegin,
+                                  nSerialEnd, fStop, pblock->nNonce, nTries);
+
+    if (!fFound && nSerialEnd < nEnd) {
+        // Split the remaining nonces into one contiguous range per thread.
+        struct Result {
+            bool fFound{false};
+            uint32_t nNonce{0};
+            uint64_t nTries{0};
+        };
+        std::vector<Result> results(nThreads);
+        std::vector<std::thread> threads;
+        const uint64_t nChunk = (nEnd - nSerialEnd + nThreads - 1) / nThreads;
+        for (unsigned int i = 0; i < nThreads; ++i) {
+            const uint64_t nFrom = std::min(nEnd, nSerialEnd + i * nChunk);
+            const uint64_t nTo = std::min(nEnd, nFrom + nChunk);
+            Result &result = results[i];
+            threads.emplace_back([&hasher, &params, &fStop, &result, pblock,
+                                  nFrom, nTo] {
+                result.fFound =
+                    GrindNonceRange(hasher, pblock->nBits, params, nFrom, nTo,
+                                    fStop, result.nNonce, result.nTries);
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        for (const Result &result : results) {
+            nTries += result.nTries;
+            if (result.fFound && !fFound) {
+                fFound = true;
+                pblock->nNonce = result.nNonce;
+            }
+        }
+    }
+
+    // Like the former generate loop, only count the nonces that failed.
+    if (fFound) {
+        --nTries;
+    }
+    nMaxTries -= std::min(nMaxTries, nTries);
+    return fFound;
+}
@@ -25,6 +25,8 @@ struct Params;
 }
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+//! Threads grinding nonces for generatetoaddress, 0 for one per core
+static const int DEFAULT_GENERATE_THREADS = 1;
 
 struct CBlockTemplateEntry {
     CTransactionRef tx;
@@ -229,4 +231,26 @@ void IncrementExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev,
                          unsigned int &nExtraNonce);
 int64_t UpdateTime(CBlockHeader *pblock, const Consensus::Params &params,
                    const CBlockIndex *pindexPrev);
+
+/**
+ * Turn a block holding only a coinbase into the block CreateNewBlock() would
+ * build on top of pindexPrev with an empty mempool. The coinbase script is
+ * left to IncrementExtraNonce().
+ */
+void UpdateEmptyBlock(CBlock *pblock, const CChainParams &chainparams,
+                      CBlockIndex *pindexPrev)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/**
+ * Search the nonces from pblock->nNonce up to nNonceEnd (excluded) for one
+ * that solves the block header, trying at most nMaxTries of them. The range
+ * is split between nThreads threads once the first few nonces failed.
+ *
+ * @return whether a solution was found, in which case pblock->nNonce is set
+ *         to it. nMaxTries is decreased by the number of nonces that
+ *         failed.
+ */
+bool SolveBlockHeader(CBlockHeader *pblock, const Consensus::Params &params,
+                      uint64_t nNonceEnd, uint64_t &nMaxTries,
+                      unsigned int nThreads);
 #endif // BITCOIN_MINER_H
@@ -16,6 +16,7 @@
 #include <consensus/consensus.h>
 #include <crypto/common.h>
 #include <crypto/sha256.h>
+#include <filteredblockserver.h>
 #include <hash.h>
 #include <net_permissions.h>
 #include <netbase.h>
@@ -28,6 +29,7 @@
 #include <cstring>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -38,6 +40,12 @@
 #endif
 
 #include <cmath>
+#include <limits>
+#include <set>
+
+// Maximum number of buffers handed to a single send call. Each queued message
+// takes up to two (header and payload).
+static constexpr size_t MAX_SEND_BUFFERS = 64;
 
 // Dump addresses to peers.dat every 15 minutes (900s)
 static constexpr int DUMP_PEERS_INTERVAL = 15 * 60;
@@ -531,6 +539,10 @@ void CNode::copyStats(CNodeStats &stats) {
         stats.mapRecvBytesPerMsgCmd = mapRecvBytesPerMsgCmd;
         stats.nRecvBytes = nRecvBytes;
     }
+    {
+        LOCK(cs_processingStats);
+        stats.mapProcessingPerMsgCmd = mapProcessingPerMsgCmd;
+    }
     stats.m_legacyWhitelisted = m_legacyWhitelisted;
     stats.m_permissionFlags = m_permissionFlags;
     {
@@ -610,18 +622,7 @@ bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
         nBytes -= handled;
 
         if (msg.complete()) {
-            // Store received bytes per message command to prevent a memory DOS,
-            // only allow valid commands.
-            mapMsgCmdSize::iterator i =
-                mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand.data());
-            if (i == mapRecvBytesPerMsgCmd.end()) {
-                i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
-            }
-
-            assert(i != mapRecvBytesPerMsgCmd.end());
-            i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
-
-            msg.nTime = nTimeMicros;
+            FinishRecvMsg(msg, nTimeMicros);
             complete = true;
         }
     }
@@ -629,6 +630,51 @@ bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
     return true;
 }
 
+Span<uint8_t> CNode::GetDirectRecvBuffer(size_t nMinSize) {
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data ||
+        vRecvMsg.back().complete()) {
+        return {};
+    }
+    CNetMessage &msg = vRecvMsg.back();
+    if (msg.hdr.nMessageSize - msg.nDataPos < nMinSize) {
+        return {};
+    }
+    return msg.GetDataBuffer();
+}
+
+void CNode::ReceivedDirect(uint32_t nBytes, bool &complete) {
+    complete = false;
+    int64_t nTimeMicros = GetTimeMicros();
+    LOCK(cs_vRecv);
+    nLastRecv = nTimeMicros / 1000000;
+    nRecvBytes += nBytes;
+
+    // The header was checked for oversize already, and the buffer never
+    // extends past the announced size.
+    CNetMessage &msg = vRecvMsg.back();
+    msg.CommitData(nBytes);
+    GetNetRecvBufferStats().nDirectBytes += nBytes;
+    if (msg.complete()) {
+        FinishRecvMsg(msg, nTimeMicros);
+        complete = true;
+    }
+}
+
+void CNode::FinishRecvMsg(CNetMessage &msg, int64_t nTimeMicros) {
+    // Store received bytes per message command to prevent a memory DOS,
+    // only allow valid commands.
+    mapMsgCmdSize::iterator i =
+        mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand.data());
+    if (i == mapRecvBytesPerMsgCmd.end()) {
+        i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    }
+
+    assert(i != mapRecvBytesPerMsgCmd.end());
+    i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+
+    msg.nTime = nTimeMicros;
+}
+
 void CNode::SetSendVersion(int nVersionIn) {
     // Send version may only be changed in the version message, and only one
     // version message is allowed per session. We can therefore treat this value
@@ -658,20 +704,20 @@ int CNode::GetSendVersion() const {
 int CNetMessage::readHeader(const Config &config, const char *pch,
                             uint32_t nBytes) {
     // copy data to temporary parsing buffer
-    uint32_t nRemaining = 24 - nHdrPos;
+    uint32_t nRemaining = hdrbuf.size() - nHdrPos;
     uint32_t nCopy = std::min(nRemaining, nBytes);
 
     memcpy(&hdrbuf[nHdrPos], pch, nCopy);
     nHdrPos += nCopy;
 
     // if header incomplete, exit
-    if (nHdrPos < 24) {
+    if (nHdrPos < hdrbuf.size()) {
         return nCopy;
     }
 
     // deserialize to CMessageHeader
     try {
-        hdrbuf >> hdr;
+        SpanReader(SER_NETWORK, vRecv.GetVersion(), MakeSpan(hdrbuf)) >> hdr;
     } catch (const std::exception &) {
         return -1;
     }
@@ -689,22 +735,40 @@ int CNetMessage::readHeader(const Config &config, const char *pch,
 }
 
 int CNetMessage::readData(const char *pch, uint32_t nBytes) {
-    unsigned int nRemaining = hdr.nMessageSize - nDataPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
+    Span<uint8_t> buffer = GetDataBuffer();
+    uint32_t nCopy = std::min<size_t>(buffer.size(), nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message
-        // size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
-
-    hasher.Write((const uint8_t *)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
-    nDataPos += nCopy;
+    memcpy(buffer.data(), pch, nCopy);
+    CommitData(nCopy);
+    GetNetRecvBufferStats().nCopiedBytes += nCopy;
 
     return nCopy;
 }
 
+Span<uint8_t> CNetMessage::GetDataBuffer() {
+    assert(in_data);
+    if (vRecv.size() == nDataPos && nDataPos < hdr.nMessageSize) {
+        // Size the buffer from the announced length, up to
+        // MAX_PREALLOCATED_SIZE. Larger messages then grow geometrically, so
+        // the payload is moved around at most a logarithmic number of times.
+        const uint32_t nNewSize = std::min<uint64_t>(
+            hdr.nMessageSize,
+            std::max<uint64_t>(MAX_PREALLOCATED_SIZE, uint64_t(nDataPos) * 2));
+        vRecv.resize(nNewSize);
+        CNetRecvBufferStats &stats = GetNetRecvBufferStats();
+        stats.nAllocations++;
+        stats.nAllocatedBytes += nNewSize;
+    }
+    return Span<uint8_t>(reinterpret_cast<uint8_t *>(&vRecv[nDataPos]),
+                         vRecv.size() - nDataPos);
+}
+
+void CNetMessage::CommitData(uint32_t nBytes) {
+    assert(nDataPos + nBytes <= vRecv.size());
+    hasher.Write(reinterpret_cast<const uint8_t *>(&vRecv[nDataPos]), nBytes);
+    nDataPos += nBytes;
+}
+
 const uint256 &CNetMessage::GetMessageHash() const {
     assert(complete());
     if (data_hash.IsNull()) {
@@ -713,26 +777,310 @@ const uint256 &CNetMessage::GetMessageHash() const {
     return data_hash;
 }
 
+std::vector<uint8_t> CNetMsgBufferPool::Acquire() {
+    LOCK(m_mutex);
+    if (m_buffers.empty()) {
+        m_misses++;
+        return {};
+    }
+    m_hits++;
+    std::vector<uint8_t> buffer = std::move(m_buffers.back());
+    m_buffers.pop_back();
+    return buffer;
+}
+
+void CNetMsgBufferPool::Release(std::vector<uint8_t> &&buffer) {
+    if (buffer.capacity() == 0 || buffer.capacity() > MAX_BUFFER_CAPACITY) {
+        return;
+    }
+    buffer.clear();
+    LOCK(m_mutex);
+    if (m_buffers.size() < MAX_BUFFERS) {
+        m_buffers.push_back(std::move(buffer));
+    }
+}
+
+size_t CNetMsgBufferPool::GetIdleCount() const {
+    LOCK(m_mutex);
+    return m_buffers.size();
+}
+
+CNetMsgBufferPool &GetNetMsgBufferPool() {
+    static CNetMsgBufferPool pool;
+    return pool;
+}
+
+CNetRecvBufferStats &GetNetRecvBufferStats() {
+    static CNetRecvBufferStats stats;
+    return stats;
+}
+
+void MsgProcessingStats::Add(int64_t time, int64_t cpu_time,
+                             int64_t queue_time, int64_t cs_main_time) {
+    nCount++;
+    nTime += time;
+    nMaxTime = std::max(nMaxTime, time);
+    nCPUTime += cpu_time;
+    nQueueTime += queue_time;
+    nMaxQueueTime = std::max(nMaxQueueTime, queue_time);
+    nCsMainTime += cs_main_time;
+
+    size_t bucket = 0;
+    while (bucket + 1 < HISTOGRAM_BUCKETS && (int64_t(1) << bucket) <= time) {
+        bucket++;
+    }
+    histogram[bucket]++;
+}
+
+MsgProcessingStats &MsgProcessingStats::
+operator+=(const MsgProcessingStats &other) {
+    nCount += other.nCount;
+    nTime += other.nTime;
+    nMaxTime = std::max(nMaxTime, other.nMaxTime);
+    nCPUTime += other.nCPUTime;
+    nQueueTime += other.nQueueTime;
+    nMaxQueueTime = std::max(nMaxQueueTime, other.nMaxQueueTime);
+    nCsMainTime += other.nCsMainTime;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        histogram[i] += other.histogram[i];
+    }
+    return *this;
+}
+
+void TxAnnouncementLog::Append(const TxId &txid) {
+    LOCK(m_mutex);
+    if (m_cursors.empty()) {
+        // Nobody to announce it to.
+        return;
+    }
+    m_pending.push_back({EndSeq(), txid});
+    Trim();
+}
+
+void TxAnnouncementLog::Trim() {
+    const size_t size = m_sorted.size() + m_pending.size();
+    if (size <= m_max_entries) {
+        return;
+    }
+    const size_t drop = size - m_max_entries;
+    const size_t drop_sorted = std::min(drop, m_sorted.size());
+    m_sorted.erase(m_sorted.begin(), m_sorted.begin() + drop_sorted);
+    m_pending.erase(m_pending.begin(),
+                    m_pending.begin() + (drop - drop_sorted));
+    m_first_pos += drop;
+    // Peers that fell this far behind miss the dropped entries.
+    for (auto &cursor : m_cursors) {
+        if (cursor.second.pos < m_first_pos) {
+            cursor.second.missed += m_first_pos - cursor.second.pos;
+            cursor.second.pos = m_first_pos;
+        }
+    }
+}
+
+void TxAnnouncementLog::SortPending(const SortFunction &sort) {
+    std::vector<TxId> txids;
+    txids.reserve(m_pending.size());
+    std::map<TxId, uint64_t> append_seqs;
+    for (const Entry &entry : m_pending) {
+        txids.push_back(entry.txid);
+        append_seqs.emplace(entry.txid, entry.append_seq);
+    }
+    sort(txids);
+    assert(txids.size() == m_pending.size());
+    m_pending.clear();
+    for (const TxId &txid : txids) {
+        m_sorted.push_back({append_seqs.at(txid), txid});
+    }
+}
+
+void TxAnnouncementLog::AddPeer(NodeId id) {
+    LOCK(m_mutex);
+    // Start at the pending batch, which may be ordered to put entries
+    // appended from now on before the ones already in it.
+    m_cursors[id] = {m_first_pos + m_sorted.size(), EndSeq()};
+}
+
+void TxAnnouncementLog::RemovePeer(NodeId id) {
+    LOCK(m_mutex);
+    m_cursors.erase(id);
+    if (m_cursors.empty()) {
+        m_first_pos = EndSeq();
+        m_sorted.clear();
+        m_pending.clear();
+    }
+}
+
+void TxAnnouncementLog::ForEachUnannounced(NodeId id,
+                                           const SortFunction &sort,
+                                           const VisitFunction &visit) {
+    // Entries are copied out a chunk at a time, so that visit() runs without
+    // the log locked. This peer's cursor is only moved by this thread, and
+    // keeps the entries it has not gone past from being dropped, unless
+    // Trim() drops them meanwhile.
+    std::vector<std::pair<uint64_t, TxId>> chunk;
+    while (true) {
+        uint64_t end_pos;
+        {
+            LOCK(m_mutex);
+            auto it = m_cursors.find(id);
+            if (it == m_cursors.end()) {
+                return;
+            }
+            Cursor &cursor = it->second;
+            if (cursor.missed > 0) {
+                LogPrint(BCLog::NET,
+                         "Announcement log full, peer=%d misses %u "
+                         "transaction announcements\n",
+                         id, cursor.missed);
+                cursor.missed = 0;
+            }
+            if (cursor.pos == EndSeq()) {
+                return;
+            }
+
+            if (!m_pending.empty()) {
+                SortPending(sort);
+
+                // Once per batch, drop what every peer went past.
+                uint64_t min_pos = cursor.pos;
+                for (const auto &other : m_cursors) {
+                    min_pos = std::min(min_pos, other.second.pos);
+                }
+                m_sorted.erase(m_sorted.begin(),
+                               m_sorted.begin() + (min_pos - m_first_pos));
+                m_first_pos = min_pos;
+            }
+
+            chunk.clear();
+            uint64_t pos = cursor.pos;
+            for (; pos < EndSeq() && chunk.size() < VISIT_CHUNK_SIZE; ++pos) {
+                const Entry &entry = m_sorted[pos - m_first_pos];
+                if (entry.append_seq >= cursor.join_seq) {
+                    chunk.emplace_back(pos, entry.txid);
+                }
+            }
+            end_pos = pos;
+        }
+
+        // Position of the first entry left to visit.
+        uint64_t next_pos = end_pos;
+        for (const auto &entry : chunk) {
+            if (!visit(entry.second)) {
+                next_pos = entry.first;
+                break;
+            }
+        }
+
+        LOCK(m_mutex);
+        auto it = m_cursors.find(id);
+        if (it == m_cursors.end()) {
+            return;
+        }
+        it->second.pos = std::max(it->second.pos, next_pos);
+        if (next_pos != end_pos) {
+            return;
+        }
+    }
+}
+
+void TxAnnouncementLog::SkipAll(NodeId id) {
+    LOCK(m_mutex);
+    auto it = m_cursors.find(id);
+    if (it != m_cursors.end()) {
+        it->second.pos = EndSeq();
+    }
+}
+
+size_t TxAnnouncementLog::size() const {
+    LOCK(m_mutex);
+    return m_sorted.size() + m_pending.size();
+}
+
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg &&msg)
+    : data(std::make_shared<std::vector<uint8_t>>(std::move(msg.data))),
+      command(std::move(msg.command)),
+      hash(Hash(data->data(), data->data() + data->size())) {}
+
+/**
+ * Send as much of the given buffers as the socket accepts, in one system call
+ * where the platform allows it. Returns the number of bytes sent, or a
+ * negative value on error.
+ */
+static int SendBuffers(SOCKET hSocket, const Span<const uint8_t> *buffers,
+                       size_t nBuffers) {
+#ifdef WIN32
+    std::array<WSABUF, MAX_SEND_BUFFERS> wsabufs;
+    for (size_t i = 0; i < nBuffers; ++i) {
+        wsabufs[i].buf =
+            reinterpret_cast<CHAR *>(const_cast<uint8_t *>(buffers[i].data()));
+        wsabufs[i].len = buffers[i].size();
+    }
+    // The socket is non-blocking: this returns once the socket buffer is
+    // full, with the number of bytes that fit in it.
+    DWORD nBytes = 0;
+    if (WSASend(hSocket, wsabufs.data(), nBuffers, &nBytes, 0, nullptr,
+                nullptr) == SOCKET_ERROR) {
+        return -1;
+    }
+    return nBytes > DWORD(std::numeric_limits<int>::max())
+               ? std::numeric_limits<int>::max()
+               : int(nBytes);
+#else
+    std::array<struct iovec, MAX_SEND_BUFFERS> iov;
+    for (size_t i = 0; i < nBuffers; ++i) {
+        iov[i].iov_base = const_cast<uint8_t *>(buffers[i].data());
+        iov[i].iov_len = buffers[i].size();
+    }
+    struct msghdr msg = {};
+    msg.msg_iov = iov.data();
+    msg.msg_iovlen = nBuffers;
+    const ssize_t nBytes =
+        sendmsg(hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    // Callers account in int, never report more than they can represent.
+    return nBytes > std::numeric_limits<int>::max()
+               ? std::numeric_limits<int>::max()
+               : int(nBytes);
+#endif
+}
+
 size_t CConnman::SocketSendData(CNode *pnode) const
     EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend) {
     size_t nSentSize = 0;
-    size_t nMsgCount = 0;
 
-    for (const auto &data : pnode->vSendMsg) {
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = 0;
+    while (!pnode->vSendMsg.empty()) {
+        // Gather the unsent part of as many queued messages as fit in one
+        // call.
+        std::array<Span<const uint8_t>, MAX_SEND_BUFFERS> buffers;
+        size_t nBuffers = 0;
+        size_t nBatchSize = 0;
+        size_t nSkip = pnode->nSendOffset;
+        for (const CQueuedNetMsg &msg : pnode->vSendMsg) {
+            if (nBuffers + 2 > buffers.size()) {
+                break;
+            }
+            const Span<const uint8_t> parts[] = {
+                MakeSpan(msg.header),
+                msg.payload ? MakeSpan(*msg.payload) : Span<const uint8_t>()};
+            for (const Span<const uint8_t> &part : parts) {
+                if (nSkip >= part.size()) {
+                    nSkip -= part.size();
+                    continue;
+                }
+                buffers[nBuffers++] = part.subspan(nSkip);
+                nBatchSize += part.size() - nSkip;
+                nSkip = 0;
+            }
+        }
+        assert(nBatchSize > 0);
 
+        int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET) {
                 break;
             }
 
-            nBytes = send(pnode->hSocket,
-                          reinterpret_cast<const char *>(data.data()) +
-                              pnode->nSendOffset,
-                          data.size() - pnode->nSendOffset,
-                          MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = SendBuffers(pnode->hSocket, buffers.data(), nBuffers);
         }
 
         if (nBytes == 0) {
@@ -755,21 +1103,29 @@ size_t CConnman::SocketSendData(CNode *pnode) const
         assert(nBytes > 0);
         pnode->nLastSend = GetSystemTimeInSeconds();
         pnode->nSendBytes += nBytes;
-        pnode->nSendOffset += nBytes;
         nSentSize += nBytes;
-        if (pnode->nSendOffset != data.size()) {
-            // could not send full message; stop sending more
-            break;
-        }
 
-        pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
+        // Retire the messages that went out completely, and recycle their
+        // payload buffers unless other peers still hold them.
+        size_t nDone = pnode->nSendOffset + nBytes;
+        while (!pnode->vSendMsg.empty() &&
+               nDone >= pnode->vSendMsg.front().size()) {
+            CQueuedNetMsg &msg = pnode->vSendMsg.front();
+            nDone -= msg.size();
+            pnode->nSendSize -= msg.MemoryUsage();
+            if (msg.payload && msg.payload.use_count() == 1) {
+                GetNetMsgBufferPool().Release(std::move(*msg.payload));
+            }
+            pnode->vSendMsg.pop_front();
+        }
+        pnode->nSendOffset = nDone;
         pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-        nMsgCount++;
-    }
 
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(),
-                          pnode->vSendMsg.begin() + nMsgCount);
+        if (size_t(nBytes) != nBatchSize) {
+            // could not send everything; the socket buffer is full
+            break;
+        }
+    }
 
     if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
@@ -1332,17 +1688,31 @@ void CConnman::SocketHandler() {
             // typical socket buffer is 8K-64K
             char pchBuf[0x10000];
             int32_t nBytes = 0;
+            // When a large enough part of a payload is still expected, read it
+            // straight into the message buffer instead of copying it from
+            // pchBuf. Such a read never extends into the next message.
+            Span<uint8_t> direct = pnode->GetDirectRecvBuffer(sizeof(pchBuf));
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET) {
                     continue;
                 }
-                nBytes =
-                    recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                if (!direct.empty()) {
+                    nBytes = recv(pnode->hSocket,
+                                  reinterpret_cast<char *>(direct.data()),
+                                  direct.size(),
+                                  MSG_DONTWAIT);
+                } else {
+                    nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf),
+                                  MSG_DONTWAIT);
+                }
             }
             if (nBytes > 0) {
                 bool notify = false;
-                if (!pnode->ReceiveMsgBytes(*config, pchBuf, nBytes, notify)) {
+                if (!direct.empty()) {
+                    pnode->ReceivedDirect(nBytes, notify);
+                } else if (!pnode->ReceiveMsgBytes(*config, pchBuf, nBytes,
+                                                   notify)) {
                     pnode->CloseSocketDisconnect();
                 }
                 RecordBytesRecv(nBytes);
@@ -2000,6 +2370,14 @@ void CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     if (manual_connection) {
         pnode->m_manual_connection = true;
     }
+    // Unlike the other permissions, which are about trusting what the peer
+    // sends us, this one is about what we send and so applies to outbound
+    // connections too.
+    NetPermissionFlags permissionFlags = PF_NONE;
+    AddWhitelistPermissionFlags(permissionFlags, pnode->addr);
+    if (NetPermissions::HasFlag(permissionFlags, PF_FASTBLOCKRELAY)) {
+        NetPermissions::AddFlag(pnode->m_permissionFlags, PF_FASTBLOCKRELAY);
+    }
 
     m_msgproc->InitializeNode(*config, pnode);
     {
@@ -2373,6 +2751,11 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
                                       connOptions.m_specified_outgoing)));
     }
 
+    if (nFilteredBlockThreads > 0) {
+        m_filtered_block_server =
+            std::make_unique<FilteredBlockServer>(nFilteredBlockThreads);
+    }
+
     // Process messages
     threadMessageHandler =
         std::thread(&TraceThread<std::function<void()>>, "msghand",
@@ -2385,7 +2768,7 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
             this->DumpAddresses();
             return true;
         },
-        DUMP_PEERS_INTERVAL * 1000);
+        DUMP_PEERS_INTERVAL * 1000, "dumpaddresses");
 
     return true;
 }
@@ -2429,6 +2812,9 @@ void CConnman::Stop() {
     if (threadMessageHandler.joinable()) {
         threadMessageHandler.join();
     }
+    // Nothing is submitted anymore. Let the queued filtered blocks go out, as
+    // they hold references to the nodes deleted below.
+    m_filtered_block_server.reset();
     if (threadOpenConnections.joinable()) {
         threadOpenConnections.join();
     }
@@ -2510,6 +2896,18 @@ std::vector<CAddress> CConnman::GetAddresses() {
     return addrman.GetAddr();
 }
 
+std::vector<CAddress> CConnman::GetCachedAddresses() {
+    const int64_t now = GetTime();
+    LOCK(m_addr_response_cache_mutex);
+    if (m_addr_response_cache_expiry <= now) {
+        m_addr_response_cache = addrman.GetAddr();
+        // Randomize the lifetime so the refresh can't be timed by a peer.
+        m_addr_response_cache_expiry = now + ADDR_RESPONSE_CACHE_LIFETIME +
+                                       GetRand(ADDR_RESPONSE_CACHE_JITTER);
+    }
+    return m_addr_response_cache;
+}
+
 bool CConnman::AddNode(const std::string &strNode) {
     LOCK(cs_vAddedNodes);
     for (const std::string &it : vAddedNodes) {
@@ -2714,6 +3112,30 @@ unsigned int CConnman::GetReceiveFloodSize() const {
     return nReceiveFloodSize;
 }
 
+void CConnman::RecordMessageProcessing(CNode *pnode,
+                                       const std::string &strCommand,
+                                       int64_t time, int64_t cpu_time,
+                                       int64_t queue_time,
+                                       int64_t cs_main_time) {
+    static const std::set<std::string> setKnownCommands(
+        getAllNetMessageTypes().begin(), getAllNetMessageTypes().end());
+    const std::string &cmd = setKnownCommands.count(strCommand)
+                                 ? strCommand
+                                 : NET_MESSAGE_COMMAND_OTHER;
+    {
+        LOCK(pnode->cs_processingStats);
+        pnode->mapProcessingPerMsgCmd[cmd].Add(time, cpu_time, queue_time,
+                                               cs_main_time);
+    }
+    LOCK(cs_processingStats);
+    mapProcessingPerMsgCmd[cmd].Add(time, cpu_time, queue_time, cs_main_time);
+}
+
+mapMsgCmdProcessingStats CConnman::GetMessageProcessingStats() {
+    LOCK(cs_processingStats);
+    return mapProcessingPerMsgCmd;
+}
+
 CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn,
              int nMyStartingHeightIn, SOCKET hSocketIn, const CAddress &addrIn,
              uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn,
@@ -2752,19 +3174,43 @@ bool CConnman::NodeFullyConnected(const CNode *pnode) {
 }
 
 void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
-    size_t nMessageSize = msg.data.size();
+    const uint256 hash =
+        Hash(msg.data.data(), msg.data.data() + msg.data.size());
+    std::shared_ptr<std::vector<uint8_t>> payload;
+    if (msg.data.empty()) {
+        GetNetMsgBufferPool().Release(std::move(msg.data));
+    } else {
+        payload = std::make_shared<std::vector<uint8_t>>(std::move(msg.data));
+    }
+    QueueMessage(pnode, msg.command, std::move(payload), hash);
+}
+
+void CConnman::PushMessage(CNode *pnode, const CSharedNetMsg &msg) {
+    QueueMessage(pnode, msg.command,
+                 msg.data->empty() ? nullptr : msg.data, msg.hash);
+}
+
+void CConnman::QueueMessage(CNode *pnode, const std::string &command,
+                            std::shared_ptr<std::vector<uint8_t>> payload,
+                            const uint256 &hash) {
+    size_t nMessageSize = payload ? payload->size() : 0;
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",
-             SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
+             SanitizeString(command.c_str()), nMessageSize, pnode->GetId());
 
-    std::vector<uint8_t> serializedHeader;
-    serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
-    CMessageHeader hdr(config->GetChainParams().NetMagic(), msg.command.c_str(),
+    // Write the header in place, it has a fixed layout.
+    CMessageHeader hdr(config->GetChainParams().NetMagic(), command.c_str(),
                        nMessageSize);
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
-
-    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+    CQueuedNetMsg queued;
+    uint8_t *pos = queued.header.data();
+    pos = std::copy(hdr.pchMessageStart.begin(), hdr.pchMessageStart.end(),
+                    pos);
+    pos = std::copy(hdr.pchCommand.begin(), hdr.pchCommand.end(), pos);
+    WriteLE32(pos, hdr.nMessageSize);
+    pos += CMessageHeader::MESSAGE_SIZE_SIZE;
+    std::copy(hash.begin(), hash.begin() + CMessageHeader::CHECKSUM_SIZE,
+              pos);
+    queued.payload = std::move(payload);
 
     size_t nBytesSent = 0;
     {
@@ -2772,16 +3218,13 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
         bool optimisticSend(pnode->vSendMsg.empty());
 
         // log total amount of bytes per command
-        pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
-        pnode->nSendSize += nTotalSize;
+        pnode->mapSendBytesPerMsgCmd[command] += nTotalSize;
+        pnode->nSendSize += queued.MemoryUsage();
 
         if (pnode->nSendSize > nSendBufferMaxSize) {
             pnode->fPauseSend = true;
         }
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize) {
-            pnode->vSendMsg.push_back(std::move(msg.data));
-        }
+        pnode->vSendMsg.push_back(std::move(queued));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true) {
@@ -26,10 +26,13 @@
 #include <threadinterrupt.h>
 #include <uint256.h>
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <deque>
+#include <functional>
+#include <map>
 #include <memory>
 #include <thread>
 
@@ -63,6 +66,10 @@ static_assert(MAX_PROTOCOL_MESSAGE_LENGTH > MAX_INV_SZ * sizeof(CInv),
 static const unsigned int MAX_LOCATOR_SZ = 101;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
+/** Minimum lifetime in seconds of the cached getaddr response */
+static const int64_t ADDR_RESPONSE_CACHE_LIFETIME = 21 * 60 * 60;
+/** Random extra lifetime in seconds of the cached getaddr response */
+static const int64_t ADDR_RESPONSE_CACHE_JITTER = 6 * 60 * 60;
 /** Maximum length of the user agent string in `version` message */
 static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 /** Maximum number of automatic outgoing nodes */
@@ -116,6 +123,203 @@ struct CSerializedNetMsg {
     std::string command;
 };
 
+/**
+ * Serialized message whose payload can be queued to any number of peers
+ * without copying it. The payload checksum is computed once, on construction.
+ */
+struct CSharedNetMsg {
+    explicit CSharedNetMsg(CSerializedNetMsg &&msg);
+
+    std::shared_ptr<std::vector<uint8_t>> data;
+    std::string command;
+    uint256 hash;
+};
+
+/**
+ * Outgoing message waiting in a peer's send queue. The header is stored
+ * inline, the payload (if any) may be shared with other peers' queues and
+ * must not be modified.
+ */
+struct CQueuedNetMsg {
+    std::array<uint8_t, CMessageHeader::HEADER_SIZE> header;
+    std::shared_ptr<std::vector<uint8_t>> payload;
+
+    size_t size() const {
+        return header.size() + (payload ? payload->size() : 0);
+    }
+
+    //! Memory held by the message: pooled payload buffers may have a much
+    //! larger capacity than the payload.
+    size_t MemoryUsage() const {
+        return header.size() + (payload ? payload->capacity() : 0);
+    }
+};
+
+/**
+ * Free list of payload buffers, so that serializing a message can reuse the
+ * memory of one that has already been sent instead of allocating.
+ */
+class CNetMsgBufferPool {
+public:
+    //! Maximum number of idle buffers kept.
+    static constexpr size_t MAX_BUFFERS = 256;
+    //! Larger buffers (e.g. blocks) are freed instead of being kept.
+    static constexpr size_t MAX_BUFFER_CAPACITY = 256 * 1024;
+
+    //! Get an empty buffer, reusing a recycled one if possible.
+    std::vector<uint8_t> Acquire();
+    //! Give back a buffer that is no longer in use.
+    void Release(std::vector<uint8_t> &&buffer);
+
+    size_t GetIdleCount() const;
+    //! Number of Acquire() calls that did and did not get a recycled buffer.
+    uint64_t GetHits() const { return m_hits; }
+    uint64_t GetMisses() const { return m_misses; }
+
+private:
+    mutable Mutex m_mutex;
+    std::vector<std::vector<uint8_t>> m_buffers GUARDED_BY(m_mutex);
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+};
+
+/** Pool used for the payloads of all outgoing P2P messages. */
+CNetMsgBufferPool &GetNetMsgBufferPool();
+
+/** Counters for the memory used to receive P2P messages. */
+struct CNetRecvBufferStats {
+    //! Payload buffer (re)allocations.
+    std::atomic<uint64_t> nAllocations{0};
+    //! Total size of those allocations.
+    std::atomic<uint64_t> nAllocatedBytes{0};
+    //! Payload bytes received straight into the message buffer.
+    std::atomic<uint64_t> nDirectBytes{0};
+    //! Payload bytes copied from the intermediate socket buffer.
+    std::atomic<uint64_t> nCopiedBytes{0};
+};
+
+CNetRecvBufferStats &GetNetRecvBufferStats();
+
+/**
+ * Transactions waiting to be announced, shared by all peers.
+ *
+ * A relayed transaction is appended once instead of being inserted in a set
+ * per peer. Entries appended since the last batch are put in relay order the
+ * first time a peer asks for them, so that ordering is done once for all
+ * peers. Each peer then only moves its own cursor through the log, filtering
+ * the entries it goes past. Entries are dropped once every peer is past them.
+ *
+ * So that a stalled peer cannot make the log grow without bound, at most
+ * max_entries are kept: the oldest ones are dropped beyond that, and peers
+ * that had not gone past them skip them, which is logged.
+ */
+class TxAnnouncementLog {
+public:
+    //! Default number of entries kept, about 4 MiB.
+    static constexpr size_t DEFAULT_MAX_ENTRIES = 100000;
+    //! Number of entries copied out of the log at a time to be visited.
+    static constexpr size_t VISIT_CHUNK_SIZE = 1000;
+
+    explicit TxAnnouncementLog(size_t max_entries = DEFAULT_MAX_ENTRIES)
+        : m_max_entries(max_entries) {}
+
+    /**
+     * Reorder the entries of a new batch. It must not add or remove any.
+     * Called with the log locked.
+     */
+    using SortFunction = std::function<void(std::vector<TxId> &)>;
+    /**
+     * Called for each entry in turn, without the log locked. Returning false
+     * stops the iteration and leaves that entry to be visited next time.
+     */
+    using VisitFunction = std::function<bool(const TxId &)>;
+
+    void Append(const TxId &txid);
+
+    //! Announce to this peer the transactions appended from now on.
+    void AddPeer(NodeId id);
+    void RemovePeer(NodeId id);
+
+    /**
+     * Visit the entries the peer has not gone past yet, in relay order.
+     * Only one thread may visit a given peer's entries at a time.
+     */
+    void ForEachUnannounced(NodeId id, const SortFunction &sort,
+                            const VisitFunction &visit);
+    //! Go past all entries without announcing them.
+    void SkipAll(NodeId id);
+
+    //! Number of entries kept.
+    size_t size() const;
+
+private:
+    //! A transaction and the sequence number it was appended with.
+    struct Entry {
+        uint64_t append_seq;
+        TxId txid;
+    };
+    struct Cursor {
+        //! Position of the next entry to visit.
+        uint64_t pos;
+        //! Entries appended before the peer was added are skipped, wherever
+        //! the ordering of their batch put them.
+        uint64_t join_seq;
+        //! Entries dropped by Trim() before the peer got to them, not
+        //! logged yet.
+        uint64_t missed{0};
+    };
+
+    const size_t m_max_entries;
+    mutable Mutex m_mutex;
+    //! Ordered entries, the first of which is at position m_first_pos.
+    std::deque<Entry> m_sorted GUARDED_BY(m_mutex);
+    uint64_t m_first_pos GUARDED_BY(m_mutex){0};
+    //! Entries appended since the last batch was ordered.
+    std::vector<Entry> m_pending GUARDED_BY(m_mutex);
+    std::map<NodeId, Cursor> m_cursors GUARDED_BY(m_mutex);
+
+    //! Positions and append sequence numbers are both counted from the
+    //! first entry ever appended, so they end at the same value.
+    uint64_t EndSeq() const EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+        return m_first_pos + m_sorted.size() + m_pending.size();
+    }
+    //! Order the pending batch and append it to m_sorted.
+    void SortPending(const SortFunction &sort)
+        EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    //! Drop the oldest entries beyond m_max_entries.
+    void Trim() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+/**
+ * Time spent on received messages, from their receipt until ProcessMessage()
+ * returns. All times are in microseconds.
+ */
+struct MsgProcessingStats {
+    //! Bucket i of the histogram counts processing times below 2^i us, the
+    //! last bucket everything above.
+    static constexpr size_t HISTOGRAM_BUCKETS = 24;
+
+    uint64_t nCount{0};
+    //! Wall clock and CPU time in ProcessMessage()
+    int64_t nTime{0};
+    int64_t nMaxTime{0};
+    int64_t nCPUTime{0};
+    //! Time waiting in the process queue of the peer
+    int64_t nQueueTime{0};
+    int64_t nMaxQueueTime{0};
+    //! Time cs_main was held in ProcessMessage()
+    int64_t nCsMainTime{0};
+    std::array<uint64_t, HISTOGRAM_BUCKETS> histogram{};
+
+    void Add(int64_t time, int64_t cpu_time, int64_t queue_time,
+             int64_t cs_main_time);
+    MsgProcessingStats &operator+=(const MsgProcessingStats &other);
+};
+
+// Command, processing stats
+typedef std::map<std::string, MsgProcessingStats> mapMsgCmdProcessingStats;
+
+class FilteredBlockServer;
 class NetEventsInterface;
 class CConnman {
 public:
@@ -141,6 +345,7 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        int nFilteredBlockThreads = 0;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
         std::vector<NetWhitebindPermissions> vWhiteBinds;
@@ -165,6 +370,7 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        nFilteredBlockThreads = connOptions.nFilteredBlockThreads;
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -210,6 +416,22 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode *pnode)> func);
 
     void PushMessage(CNode *pnode, CSerializedNetMsg &&msg);
+    /**
+     * Queue a message whose payload is shared with other peers, e.g. a block
+     * announced to everyone. The payload is neither copied nor rehashed.
+     */
+    void PushMessage(CNode *pnode, const CSharedNetMsg &msg);
+
+    //! Queue a transaction for announcement to all peers.
+    void RelayTransaction(const TxId &txid) {
+        m_tx_announcements.Append(txid);
+    }
+    TxAnnouncementLog &GetTxAnnouncementLog() { return m_tx_announcements; }
+
+    //! Worker threads building filtered blocks, if any.
+    FilteredBlockServer *GetFilteredBlockServer() {
+        return m_filtered_block_server.get();
+    }
 
     template <typename Callable> void ForEachNode(Callable &&func) {
         LOCK(cs_vNodes);
@@ -258,6 +480,12 @@ public:
     void AddNewAddresses(const std::vector<CAddress> &vAddr,
                          const CAddress &addrFrom, int64_t nTimePenalty = 0);
     std::vector<CAddress> GetAddresses();
+    /**
+     * Addresses to answer a getaddr with. The selection is cached so that
+     * getaddr floods neither walk the whole address manager under its lock
+     * nor let a peer map the table by asking repeatedly from new connections.
+     */
+    std::vector<CAddress> GetCachedAddresses();
 
     // This allows temporarily exceeding nMaxOutbound, with the goal of finding
     // a peer that is better than all our current peers.
@@ -317,6 +545,15 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /**
+     * Account for a message of command strCommand received from pnode, in the
+     * stats of the peer and in the totals since startup.
+     */
+    void RecordMessageProcessing(CNode *pnode, const std::string &strCommand,
+                                 int64_t time, int64_t cpu_time,
+                                 int64_t queue_time, int64_t cs_main_time);
+    mapMsgCmdProcessingStats GetMessageProcessingStats();
+
     void WakeMessageHandler();
 
     /**
@@ -377,6 +614,9 @@ private:
     NodeId GetNewNodeId();
 
     size_t SocketSendData(CNode *pnode) const;
+    void QueueMessage(CNode *pnode, const std::string &command,
+                      std::shared_ptr<std::vector<uint8_t>> payload,
+                      const uint256 &hash);
     void DumpAddresses();
 
     // Network stats
@@ -400,6 +640,11 @@ private:
     uint64_t nMaxOutboundLimit GUARDED_BY(cs_totalBytesSent);
     uint64_t nMaxOutboundTimeframe GUARDED_BY(cs_totalBytesSent);
 
+    // Message processing totals of all peers since startup
+    Mutex cs_processingStats;
+    mapMsgCmdProcessingStats
+        mapProcessingPerMsgCmd GUARDED_BY(cs_processingStats);
+
     // P2P timeout in seconds
     int64_t m_peer_connect_timeout;
 
@@ -437,11 +682,21 @@ private:
     std::atomic<int> nBestHeight;
     CClientUIInterface *clientInterface;
     NetEventsInterface *m_msgproc;
+    TxAnnouncementLog m_tx_announcements;
+    int nFilteredBlockThreads;
+    std::unique_ptr<FilteredBlockServer> m_filtered_block_server;
     BanMan *m_banman;
 
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
+    /** Cached getaddr response, see GetCachedAddresses() */
+    Mutex m_addr_response_cache_mutex;
+    std::vector<CAddress>
+        m_addr_response_cache GUARDED_BY(m_addr_response_cache_mutex);
+    int64_t m_addr_response_cache_expiry GUARDED_BY(
+        m_addr_response_cache_mutex){0};
+
     /** flag for waking the message processor. */
     bool fMsgProcWake;
 
@@ -575,6 +830,7 @@ struct CNodeStats {
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdProcessingStats mapProcessingPerMsgCmd;
     NetPermissionFlags m_permissionFlags;
     bool m_legacyWhitelisted;
     double dPingTime;
@@ -595,11 +851,16 @@ private:
     mutable uint256 data_hash;
 
 public:
+    //! Payload space allocated eagerly once the header is known. Past that,
+    //! the buffer grows with the data actually received, so that a peer
+    //! announcing a large message can't make us allocate it for free.
+    static constexpr uint32_t MAX_PREALLOCATED_SIZE = 256 * 1024;
+
     // Parsing header (false) or data (true)
     bool in_data;
 
     // Partially received header.
-    CDataStream hdrbuf;
+    std::array<uint8_t, CMessageHeader::HEADER_SIZE> hdrbuf;
     // Complete header.
     CMessageHeader hdr;
     uint32_t nHdrPos;
@@ -613,9 +874,7 @@ public:
 
     CNetMessage(const CMessageHeader::MessageMagic &pchMessageStartIn,
                 int nTypeIn, int nVersionIn)
-        : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn),
-          vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+        : hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
@@ -632,13 +891,18 @@ public:
 
     const uint256 &GetMessageHash() const;
 
-    void SetVersion(int nVersionIn) {
-        hdrbuf.SetVersion(nVersionIn);
-        vRecv.SetVersion(nVersionIn);
-    }
+    void SetVersion(int nVersionIn) { vRecv.SetVersion(nVersionIn); }
 
     int readHeader(const Config &config, const char *pch, uint32_t nBytes);
     int readData(const char *pch, uint32_t nBytes);
+
+    /**
+     * Space for the next payload bytes, directly in the message buffer. Only
+     * valid while reading data, and until the next call on this message.
+     */
+    Span<uint8_t> GetDataBuffer();
+    //! Account for nBytes written at the start of GetDataBuffer().
+    void CommitData(uint32_t nBytes);
 };
 
 /** Information about a peer */
@@ -649,12 +913,12 @@ public:
     // socket
     std::atomic<ServiceFlags> nServices{NODE_NONE};
     SOCKET hSocket GUARDED_BY(cs_hSocket);
-    // Total size of all vSendMsg entries.
+    // Total memory usage of all vSendMsg entries.
     size_t nSendSize{0};
     // Offset inside the first vSendMsg already sent.
     size_t nSendOffset{0};
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<uint8_t>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<CQueuedNetMsg> vSendMsg GUARDED_BY(cs_vSend);
     mutable RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -666,6 +930,9 @@ public:
     RecursiveMutex cs_sendProcessing;
 
     std::deque<CInv> vRecvGetData;
+    // Set while a filtered block is being built for this peer off the message
+    // handler thread. Its further requests are held back until it is sent.
+    std::atomic<bool> fFilteredBlockPending{false};
     uint64_t nRecvBytes GUARDED_BY(cs_vRecv){0};
     std::atomic<int> nRecvVersion{INIT_PROTO_VERSION};
 
@@ -731,6 +998,9 @@ public:
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd GUARDED_BY(cs_vRecv);
+    Mutex cs_processingStats;
+    mapMsgCmdProcessingStats
+        mapProcessingPerMsgCmd GUARDED_BY(cs_processingStats);
 
 public:
     BlockHash hashContinue;
@@ -743,11 +1013,9 @@ public:
     int64_t nNextAddrSend GUARDED_BY(cs_sendProcessing){0};
     int64_t nNextLocalAddrSend GUARDED_BY(cs_sendProcessing){0};
 
-    // Inventory based relay.
+    // Inventory based relay. Transactions to announce are kept in the
+    // connection manager's TxAnnouncementLog.
     CRollingBloomFilter filterInventoryKnown GUARDED_BY(cs_inventory);
-    // Set of transaction ids we still have to announce. They are sorted by the
-    // mempool before relay, so the order is not important.
-    std::set<TxId> setInventoryTxToSend;
     // List of block ids we still have announce. There is no final sorting
     // before sending, as they are always sent immediately and in the order
     // requested.
@@ -802,6 +1070,9 @@ private:
     // Used only by SocketHandler thread
     std::list<CNetMessage> vRecvMsg;
 
+    void FinishRecvMsg(CNetMessage &msg, int64_t nTimeMicros)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_vRecv);
+
     mutable RecursiveMutex cs_addrName;
     std::string addrName GUARDED_BY(cs_addrName);
 
@@ -824,6 +1095,16 @@ public:
     bool ReceiveMsgBytes(const Config &config, const char *pch, uint32_t nBytes,
                          bool &complete);
 
+    /**
+     * Space where the rest of the payload being received can be read from the
+     * socket in place. Empty if no payload is in progress or if less than
+     * nMinSize bytes of it are left, as reading those separately would cost
+     * more than copying them.
+     */
+    Span<uint8_t> GetDirectRecvBuffer(size_t nMinSize);
+    //! Account for nBytes received into GetDirectRecvBuffer().
+    void ReceivedDirect(uint32_t nBytes, bool &complete);
+
     void SetRecvVersion(int nVersionIn) { nRecvVersion = nVersionIn; }
     int GetRecvVersion() const { return nRecvVersion; }
     void SetSendVersion(int nVersionIn);
@@ -863,14 +1144,10 @@ public:
         filterInventoryKnown.insert(inv.hash);
     }
 
+    //! Transactions are announced through CConnman::RelayTransaction().
     void PushInventory(const CInv &inv) {
         LOCK(cs_inventory);
-        if (inv.type == MSG_TX) {
-            // inv.hash is a TxId
-            if (!filterInventoryKnown.contains(inv.hash)) {
-                setInventoryTxToSend.emplace(inv.hash);
-            }
-        } else if (inv.type == MSG_BLOCK) {
+        if (inv.type == MSG_BLOCK) {
             // inv.hash is a BlockHash
             vInventoryBlockToSend.emplace_back(inv.hash);
         }
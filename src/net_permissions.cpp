@@ -50,6 +50,8 @@ bool TryParsePermissionFlags(const std::string str, NetPermissionFlags &output,
                 NetPermissions::AddFlag(flags, PF_ALL);
             } else if (permission == "relay") {
                 NetPermissions::AddFlag(flags, PF_RELAY);
+            } else if (permission == "fastblockrelay") {
+                NetPermissions::AddFlag(flags, PF_FASTBLOCKRELAY);
             } else if (permission.length() == 0) {
                 // Allow empty entries
             } else {
@@ -83,6 +85,9 @@ std::vector<std::string> NetPermissions::ToStrings(NetPermissionFlags flags) {
     if (NetPermissions::HasFlag(flags, PF_MEMPOOL)) {
         strings.push_back("mempool");
     }
+    if (NetPermissions::HasFlag(flags, PF_FASTBLOCKRELAY)) {
+        strings.push_back("fastblockrelay");
+    }
     return strings;
 }
 
@@ -23,6 +23,10 @@ enum NetPermissionFlags {
     PF_NOBAN = (1U << 4),
     // Can query the mempool
     PF_MEMPOOL = (1U << 5),
+    // Send new blocks to this peer as soon as their header, proof of work and
+    // transactions are checked, before they are connected. Also applies to
+    // outbound connections. Not part of PF_ALL: it must be named explicitly.
+    PF_FASTBLOCKRELAY = (1U << 6),
 
     // True if the user did not specifically set fine grained permissions
     PF_ISIMPLICIT = (1U << 31),
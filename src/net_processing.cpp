@@ -8,6 +8,7 @@
 #include <addrman.h>
 #include <arith_uint256.h>
 #include <banman.h>
+#include <blockdownloadstats.h>
 #include <blockencodings.h>
 #include <blockvalidity.h>
 #include <chain.h>
@@ -15,6 +16,7 @@
 #include <config.h>
 #include <consensus/validation.h>
 #include <extversion.h>
+#include <filteredblockserver.h>
 #include <hash.h>
 #include <merkleblock.h>
 #include <net.h>
@@ -37,6 +39,7 @@
 #include <validationinterface.h>
 
 #include <memory>
+#include <utility>
 
 #if defined(NDEBUG)
 #error "Bitcoin cannot be compiled without assertions."
@@ -118,6 +121,20 @@ static_assert(INBOUND_PEER_TX_DELAY >= MAX_GETDATA_RANDOM_DELAY,
  */
 static const unsigned int MAX_GETDATA_SZ = 1000;
 
+/**
+ * How long (in microseconds) the block holding back validation must have been
+ * in flight before it is also requested from another peer.
+ */
+// 2 seconds
+static constexpr int64_t BLOCK_DUPLICATE_MIN_WAIT = 2 * 1000000;
+/**
+ * How long to wait (in microseconds) for a block requested a second time,
+ * before stall detection applies again to the peer it was first requested
+ * from.
+ */
+// 10 seconds
+static constexpr int64_t BLOCK_DUPLICATE_TIMEOUT = 10 * 1000000;
+
 /// How many non standard orphan do we consider from a node before ignoring it.
 static constexpr uint32_t MAX_NON_STANDARD_ORPHAN_PER_NODE = 5;
 
@@ -126,6 +143,8 @@ RecursiveMutex g_cs_orphans;
 std::map<TxId, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 }
 
+bool g_adaptive_block_download = DEFAULT_ADAPTIVE_BLOCK_DOWNLOAD;
+
 /**
  * Average delay between local address broadcasts in milliseconds.
  */
@@ -189,10 +208,23 @@ struct QueuedBlock {
     bool fValidatedHeaders;
     //! Optional, used for CMPCTBLOCK downloads
     std::unique_ptr<PartiallyDownloadedBlock> partialBlock;
+    //! When the block was requested (in microseconds).
+    int64_t nRequestTime;
 };
 std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator>>
     mapBlocksInFlight GUARDED_BY(cs_main);
 
+/**
+ * Blocks in flight that were requested a second time, from a peer expected to
+ * deliver them sooner, because validation is waiting for them. Maps them to
+ * that peer and the time of the second request (in microseconds).
+ */
+std::map<uint256, std::pair<NodeId, int64_t>>
+    mapBlocksDuplicated GUARDED_BY(cs_main);
+/** Number of blocks requested a second time, and delivered first that way. */
+uint64_t nBlocksDuplicated GUARDED_BY(cs_main) = 0;
+uint64_t nBlocksDuplicatedFirst GUARDED_BY(cs_main) = 0;
+
 /** Stack of nodes which we have set to announce using compact blocks */
 std::list<NodeId> lNodesAnnouncingHeaderAndIDs GUARDED_BY(cs_main);
 
@@ -283,8 +315,16 @@ struct CNodeState {
     //! When the first entry in vBlocksInFlight started downloading. Don't care
     //! when vBlocksInFlight is empty.
     int64_t nDownloadingSince;
+    //! When the last block requested from this peer was received, as
+    //! timestamped by the socket handler.
+    int64_t nLastBlockReceived;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Blocks in flight from another peer, that we also requested from this
+    //! one.
+    std::set<uint256> setBlocksDuplicated;
+    //! How fast this peer delivers the blocks we request.
+    BlockDownloadStats downloadStats;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block
@@ -417,6 +457,7 @@ struct CNodeState {
         nHeadersSyncTimeout = 0;
         nStallingSince = 0;
         nDownloadingSince = 0;
+        nLastBlockReceived = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
@@ -497,6 +538,16 @@ static void PushNodeVersion(const Config &config, CNode *pnode,
 // peer.
 static bool MarkBlockAsReceived(const uint256 &hash)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    bool fDuplicated = false;
+    auto itDuplicated = mapBlocksDuplicated.find(hash);
+    if (itDuplicated != mapBlocksDuplicated.end()) {
+        CNodeState *state = State(itDuplicated->second.first);
+        assert(state != nullptr);
+        state->setBlocksDuplicated.erase(hash);
+        mapBlocksDuplicated.erase(itDuplicated);
+        fDuplicated = true;
+    }
+
     std::map<uint256,
              std::pair<NodeId, std::list<QueuedBlock>::iterator>>::iterator
         itInFlight = mapBlocksInFlight.find(hash);
@@ -523,7 +574,116 @@ static bool MarkBlockAsReceived(const uint256 &hash)
         return true;
     }
 
-    return false;
+    return fDuplicated;
+}
+
+/** Number of blocks to keep in flight from a peer. */
+static unsigned int GetBlockDownloadWindow(const CNodeState &state)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    if (!g_adaptive_block_download) {
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    }
+    return state.downloadStats.GetWindow(MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+/**
+ * Whether to request a block in flight from another peer from this one as well,
+ * because validation is waiting for it and this peer is expected to deliver it
+ * sooner.
+ */
+static bool ShouldDuplicateBlockRequest(const CNodeState &state,
+                                        const CBlockIndex *pindex,
+                                        int64_t nNow)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    const BlockHash &hash = pindex->GetBlockHash();
+    if (mapBlocksDuplicated.count(hash)) {
+        return false;
+    }
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    assert(itInFlight != mapBlocksInFlight.end());
+    const int64_t nWaited = nNow - itInFlight->second.second->nRequestTime;
+    if (nWaited < BLOCK_DUPLICATE_MIN_WAIT) {
+        return false;
+    }
+
+    // This peer must be known to be faster than the wait so far...
+    const int64_t nExpected =
+        state.downloadStats.GetExpectedArrival(state.nBlocksInFlight);
+    if (nExpected < 0 || nExpected >= nWaited) {
+        return false;
+    }
+    // ...and the other peer well behind what it usually achieves.
+    const CNodeState *holder = State(itInFlight->second.first);
+    assert(holder != nullptr);
+    const int64_t nHolderExpected =
+        holder->downloadStats.GetExpectedArrival(holder->nBlocksInFlight);
+    return nHolderExpected < 0 || nWaited > 2 * nHolderExpected;
+}
+
+/**
+ * Forget the blocks requested a second time from this peer that it did not
+ * deliver in time, so that the peer they were first requested from can be
+ * found stalling again.
+ */
+static void ExpireDuplicatedBlocks(CNodeState &state, int64_t nNow)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    for (auto it = state.setBlocksDuplicated.begin();
+         it != state.setBlocksDuplicated.end();) {
+        auto itDuplicated = mapBlocksDuplicated.find(*it);
+        assert(itDuplicated != mapBlocksDuplicated.end());
+        if (itDuplicated->second.second > nNow - BLOCK_DUPLICATE_TIMEOUT) {
+            ++it;
+            continue;
+        }
+        LogPrint(BCLog::NET, "Timeout of duplicate block request %s peer=%d\n",
+                 it->ToString(), itDuplicated->second.first);
+        mapBlocksDuplicated.erase(itDuplicated);
+        it = state.setBlocksDuplicated.erase(it);
+    }
+}
+
+/**
+ * Measure the download performance of a peer from a block it sent us, before
+ * the block is marked as received.
+ */
+static void RecordBlockDownload(NodeId nodeid, const uint256 &hash,
+                                uint64_t nSize, int64_t nTimeReceived)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+
+    auto itDuplicated = mapBlocksDuplicated.find(hash);
+    if (itDuplicated != mapBlocksDuplicated.end() &&
+        itDuplicated->second.first == nodeid) {
+        // The second request was not queued in order with the others, so
+        // its timing is not a meaningful sample.
+        nBlocksDuplicatedFirst += mapBlocksInFlight.count(hash);
+        return;
+    }
+
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() ||
+        itInFlight->second.first != nodeid) {
+        // Unrequested: it tells us nothing.
+        return;
+    }
+    // Receive times rather than the current time, so that neither the time
+    // spent in the receive queue nor our own validation of the previous block
+    // count against the peer.
+    const int64_t nPrevReceived =
+        std::exchange(state->nLastBlockReceived, nTimeReceived);
+    if (state->vBlocksInFlight.begin() != itInFlight->second.second) {
+        // Delivered out of order: it tells us nothing.
+        return;
+    }
+    const QueuedBlock &queued = *itInFlight->second.second;
+    if (queued.nRequestTime >= nPrevReceived) {
+        // Nothing was in flight when it was requested.
+        state->downloadStats.AddLatency(nTimeReceived - queued.nRequestTime);
+    } else {
+        // It was queued behind the previous block.
+        state->downloadStats.AddInterval(nTimeReceived - nPrevReceived, nSize);
+    }
 }
 
 // returns false, still setting pit, if the block was already in flight from the
@@ -553,17 +713,18 @@ MarkBlockAsInFlight(const Config &config, NodeId nodeid, const uint256 &hash,
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
+    const int64_t nNow = GetTimeMicros();
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(
         state->vBlocksInFlight.end(),
         {hash, pindex, pindex != nullptr,
          std::unique_ptr<PartiallyDownloadedBlock>(
-             pit ? new PartiallyDownloadedBlock(config, &g_mempool)
-                 : nullptr)});
+             pit ? new PartiallyDownloadedBlock(config, &g_mempool) : nullptr),
+         nNow});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
         // We're starting a block download (batch) from this peer.
-        state->nDownloadingSince = GetTimeMicros();
+        state->nDownloadingSince = nNow;
     }
 
     if (state->nBlocksInFlightValidHeaders == 1 && pindex != nullptr) {
@@ -708,11 +869,14 @@ static bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex)
 
 /**
  * Update pindexLastCommonBlock and add not-in-flight missing successors to
- * vBlocks, until it has at most count entries.
+ * vBlocks, until it has at most count entries. pindexWaitingFor is set to the
+ * first missing block in flight from another peer, if the blocks before it
+ * are all downloaded.
  */
 static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count,
                                      std::vector<const CBlockIndex *> &vBlocks,
                                      NodeId &nodeStaller,
+                                     const CBlockIndex *&pindexWaitingFor,
                                      const Consensus::Params &consensusParams)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     if (count == 0) {
@@ -807,6 +971,9 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count,
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                if (waitingfor != nodeid && pindex->pprev->HaveTxsDownloaded()) {
+                    pindexWaitingFor = pindex;
+                }
             }
         }
     }
@@ -909,6 +1076,7 @@ void PeerLogicValidation::InitializeNode(const Config &config, CNode *pnode) {
             std::forward_as_tuple(nodeid),
             std::forward_as_tuple(addr, std::move(addrName)));
     }
+    connman->GetTxAnnouncementLog().AddPeer(nodeid);
     if (!pnode->fInbound) {
         PushNodeVersion(config, pnode, connman, GetTime());
     }
@@ -917,6 +1085,7 @@ void PeerLogicValidation::InitializeNode(const Config &config, CNode *pnode) {
 void PeerLogicValidation::FinalizeNode(const Config &config, NodeId nodeid,
                                        bool &fUpdateConnectionTime) {
     fUpdateConnectionTime = false;
+    connman->GetTxAnnouncementLog().RemovePeer(nodeid);
     LOCK(cs_main);
     CNodeState *state = State(nodeid);
     assert(state != nullptr);
@@ -932,6 +1101,9 @@ void PeerLogicValidation::FinalizeNode(const Config &config, NodeId nodeid,
     for (const QueuedBlock &entry : state->vBlocksInFlight) {
         mapBlocksInFlight.erase(entry.hash);
     }
+    for (const uint256 &hash : state->setBlocksDuplicated) {
+        mapBlocksDuplicated.erase(hash);
+    }
     internal::EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
@@ -945,6 +1117,7 @@ void PeerLogicValidation::FinalizeNode(const Config &config, NodeId nodeid,
     if (mapNodeState.empty()) {
         // Do a consistency check after the last peer is removed.
         assert(mapBlocksInFlight.empty());
+        assert(mapBlocksDuplicated.empty());
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
         assert(g_outbound_peers_with_protect_from_disconnect == 0);
@@ -969,9 +1142,23 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
         }
     }
+    stats.nBlocksDuplicated = state->setBlocksDuplicated.size();
+    stats.nBlockDownloadWindow = GetBlockDownloadWindow(*state);
+    stats.nBlockLatency = state->downloadStats.GetLatency();
+    stats.nBlockInterval = state->downloadStats.GetInterval();
+    stats.dBlockBytesPerSecond = state->downloadStats.GetBytesPerSecond();
+    stats.fStalling = state->nStallingSince != 0;
     return true;
 }
 
+void GetBlockDownloadTotals(BlockDownloadTotals &totals) {
+    LOCK(cs_main);
+    totals.nBlocksInFlight = mapBlocksInFlight.size();
+    totals.nBlocksDuplicatedInFlight = mapBlocksDuplicated.size();
+    totals.nBlocksDuplicated = nBlocksDuplicated;
+    totals.nBlocksDuplicatedFirst = nBlocksDuplicatedFirst;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -1200,7 +1387,7 @@ PeerLogicValidation::PeerLogicValidation(CConnman *connmanIn, BanMan *banman,
             this->CheckForStaleTipAndEvictPeers(consensusParams);
             return true;
         },
-        EXTRA_PEER_CHECK_INTERVAL * 1000);
+        EXTRA_PEER_CHECK_INTERVAL * 1000, "stalecheck");
 }
 
 /**
@@ -1255,6 +1442,34 @@ static std::shared_ptr<const CBlock>
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs>
     most_recent_compact_block GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
+// Serialized CMPCTBLOCK and BLOCK messages for the above, shared by all the
+// peers they are sent to. The BLOCK message is only built on first use.
+static std::shared_ptr<const CSharedNetMsg>
+    most_recent_compact_block_msg GUARDED_BY(cs_most_recent_block);
+static std::shared_ptr<const CSharedNetMsg>
+    most_recent_block_msg GUARDED_BY(cs_most_recent_block);
+
+/**
+ * Get the serialized BLOCK message for the most recent block, building it if
+ * needed.
+ */
+static std::shared_ptr<const CSharedNetMsg>
+GetMostRecentBlockMsg(const std::shared_ptr<const CBlock> &pblock) {
+    {
+        LOCK(cs_most_recent_block);
+        if (most_recent_block == pblock && most_recent_block_msg) {
+            return most_recent_block_msg;
+        }
+    }
+    // Serialize without holding the lock, blocks can be large.
+    auto msg = std::make_shared<const CSharedNetMsg>(
+        CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::BLOCK, *pblock));
+    LOCK(cs_most_recent_block);
+    if (most_recent_block == pblock) {
+        most_recent_block_msg = msg;
+    }
+    return msg;
+}
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
@@ -1265,6 +1480,23 @@ void PeerLogicValidation::NewPoWValidBlock(
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock =
         std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    // Serialized once, every peer gets the same payload.
+    std::shared_ptr<const CSharedNetMsg> pcmpctmsg =
+        std::make_shared<const CSharedNetMsg>(
+            msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+
+    // Peers with PF_FASTBLOCKRELAY that cannot take the compact block get the
+    // whole block. Serialize it now rather than under cs_main, blocks can be
+    // large.
+    bool fAnyFastRelay = false;
+    connman->ForEachNode([&fAnyFastRelay](CNode *pnode) {
+        fAnyFastRelay |= pnode->HasPermission(PF_FASTBLOCKRELAY);
+    });
+    std::shared_ptr<const CSharedNetMsg> pblockmsg;
+    if (fAnyFastRelay) {
+        pblockmsg = std::make_shared<const CSharedNetMsg>(
+            msgMaker.Make(NetMsgType::BLOCK, *pblock));
+    }
 
     LOCK(cs_main);
 
@@ -1281,29 +1513,50 @@ void PeerLogicValidation::NewPoWValidBlock(
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_compact_block_msg = pcmpctmsg;
+        most_recent_block_msg = pblockmsg;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker,
+    connman->ForEachNode([this, &pcmpctmsg, &pblockmsg, pindex,
                           &hashBlock](CNode *pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
-        if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect) {
+        // Trusted peers get the block whether or not they asked for
+        // high-bandwidth compact blocks, and still validate it themselves.
+        const bool fFastRelay = pnode->HasPermission(PF_FASTBLOCKRELAY);
+        // Older peers would ban us for a compact block that turns out to be
+        // invalid.
+        const bool fCompactOk = pnode->nVersion >= INVALID_CB_NO_BAN_VERSION;
+        if ((!fCompactOk && !fFastRelay) || pnode->fDisconnect) {
             return;
         }
         ProcessBlockAvailability(pnode->GetId());
         CNodeState &state = *State(pnode->GetId());
         // If the peer has, or we announced to them the previous block already,
         // but we don't think they have this one, go ahead and announce it.
-        if (state.fPreferHeaderAndIDs && !PeerHasHeader(&state, pindex) &&
-            PeerHasHeader(&state, pindex->pprev)) {
+        // Otherwise the peer could not connect the block and would penalize
+        // us for it: it gets the usual announcement once the block is
+        // connected.
+        if (PeerHasHeader(&state, pindex) ||
+            !PeerHasHeader(&state, pindex->pprev)) {
+            return;
+        }
+        if (fCompactOk &&
+            (state.fPreferHeaderAndIDs ||
+             (fFastRelay && state.fSupportsDesiredCmpctVersion))) {
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n",
                      "PeerLogicValidation::NewPoWValidBlock",
                      hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(
-                pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
-            state.pindexBestHeaderSent = pindex;
+            connman->PushMessage(pnode, *pcmpctmsg);
+        } else if (fFastRelay && pblockmsg) {
+            LogPrint(BCLog::NET, "%s sending block %s to peer=%d\n",
+                     "PeerLogicValidation::NewPoWValidBlock",
+                     hashBlock.ToString(), pnode->GetId());
+            connman->PushMessage(pnode, *pblockmsg);
+        } else {
+            return;
         }
+        state.pindexBestHeaderSent = pindex;
     });
 }
 
@@ -1441,8 +1694,7 @@ static bool AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
 }
 
 static void RelayTransaction(const CTransaction &tx, CConnman *connman) {
-    CInv inv(MSG_TX, tx.GetId());
-    connman->ForEachNode([&inv](CNode *pnode) { pnode->PushInventory(inv); });
+    connman->RelayTransaction(tx.GetId());
 }
 
 static void RelayAddress(const CAddress &addr, bool fReachable,
@@ -1488,6 +1740,56 @@ static void RelayAddress(const CAddress &addr, bool fReachable,
     connman->ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/**
+ * Send the block filtered by the peer's bloom filter, if it loaded one. The
+ * elements of the block's transactions are extracted here unless given.
+ */
+static void
+SendFilteredBlock(CNode *pfrom, const CBlock &block,
+                  const FilteredBlockServer::BlockElements *elements,
+                  CConnman *connman) {
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    bool sendMerkleBlock = false;
+    CMerkleBlock merkleBlock;
+    {
+        LOCK(pfrom->cs_filter);
+        if (pfrom->pfilter) {
+            sendMerkleBlock = true;
+            merkleBlock = elements
+                              ? CMerkleBlock(block, *elements, *pfrom->pfilter)
+                              : CMerkleBlock(block, *pfrom->pfilter);
+        }
+    }
+    if (sendMerkleBlock) {
+        std::vector<CSerializedNetMsg> msgs;
+        msgs.reserve(1 + merkleBlock.vMatchedTxn.size());
+        msgs.push_back(msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+        // CMerkleBlock just contains hashes, so also push any transactions in
+        // the block the client did not see. This avoids hurting performance by
+        // pointlessly requiring a round-trip. Note that there is currently no
+        // way for a node to request any single transactions we didn't send
+        // here - they must either disconnect and retry or request the full
+        // block. Thus, the protocol spec specified allows for us to provide
+        // duplicate txn here, however we MUST always provide at least what the
+        // remote peer needs.
+        typedef std::pair<size_t, uint256> PairType;
+        for (PairType &pair : merkleBlock.vMatchedTxn) {
+            msgs.push_back(
+                msgMaker.Make(NetMsgType::TX, *block.vtx[pair.first]));
+        }
+        // Clients take the first message that is not a TX as the end of the
+        // filtered block, so nothing else may be queued in between. This
+        // may run on a FilteredBlockServer thread while other threads send
+        // to the peer.
+        LOCK(pfrom->cs_vSend);
+        for (CSerializedNetMsg &msg : msgs) {
+            connman->PushMessage(pfrom, std::move(msg));
+        }
+    }
+    // else
+    // no response
+}
+
 static void ProcessGetBlockData(const Config &config, CNode *pfrom,
                                 const CInv &inv, CConnman *connman,
                                 const std::atomic<bool> &interruptMsgProc) {
@@ -1499,10 +1801,12 @@ static void ProcessGetBlockData(const Config &config, CNode *pfrom,
     bool send = false;
     std::shared_ptr<const CBlock> a_recent_block;
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
+    std::shared_ptr<const CSharedNetMsg> a_recent_compact_block_msg;
     {
         LOCK(cs_most_recent_block);
         a_recent_block = most_recent_block;
         a_recent_compact_block = most_recent_compact_block;
+        a_recent_compact_block_msg = most_recent_compact_block_msg;
     }
 
     bool need_activate_chain = false;
@@ -1582,51 +1886,76 @@ static void ProcessGetBlockData(const Config &config, CNode *pfrom,
     // before trying to send.
     if (send && pindex->nStatus.hasData()) {
         std::shared_ptr<const CBlock> pblock;
+        // Serialized block, used instead of pblock when the request can be
+        // answered without deserializing the block.
+        std::vector<uint8_t> raw_block;
         if (a_recent_block &&
             a_recent_block->GetHash() == pindex->GetBlockHash()) {
             pblock = a_recent_block;
-        } else {
-            // Send block from disk
+        } else if (inv.type == MSG_FILTERED_BLOCK) {
+            // Send block from disk, filtering needs the transactions
             std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
             if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
                 assert(!"cannot load block from disk");
             }
             pblock = pblockRead;
+        } else {
+            // Send block from disk as is
+            if (!ReadRawBlockFromDisk(raw_block, pindex, consensusParams,
+                                      config.GetChainParams().DiskMagic())) {
+                assert(!"cannot load block from disk");
+            }
         }
-        if (inv.type == MSG_BLOCK) {
-            connman->PushMessage(pfrom,
-                                 msgMaker.Make(NetMsgType::BLOCK, *pblock));
-        } else if (inv.type == MSG_FILTERED_BLOCK) {
-            bool sendMerkleBlock = false;
-            CMerkleBlock merkleBlock;
-            {
-                LOCK(pfrom->cs_filter);
-                if (pfrom->pfilter) {
-                    sendMerkleBlock = true;
-                    merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
-                }
+        auto pushFullBlock = [&]() {
+            if (pblock && pblock == a_recent_block) {
+                connman->PushMessage(pfrom, *GetMostRecentBlockMsg(pblock));
+                return;
             }
-            if (sendMerkleBlock) {
+            if (pblock) {
                 connman->PushMessage(
-                    pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                // CMerkleBlock just contains hashes, so also push any
-                // transactions in the block the client did not see. This avoids
-                // hurting performance by pointlessly requiring a round-trip.
-                // Note that there is currently no way for a node to request any
-                // single transactions we didn't send here - they must either
-                // disconnect and retry or request the full block. Thus, the
-                // protocol spec specified allows for us to provide duplicate
-                // txn here, however we MUST always provide at least what the
-                // remote peer needs.
-                typedef std::pair<size_t, uint256> PairType;
-                for (PairType &pair : merkleBlock.vMatchedTxn) {
-                    connman->PushMessage(
-                        pfrom, msgMaker.Make(NetMsgType::TX,
-                                             *pblock->vtx[pair.first]));
+                    pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+                return;
+            }
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            msg.data = std::move(raw_block);
+            connman->PushMessage(pfrom, std::move(msg));
+        };
+        if (inv.type == MSG_BLOCK) {
+            pushFullBlock();
+        } else if (inv.type == MSG_FILTERED_BLOCK) {
+            FilteredBlockServer *server = connman->GetFilteredBlockServer();
+            if (server) {
+                // Build it off this thread, holding the peer's other requests
+                // back until it is sent so that responses stay in order. The
+                // inv asking for the next batch goes out right after it.
+                BlockHash continueHash;
+                if (hash == pfrom->hashContinue) {
+                    continueHash = ::ChainActive().Tip()->GetBlockHash();
+                    pfrom->hashContinue = BlockHash();
                 }
+                auto job = [pfrom, connman, continueHash](
+                               const CBlock &block,
+                               const FilteredBlockServer::BlockElements
+                                   &elements) {
+                    SendFilteredBlock(pfrom, block, &elements, connman);
+                    if (!continueHash.IsNull()) {
+                        std::vector<CInv> vInv;
+                        vInv.emplace_back(MSG_BLOCK, continueHash);
+                        connman->PushMessage(
+                            pfrom, CNetMsgMaker(pfrom->GetSendVersion())
+                                       .Make(NetMsgType::INV, vInv));
+                    }
+                    pfrom->fFilteredBlockPending = false;
+                    pfrom->Release();
+                    connman->WakeMessageHandler();
+                };
+                pfrom->AddRef();
+                pfrom->fFilteredBlockPending = true;
+                server->Submit(pblock, std::move(job));
+            } else {
+                SendFilteredBlock(pfrom, *pblock, nullptr, connman);
             }
-            // else
-            // no response
         } else if (inv.type == MSG_CMPCT_BLOCK) {
             // If a peer is asking for old blocks, we're almost guaranteed they
             // won't have a useful mempool to match against a compact block, and
@@ -1636,14 +1965,21 @@ static void ProcessGetBlockData(const Config &config, CNode *pfrom,
             if (CanDirectFetch(consensusParams) &&
                 pindex->nHeight >=
                     ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
-                CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
-                connman->PushMessage(
-                    pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                         cmpctblock));
+                if (pblock && pblock == a_recent_block &&
+                    a_recent_compact_block_msg) {
+                    connman->PushMessage(pfrom, *a_recent_compact_block_msg);
+                } else {
+                    CBlockHeaderAndShortTxIDs cmpctblock =
+                        pblock ? CBlockHeaderAndShortTxIDs(*pblock)
+                               : CBlockHeaderAndShortTxIDs(
+                                     CBlockView(MakeSpan(raw_block)));
+                    connman->PushMessage(
+                        pfrom,
+                        msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
+                                      cmpctblock));
+                }
             } else {
-                connman->PushMessage(
-                    pfrom,
-                    msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                pushFullBlock();
             }
         }
 
@@ -1668,6 +2004,10 @@ static void ProcessGetData(const Config &config, CNode *pfrom,
     LOCKS_EXCLUDED(cs_main) {
     AssertLockNotHeld(cs_main);
 
+    if (pfrom->fFilteredBlockPending) {
+        return;
+    }
+
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
@@ -3464,6 +3804,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             return true;
         }
 
+        const uint64_t nBlockSize = vRecv.size();
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
         vRecv >> *pblock;
 
@@ -3479,6 +3820,8 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
+            RecordBlockDownload(pfrom->GetId(), hash, nBlockSize,
+                                nTimeReceived);
             // Also always process if we requested the block explicitly, as we
             // may need it even though it is not a candidate for a new best tip.
             forceProcessing |= MarkBlockAsReceived(hash);
@@ -3522,7 +3865,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         pfrom->fSentAddr = true;
 
         pfrom->vAddrToSend.clear();
-        std::vector<CAddress> vAddr = connman->GetAddresses();
+        std::vector<CAddress> vAddr = connman->GetCachedAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr) {
             if (g_banman && (g_banman->IsDiscouraged(addr) || g_banman->IsBanned(addr))) {
@@ -3812,6 +4155,12 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
         return false;
     }
 
+    // A filtered block is being built for this peer: wait until it is sent,
+    // which wakes the message handler, before handling anything else.
+    if (pfrom->fFilteredBlockPending) {
+        return false;
+    }
+
     // this maintains the order of responses and prevents vRecvGetData from
     // growing unbounded
     if (!pfrom->vRecvGetData.empty()) {
@@ -3895,6 +4244,9 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
 
     // Process message
     bool fRet = false;
+    const int64_t nProcessStart = GetTimeMicros();
+    const int64_t nProcessStartCPU = GetThreadCPUTimeMicros();
+    LockHoldTimer csMainTimer(cs_main);
     try {
         fRet = ProcessMessage(config, pfrom, strCommand, vRecv, msg.nTime,
                               connman, interruptMsgProc, m_enable_bip61);
@@ -3944,6 +4296,13 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
         PrintExceptionContinue(nullptr, "ProcessMessages()");
     }
 
+    const int64_t nProcessEnd = GetTimeMicros();
+    connman->RecordMessageProcessing(
+        pfrom, strCommand, nProcessEnd - nProcessStart,
+        GetThreadCPUTimeMicros() - nProcessStartCPU,
+        std::max<int64_t>(0, nProcessStart - msg.nTime),
+        csMainTimer.GetHeldMicros());
+
     if (!fRet) {
         LogPrint(BCLog::NET, "%s(%s, %u bytes) FAILED peer=%d\n", __func__,
                  SanitizeString(strCommand), nMessageSize, pfrom->GetId());
@@ -4148,23 +4507,6 @@ void PeerLogicValidation::CheckForStaleTipAndEvictPeers(
     m_stale_tip_check_time = time_in_seconds + STALE_CHECK_INTERVAL;
 }
 
-namespace {
-class CompareInvMempoolOrder {
-    CTxMemPool *mp;
-
-public:
-    explicit CompareInvMempoolOrder(CTxMemPool *_mempool) { mp = _mempool; }
-
-    bool operator()(std::set<TxId>::iterator a, std::set<TxId>::iterator b) {
-        /**
-         * As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later.
-         */
-        return mp->CompareDepthAndScore(*b, *a);
-    }
-};
-} // namespace
-
 bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                                        std::atomic<bool> &interruptMsgProc) {
     const Consensus::Params &consensusParams =
@@ -4397,12 +4739,8 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                 {
                     LOCK(cs_most_recent_block);
                     if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                        CBlockHeaderAndShortTxIDs cmpctblock(
-                            *most_recent_block);
-                        connman->PushMessage(
-                            pto,
-                            msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                          cmpctblock));
+                        connman->PushMessage(pto,
+                                             *most_recent_compact_block_msg);
                         fGotBlockFromCache = true;
                     }
                 }
@@ -4510,7 +4848,7 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
         if (fSendTrickle) {
             LOCK(pto->cs_filter);
             if (!pto->fRelayTxes) {
-                pto->setInventoryTxToSend.clear();
+                connman->GetTxAnnouncementLog().SkipAll(pto->GetId());
             }
         }
 
@@ -4527,8 +4865,9 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
             LOCK(pto->cs_filter);
 
             for (const auto &txinfo : vtxinfo) {
+                // Marking it known below keeps it from being announced again
+                // through the announcement log.
                 const TxId &txid = txinfo.tx->GetId();
-                pto->setInventoryTxToSend.erase(txid);
                 if (filterrate != Amount::zero() &&
                     txinfo.feeRate.GetFeePerK() < filterrate) {
                     continue;
@@ -4550,55 +4889,43 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
 
         // Determine transactions to relay
         if (fSendTrickle) {
-            // Produce a vector with all candidates for sending
-            std::vector<std::set<TxId>::iterator> vInvTx;
-            vInvTx.reserve(pto->setInventoryTxToSend.size());
-            for (std::set<TxId>::iterator it =
-                     pto->setInventoryTxToSend.begin();
-                 it != pto->setInventoryTxToSend.end(); it++) {
-                vInvTx.push_back(it);
-            }
             Amount filterrate = Amount::zero();
             {
                 LOCK(pto->cs_feeFilter);
                 filterrate = pto->minFeeFilter;
             }
             // Topologically and fee-rate sort the inventory we send for privacy
-            // and priority reasons. A heap is used so that not all items need
-            // sorting if only a few are being sent.
-            CompareInvMempoolOrder compareInvMempoolOrder(&g_mempool);
-            std::make_heap(vInvTx.begin(), vInvTx.end(),
-                           compareInvMempoolOrder);
+            // and priority reasons. The log does it once per batch, for all
+            // peers.
+            auto sortByMempoolOrder = [](std::vector<TxId> &txids) {
+                g_mempool.SortByDepthAndScore(txids);
+            };
             // No reason to drain out at many times the network's capacity,
             // especially since we have many peers and some will draw much
             // shorter delays.
             unsigned int nRelayedTransactions = 0;
             LOCK(pto->cs_filter);
-            while (!vInvTx.empty() && nRelayedTransactions < nMaxBroadcasts) {
-                // Fetch the top element from the heap
-                std::pop_heap(vInvTx.begin(), vInvTx.end(),
-                              compareInvMempoolOrder);
-                std::set<TxId>::iterator it = vInvTx.back();
-                vInvTx.pop_back();
-                TxId txid = *it;
-                // Remove it from the to-be-sent set
-                pto->setInventoryTxToSend.erase(it);
+            auto relay = [&](const TxId &txid)
+                             EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+                if (nRelayedTransactions >= nMaxBroadcasts) {
+                    return false;
+                }
                 // Check if not in the filter already
                 if (pto->filterInventoryKnown.contains(txid)) {
-                    continue;
+                    return true;
                 }
                 // Not in the mempool anymore? don't bother sending it.
                 auto txinfo = g_mempool.info(txid);
                 if (!txinfo.tx) {
-                    continue;
+                    return true;
                 }
                 if (filterrate != Amount::zero() &&
                     txinfo.feeRate.GetFeePerK() < filterrate) {
-                    continue;
+                    return true;
                 }
                 if (pto->pfilter &&
                     !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) {
-                    continue;
+                    return true;
                 }
                 // Send
                 vInv.emplace_back(MSG_TX, txid);
@@ -4624,7 +4951,10 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                     vInv.clear();
                 }
                 pto->filterInventoryKnown.insert(txid);
-            }
+                return true;
+            };
+            connman->GetTxAnnouncementLog().ForEachUnannounced(
+                pto->GetId(), sortByMempoolOrder, relay);
         }
     }
     if (!vInv.empty()) {
@@ -4716,15 +5046,19 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
     // Message: getdata (blocks)
     //
     std::vector<CInv> vGetData;
+    ExpireDuplicatedBlocks(state, nNow);
+    const unsigned int nWindow = GetBlockDownloadWindow(state);
+    const unsigned int nInFlight =
+        state.nBlocksInFlight + state.setBlocksDuplicated.size();
     if (!pto->fClient &&
         ((fFetch && !pto->m_limited_node) || !IsInitialBlockDownload()) &&
-        state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        nInFlight < nWindow) {
         std::vector<const CBlockIndex *> vToDownload;
         NodeId staller = -1;
-        FindNextBlocksToDownload(pto->GetId(),
-                                 MAX_BLOCKS_IN_TRANSIT_PER_PEER -
-                                     state.nBlocksInFlight,
-                                 vToDownload, staller, consensusParams);
+        const CBlockIndex *pindexWaitingFor = nullptr;
+        FindNextBlocksToDownload(pto->GetId(), nWindow - nInFlight,
+                                 vToDownload, staller, pindexWaitingFor,
+                                 consensusParams);
         for (const CBlockIndex *pindex : vToDownload) {
             vGetData.emplace_back(MSG_BLOCK, pindex->GetBlockHash());
             MarkBlockAsInFlight(config, pto->GetId(), pindex->GetBlockHash(),
@@ -4733,7 +5067,26 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                      pindex->GetBlockHash().ToString(), pindex->nHeight,
                      pto->GetId());
         }
-        if (state.nBlocksInFlight == 0 && staller != -1) {
+        if (pindexWaitingFor && g_adaptive_block_download &&
+            nInFlight + vToDownload.size() < nWindow &&
+            ShouldDuplicateBlockRequest(state, pindexWaitingFor, nNow)) {
+            const BlockHash &hash = pindexWaitingFor->GetBlockHash();
+            vGetData.emplace_back(MSG_BLOCK, hash);
+            mapBlocksDuplicated.emplace(
+                hash, std::make_pair(pto->GetId(), nNow));
+            state.setBlocksDuplicated.insert(hash);
+            nBlocksDuplicated++;
+            LogPrint(BCLog::NET,
+                     "Requesting block %s (%d) from peer=%d too, as peer=%d "
+                     "holds back validation\n",
+                     hash.ToString(), pindexWaitingFor->nHeight, pto->GetId(),
+                     mapBlocksInFlight[hash].first);
+        }
+        // The peer the block at the head of the window was first requested
+        // from is not stalling while a faster peer is sending it.
+        if (state.nBlocksInFlight == 0 && staller != -1 &&
+            !(pindexWaitingFor &&
+              mapBlocksDuplicated.count(pindexWaitingFor->GetBlockHash()))) {
             if (State(staller)->nStallingSince == 0) {
                 State(staller)->nStallingSince = nNow;
                 LogPrint(BCLog::NET, "Stall started peer=%d\n", staller);
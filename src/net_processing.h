@@ -42,6 +42,15 @@ static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 
 /** Default for BIP61 (sending reject messages) */
 static constexpr bool DEFAULT_ENABLE_BIP61 = true;
+/** Default for -adaptiveblockdownload */
+static constexpr bool DEFAULT_ADAPTIVE_BLOCK_DOWNLOAD = true;
+
+/**
+ * Size the number of blocks in flight from each peer after its measured
+ * latency and block interval, and request the block holding back validation
+ * again from a faster peer when it is late.
+ */
+extern bool g_adaptive_block_download;
 
 class PeerLogicValidation final : public CValidationInterface,
                                   public NetEventsInterface {
@@ -139,10 +148,32 @@ struct CNodeStateStats {
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    //! Blocks in flight from another peer also requested from this one.
+    size_t nBlocksDuplicated = 0;
+    //! Number of blocks to keep in flight from this peer.
+    unsigned int nBlockDownloadWindow = 0;
+    //! Measured block download latency and interval in microseconds, 0 if
+    //! not measured yet.
+    int64_t nBlockLatency = 0;
+    int64_t nBlockInterval = 0;
+    double dBlockBytesPerSecond = 0;
+    bool fStalling = false;
 };
 
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+
+struct BlockDownloadTotals {
+    size_t nBlocksInFlight = 0;
+    size_t nBlocksDuplicatedInFlight = 0;
+    //! Blocks requested a second time since startup, and how many of them
+    //! arrived from the second peer first.
+    uint64_t nBlocksDuplicated = 0;
+    uint64_t nBlocksDuplicatedFirst = 0;
+};
+
+/** Get the state of block download from all peers */
+void GetBlockDownloadTotals(BlockDownloadTotals &totals);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch, const std::string &reason = "");
 
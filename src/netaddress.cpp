@@ -725,6 +725,26 @@ bool CSubNet::IsSingleIP() const {
     return 0 == std::memcmp(netmask, pchSingleAddressNetmask, sizeof(pchSingleAddressNetmask));
 }
 
+int CSubNet::GetPrefixLength() const {
+    int n = 0;
+    for (; n < 16 && netmask[n] == 0xff; ++n) {
+    }
+    int prefix = n * 8;
+    if (n < 16) {
+        const int bits = NetmaskBits(netmask[n]);
+        if (bits < 0) {
+            return -1;
+        }
+        prefix += bits;
+        for (++n; n < 16; ++n) {
+            if (netmask[n] != 0x00) {
+                return -1;
+            }
+        }
+    }
+    return prefix;
+}
+
 bool operator==(const CSubNet &a, const CSubNet &b) {
     return a.valid == b.valid && a.network == b.network &&
            !std::memcmp(a.netmask, b.netmask, 16);
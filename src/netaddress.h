@@ -153,6 +153,9 @@ public:
     constexpr bool IsValid() const { return valid; }
     // returns true if this is a single ip subnet (<ipv4>/32 or <ipv6>/128)
     bool IsSingleIP() const;
+    //! Number of leading one bits of the netmask over all 128 bits of the
+    //! (IPv4-mapped) address, or -1 if the netmask is not a contiguous prefix
+    int GetPrefixLength() const;
 
     constexpr const CNetAddr & Network() const { return network; }
 
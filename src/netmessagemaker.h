@@ -18,6 +18,7 @@ public:
                            Args &&... args) const {
         CSerializedNetMsg msg;
         msg.command = std::move(sCommand);
+        msg.data = GetNetMsgBufferPool().Acquire();
         CVectorWriter{SER_NETWORK, nFlags | nVersion, msg.data, 0,
                       std::forward<Args>(args)...};
         return msg;
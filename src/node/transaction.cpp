@@ -82,8 +82,7 @@ TxId BroadcastTransaction(const Config &config, const CTransactionRef tx,
             "Error: Peer-to-peer functionality missing or disabled");
     }
 
-    CInv inv(MSG_TX, txid);
-    g_connman->ForEachNode([&inv](CNode *pnode) { pnode->PushInventory(inv); });
+    g_connman->RelayTransaction(txid);
 
     return txid;
 }
@@ -0,0 +1,88 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/blockview.h>
+
+#include <consensus/merkle.h>
+#include <hash.h>
+#include <streams.h>
+#include <version.h>
+
+#include <ios>
+#include <limits>
+#include <memory>
+
+namespace {
+//! Skip a compact size prefixed byte vector, as used for scripts.
+void SkipVector(SpanReader &s) {
+    s.ignore(ReadCompactSize(s));
+}
+
+//! Skip one serialized transaction, mirroring UnserializeTransaction.
+void SkipTransaction(SpanReader &s) {
+    // nVersion
+    s.ignore(4);
+    const uint64_t nInputs = ReadCompactSize(s);
+    for (uint64_t i = 0; i < nInputs; ++i) {
+        // prevout (txid + index), scriptSig, nSequence
+        s.ignore(32 + 4);
+        SkipVector(s);
+        s.ignore(4);
+    }
+    const uint64_t nOutputs = ReadCompactSize(s);
+    for (uint64_t i = 0; i < nOutputs; ++i) {
+        // nValue, scriptPubKey
+        s.ignore(8);
+        SkipVector(s);
+    }
+    // nLockTime
+    s.ignore(4);
+}
+} // namespace
+
+CBlockView::CBlockView(Span<const uint8_t> data) : m_data(data) {
+    if (m_data.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::ios_base::failure("CBlockView: block too large");
+    }
+
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, m_data);
+    s >> m_header;
+    const uint64_t nTx = ReadCompactSize(s);
+    // Each transaction is at least 10 bytes, so a bogus count cannot make us
+    // reserve more than the buffer could possibly describe.
+    m_tx_offsets.reserve(std::min<uint64_t>(nTx, s.size() / 10) + 1);
+    for (uint64_t i = 0; i < nTx; ++i) {
+        m_tx_offsets.push_back(m_data.size() - s.size());
+        SkipTransaction(s);
+    }
+    m_tx_offsets.push_back(m_data.size() - s.size());
+
+    if (!s.empty()) {
+        throw std::ios_base::failure("CBlockView: trailing data");
+    }
+}
+
+TxId CBlockView::GetTxId(size_t n) const {
+    const Span<const uint8_t> tx = GetTxData(n);
+    return TxId(Hash(tx.begin(), tx.end()));
+}
+
+CTransactionRef CBlockView::GetTransaction(size_t n) const {
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, GetTxData(n));
+    return std::make_shared<const CTransaction>(deserialize, s);
+}
+
+uint256 CBlockView::ComputeMerkleRoot(bool *mutated) const {
+    std::vector<uint256> leaves;
+    leaves.resize(GetTxCount());
+    for (size_t s = 0; s < leaves.size(); s++) {
+        leaves[s] = GetTxId(s);
+    }
+    return ::ComputeMerkleRoot(std::move(leaves), mutated);
+}
+
+void CBlockView::ToBlock(CBlock &block) const {
+    SpanReader s(SER_NETWORK, PROTOCOL_VERSION, m_data);
+    s >> block;
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PRIMITIVES_BLOCKVIEW_H
+#define BITCOIN_PRIMITIVES_BLOCKVIEW_H
+
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <primitives/txid.h>
+#include <span.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Read-only view over a serialized block.
+ *
+ * Parsing only records where the header and each transaction live in the
+ * underlying buffer, so paths that just need to hash, inspect or relay a
+ * block avoid materializing every CTransaction. The buffer is not copied and
+ * must outlive the view.
+ */
+class CBlockView {
+private:
+    Span<const uint8_t> m_data;
+    CBlockHeader m_header;
+    //! Offset of each transaction in m_data, plus a trailing end offset.
+    std::vector<uint32_t> m_tx_offsets;
+
+public:
+    /**
+     * Parse a serialized block. Throws std::ios_base::failure if the data is
+     * truncated, has trailing bytes or is otherwise malformed.
+     */
+    explicit CBlockView(Span<const uint8_t> data);
+
+    const CBlockHeader &GetHeader() const { return m_header; }
+    BlockHash GetHash() const { return m_header.GetHash(); }
+
+    //! The whole serialized block, as passed to the constructor.
+    Span<const uint8_t> GetData() const { return m_data; }
+
+    size_t GetTxCount() const { return m_tx_offsets.size() - 1; }
+
+    //! Serialized bytes of the n-th transaction.
+    Span<const uint8_t> GetTxData(size_t n) const {
+        return m_data.subspan(m_tx_offsets[n],
+                              m_tx_offsets[n + 1] - m_tx_offsets[n]);
+    }
+
+    //! Hash the n-th transaction in place.
+    TxId GetTxId(size_t n) const;
+
+    //! Deserialize the n-th transaction.
+    CTransactionRef GetTransaction(size_t n) const;
+
+    /**
+     * Compute the merkle root from the serialized transactions, with the same
+     * semantics as BlockMerkleRoot.
+     */
+    uint256 ComputeMerkleRoot(bool *mutated = nullptr) const;
+
+    //! Deserialize the full block.
+    void ToBlock(CBlock &block) const;
+};
+
+#endif // BITCOIN_PRIMITIVES_BLOCKVIEW_H
@@ -227,7 +227,12 @@ static bool rest_block(const Config &config, HTTPRequest *req,
 
     const BlockHash hash(rawHash);
 
+    const CChainParams &params = config.GetChainParams();
+    // The binary and hex formats return the block as stored on disk, so only
+    // the JSON format needs to deserialize it.
+    const bool raw = rf == RetFormat::BINARY || rf == RetFormat::HEX;
     CBlock block;
+    std::vector<uint8_t> rawBlock;
     CBlockIndex *pblockindex = nullptr;
     CBlockIndex *tip = nullptr;
     {
@@ -243,28 +248,25 @@ static bool rest_block(const Config &config, HTTPRequest *req,
                            hashStr + " not available (pruned data)");
         }
 
-        if (!ReadBlockFromDisk(block, pblockindex,
-                               config.GetChainParams().GetConsensus())) {
+        if (raw ? !ReadRawBlockFromDisk(rawBlock, pblockindex,
+                                        params.GetConsensus(),
+                                        params.DiskMagic())
+                : !ReadBlockFromDisk(block, pblockindex,
+                                     params.GetConsensus())) {
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
         }
     }
 
     switch (rf) {
         case RetFormat::BINARY: {
-            CDataStream ssBlock(SER_NETWORK,
-                                PROTOCOL_VERSION | RPCSerializationFlags());
-            ssBlock << block;
-            std::string binaryBlock = ssBlock.str();
+            std::string binaryBlock(rawBlock.begin(), rawBlock.end());
             req->WriteHeader("Content-Type", "application/octet-stream");
             req->WriteReply(HTTP_OK, binaryBlock);
             return true;
         }
 
         case RetFormat::HEX: {
-            CDataStream ssBlock(SER_NETWORK,
-                                PROTOCOL_VERSION | RPCSerializationFlags());
-            ssBlock << block;
-            std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+            std::string strHex = HexStr(rawBlock.begin(), rawBlock.end()) + "\n";
             req->WriteHeader("Content-Type", "text/plain");
             req->WriteReply(HTTP_OK, strHex);
             return true;
@@ -19,6 +19,7 @@
 #include <key_io.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
+#include <rpc/longpoll.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
@@ -212,6 +213,63 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex *pindex) {
         latestblock.height = pindex->nHeight;
     }
     cond_blockchange.notify_all();
+    longpoll::Notify();
+}
+
+static UniValue LatestBlockToJSON() {
+    CUpdatedBlock block;
+    {
+        LOCK(cs_blockchange);
+        block = latestblock;
+    }
+    UniValue::Object ret;
+    ret.reserve(2);
+    ret.emplace_back("hash", block.hash.GetHex());
+    ret.emplace_back("height", block.height);
+    return ret;
+}
+
+/**
+ * Wait until ready(latestblock) holds or the timeout, in milliseconds (0 for
+ * none), expires, and return the latest block. The request is parked rather
+ * than blocking the calling thread when it allows it.
+ */
+static UniValue
+WaitForBlockChange(const JSONRPCRequest &request, int timeout,
+                   const std::function<bool(const CUpdatedBlock &)> &ready) {
+    if (request.defer) {
+        const auto deadline =
+            timeout ? longpoll::Clock::now() + std::chrono::milliseconds(timeout)
+                    : longpoll::Clock::time_point::max();
+        longpoll::Park(
+            request,
+            [ready, deadline](longpoll::Clock::time_point now,
+                              longpoll::Clock::time_point &next) {
+                if (now >= deadline) {
+                    return true;
+                }
+                next = deadline;
+                LOCK(cs_blockchange);
+                return ready(latestblock) || !IsRPCRunning();
+            },
+            &LatestBlockToJSON);
+        return UniValue();
+    }
+
+    {
+        WAIT_LOCK(cs_blockchange, lock);
+        if (timeout) {
+            cond_blockchange.wait_for(
+                lock, std::chrono::milliseconds(timeout), [&ready] {
+                    return ready(latestblock) || !IsRPCRunning();
+                });
+        } else {
+            cond_blockchange.wait(lock, [&ready] {
+                return ready(latestblock) || !IsRPCRunning();
+            });
+        }
+    }
+    return LatestBlockToJSON();
 }
 
 static UniValue waitfornewblock(const Config &config,
@@ -246,27 +304,14 @@ static UniValue waitfornewblock(const Config &config,
 
     CUpdatedBlock block;
     {
-        WAIT_LOCK(cs_blockchange, lock);
-        block = latestblock;
-        if (timeout) {
-            cond_blockchange.wait_for(
-                lock, std::chrono::milliseconds(timeout), [&block] {
-                    return latestblock.height != block.height ||
-                           latestblock.hash != block.hash || !IsRPCRunning();
-                });
-        } else {
-            cond_blockchange.wait(lock, [&block] {
-                return latestblock.height != block.height ||
-                       latestblock.hash != block.hash || !IsRPCRunning();
-            });
-        }
+        LOCK(cs_blockchange);
         block = latestblock;
     }
-    UniValue::Object ret;
-    ret.reserve(2);
-    ret.emplace_back("hash", block.hash.GetHex());
-    ret.emplace_back("height", block.height);
-    return ret;
+    return WaitForBlockChange(request, timeout,
+                              [block](const CUpdatedBlock &latest) {
+                                  return latest.height != block.height ||
+                                         latest.hash != block.hash;
+                              });
 }
 
 static UniValue waitforblock(const Config &config,
@@ -304,27 +349,10 @@ static UniValue waitforblock(const Config &config,
         timeout = request.params[1].get_int();
     }
 
-    CUpdatedBlock block;
-    {
-        WAIT_LOCK(cs_blockchange, lock);
-        if (timeout) {
-            cond_blockchange.wait_for(
-                lock, std::chrono::milliseconds(timeout), [&hash] {
-                    return latestblock.hash == hash || !IsRPCRunning();
-                });
-        } else {
-            cond_blockchange.wait(lock, [&hash] {
-                return latestblock.hash == hash || !IsRPCRunning();
-            });
-        }
-        block = latestblock;
-    }
-
-    UniValue::Object ret;
-    ret.reserve(2);
-    ret.emplace_back("hash", block.hash.GetHex());
-    ret.emplace_back("height", block.height);
-    return ret;
+    return WaitForBlockChange(request, timeout,
+                              [hash](const CUpdatedBlock &latest) {
+                                  return latest.hash == hash;
+                              });
 }
 
 static UniValue waitforblockheight(const Config &config,
@@ -359,26 +387,10 @@ static UniValue waitforblockheight(const Config &config,
         timeout = request.params[1].get_int();
     }
 
-    CUpdatedBlock block;
-    {
-        WAIT_LOCK(cs_blockchange, lock);
-        if (timeout) {
-            cond_blockchange.wait_for(
-                lock, std::chrono::milliseconds(timeout), [&height] {
-                    return latestblock.height >= height || !IsRPCRunning();
-                });
-        } else {
-            cond_blockchange.wait(lock, [&height] {
-                return latestblock.height >= height || !IsRPCRunning();
-            });
-        }
-        block = latestblock;
-    }
-    UniValue::Object ret;
-    ret.reserve(2);
-    ret.emplace_back("hash", block.hash.GetHex());
-    ret.emplace_back("height", block.height);
-    return ret;
+    return WaitForBlockChange(request, timeout,
+                              [height](const CUpdatedBlock &latest) {
+                                  return latest.height >= height;
+                              });
 }
 
 static UniValue
@@ -884,12 +896,11 @@ static void ThrowIfPrunedBlock(const CBlockIndex *pblockindex) EXCLUSIVE_LOCKS_R
     }
 }
 
-/// Lock-free -- will throw if block not found or was pruned, etc. Guaranteed to return a valid block or fail.
-static CBlock ReadBlockChecked(const Config &config, const CBlockIndex *pblockindex) {
-    CBlock block;
-    auto doRead = [&] {
-        if (!ReadBlockFromDisk(block, pblockindex,
-                               config.GetChainParams().GetConsensus())) {
+/// Lock-free -- will throw if the block could not be read from disk.
+template <typename ReadFn>
+static void ReadBlockFileChecked(ReadFn &&doRead) {
+    auto checkedRead = [&] {
+        if (!doRead()) {
             // Block not found on disk. This could be because we have the block
             // header in our index but don't have the block (for example if a
             // non-whitelisted node sends us an unrequested long chain of valid
@@ -904,13 +915,32 @@ static CBlock ReadBlockChecked(const Config &config, const CBlockIndex *pblockin
         // block file we have open here, in which case on Windows the node would AbortNode().  Hence
         // the need for this locking in the fPrunedMode case only.
         LOCK(cs_main);
-        doRead();
+        checkedRead();
     } else {
         // Non-pruned mode, we can benefit from not having to grab cs_main here since blocks never
         // go away -- this increases parallelism in the case of non-pruning nodes.
-        doRead();
+        checkedRead();
     }
+}
 
+/// Lock-free -- will throw if block not found or was pruned, etc. Guaranteed to return a valid block or fail.
+static CBlock ReadBlockChecked(const Config &config, const CBlockIndex *pblockindex) {
+    CBlock block;
+    ReadBlockFileChecked([&] {
+        return ReadBlockFromDisk(block, pblockindex,
+                                 config.GetChainParams().GetConsensus());
+    });
+    return block;
+}
+
+/// Like ReadBlockChecked, but returns the serialized block as stored on disk.
+static std::vector<uint8_t> ReadRawBlockChecked(const Config &config, const CBlockIndex *pblockindex) {
+    const CChainParams &params = config.GetChainParams();
+    std::vector<uint8_t> block;
+    ReadBlockFileChecked([&] {
+        return ReadRawBlockFromDisk(block, pblockindex, params.GetConsensus(),
+                                    params.DiskMagic());
+    });
     return block;
 }
 
@@ -1000,16 +1030,16 @@ static UniValue getblock(const Config &config, const JSONRPCRequest &request) {
         ThrowIfPrunedBlock(pblockindex);
     }
 
-    const CBlock block = ReadBlockChecked(config, pblockindex);
-
     if (verbosity <= 0) {
-        CDataStream ssBlock(SER_NETWORK,
-                            PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        // The serialized block is returned as stored, there is no need to
+        // deserialize it.
+        const std::vector<uint8_t> block =
+            ReadRawBlockChecked(config, pblockindex);
+        return HexStr(block.begin(), block.end());
     }
 
+    const CBlock block = ReadBlockChecked(config, pblockindex);
+
     return blockToJSON(config, block, ::ChainActive().Tip(), pblockindex, verbosity >= 2);
 }
 
@@ -132,6 +132,9 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"prioritisetransaction", 2, "fee_delta"},
     {"setban", 2, "bantime"},
     {"setban", 3, "absolute"},
+    {"importbanlist", 0, "subnets"},
+    {"importbanlist", 1, "bantime"},
+    {"importbanlist", 2, "absolute"},
     {"clearbanned", 0, "manual"},
     {"clearbanned", 1, "automatic"},
     {"setnetworkactive", 0, "state"},
@@ -5,10 +5,28 @@
 #ifndef BITCOIN_RPC_JSONRPCREQUEST_H
 #define BITCOIN_RPC_JSONRPCREQUEST_H
 
+#include <functional>
+#include <memory>
 #include <string>
 
 #include <univalue.h>
 
+/**
+ * Answers a request whose handler returned before it had a result, see
+ * JSONRPCRequest::defer.
+ */
+class RPCDeferredReply {
+public:
+    virtual ~RPCDeferredReply() {}
+
+    /**
+     * Answer the request with the result of fn, run on an RPC worker thread.
+     * fn may throw like a handler. Call this once, from any thread. A request
+     * dropped without being answered gets an error reply.
+     */
+    virtual void Complete(std::function<UniValue()> fn) = 0;
+};
+
 class JSONRPCRequest {
 public:
     UniValue id;
@@ -17,6 +35,14 @@ public:
     bool fHelp = false;
     std::string URI;
     std::string authUser;
+    /**
+     * Set by the HTTP RPC server for requests outside of a batch, and only
+     * valid while the handler runs. A handler that would block until an event
+     * can call it instead and return: the worker thread is released, the
+     * value returned by the handler is ignored, and the request is answered
+     * through the returned object.
+     */
+    std::function<std::shared_ptr<RPCDeferredReply>()> defer;
 
     void parse(UniValue&& valRequest);
 };
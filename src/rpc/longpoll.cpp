@@ -0,0 +1,150 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/longpoll.h>
+
+#include <rpc/server.h>
+#include <sync.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace longpoll {
+namespace {
+struct Waiter {
+    std::shared_ptr<RPCDeferredReply> reply;
+    CheckFn check;
+    std::function<UniValue()> result;
+    //! Keeps the request listed by getrpcinfo until it is answered
+    std::shared_ptr<RPCCommandExecution> execution;
+    //! When to check the waiter if nothing is notified before
+    Clock::time_point next{Clock::time_point::max()};
+};
+
+Mutex g_mutex;
+std::condition_variable g_cond;
+std::list<Waiter> g_waiters GUARDED_BY(g_mutex);
+//! Whether all waiters are to be checked
+bool g_notified GUARDED_BY(g_mutex){false};
+bool g_stopped GUARDED_BY(g_mutex){false};
+std::thread g_thread GUARDED_BY(g_mutex);
+
+void Answer(Waiter &waiter) {
+    waiter.reply->Complete(
+        [result = std::move(waiter.result),
+         execution = std::move(waiter.execution)] { return result(); });
+}
+
+void ThreadLongPoll() {
+    while (true) {
+        // Checks run without the lock, so that they can take other locks and
+        // Park() or Notify() are never blocked by them.
+        std::list<Waiter> due;
+        Clock::time_point now;
+        {
+            WAIT_LOCK(g_mutex, lock);
+            Clock::time_point wakeTime = Clock::time_point::max();
+            for (const Waiter &waiter : g_waiters) {
+                wakeTime = std::min(wakeTime, waiter.next);
+            }
+            const auto woken = [] { return g_notified || g_stopped; };
+            if (wakeTime == Clock::time_point::max()) {
+                g_cond.wait(lock, woken);
+            } else {
+                g_cond.wait_until(lock, wakeTime, woken);
+            }
+            if (g_stopped) {
+                return;
+            }
+
+            const bool notified = std::exchange(g_notified, false);
+            now = Clock::now();
+            for (auto it = g_waiters.begin(); it != g_waiters.end();) {
+                const auto next = std::next(it);
+                if (notified || it->next <= now) {
+                    due.splice(due.end(), g_waiters, it);
+                }
+                it = next;
+            }
+        }
+
+        for (auto it = due.begin(); it != due.end();) {
+            it->next = Clock::time_point::max();
+            if (it->check(now, it->next)) {
+                Answer(*it);
+                it = due.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        LOCK(g_mutex);
+        g_waiters.splice(g_waiters.end(), due);
+    }
+}
+} // namespace
+
+void Park(const JSONRPCRequest &request, CheckFn check,
+          std::function<UniValue()> result) {
+    Waiter waiter;
+    waiter.execution = std::make_shared<RPCCommandExecution>(request.strMethod);
+    waiter.check = std::move(check);
+    waiter.result = std::move(result);
+    waiter.reply = request.defer();
+    {
+        LOCK(g_mutex);
+        if (!g_stopped) {
+            if (!g_thread.joinable()) {
+                g_thread = std::thread(
+                    &TraceThread<std::function<void()>>, "longpoll",
+                    std::function<void()>(&ThreadLongPoll));
+            }
+            g_waiters.push_back(std::move(waiter));
+            // Check it right away, the event may have happened already.
+            g_notified = true;
+            g_cond.notify_one();
+            return;
+        }
+    }
+    // Shutting down
+    Answer(waiter);
+}
+
+void Notify() {
+    {
+        LOCK(g_mutex);
+        g_notified = true;
+    }
+    g_cond.notify_one();
+}
+
+void Stop() {
+    std::thread thread;
+    {
+        LOCK(g_mutex);
+        g_stopped = true;
+        thread = std::move(g_thread);
+    }
+    g_cond.notify_one();
+    if (thread.joinable()) {
+        thread.join();
+    }
+
+    std::list<Waiter> waiters;
+    {
+        LOCK(g_mutex);
+        waiters.swap(g_waiters);
+    }
+    for (Waiter &waiter : waiters) {
+        Answer(waiter);
+    }
+}
+
+} // namespace longpoll
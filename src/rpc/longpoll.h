@@ -0,0 +1,52 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_LONGPOLL_H
+#define BITCOIN_RPC_LONGPOLL_H
+
+#include <rpc/jsonrpcrequest.h>
+
+#include <univalue.h>
+
+#include <chrono>
+#include <functional>
+
+/**
+ * Long-poll requests (waitfornewblock, getblocktemplate with a longpollid...)
+ * parked until the event they wait for, instead of each holding an RPC worker
+ * thread. A single thread checks the parked requests when notified and when
+ * they ask to, and answers those that are done.
+ */
+namespace longpoll {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Whether a parked request is done. Otherwise, sets next to the time it
+ * should be checked again if nothing is notified before, which is
+ * Clock::time_point::max() unless changed.
+ */
+using CheckFn = std::function<bool(Clock::time_point now,
+                                   Clock::time_point &next)>;
+
+/**
+ * Park a request whose handler may defer its reply (request.defer is set).
+ * check is called on the long-poll thread right away, on every Notify() and
+ * at the time it asks for. Once it returns true, or on Stop(), the request is
+ * answered with the result of result, run on an RPC worker thread.
+ *
+ * check must not block: it is called for every parked request in turn.
+ */
+void Park(const JSONRPCRequest &request, CheckFn check,
+          std::function<UniValue()> result);
+
+//! Have the parked requests checked, e.g. after the chain tip changed.
+void Notify();
+
+//! Answer all parked requests and stop the long-poll thread.
+void Stop();
+
+} // namespace longpoll
+
+#endif // BITCOIN_RPC_LONGPOLL_H
@@ -16,12 +16,14 @@
 #include <core_io.h>
 #include <fs.h>
 #include <gbtlight.h>
+#include <gbtlightstore.h>
 #include <key_io.h>
 #include <miner.h>
 #include <net.h>
 #include <policy/policy.h>
 #include <pow.h>
 #include <rpc/blockchain.h>
+#include <rpc/longpoll.h>
 #include <rpc/mining.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
@@ -35,11 +37,14 @@
 
 #include <univalue.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <list>
 #include <memory>
+#include <thread>
 
 /**
  * Return average network hashes per second based on the last 'lookup' blocks,
@@ -132,38 +137,46 @@ UniValue generateBlocks(const Config &config,
     }
 
     const uint64_t nExcessiveBlockSize = config.GetExcessiveBlockSize();
+    const CChainParams &chainparams = config.GetChainParams();
+    const int nThreadsArg =
+        gArgs.GetArg("-generatethreads", DEFAULT_GENERATE_THREADS);
+    const unsigned int nThreads =
+        nThreadsArg > 0 ? nThreadsArg
+                        : std::max(1U, std::thread::hardware_concurrency());
 
     unsigned int nExtraNonce = 0;
     UniValue::Array blockHashes;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
     while (nHeight < nHeightEnd && !ShutdownRequested()) {
-        std::unique_ptr<CBlockTemplate> pblocktemplate(
-            BlockAssembler(config, g_mempool)
-                .CreateNewBlock(coinbaseScript->reserveScript));
-
-        if (!pblocktemplate.get()) {
-            throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't create new block");
+        CBlock *pblock = pblocktemplate ? &pblocktemplate->block : nullptr;
+        // While the mempool stays empty, the next block only differs from the
+        // previous one by its header and coinbase: skip assembling it and
+        // checking its validity, which dominate when generating many blocks
+        // on regtest.
+        if (pblock && pblock->vtx.size() == 1 && g_mempool.size() == 0) {
+            LOCK(cs_main);
+            UpdateEmptyBlock(pblock, chainparams, ::ChainActive().Tip());
+        } else {
+            pblocktemplate = BlockAssembler(config, g_mempool)
+                                 .CreateNewBlock(coinbaseScript->reserveScript);
+            if (!pblocktemplate.get()) {
+                throw JSONRPCError(RPC_INTERNAL_ERROR,
+                                   "Couldn't create new block");
+            }
+            pblock = &pblocktemplate->block;
         }
 
-        CBlock *pblock = &pblocktemplate->block;
-
         {
             LOCK(cs_main);
             IncrementExtraNonce(pblock, ::ChainActive().Tip(),
                                 nExcessiveBlockSize, nExtraNonce);
         }
 
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount &&
-               !CheckProofOfWork(pblock->GetHash(), pblock->nBits,
-                                 config.GetChainParams().GetConsensus())) {
-            ++pblock->nNonce;
-            --nMaxTries;
-        }
-
-        if (nMaxTries == 0) {
-            break;
-        }
-
-        if (pblock->nNonce == nInnerLoopCount) {
+        if (!SolveBlockHeader(pblock, chainparams.GetConsensus(),
+                              nInnerLoopCount, nMaxTries, nThreads)) {
+            if (nMaxTries == 0) {
+                break;
+            }
             continue;
         }
 
@@ -355,12 +368,20 @@ std::unordered_map<JobId, std::vector<CTransactionRef>, TrivialJobIdHasher> gJob
 /// This list allows us to implement an LRU cache. We remove items when this grows too large.
 std::list<JobId> gJobIdList GUARDED_BY(gJobIdMut);
 
-/// Bytes used as header and footer for the getblocktemplatelight data files we write out.
-const std::string kDataFileMagic = "GBT";
+/// Job ids and parents of the last templates made by getblocktemplate(light). CreateNewBlock() checked their
+/// transactions with TestBlockValidity(), so blocks submitted for them do not need their scripts checked again.
+std::list<std::pair<JobId, BlockHash>> gValidatedJobs GUARDED_BY(cs_main);
+/// Templates are replaced every few seconds while miners keep working on older ones for a while.
+const size_t kValidatedJobsMax = 32;
 } // namespace
 } // namespace gbtl
 
-static UniValue getblocktemplatecommon(bool fLight, const Config &config, const JSONRPCRequest &request) {
+/**
+ * @param[in] fLongPollDone  The request has a longpollid, and was parked until
+ *                           the long poll completed: answer it right away.
+ */
+static UniValue getblocktemplatecommon(bool fLight, const Config &config, const JSONRPCRequest &request,
+                                       bool fLongPollDone = false) {
     const bool wrongParamSize = fLight ? request.params.size() > 2 : request.params.size() > 1;
     if (request.fHelp || wrongParamSize) {
         const std::string name = fLight ? "getblocktemplatelight" : "getblocktemplate";
@@ -560,9 +581,14 @@ static UniValue getblocktemplatecommon(bool fLight, const Config &config, const
                            "Bitcoin is downloading blocks...");
     }
 
-    static unsigned int nTransactionsUpdatedLast;
+    // Atomic since long-poll waiters read it without holding cs_main
+    static std::atomic<unsigned int> nTransactionsUpdatedLast{0};
 
-    if (!lpval->isNull()) {
+    if (fLongPollDone) {
+        if (!IsRPCRunning()) {
+            throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+        }
+    } else if (!lpval->isNull()) {
         // Wait to respond until either the best block changes, OR a minute has
         // passed and there are more transactions
         uint256 hashWatchedChain;
@@ -582,11 +608,44 @@ static UniValue getblocktemplatecommon(bool fLight, const Config &config, const
             nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
         }
 
+        if (request.defer) {
+            // Same as below, without holding a worker thread while waiting.
+            const auto mintxtime = longpoll::Clock::now() + std::chrono::minutes(1);
+            checktxtime = mintxtime;
+            JSONRPCRequest parked = request;
+            parked.defer = nullptr;
+            longpoll::Park(
+                request,
+                [hashWatchedChain, nTransactionsUpdatedLastLP, mintxtime, checktxtime](
+                    longpoll::Clock::time_point now, longpoll::Clock::time_point &next) mutable {
+                    {
+                        LOCK(g_best_block_mutex);
+                        if (g_best_block != hashWatchedChain || !IsRPCRunning()) {
+                            return true;
+                        }
+                    }
+                    if (now >= mintxtime && nTransactionsUpdatedLast != nTransactionsUpdatedLastLP) {
+                        return true;
+                    }
+                    if (now >= checktxtime) {
+                        if (g_mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP) {
+                            return true;
+                        }
+                        checktxtime = now + std::chrono::seconds(10);
+                    }
+                    next = checktxtime;
+                    return false;
+                },
+                [fLight, &config, parked] { return getblocktemplatecommon(fLight, config, parked, true); });
+            return UniValue();
+        }
+
         // Release the wallet and main lock while waiting
         LEAVE_CRITICAL_SECTION(cs_main);
         {
             checktxtime =
                 std::chrono::steady_clock::now() + std::chrono::minutes(1);
+            const auto mintxtime = checktxtime;
 
             WAIT_LOCK(g_best_block_mutex, lock);
             while (g_best_block == hashWatchedChain && IsRPCRunning()) {
@@ -598,6 +657,12 @@ static UniValue getblocktemplatecommon(bool fLight, const Config &config, const
                         break;
                     }
                     checktxtime += std::chrono::seconds(10);
+                } else if (std::chrono::steady_clock::now() >= mintxtime &&
+                           nTransactionsUpdatedLast !=
+                               nTransactionsUpdatedLastLP) {
+                    // Another caller created a template with newer
+                    // transactions, answer with it right away.
+                    break;
                 }
             }
         }
@@ -620,6 +685,8 @@ static UniValue getblocktemplatecommon(bool fLight, const Config &config, const
     static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
     static std::unique_ptr<LightResult> plightresult; // fLight mode only, cached result associated with pblocktemplate
+    // Incremented every time pblocktemplate is replaced
+    static uint64_t nTemplateGeneration;
     if (pindexPrev != ::ChainActive().Tip() ||
         (g_mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
          GetTime() - nStart > 5)) {
@@ -643,6 +710,31 @@ static UniValue getblocktemplatecommon(bool fLight, const Config &config, const
 
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
+        ++nTemplateGeneration;
+
+        // CreateNewBlock() checked the transactions with TestBlockValidity(), remember the job for submitblock. This
+        // also gives getblocktemplatelight its result for the template.
+        std::vector<uint256> merkleSteps;
+        const gbtl::JobId templateJobId =
+            gbtl::GetJobId(pblocktemplate->block.hashPrevBlock, pblocktemplate->block.vtx, &merkleSteps);
+        UniValue::Array merkle;
+        merkle.reserve(merkleSteps.size());
+        for (const auto &h : merkleSteps) {
+            merkle.emplace_back(h.GetHex());
+        }
+        plightresult.reset(new LightResult(templateJobId, merkle));
+        gbtl::gValidatedJobs.emplace_back(templateJobId, pblocktemplate->block.hashPrevBlock);
+        if (gbtl::gValidatedJobs.size() > gbtl::kValidatedJobsMax) {
+            gbtl::gValidatedJobs.pop_front();
+        }
+
+        // Wake up long-poll waiters that are due for a template with newer
+        // transactions; they are answered from the cached result below.
+        {
+            LOCK(g_best_block_mutex);
+        }
+        g_best_block_cv.notify_all();
+        longpoll::Notify();
     }
 
     assert(pindexPrev);
@@ -704,6 +796,35 @@ static UniValue getblocktemplatecommon(bool fLight, const Config &config, const
     UpdateTime(pblock, config.GetChainParams().GetConsensus(), pindexPrev);
     pblock->nNonce = 0;
 
+    // The result only depends on the template, nBits (which may follow nTime
+    // on testnet) and nTime. Several pool frontends typically poll the same
+    // node with identical requests, so the result is built once per template
+    // and shared, instead of encoding every transaction again for each caller.
+    // Requests with additional_txs are not cached.
+    struct CachedResult {
+        const uint64_t nGeneration;
+        const uint32_t nBits;
+        const gbtl::JobId jobId; // fLight mode only
+        const UniValue::Object result;
+        CachedResult(uint64_t _nGeneration, uint32_t _nBits, const gbtl::JobId &_jobId, const UniValue::Object &_result)
+            : nGeneration(_nGeneration), nBits(_nBits), jobId(_jobId), result(_result) {}
+    };
+    static std::unique_ptr<CachedResult> pcachedresults[2]; // indexed by fLight
+    std::unique_ptr<CachedResult> &pcachedresult = pcachedresults[fLight];
+    const bool fCacheable = pvtx == &pblock->vtx;
+    if (fCacheable && pcachedresult && pcachedresult->nGeneration == nTemplateGeneration &&
+        pcachedresult->nBits == pblock->nBits) {
+        UniValue::Object result(pcachedresult->result);
+        result.at("curtime") = pblock->GetBlockTime();
+        if (fLight) {
+            // The job may have been evicted from the in-memory cache since the result was built
+            gbtl::CacheAndSaveTxsToFile(pcachedresult->jobId, pvtx);
+        }
+        LogPrint(BCLog::RPC, "getblocktemplatecommon: using cached result, took %f secs\n",
+                 (GetTimeMicros() - t0) / 1e6);
+        return result;
+    }
+
     UniValue::Array aCaps;
     aCaps.reserve(1);
     aCaps.emplace_back("proposal");
@@ -719,35 +840,15 @@ static UniValue getblocktemplatecommon(bool fLight, const Config &config, const
             jobId = plightresult->jobId; // copy jobId
             merkle = plightresult->merkle; // copy UniValue
         } else {
-            // merkle cached result not available (new template) or we have additional_txs and can't use cached result
+            // we have additional_txs and can't use cached result
             LogPrint(BCLog::RPC, "Calculating new merkle result\n");
-            std::vector<uint256> vtxIdsNoCoinbase; // txs without coinbase
-            // we reserve 1 more than we need, because makeMerkleBranch may use a little more space
-            vtxIdsNoCoinbase.reserve(pvtx->size());
-            for (const auto &tx : *pvtx) {
-                if (tx->IsCoinBase())
-                    continue;
-                vtxIdsNoCoinbase.push_back(tx->GetId());
-            }
-            // make merkleSteps and merkle branch
-            const auto merkleSteps = gbtl::MakeMerkleBranch(std::move(vtxIdsNoCoinbase));
+            std::vector<uint256> merkleSteps;
+            // Compute the jobId -- we will return this jobId to the client and also generate a cache entry based on it
+            // towards the end of this function.
+            jobId = gbtl::GetJobId(pblock->hashPrevBlock, *pvtx, &merkleSteps);
             merkle.reserve(merkleSteps.size());
-            // hash source is Hash160(hashPrevBlock + concatenation_of_all_merkle_step_hashes)
-            std::vector<uint8_t> hashSource;
-            hashSource.reserve(pblock->hashPrevBlock.size() + merkleSteps.size()*32);
-            hashSource.insert(hashSource.end(), pblock->hashPrevBlock.begin(), pblock->hashPrevBlock.end());
             for (const auto &h : merkleSteps) {
                 merkle.emplace_back(h.GetHex()); // push UniValue
-                hashSource.insert(hashSource.end(), h.begin(), h.end()); // add to hash source
-            }
-            // Compute the jobId -- we will return this jobId to the client and also generate a cache entry based on it
-            // towards the end of this function.
-            jobId = Hash160(hashSource.begin(), hashSource.end());
-
-            // Finally, cache the merkle results if they were calculated from the tx's in pblock (no additional_txs).
-            if (pvtx == &pblock->vtx) {
-                plightresult.reset(new LightResult(jobId, merkle));
-                LogPrint(BCLog::RPC, "Saved merkle result\n");
             }
         }
     } else {
@@ -817,10 +918,13 @@ static UniValue getblocktemplatecommon(bool fLight, const Config &config, const
     result.emplace_back("height", pindexPrev->nHeight + 1);
 
     if (fLight) {
-        // Note: this must be called with cs_main held (which is the case here)
         gbtl::CacheAndSaveTxsToFile(jobId, pvtx);
     }
 
+    if (fCacheable) {
+        pcachedresult.reset(new CachedResult(nTemplateGeneration, pblock->nBits, jobId, result));
+    }
+
     LogPrint(BCLog::RPC, "getblocktemplatecommon: took %f secs\n", (GetTimeMicros() - t0) / 1e6);
     return result;
 }
@@ -887,6 +991,8 @@ static UniValue submitblockcommon(const Config &config, const JSONRPCRequest &re
     }
 
     const BlockHash hash = block.GetHash();
+    // submitblocklight's transactions are those of jobId, a full block's are identified the same way
+    const gbtl::JobId blockJobId = jobId ? *jobId : gbtl::GetJobId(block.hashPrevBlock, block.vtx);
     {
         LOCK(cs_main);
         const CBlockIndex *pindex = LookupBlockIndex(hash);
@@ -898,6 +1004,14 @@ static UniValue submitblockcommon(const Config &config, const JSONRPCRequest &re
                 return "duplicate-invalid";
             }
         }
+        // The transactions of a recent template were checked on top of the same parent when it was made; only the
+        // header, the coinbase and the proof of work are new. CheckBlock() still ties the transactions to the header
+        // through the merkle root.
+        if (gbtl::IsValidatedJob(blockJobId, block.hashPrevBlock)) {
+            LogPrint(BCLog::RPC, "SubmitBlock: block %s solves template job_id %s, skipping script checks\n",
+                     hash.ToString(), blockJobId.GetHex());
+            MarkBlockScriptsChecked(hash);
+        }
     }
 
     bool new_block;
@@ -1084,6 +1198,41 @@ std::vector<uint256> MakeMerkleBranch(std::vector<uint256> hashes) {
   return steps;
 }
 
+JobId GetJobId(const BlockHash &hashPrevBlock, const std::vector<CTransactionRef> &vtx,
+               std::vector<uint256> *merkleSteps) {
+    std::vector<uint256> vtxIdsNoCoinbase; // txs without coinbase
+    // we reserve 1 more than we need, because makeMerkleBranch may use a little more space
+    vtxIdsNoCoinbase.reserve(vtx.size());
+    for (const auto &tx : vtx) {
+        if (tx->IsCoinBase())
+            continue;
+        vtxIdsNoCoinbase.push_back(tx->GetId());
+    }
+    // make merkleSteps and merkle branch
+    std::vector<uint256> steps = MakeMerkleBranch(std::move(vtxIdsNoCoinbase));
+    // hash source is Hash160(hashPrevBlock + concatenation_of_all_merkle_step_hashes)
+    std::vector<uint8_t> hashSource;
+    hashSource.reserve(hashPrevBlock.size() + steps.size()*32);
+    hashSource.insert(hashSource.end(), hashPrevBlock.begin(), hashPrevBlock.end());
+    for (const auto &h : steps) {
+        hashSource.insert(hashSource.end(), h.begin(), h.end()); // add to hash source
+    }
+    if (merkleSteps) {
+        *merkleSteps = std::move(steps);
+    }
+    return Hash160(hashSource.begin(), hashSource.end());
+}
+
+bool IsValidatedJob(const JobId &jobId, const BlockHash &hashPrevBlock) {
+    AssertLockHeld(cs_main);
+    for (const auto &job : gValidatedJobs) {
+        if (job.first == jobId) {
+            return job.second == hashPrevBlock;
+        }
+    }
+    return false;
+}
+
 bool GetTxsFromCache(const JobId &jobId, CBlock &block) {
     LOCK(gJobIdMut);
     const auto it = gJobIdTxCache.find(jobId);
@@ -1102,6 +1251,12 @@ void LoadTxsFromFile(const JobId &jobId, CBlock &block) {
     const char *const errDataBad = "job_id data is invalid";
 
     const auto jobIdStr = jobId.GetHex();
+    JobStore &store = GetJobStore();
+    // the job may not have been written out yet
+    if (store.GetQueued(jobId, block.vtx)) {
+        LogPrint(BCLog::RPC, "SubmitBlockLight job_id %s found in the job store queue\n", jobIdStr);
+        return;
+    }
     fs::path filename = GetJobDataDir() / jobIdStr;
     if (!fs::exists(filename)) {
         LogPrintf("WARNING: SubmitBlockLight cannot find file for job_id %s, searching trash dir\n", jobIdStr);
@@ -1112,45 +1267,13 @@ void LoadTxsFromFile(const JobId &jobId, CBlock &block) {
         }
     }
     LogPrint(BCLog::RPC, "SubmitBlockLight job_id %s found in %s\n", jobIdStr, filename.string());
+    // read into a temporary vector so that `block` is left alone on failure
+    std::vector<CTransactionRef> txs;
     try {
-        const auto magicLen = kDataFileMagic.size(); // 3 for "GBT"
-        std::vector<uint8_t> dataBuf;
-        {
-            fs::ifstream file(filename);
-
-            if (!file.is_open()) {
-                LogPrintf("WARNING: SubmitBlockLight found file for job_id %s, but open failed\n", jobIdStr);
-                throw JSONRPCError(RPC_INTERNAL_ERROR, errNoData);
-            }
-
-            std::streamoff fileSize{};
-            if (!file.seekg(0, file.end) || (fileSize = file.tellg()) < std::streamoff(magicLen * 2 + 1)) {
-                LogPrintf("WARNING: SubmitBlockLight job_id %s has invalid size\n", jobIdStr);
-                throw JSONRPCError(RPC_DESERIALIZATION_ERROR, errDataEmpty);
-            }
-            file.seekg(0, file.beg);
-            dataBuf.resize(size_t(fileSize));
-            char * const charDataBuf = reinterpret_cast<char *>(dataBuf.data());
-            file.read(charDataBuf, fileSize);
-            // check read was good and that header and footer match
-            if (file.fail()
-                    // header must match "GBT"
-                    || 0 != std::memcmp(charDataBuf, kDataFileMagic.data(), magicLen)
-                    // footer must match "GBT"
-                    || 0 != std::memcmp(charDataBuf + fileSize - magicLen, kDataFileMagic.data(), magicLen)) {
-                LogPrintf("WARNING: SubmitBlockLight job_id %s appears to be corrupt\n", jobIdStr);
-                throw JSONRPCError(RPC_DESERIALIZATION_ERROR, errDataBad);
-            }
-            // everything's ok, proceed
-        }
-        // deserialize the vector directly, starting at pos 3 (after "GBT" header)
-        VectorReader vr(SER_NETWORK, PROTOCOL_VERSION, dataBuf, magicLen /* start pos */);
-        uint32_t txCount = 0;
-        vr >> txCount;
-        for (uint32_t i = 0; i < txCount; ++i) {
-            CMutableTransaction mutableTx;
-            vr >> mutableTx;
-            block.vtx.push_back(MakeTransactionRef(std::move(mutableTx)));
+        // txs still in the mempool are taken from there, the others are read from GetJobTxDir()
+        if (!store.ReadJobFile(filename, txs, &g_mempool)) {
+            LogPrintf("WARNING: SubmitBlockLight job_id %s has invalid size\n", jobIdStr);
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, errDataEmpty);
         }
     } catch (const std::exception & e) {
         // Note: JSONRPCError() above throws a UniValue so it will not be caught here (but it will
@@ -1159,75 +1282,31 @@ void LoadTxsFromFile(const JobId &jobId, CBlock &block) {
         LogPrintf("WARNING: SubmitBlockLight job_id %s failed to deserialize: %s\n", jobIdStr, e.what());
         throw JSONRPCError(RPC_DESERIALIZATION_ERROR, errDataBad);
     }
+    block.vtx.insert(block.vtx.end(), txs.begin(), txs.end());
 }
 
 void CacheAndSaveTxsToFile(const JobId &jobId, const std::vector<CTransactionRef> *pvtx) {
-    std::vector<CTransactionRef> storeTxs;
-    bool didSetupStoreTxs = false;
-    const auto setupStoreTxs = [&storeTxs, &didSetupStoreTxs, pvtx] {
-        if (didSetupStoreTxs)
-            return;
-        if (!pvtx->empty()) {
-            // we store all but the first tx (all but coinbase)
-            auto start = pvtx->front()->IsCoinBase() ? std::next(pvtx->begin()) : pvtx->begin();
-            storeTxs.insert(storeTxs.end(), start, pvtx->end());
-        }
-        didSetupStoreTxs = true;
-    };
-    // first, write to file if file does not already exist
-    {
-        const auto jobIdStr = jobId.GetHex();
-        fs::path outputFile = GetJobDataDir() / jobIdStr;
-        // There is no race condition here because this function is called from getblocktemplatecommon,
-        // with the cs_main lock held.
-        AssertLockHeld(cs_main);
-        if (!fs::exists(outputFile)) {
-            setupStoreTxs();
-            CDataStream datastream(SER_NETWORK, PROTOCOL_VERSION);
-            const uint32_t nTx = uint32_t(storeTxs.size());
-            datastream.reserve(256 * nTx + sizeof(nTx)); // assume avg 256 byte tx size. This doesn't have to be exact, this is just to avoid redundant allocations as we serialize.
-            datastream << nTx; // first write the size
-            for (const auto &txRef : storeTxs)
-                datastream << *txRef;
-
-            const auto t0 = GetTimeMicros(); // for perf. logging iff BCLog::RPC is enabled
-            auto tmpOut = outputFile;
-            tmpOut += gbtl::tmpExt; // += ".tmp"
-            bool ok{};
-            {
-                fs::ofstream ofile(tmpOut, std::ios_base::binary|std::ios_base::out|std::ios_base::trunc);
-                if ((ok = ofile.is_open())) {
-                    // "GBT" magic bytes at front
-                    using std::streamsize;
-                    ofile.write(kDataFileMagic.data(), streamsize(kDataFileMagic.size()));
-                    if (ofile)
-                        ofile.write(datastream.data(), streamsize(datastream.size()));
-                    if (ofile)
-                        // "GBT" magic bytes at end
-                        ofile.write(kDataFileMagic.data(), streamsize(kDataFileMagic.size()));
-                    ok = bool(ofile);
-                }
-            } // file is closed
-            if (ok) {
-                // now, atomically move it in place.
-                fs::rename(tmpOut, outputFile); // may throw (unlikely) iff another prog. created outputFile just now
-                LogPrint(BCLog::RPC, "getblocktemplatelight: %d txs written to %s in %f secs\n", storeTxs.size(),
-                         outputFile.string(), (GetTimeMicros() - t0) / 1e6);
-            } else {
-                LogPrintf("getblocktemplatelight: cannot write tx data to %s\n", tmpOut.string());
-                try { fs::remove(tmpOut); } catch (...) {}
-                // We must throw here. Clients should be alerted that there is a misconfiguration with bitcoind (even
-                // though we could theoretically continue and rely on in-memory cache, we are better off doing this).
-                throw JSONRPCError(RPC_INTERNAL_ERROR, "failed to save job tx data to disk");
-            }
-        }
+    // Report a failure of the job store to write out an earlier job. Clients should be alerted that there is a
+    // misconfiguration with bitcoind (even though we could theoretically continue and rely on in-memory cache, we are
+    // better off doing this).
+    if (GetJobStore().HasFailed()) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "failed to save job tx data to disk");
     }
-    // lastly, store cache if not already in cache
+    std::vector<CTransactionRef> storeTxs;
     {
         // we must hold this lock here since this data is shared with submitblocklight which doesn't hold cs_main
         LOCK(gJobIdMut);
-        if (gJobIdTxCache.find(jobId) == gJobIdTxCache.end()) {
-            setupStoreTxs();
+        auto it = gJobIdTxCache.find(jobId);
+        if (it != gJobIdTxCache.end()) {
+            // Already cached, but the job file may have expired and been removed since (a cached template can
+            // outlive -gbtstoretime), so it is handed to the job store again.
+            storeTxs = it->second;
+        } else {
+            if (!pvtx->empty()) {
+                // we store all but the first tx (all but coinbase)
+                auto start = pvtx->front()->IsCoinBase() ? std::next(pvtx->begin()) : pvtx->begin();
+                storeTxs.insert(storeTxs.end(), start, pvtx->end());
+            }
             // put in cache, but first check size to limit cache size
             if (gJobIdTxCache.size() >= GetJobCacheSize() && !gJobIdList.empty()) {
                 // remove the oldest jobId
@@ -1237,13 +1316,12 @@ void CacheAndSaveTxsToFile(const JobId &jobId, const std::vector<CTransactionRef
                 gJobIdTxCache.erase(oldJobId);
                 gJobIdList.pop_front();
             }
-            // we insert using emplace and forward_as_tuple for minimal overhead
-            gJobIdTxCache.emplace(std::piecewise_construct,
-                                  std::forward_as_tuple(jobId), std::forward_as_tuple(std::move(storeTxs)));
-            // NB: at this point storeTxs is empty (moved)
+            gJobIdTxCache.emplace(jobId, storeTxs);
             gJobIdList.push_back(jobId);
         }
     }
+    // lastly, write it out in the background (this is a no-op if the job data file already exists)
+    GetJobStore().Store(jobId, std::move(storeTxs));
 }
 
 } // namespace gbtl
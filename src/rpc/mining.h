@@ -6,6 +6,7 @@
 #define BITCOIN_RPC_MINING_H
 
 #include <gbtlight.h>
+#include <primitives/blockhash.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
 
@@ -25,6 +26,15 @@ namespace gbtl {
 /** Used by getblocktemplatelight for the "merkle" UniValue entry it returns.  Returns a merkle branch used to
  *  reconstruct the merkle root for submitblocklight.  See the implementation of this function for more documentation.*/
 std::vector<uint256> MakeMerkleBranch(std::vector<uint256> vtxHashes);
+/** Returns the job id getblocktemplatelight assigns to the transactions of vtx (the coinbase, if any, is ignored) on
+ *  top of hashPrevBlock: the Hash160 of hashPrevBlock followed by the merkle branch of the transactions.  If
+ *  merkleSteps is not nullptr, the merkle branch is returned there too. */
+JobId GetJobId(const BlockHash &hashPrevBlock, const std::vector<CTransactionRef> &vtx,
+               std::vector<uint256> *merkleSteps = nullptr);
+/** Returns true if jobId is one of the last templates made by getblocktemplate or getblocktemplatelight, whose
+ *  transactions were checked by TestBlockValidity() on top of hashPrevBlock.
+ *  IMPORTANT: This function must be called with the cs_main lock held. */
+bool IsValidatedJob(const JobId &jobId, const BlockHash &hashPrevBlock);
 /** Used by submitblocklight.  Returns false if jobId is not in cache, otherwise returns true and puts the tx's for
  *  jobId into the specified block.
  *  Precondition: `block` should contain a single coinbase tx.
@@ -38,10 +48,9 @@ bool GetTxsFromCache(const JobId &jobId, CBlock &block);
  *  Postcondition: If no exception is thrown, `block` contains its coinbase tx + the txs associated with jobId in
  *                 consensus order.  The merkle root for `block` is not modified by this function.   */
 void LoadTxsFromFile(const JobId &jobId, CBlock &block);
-/** Saves the tx's from pvtx (stripping the coinbase, if any) for jobId to the gJobIdTxCache and also to a disk file
- *  in GetJobDataDir().  submitblocklight will use these cached tx's later to reconstruct the transactions for a block.
- *  IMPORTANT: This function must be called with the cs_main lock held.  Test code should take cs_main before
- *             calling this function.   */
+/** Saves the tx's from pvtx (stripping the coinbase, if any) for jobId to the gJobIdTxCache and queues them to be
+ *  written to the job store in GetJobDataDir().  submitblocklight will use these cached tx's later to reconstruct the
+ *  transactions for a block.  Throws JSONRPCError if the job store failed to write out an earlier job.  */
 void CacheAndSaveTxsToFile(const JobId &jobId, const std::vector<CTransactionRef> *pvtx);
 }
 #endif // BITCOIN_RPC_MINING_H
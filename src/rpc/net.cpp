@@ -77,6 +77,31 @@ static UniValue ping(const Config &config, const JSONRPCRequest &request) {
     return UniValue();
 }
 
+static UniValue::Object
+MsgProcessingStatsToJSON(const MsgProcessingStats &stats) {
+    UniValue::Object obj;
+    obj.reserve(8);
+    obj.emplace_back("count", stats.nCount);
+    obj.emplace_back("time_us", stats.nTime);
+    obj.emplace_back("max_time_us", stats.nMaxTime);
+    obj.emplace_back("cpu_us", stats.nCPUTime);
+    obj.emplace_back("queue_us", stats.nQueueTime);
+    obj.emplace_back("max_queue_us", stats.nMaxQueueTime);
+    obj.emplace_back("cs_main_us", stats.nCsMainTime);
+    // Leave out the empty buckets at the end.
+    size_t nBuckets = stats.histogram.size();
+    while (nBuckets > 0 && stats.histogram[nBuckets - 1] == 0) {
+        nBuckets--;
+    }
+    UniValue::Array histogram;
+    histogram.reserve(nBuckets);
+    for (size_t i = 0; i < nBuckets; i++) {
+        histogram.emplace_back(stats.histogram[i]);
+    }
+    obj.emplace_back("histogram", std::move(histogram));
+    return obj;
+}
+
 static UniValue getpeerinfo(const Config &config,
                             const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() != 0) {
@@ -149,6 +174,12 @@ static UniValue getpeerinfo(const Config &config,
             "       \"addr\": n,              (numeric) The total bytes "
             "received aggregated by message type\n"
             "       ...\n"
+            "    },\n"
+            "    \"processing_per_msg\": {\n"
+            "       \"addr\": {...},          (json object) The time spent "
+            "on received messages aggregated by message type, see "
+            "getmessagestats\n"
+            "       ...\n"
             "    }\n"
             "  }\n"
             "  ,...\n"
@@ -250,6 +281,13 @@ static UniValue getpeerinfo(const Config &config,
         }
         obj.emplace_back("bytesrecv_per_msg", std::move(recvPerMsgCmd));
 
+        UniValue::Object processingPerMsgCmd;
+        for (const auto &i : stats.mapProcessingPerMsgCmd) {
+            processingPerMsgCmd.emplace_back(
+                i.first, MsgProcessingStatsToJSON(i.second));
+        }
+        obj.emplace_back("processing_per_msg", std::move(processingPerMsgCmd));
+
         ret.emplace_back(obj);
     }
 
@@ -505,6 +543,195 @@ static UniValue getnettotals(const Config &config,
     return obj;
 }
 
+static UniValue getmessagestats(const Config &config,
+                                const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            RPCHelpMan{"getmessagestats",
+                "\nReturns the time spent on received P2P messages since "
+                "startup, by message type, and the connected peers ordered by "
+                "the time spent on their messages.\n",
+                {}}
+                .ToString() +
+            "\nResult:\n"
+            "{\n"
+            "  \"messages\": {\n"
+            "    \"addr\": {\n"
+            "      \"count\": n,          (numeric) Messages processed\n"
+            "      \"time_us\": n,        (numeric) Total time spent "
+            "processing them, in microseconds\n"
+            "      \"max_time_us\": n,    (numeric) Longest processing "
+            "time\n"
+            "      \"cpu_us\": n,         (numeric) CPU time of the message "
+            "handler thread while processing them\n"
+            "      \"queue_us\": n,       (numeric) Total time they waited "
+            "between being received and being processed\n"
+            "      \"max_queue_us\": n,   (numeric) Longest wait\n"
+            "      \"cs_main_us\": n,     (numeric) Time cs_main was held "
+            "while processing them, 0 unless built with "
+            "ENABLE_LOCK_HOLD_STATS\n"
+            "      \"histogram\": [n,...] (json array) Number of messages "
+            "processed in less than 1, 2, 4, ... microseconds, the last "
+            "entry counting all longer ones. Trailing zeros are left out\n"
+            "    },\n"
+            "    ...\n"
+            "  },\n"
+            "  \"peers\": [\n"
+            "    {\n"
+            "      \"id\": n,             (numeric) Peer index\n"
+            "      \"addr\": \"host:port\", (string) The IP address and "
+            "port of the peer\n"
+            "      ...                  Totals over all message types, as "
+            "above\n"
+            "    },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmessagestats", "") +
+            HelpExampleRpc("getmessagestats", ""));
+    }
+
+    if (!g_connman) {
+        throw JSONRPCError(
+            RPC_CLIENT_P2P_DISABLED,
+            "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    UniValue::Object messages;
+    for (const auto &i : g_connman->GetMessageProcessingStats()) {
+        messages.emplace_back(i.first, MsgProcessingStatsToJSON(i.second));
+    }
+
+    std::vector<CNodeStats> vstats;
+    g_connman->GetNodeStats(vstats);
+    std::vector<std::pair<const CNodeStats *, MsgProcessingStats>> peers;
+    peers.reserve(vstats.size());
+    for (const CNodeStats &stats : vstats) {
+        MsgProcessingStats total;
+        for (const auto &i : stats.mapProcessingPerMsgCmd) {
+            total += i.second;
+        }
+        peers.emplace_back(&stats, total);
+    }
+    std::sort(peers.begin(), peers.end(), [](const auto &a, const auto &b) {
+        return a.second.nTime > b.second.nTime;
+    });
+
+    UniValue::Array peersArray;
+    peersArray.reserve(peers.size());
+    for (const auto &peer : peers) {
+        UniValue::Object obj;
+        obj.reserve(10);
+        obj.emplace_back("id", peer.first->nodeid);
+        obj.emplace_back("addr", peer.first->addrName);
+        for (auto &field : MsgProcessingStatsToJSON(peer.second)) {
+            obj.emplace_back(std::move(field));
+        }
+        peersArray.emplace_back(std::move(obj));
+    }
+
+    UniValue::Object ret;
+    ret.reserve(2);
+    ret.emplace_back("messages", std::move(messages));
+    ret.emplace_back("peers", std::move(peersArray));
+    return ret;
+}
+
+static UniValue getblockdownloadinfo(const Config &config,
+                                     const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            RPCHelpMan{"getblockdownloadinfo",
+                "\nReturns the state of block download from peers.\n",
+                {}}
+                .ToString() +
+            "\nResult:\n"
+            "{\n"
+            "  \"adaptive\": true|false,     (boolean) Whether the number "
+            "of blocks in flight follows the measured performance of each "
+            "peer (-adaptiveblockdownload)\n"
+            "  \"inflight\": n,              (numeric) Blocks in flight\n"
+            "  \"duplicates_inflight\": n,   (numeric) Blocks in flight "
+            "that were requested from a second peer too\n"
+            "  \"duplicates\": n,            (numeric) Blocks requested "
+            "from a second peer since startup, as they held back "
+            "validation\n"
+            "  \"duplicates_first\": n,      (numeric) How many of those "
+            "arrived from the second peer first\n"
+            "  \"peers\": [\n"
+            "    {\n"
+            "      \"id\": n,                (numeric) Peer index\n"
+            "      \"addr\": \"host:port\",   (string) The IP address and "
+            "port of the peer\n"
+            "      \"inflight\": n,          (numeric) Blocks in flight from "
+            "the peer, including duplicate requests\n"
+            "      \"window\": n,            (numeric) Blocks to keep in "
+            "flight from the peer\n"
+            "      \"latency_us\": n,        (numeric) Time for a block "
+            "requested alone to arrive, 0 if not measured yet\n"
+            "      \"interval_us\": n,       (numeric) Time between the "
+            "arrival of consecutive blocks, 0 if not measured yet\n"
+            "      \"bytes_per_second\": n,  (numeric) Block throughput\n"
+            "      \"duplicates_inflight\": n, (numeric) Blocks in flight "
+            "from another peer also requested from this one\n"
+            "      \"stalling\": true|false  (boolean) Whether the peer "
+            "holds back the download window\n"
+            "    },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockdownloadinfo", "") +
+            HelpExampleRpc("getblockdownloadinfo", ""));
+    }
+
+    if (!g_connman) {
+        throw JSONRPCError(
+            RPC_CLIENT_P2P_DISABLED,
+            "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    std::vector<CNodeStats> vstats;
+    g_connman->GetNodeStats(vstats);
+
+    UniValue::Array peers;
+    peers.reserve(vstats.size());
+    for (const CNodeStats &stats : vstats) {
+        CNodeStateStats statestats;
+        if (!GetNodeStateStats(stats.nodeid, statestats)) {
+            continue;
+        }
+        UniValue::Object obj;
+        obj.reserve(9);
+        obj.emplace_back("id", stats.nodeid);
+        obj.emplace_back("addr", stats.addrName);
+        obj.emplace_back("inflight", statestats.vHeightInFlight.size() +
+                                         statestats.nBlocksDuplicated);
+        obj.emplace_back("window", statestats.nBlockDownloadWindow);
+        obj.emplace_back("latency_us", statestats.nBlockLatency);
+        obj.emplace_back("interval_us", statestats.nBlockInterval);
+        obj.emplace_back("bytes_per_second",
+                         int64_t(statestats.dBlockBytesPerSecond));
+        obj.emplace_back("duplicates_inflight", statestats.nBlocksDuplicated);
+        obj.emplace_back("stalling", statestats.fStalling);
+        peers.emplace_back(std::move(obj));
+    }
+
+    BlockDownloadTotals totals;
+    GetBlockDownloadTotals(totals);
+
+    UniValue::Object ret;
+    ret.reserve(6);
+    ret.emplace_back("adaptive", g_adaptive_block_download);
+    ret.emplace_back("inflight", totals.nBlocksInFlight);
+    ret.emplace_back("duplicates_inflight", totals.nBlocksDuplicatedInFlight);
+    ret.emplace_back("duplicates", totals.nBlocksDuplicated);
+    ret.emplace_back("duplicates_first", totals.nBlocksDuplicatedFirst);
+    ret.emplace_back("peers", std::move(peers));
+    return ret;
+}
+
 static UniValue::Array GetNetworksInfo() {
     UniValue::Array networks;
     for (int n = 0; n < NET_MAX; ++n) {
@@ -587,6 +814,23 @@ static UniValue getnetworkinfo(const Config &config,
             "  }\n"
             "  ,...\n"
             "  ]\n"
+            "  \"buffers\": {                           (object) P2P message "
+            "buffer counters since startup\n"
+            "    \"recvallocations\": xxxxx,            (numeric) receive "
+            "buffer allocations\n"
+            "    \"recvallocatedbytes\": xxxxx,         (numeric) bytes "
+            "allocated by those\n"
+            "    \"recvdirectbytes\": xxxxx,            (numeric) payload "
+            "bytes read from the socket in place\n"
+            "    \"recvcopiedbytes\": xxxxx,            (numeric) payload "
+            "bytes copied from the intermediate socket buffer\n"
+            "    \"sendpoolhits\": xxxxx,               (numeric) outgoing "
+            "messages serialized into a recycled buffer\n"
+            "    \"sendpoolmisses\": xxxxx,             (numeric) outgoing "
+            "messages that needed a new buffer\n"
+            "    \"sendpoolidle\": xxxxx                (numeric) recycled "
+            "buffers currently available\n"
+            "  }\n"
             "  \"warnings\": \"...\"                    (string) any network "
             "and blockchain warnings\n"
             "}\n"
@@ -597,7 +841,7 @@ static UniValue getnetworkinfo(const Config &config,
 
     LOCK(cs_main);
     UniValue::Object obj;
-    obj.reserve(g_connman ? 13 : 10);
+    obj.reserve(g_connman ? 14 : 11);
     obj.emplace_back("version", CLIENT_VERSION);
     obj.emplace_back("subversion", userAgent(config));
     obj.emplace_back("protocolversion", PROTOCOL_VERSION);
@@ -627,6 +871,18 @@ static UniValue getnetworkinfo(const Config &config,
         }
     }
     obj.emplace_back("localaddresses", std::move(localAddresses));
+    const CNetRecvBufferStats &recvStats = GetNetRecvBufferStats();
+    const CNetMsgBufferPool &sendPool = GetNetMsgBufferPool();
+    UniValue::Object buffers;
+    buffers.reserve(7);
+    buffers.emplace_back("recvallocations", recvStats.nAllocations.load());
+    buffers.emplace_back("recvallocatedbytes", recvStats.nAllocatedBytes.load());
+    buffers.emplace_back("recvdirectbytes", recvStats.nDirectBytes.load());
+    buffers.emplace_back("recvcopiedbytes", recvStats.nCopiedBytes.load());
+    buffers.emplace_back("sendpoolhits", sendPool.GetHits());
+    buffers.emplace_back("sendpoolmisses", sendPool.GetMisses());
+    buffers.emplace_back("sendpoolidle", sendPool.GetIdleCount());
+    obj.emplace_back("buffers", std::move(buffers));
     obj.emplace_back("warnings", GetWarnings("statusbar"));
     return obj;
 }
@@ -727,6 +983,87 @@ static UniValue setban(const Config &config, const JSONRPCRequest &request) {
     return UniValue();
 }
 
+static UniValue importbanlist(const Config &config,
+                              const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 3) {
+        throw std::runtime_error(
+            "importbanlist [\"subnet\",...] ( bantime absolute )\n"
+            "\nBans many IPs/Subnets at once, e.g. to load a blocklist. The "
+            "banlist is stored to disk once for the whole list. Entries that "
+            "are already banned for at least as long are left unchanged.\n"
+            "\nArguments:\n"
+            "1. \"subnets\"      (array, required) The IPs/Subnets, each with "
+            "an optional netmask (default is /32 = single IP)\n"
+            "2. \"bantime\"      (numeric, optional) time in seconds how long "
+            "(or until when if [absolute] is set) the IPs are banned (0 or "
+            "empty means using the default time of 24h which can also be "
+            "overwritten by the -bantime startup argument)\n"
+            "3. \"absolute\"     (boolean, optional) If set, the bantime must "
+            "be an absolute timestamp in seconds since epoch (Jan 1 1970 GMT)\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"banned\": n,       (numeric) Number of new or extended bans\n"
+            "  \"invalid\": [       (array) Entries that are not a valid "
+            "IP/Subnet and were skipped\n"
+            "    \"subnet\",...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("importbanlist",
+                           "\"[\\\"192.168.0.0/24\\\",\\\"10.0.0.1\\\"]\" "
+                           "86400") +
+            HelpExampleRpc("importbanlist",
+                           "[\"192.168.0.0/24\", \"10.0.0.1\"], 86400"));
+    }
+
+    if (!g_banman) {
+        throw JSONRPCError(RPC_DATABASE_ERROR,
+                           "Error: Ban database not loaded");
+    }
+
+    const UniValue::Array &entries = request.params[0].get_array();
+    std::vector<CSubNet> subNets;
+    subNets.reserve(entries.size());
+    UniValue::Array invalid;
+    for (const UniValue &entry : entries) {
+        const std::string &str = entry.get_str();
+        CSubNet subNet;
+        if (str.find('/') != std::string::npos) {
+            LookupSubNet(str.c_str(), subNet);
+        } else {
+            CNetAddr resolved;
+            LookupHost(str.c_str(), resolved, false);
+            subNet = CSubNet(resolved);
+        }
+        if (subNet.IsValid()) {
+            subNets.push_back(subNet);
+        } else {
+            invalid.emplace_back(str);
+        }
+    }
+
+    // Use standard bantime if not specified.
+    int64_t banTime = 0;
+    if (!request.params[1].isNull()) {
+        banTime = request.params[1].get_int64();
+    }
+    const bool absolute = request.params[2].isTrue();
+
+    const size_t banned = g_banman->BanMany(subNets, banTime, absolute);
+    if (g_connman) {
+        for (const CSubNet &subNet : subNets) {
+            g_connman->DisconnectNode(subNet);
+        }
+    }
+
+    UniValue::Object result;
+    result.reserve(2);
+    result.emplace_back("banned", banned);
+    result.emplace_back("invalid", std::move(invalid));
+    return result;
+}
+
 static UniValue listbanned(const Config&,
                            const JSONRPCRequest& request)
 {
@@ -901,8 +1238,11 @@ static const ContextFreeRPCCommand commands[] = {
     { "network",            "disconnectnode",         disconnectnode,         {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       getaddednodeinfo,       {"node"} },
     { "network",            "getnettotals",           getnettotals,           {} },
+    { "network",            "getmessagestats",        getmessagestats,        {} },
+    { "network",            "getblockdownloadinfo",   getblockdownloadinfo,   {} },
     { "network",            "getnetworkinfo",         getnetworkinfo,         {} },
     { "network",            "setban",                 setban,                 {"subnet", "command", "bantime", "absolute"} },
+    { "network",            "importbanlist",          importbanlist,          {"subnets", "bantime", "absolute"} },
     { "network",            "listbanned",             listbanned,             {} },
     { "network",            "clearbanned",            clearbanned,            {"manual", "automatic"} },
     { "network",            "setnetworkactive",       setnetworkactive,       {"state"} },
@@ -38,11 +38,6 @@ static RPCTimerInterface *timerInterface = nullptr;
 /* Map of name to timer. */
 static std::map<std::string, std::unique_ptr<RPCTimerBase>> deadlineTimers;
 
-struct RPCCommandExecutionInfo {
-    std::string method;
-    int64_t start;
-};
-
 struct RPCServerInfo {
     Mutex mutex;
     std::list<RPCCommandExecutionInfo> active_commands GUARDED_BY(mutex);
@@ -50,19 +45,16 @@ struct RPCServerInfo {
 
 static RPCServerInfo g_rpc_server_info;
 
-struct RPCCommandExecution {
-    std::list<RPCCommandExecutionInfo>::iterator it;
-    explicit RPCCommandExecution(const std::string &method) {
-        LOCK(g_rpc_server_info.mutex);
-        it = g_rpc_server_info.active_commands.insert(
-            g_rpc_server_info.active_commands.cend(),
-            {method, GetTimeMicros()});
-    }
-    ~RPCCommandExecution() {
-        LOCK(g_rpc_server_info.mutex);
-        g_rpc_server_info.active_commands.erase(it);
-    }
-};
+RPCCommandExecution::RPCCommandExecution(const std::string &method) {
+    LOCK(g_rpc_server_info.mutex);
+    it = g_rpc_server_info.active_commands.insert(
+        g_rpc_server_info.active_commands.cend(), {method, GetTimeMicros()});
+}
+
+RPCCommandExecution::~RPCCommandExecution() {
+    LOCK(g_rpc_server_info.mutex);
+    g_rpc_server_info.active_commands.erase(it);
+}
 
 UniValue RPCServer::ExecuteCommand(Config &config,
                                    const JSONRPCRequest &request) const {
@@ -71,6 +71,28 @@ public:
     void RegisterCommand(std::unique_ptr<RPCCommand> command);
 };
 
+struct RPCCommandExecutionInfo {
+    std::string method;
+    int64_t start;
+};
+
+/**
+ * Lists a command in the active commands of getrpcinfo for as long as it
+ * exists: while its handler runs, or while it is parked after a long-poll
+ * handler deferred its reply.
+ */
+class RPCCommandExecution {
+public:
+    explicit RPCCommandExecution(const std::string &method);
+    ~RPCCommandExecution();
+
+    RPCCommandExecution(const RPCCommandExecution &) = delete;
+    RPCCommandExecution &operator=(const RPCCommandExecution &) = delete;
+
+private:
+    std::list<RPCCommandExecutionInfo>::iterator it;
+};
+
 /**
  * Query whether RPC is running
  */
@@ -4,12 +4,22 @@
 
 #include <scheduler.h>
 
+#include <logging.h>
 #include <random.h>
 #include <reverselock.h>
 
 #include <cassert>
 #include <utility>
 
+/** Tasks running or delayed longer than this are logged, in microseconds. */
+static constexpr int64_t SLOW_TASK_THRESHOLD = 100 * 1000;
+
+static int64_t MicrosBetween(boost::chrono::system_clock::time_point from,
+                             boost::chrono::system_clock::time_point to) {
+    return boost::chrono::duration_cast<boost::chrono::microseconds>(to - from)
+        .count();
+}
+
 CScheduler::CScheduler()
     : nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false) {}
 
@@ -18,6 +28,35 @@ CScheduler::~CScheduler() {
 }
 
 void CScheduler::serviceQueue() {
+    serviceTasks(false);
+}
+
+void CScheduler::serviceHighPriorityQueue() {
+    serviceTasks(true);
+}
+
+bool CScheduler::isEmpty(bool fHighPriorityOnly) const {
+    for (size_t i = 0; i < numQueues(fHighPriorityOnly); i++) {
+        if (!taskQueues[i].empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+boost::chrono::system_clock::time_point
+CScheduler::firstTaskTime(bool fHighPriorityOnly) const {
+    boost::chrono::system_clock::time_point first =
+        boost::chrono::system_clock::time_point::max();
+    for (size_t i = 0; i < numQueues(fHighPriorityOnly); i++) {
+        if (!taskQueues[i].empty()) {
+            first = std::min(first, taskQueues[i].begin()->first);
+        }
+    }
+    return first;
+}
+
+void CScheduler::serviceTasks(bool fHighPriorityOnly) {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
     ++nThreadsServicingQueue;
 
@@ -25,12 +64,12 @@ void CScheduler::serviceQueue() {
     // waiting or when the user's function is called.
     while (!shouldStop()) {
         try {
-            if (!shouldStop() && taskQueue.empty()) {
+            if (!shouldStop() && isEmpty(fHighPriorityOnly)) {
                 reverse_lock<boost::unique_lock<boost::mutex>> rlock(lock);
                 // Use this chance to get more entropy
                 RandAddSeedSleep();
             }
-            while (!shouldStop() && taskQueue.empty()) {
+            while (!shouldStop() && isEmpty(fHighPriorityOnly)) {
                 // Wait until there is something to do.
                 newTaskScheduled.wait(lock);
             }
@@ -40,9 +79,9 @@ void CScheduler::serviceQueue() {
             // Some boost versions have a conflicting overload of wait_until
             // that returns void. Explicitly use a template here to avoid
             // hitting that overload.
-            while (!shouldStop() && !taskQueue.empty()) {
+            while (!shouldStop() && !isEmpty(fHighPriorityOnly)) {
                 boost::chrono::system_clock::time_point timeToWaitFor =
-                    taskQueue.begin()->first;
+                    firstTaskTime(fHighPriorityOnly);
                 try {
                     if (newTaskScheduled.wait_until<>(lock, timeToWaitFor) ==
                         boost::cv_status::timeout) {
@@ -69,18 +108,52 @@ void CScheduler::serviceQueue() {
 
             // If there are multiple threads, the queue can empty while we're
             // waiting (another thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty()) {
+            if (shouldStop() || isEmpty(fHighPriorityOnly)) {
                 continue;
             }
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            // Take the first due task of the highest priority.
+            const boost::chrono::system_clock::time_point now =
+                boost::chrono::system_clock::now();
+            TaskQueue *queue = nullptr;
+            for (size_t i = 0; i < numQueues(fHighPriorityOnly); i++) {
+                if (!taskQueues[i].empty() &&
+                    taskQueues[i].begin()->first <= now) {
+                    queue = &taskQueues[i];
+                    break;
+                }
+            }
+            if (queue == nullptr) {
+                continue;
+            }
+            const boost::chrono::system_clock::time_point due =
+                queue->begin()->first;
+            Task task = std::move(queue->begin()->second);
+            queue->erase(queue->begin());
 
+            boost::chrono::system_clock::time_point end;
             {
                 // Unlock before calling f, so it can reschedule itself or
                 // another task without deadlocking:
                 reverse_lock<boost::unique_lock<boost::mutex>> rlock(lock);
-                f();
+                task.f();
+                end = boost::chrono::system_clock::now();
+            }
+
+            const int64_t delay = std::max<int64_t>(MicrosBetween(due, now), 0);
+            const int64_t time = MicrosBetween(now, end);
+            const std::string name = task.name.empty() ? "unnamed" : task.name;
+            TaskStats &stats = taskStats[name];
+            stats.nRuns++;
+            stats.nTotalTime += time;
+            stats.nMaxTime = std::max(stats.nMaxTime, time);
+            stats.nTotalDelay += delay;
+            stats.nMaxDelay = std::max(stats.nMaxDelay, delay);
+            if (time > SLOW_TASK_THRESHOLD || delay > SLOW_TASK_THRESHOLD) {
+                LogPrint(BCLog::BENCH,
+                         "Scheduler task %s started %.2fms late and ran for "
+                         "%.2fms\n",
+                         name, delay * 0.001, time * 0.001);
             }
         } catch (...) {
             --nThreadsServicingQueue;
@@ -88,7 +161,9 @@ void CScheduler::serviceQueue() {
         }
     }
     --nThreadsServicingQueue;
-    newTaskScheduled.notify_one();
+    // Threads servicing only high priority tasks do not notice the others
+    // draining, let them check whether to stop.
+    newTaskScheduled.notify_all();
 }
 
 void CScheduler::stop(bool drain) {
@@ -104,18 +179,25 @@ void CScheduler::stop(bool drain) {
 }
 
 void CScheduler::schedule(CScheduler::Function f,
-                          boost::chrono::system_clock::time_point t) {
+                          boost::chrono::system_clock::time_point t,
+                          const std::string &name, Priority priority) {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueues[static_cast<size_t>(priority)].insert(
+            std::make_pair(t, Task{std::move(f), name}));
     }
-    newTaskScheduled.notify_one();
+    // Threads servicing only high priority tasks ignore the others, so wake
+    // them all.
+    newTaskScheduled.notify_all();
 }
 
 void CScheduler::scheduleFromNow(CScheduler::Function f,
-                                 int64_t deltaMilliSeconds) {
-    schedule(f, boost::chrono::system_clock::now() +
-                    boost::chrono::milliseconds(deltaMilliSeconds));
+                                 int64_t deltaMilliSeconds,
+                                 const std::string &name, Priority priority) {
+    schedule(std::move(f),
+             boost::chrono::system_clock::now() +
+                 boost::chrono::milliseconds(deltaMilliSeconds),
+             name, priority);
 }
 
 void CScheduler::MockForward(boost::chrono::seconds delta_seconds) {
@@ -125,18 +207,19 @@ void CScheduler::MockForward(boost::chrono::seconds delta_seconds) {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
 
-        // use temp_queue to maintain updated schedule
-        std::multimap<boost::chrono::system_clock::time_point, Function>
-            temp_queue;
+        for (TaskQueue &taskQueue : taskQueues) {
+            // use temp_queue to maintain updated schedule
+            TaskQueue temp_queue;
 
-        for (const auto &element : taskQueue) {
-            temp_queue.emplace_hint(temp_queue.cend(),
-                                    element.first - delta_seconds,
-                                    element.second);
-        }
+            for (const auto &element : taskQueue) {
+                temp_queue.emplace_hint(temp_queue.cend(),
+                                        element.first - delta_seconds,
+                                        element.second);
+            }
 
-        // point taskQueue to temp_queue
-        taskQueue = std::move(temp_queue);
+            // point taskQueue to temp_queue
+            taskQueue = std::move(temp_queue);
+        }
     }
 
     // notify that the taskQueue needs to be processed
@@ -144,27 +227,39 @@ void CScheduler::MockForward(boost::chrono::seconds delta_seconds) {
 }
 
 static void Repeat(CScheduler *s, CScheduler::Predicate p,
-                   int64_t deltaMilliSeconds) {
+                   int64_t deltaMilliSeconds, const std::string &name,
+                   CScheduler::Priority priority) {
     if (p()) {
-        s->scheduleFromNow(std::bind(&Repeat, s, p, deltaMilliSeconds),
-                           deltaMilliSeconds);
+        s->scheduleFromNow(
+            std::bind(&Repeat, s, p, deltaMilliSeconds, name, priority),
+            deltaMilliSeconds, name, priority);
     }
 }
 
 void CScheduler::scheduleEvery(CScheduler::Predicate p,
-                               int64_t deltaMilliSeconds) {
-    scheduleFromNow(std::bind(&Repeat, this, p, deltaMilliSeconds),
-                    deltaMilliSeconds);
+                               int64_t deltaMilliSeconds,
+                               const std::string &name, Priority priority) {
+    scheduleFromNow(
+        std::bind(&Repeat, this, p, deltaMilliSeconds, name, priority),
+        deltaMilliSeconds, name, priority);
 }
 
 size_t
 CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
                          boost::chrono::system_clock::time_point &last) const {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
-    size_t result = taskQueue.size();
-    if (!taskQueue.empty()) {
-        first = taskQueue.begin()->first;
-        last = taskQueue.rbegin()->first;
+    size_t result = 0;
+    for (const TaskQueue &taskQueue : taskQueues) {
+        if (taskQueue.empty()) {
+            continue;
+        }
+        if (result == 0 || taskQueue.begin()->first < first) {
+            first = taskQueue.begin()->first;
+        }
+        if (result == 0 || taskQueue.rbegin()->first > last) {
+            last = taskQueue.rbegin()->first;
+        }
+        result += taskQueue.size();
     }
     return result;
 }
@@ -174,6 +269,11 @@ bool CScheduler::AreThreadsServicingQueue() const {
     return nThreadsServicingQueue;
 }
 
+std::map<std::string, CScheduler::TaskStats> CScheduler::GetTaskStats() const {
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    return taskStats;
+}
+
 void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
     {
         LOCK(m_cs_callbacks_pending);
@@ -188,7 +288,9 @@ void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
         }
     }
     m_pscheduler->schedule(
-        std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this));
+        std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this),
+        boost::chrono::system_clock::now(), m_name,
+        CScheduler::Priority::HIGH);
 }
 
 void SingleThreadedSchedulerClient::ProcessQueue() {
@@ -15,7 +15,14 @@
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
 
+#include <cstdint>
 #include <map>
+#include <string>
+
+/** Default for -schedulerthreads */
+static constexpr int DEFAULT_SCHEDULER_THREADS = 1;
+/** Maximum for -schedulerthreads */
+static constexpr int MAX_SCHEDULER_THREADS = 8;
 
 //
 // Simple class for background tasks that should be run periodically or once
@@ -28,6 +35,11 @@
 // s->scheduleFromNow(std::bind(Class::func, this, argument), 3);
 // boost::thread* t = new boost::thread(std::bind(CScheduler::serviceQueue, s));
 //
+// Tasks are scheduled on one of two priority lanes. Threads running
+// serviceQueue start due high priority tasks first, while threads running
+// serviceHighPriorityQueue only run those, so that a long maintenance task
+// cannot hold back latency-sensitive callbacks.
+//
 // ... then at program shutdown, clean up the thread running serviceQueue:
 // t->interrupt();
 // t->join();
@@ -43,19 +55,43 @@ public:
     typedef std::function<void()> Function;
     typedef std::function<bool()> Predicate;
 
-    // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t =
-                                  boost::chrono::system_clock::now());
+    enum class Priority {
+        //! Callbacks something is waiting on, e.g. validation notifications
+        HIGH,
+        //! Periodic maintenance
+        LOW,
+    };
+
+    //! Run time of the tasks of one name, in microseconds.
+    struct TaskStats {
+        uint64_t nRuns = 0;
+        int64_t nTotalTime = 0;
+        int64_t nMaxTime = 0;
+        //! Time between when tasks were due and when they started.
+        int64_t nTotalDelay = 0;
+        int64_t nMaxDelay = 0;
+    };
+
+    // Call func at/after time t. The name identifies the task in the run time
+    // statistics.
+    void schedule(Function f,
+                  boost::chrono::system_clock::time_point t =
+                      boost::chrono::system_clock::now(),
+                  const std::string &name = "", Priority priority = Priority::LOW);
 
     // Convenience method: call f once deltaMilliSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaMilliSeconds);
+    void scheduleFromNow(Function f, int64_t deltaMilliSeconds,
+                         const std::string &name = "",
+                         Priority priority = Priority::LOW);
 
     // Another convenience method: call p approximately every deltaMilliSeconds
     // forever, starting deltaMilliSeconds from now untill p returns false. To
     // be more precise: every time p is finished, it is rescheduled to run
     // deltaMilliSeconds later. If you need more accurate scheduling, don't use
     // this method.
-    void scheduleEvery(Predicate p, int64_t deltaMilliSeconds);
+    void scheduleEvery(Predicate p, int64_t deltaMilliSeconds,
+                       const std::string &name = "",
+                       Priority priority = Priority::LOW);
 
     /**
      * Mock the scheduler to fast forward in time.
@@ -70,6 +106,9 @@ public:
     // using boost::interrupt_thread
     void serviceQueue();
 
+    // Same as serviceQueue, but only runs high priority tasks.
+    void serviceHighPriorityQueue();
+
     // Tell any threads running serviceQueue to stop as soon as they're done
     // servicing whatever task they're currently servicing (drain=false) or when
     // there is no work left to be done (drain=true)
@@ -83,16 +122,39 @@ public:
     // Returns true if there are threads actively running in serviceQueue()
     bool AreThreadsServicingQueue() const;
 
+    // Returns the run time statistics of the tasks run so far, by name
+    std::map<std::string, TaskStats> GetTaskStats() const;
+
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    struct Task {
+        Function f;
+        std::string name;
+    };
+    typedef std::multimap<boost::chrono::system_clock::time_point, Task>
+        TaskQueue;
+
+    //! One queue per priority, highest first.
+    TaskQueue taskQueues[2];
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
     bool stopRequested;
     bool stopWhenEmpty;
+    std::map<std::string, TaskStats> taskStats;
+
     bool shouldStop() const {
-        return stopRequested || (stopWhenEmpty && taskQueue.empty());
+        return stopRequested ||
+               (stopWhenEmpty && taskQueues[0].empty() && taskQueues[1].empty());
+    }
+    void serviceTasks(bool fHighPriorityOnly);
+    //! Queues the thread picks tasks from.
+    size_t numQueues(bool fHighPriorityOnly) const {
+        return fHighPriorityOnly ? 1 : 2;
     }
+    bool isEmpty(bool fHighPriorityOnly) const;
+    //! Time of the first task among those queues, which must not be empty.
+    boost::chrono::system_clock::time_point
+    firstTaskTime(bool fHighPriorityOnly) const;
 };
 
 /**
@@ -108,6 +170,9 @@ private:
 class SingleThreadedSchedulerClient {
 private:
     CScheduler *m_pscheduler;
+    //! Name of the task processing the callbacks, which are scheduled with
+    //! high priority.
+    const std::string m_name;
 
     RecursiveMutex m_cs_callbacks_pending;
     std::list<std::function<void()>>
@@ -118,8 +183,9 @@ private:
     void ProcessQueue();
 
 public:
-    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn)
-        : m_pscheduler(pschedulerIn) {}
+    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn,
+                                           std::string name = "callbacks")
+        : m_pscheduler(pschedulerIn), m_name(std::move(name)) {}
 
     /**
      * Add a callback to be executed. Callbacks are executed serially
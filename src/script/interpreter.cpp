@@ -37,13 +37,123 @@ bool CastToBool(const valtype &vch) {
  */
 #define stacktop(i) (stack.at(stack.size() + (i)))
 #define altstacktop(i) (altstack.at(altstack.size() + (i)))
+
+namespace {
+
+/**
+ * Buffers of stack elements and stacks that went out of use during script
+ * evaluation, kept so that later pushes can reuse their memory instead of
+ * going through the allocator. There is one cache per thread, so the script
+ * check threads never contend on it, and it outlives individual EvalScript
+ * calls so that validating many inputs in a row reaches a steady state with
+ * no per-element allocations.
+ */
+class StackMemoryCache {
+private:
+    //! Elements larger than this are rare and are returned to the allocator.
+    static constexpr size_t MAX_ELEMENT_CAPACITY = MAX_SCRIPT_ELEMENT_SIZE;
+    static constexpr size_t MAX_ELEMENTS = MAX_STACK_SIZE;
+    static constexpr size_t MAX_STACKS = 8;
+
+    std::vector<valtype> m_elements;
+    std::vector<std::vector<valtype>> m_stacks;
+
+public:
+    /** Return an empty element, with some capacity if one is available. */
+    valtype TakeElement() {
+        if (m_elements.empty()) {
+            return {};
+        }
+        valtype vch = std::move(m_elements.back());
+        m_elements.pop_back();
+        return vch;
+    }
+
+    void RecycleElement(valtype &&vch) {
+        if (vch.capacity() == 0 || vch.capacity() > MAX_ELEMENT_CAPACITY ||
+            m_elements.size() >= MAX_ELEMENTS) {
+            return;
+        }
+        vch.clear();
+        m_elements.push_back(std::move(vch));
+    }
+
+    std::vector<valtype> TakeStack() {
+        if (m_stacks.empty()) {
+            return {};
+        }
+        std::vector<valtype> stack = std::move(m_stacks.back());
+        m_stacks.pop_back();
+        return stack;
+    }
+
+    void RecycleStack(std::vector<valtype> &&stack) {
+        for (valtype &vch : stack) {
+            RecycleElement(std::move(vch));
+        }
+        if (stack.capacity() == 0 || m_stacks.size() >= MAX_STACKS) {
+            return;
+        }
+        stack.clear();
+        m_stacks.push_back(std::move(stack));
+    }
+};
+
+thread_local StackMemoryCache g_stack_memory;
+
+/** Stack whose memory comes from, and returns to, the thread's cache. */
+class CachedStack {
+private:
+    std::vector<valtype> m_stack;
+
+public:
+    CachedStack() : m_stack(g_stack_memory.TakeStack()) {}
+    ~CachedStack() { g_stack_memory.RecycleStack(std::move(m_stack)); }
+
+    CachedStack(const CachedStack &) = delete;
+    CachedStack &operator=(const CachedStack &) = delete;
+
+    std::vector<valtype> &get() { return m_stack; }
+};
+
+} // namespace
+
 static inline void popstack(std::vector<valtype> &stack) {
     if (stack.empty()) {
         throw std::runtime_error("popstack(): stack empty");
     }
+    g_stack_memory.RecycleElement(std::move(stack.back()));
     stack.pop_back();
 }
 
+/** Remove an element from the middle of the stack. */
+static inline void erasestack(std::vector<valtype> &stack,
+                              std::vector<valtype>::iterator it) {
+    g_stack_memory.RecycleElement(std::move(*it));
+    stack.erase(it);
+}
+
+/** Copy of a stack element, using cached memory if available. */
+static inline valtype copyelement(const valtype &vch) {
+    valtype copy = g_stack_memory.TakeElement();
+    copy.assign(vch.begin(), vch.end());
+    return copy;
+}
+
+static inline valtype boolelement(bool fValue) {
+    valtype vch = g_stack_memory.TakeElement();
+    if (fValue) {
+        vch.push_back(1);
+    }
+    return vch;
+}
+
+static inline valtype numelement(const CScriptNum &bn) {
+    valtype vch = g_stack_memory.TakeElement();
+    bn.getvch(vch);
+    return vch;
+}
+
 int FindAndDelete(CScript &script, const CScript &b) {
     int nFound = 0;
     if (b.empty()) {
@@ -105,8 +215,6 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                 ScriptExecutionMetrics &metrics, ScriptError *serror) {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
-    static const valtype vchFalse(0);
-    static const valtype vchTrue(1, 1);
 
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
@@ -114,7 +222,8 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
     opcodetype opcode;
     valtype vchPushValue;
     std::vector<bool> vfExec;
-    std::vector<valtype> altstack;
+    CachedStack cached_altstack;
+    std::vector<valtype> &altstack = cached_altstack.get();
     set_error(serror, ScriptError::UNKNOWN);
     if (script.size() > MAX_SCRIPT_SIZE) {
         return set_error(serror, ScriptError::SCRIPT_SIZE);
@@ -151,7 +260,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                     !CheckMinimalPush(vchPushValue, opcode)) {
                     return set_error(serror, ScriptError::MINIMALDATA);
                 }
-                stack.push_back(vchPushValue);
+                stack.push_back(copyelement(vchPushValue));
             } else if (fExec || (OP_IF <= opcode && opcode <= OP_ENDIF)) {
                 switch (opcode) {
                     //
@@ -176,7 +285,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                     case OP_16: {
                         // ( -- value)
                         CScriptNum bn((int)opcode - (int)(OP_1 - 1));
-                        stack.push_back(bn.getvch());
+                        stack.push_back(numelement(bn));
                         // The result of these opcodes should always be the
                         // minimal way to push the data they push, so no need
                         // for a CheckMinimalPush here.
@@ -364,7 +473,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        altstack.push_back(stacktop(-1));
+                        altstack.push_back(std::move(stacktop(-1)));
                         popstack(stack);
                     } break;
 
@@ -374,7 +483,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                                 serror,
                                 ScriptError::INVALID_ALTSTACK_OPERATION);
                         }
-                        stack.push_back(altstacktop(-1));
+                        stack.push_back(std::move(altstacktop(-1)));
                         popstack(altstack);
                     } break;
 
@@ -394,10 +503,10 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        valtype vch1 = stacktop(-2);
-                        valtype vch2 = stacktop(-1);
-                        stack.push_back(vch1);
-                        stack.push_back(vch2);
+                        valtype vch1 = copyelement(stacktop(-2));
+                        valtype vch2 = copyelement(stacktop(-1));
+                        stack.push_back(std::move(vch1));
+                        stack.push_back(std::move(vch2));
                     } break;
 
                     case OP_3DUP: {
@@ -406,12 +515,12 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        valtype vch1 = stacktop(-3);
-                        valtype vch2 = stacktop(-2);
-                        valtype vch3 = stacktop(-1);
-                        stack.push_back(vch1);
-                        stack.push_back(vch2);
-                        stack.push_back(vch3);
+                        valtype vch1 = copyelement(stacktop(-3));
+                        valtype vch2 = copyelement(stacktop(-2));
+                        valtype vch3 = copyelement(stacktop(-1));
+                        stack.push_back(std::move(vch1));
+                        stack.push_back(std::move(vch2));
+                        stack.push_back(std::move(vch3));
                     } break;
 
                     case OP_2OVER: {
@@ -420,10 +529,10 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        valtype vch1 = stacktop(-4);
-                        valtype vch2 = stacktop(-3);
-                        stack.push_back(vch1);
-                        stack.push_back(vch2);
+                        valtype vch1 = copyelement(stacktop(-4));
+                        valtype vch2 = copyelement(stacktop(-3));
+                        stack.push_back(std::move(vch1));
+                        stack.push_back(std::move(vch2));
                     } break;
 
                     case OP_2ROT: {
@@ -432,11 +541,11 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        valtype vch1 = stacktop(-6);
-                        valtype vch2 = stacktop(-5);
+                        valtype vch1 = std::move(stacktop(-6));
+                        valtype vch2 = std::move(stacktop(-5));
                         stack.erase(stack.end() - 6, stack.end() - 4);
-                        stack.push_back(vch1);
-                        stack.push_back(vch2);
+                        stack.push_back(std::move(vch1));
+                        stack.push_back(std::move(vch2));
                     } break;
 
                     case OP_2SWAP: {
@@ -455,16 +564,15 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        valtype vch = stacktop(-1);
-                        if (CastToBool(vch)) {
-                            stack.push_back(vch);
+                        if (CastToBool(stacktop(-1))) {
+                            stack.push_back(copyelement(stacktop(-1)));
                         }
                     } break;
 
                     case OP_DEPTH: {
                         // -- stacksize
                         CScriptNum bn(stack.size());
-                        stack.push_back(bn.getvch());
+                        stack.push_back(numelement(bn));
                     } break;
 
                     case OP_DROP: {
@@ -482,8 +590,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        valtype vch = stacktop(-1);
-                        stack.push_back(vch);
+                        stack.push_back(copyelement(stacktop(-1)));
                     } break;
 
                     case OP_NIP: {
@@ -492,7 +599,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        stack.erase(stack.end() - 2);
+                        erasestack(stack, stack.end() - 2);
                     } break;
 
                     case OP_OVER: {
@@ -501,8 +608,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        valtype vch = stacktop(-2);
-                        stack.push_back(vch);
+                        stack.push_back(copyelement(stacktop(-2)));
                     } break;
 
                     case OP_PICK:
@@ -520,11 +626,13 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        valtype vch = stacktop(-n - 1);
                         if (opcode == OP_ROLL) {
+                            valtype vch = std::move(stacktop(-n - 1));
                             stack.erase(stack.end() - n - 1);
+                            stack.push_back(std::move(vch));
+                        } else {
+                            stack.push_back(copyelement(stacktop(-n - 1)));
                         }
-                        stack.push_back(vch);
                     } break;
 
                     case OP_ROT: {
@@ -554,8 +662,8 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             return set_error(
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
-                        valtype vch = stacktop(-1);
-                        stack.insert(stack.end() - 2, vch);
+                        stack.insert(stack.end() - 2,
+                                     copyelement(stacktop(-1)));
                     } break;
 
                     case OP_SIZE: {
@@ -565,7 +673,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
                         CScriptNum bn(stacktop(-1).size());
-                        stack.push_back(bn.getvch());
+                        stack.push_back(numelement(bn));
                     } break;
 
                     //
@@ -635,7 +743,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             //    fEqual = !fEqual;
                             popstack(stack);
                             popstack(stack);
-                            stack.push_back(fEqual ? vchTrue : vchFalse);
+                            stack.push_back(boolelement(fEqual));
                             if (opcode == OP_EQUALVERIFY) {
                                 if (fEqual) {
                                     popstack(stack);
@@ -688,7 +796,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                                 break;
                         }
                         popstack(stack);
-                        stack.push_back(bn.getvch());
+                        stack.push_back(numelement(bn));
                     } break;
 
                     case OP_ADD:
@@ -780,7 +888,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                         }
                         popstack(stack);
                         popstack(stack);
-                        stack.push_back(bn.getvch());
+                        stack.push_back(numelement(bn));
 
                         if (opcode == OP_NUMEQUALVERIFY) {
                             if (CastToBool(stacktop(-1))) {
@@ -805,7 +913,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                         popstack(stack);
                         popstack(stack);
                         popstack(stack);
-                        stack.push_back(fValue ? vchTrue : vchFalse);
+                        stack.push_back(boolelement(fValue));
                     } break;
 
                     //
@@ -822,11 +930,12 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                                 serror, ScriptError::INVALID_STACK_OPERATION);
                         }
                         valtype &vch = stacktop(-1);
-                        valtype vchHash((opcode == OP_RIPEMD160 ||
-                                         opcode == OP_SHA1 ||
-                                         opcode == OP_HASH160)
-                                            ? 20
-                                            : 32);
+                        valtype vchHash = g_stack_memory.TakeElement();
+                        vchHash.resize((opcode == OP_RIPEMD160 ||
+                                        opcode == OP_SHA1 ||
+                                        opcode == OP_HASH160)
+                                           ? 20
+                                           : 32);
                         if (opcode == OP_RIPEMD160) {
                             CRIPEMD160()
                                 .Write(vch.data(), vch.size())
@@ -849,7 +958,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                                 .Finalize(vchHash.data());
                         }
                         popstack(stack);
-                        stack.push_back(vchHash);
+                        stack.push_back(std::move(vchHash));
                     } break;
 
                     case OP_CODESEPARATOR: {
@@ -895,7 +1004,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
 
                         popstack(stack);
                         popstack(stack);
-                        stack.push_back(fSuccess ? vchTrue : vchFalse);
+                        stack.push_back(boolelement(fSuccess));
                         if (opcode == OP_CHECKSIGVERIFY) {
                             if (fSuccess) {
                                 popstack(stack);
@@ -944,7 +1053,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                         popstack(stack);
                         popstack(stack);
                         popstack(stack);
-                        stack.push_back(fSuccess ? vchTrue : vchFalse);
+                        stack.push_back(boolelement(fSuccess));
                         if (opcode == OP_CHECKDATASIGVERIFY) {
                             if (fSuccess) {
                                 popstack(stack);
@@ -1178,7 +1287,7 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                             popstack(stack);
                         }
 
-                        stack.push_back(fSuccess ? vchTrue : vchFalse);
+                        stack.push_back(boolelement(fSuccess));
                         if (opcode == OP_CHECKMULTISIGVERIFY) {
                             if (fSuccess) {
                                 popstack(stack);
@@ -1225,14 +1334,11 @@ bool EvalScript(std::vector<valtype> &stack, const CScript &script,
                                              ScriptError::INVALID_SPLIT_RANGE);
                         }
 
-                        // Prepare the results in their own buffer as `data`
-                        // will be invalidated.
-                        valtype n1(data.begin(), data.begin() + position);
-                        valtype n2(data.begin() + position, data.end());
-
-                        // Replace existing stack values by the new values.
-                        stacktop(-2) = std::move(n1);
-                        stacktop(-1) = std::move(n2);
+                        // The second half goes into the position element's
+                        // buffer, then the data element is truncated in place.
+                        valtype &n2 = stacktop(-1);
+                        n2.assign(data.begin() + position, data.end());
+                        stacktop(-2).resize(position);
                     } break;
 
                     case OP_REVERSEBYTES: {
@@ -1693,9 +1799,150 @@ bool GenericTransactionSignatureChecker<T>::CheckSequence(
 template class GenericTransactionSignatureChecker<CTransaction>;
 template class GenericTransactionSignatureChecker<CMutableTransaction>;
 
-bool VerifyScript(const CScript &scriptSig, const CScript &scriptPubKey,
-                  uint32_t flags, const BaseSignatureChecker &checker,
-                  ScriptExecutionMetrics &metricsOut, ScriptError *serror) {
+namespace {
+
+/**
+ * Parse a script made of exactly n data pushes into stack, the way EvalScript
+ * would push them. Returns false for anything else, including pushes that
+ * EvalScript would reject.
+ */
+bool ParsePushOnlyScript(const CScript &script, size_t n, uint32_t flags,
+                         std::vector<valtype> &stack) {
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    for (size_t i = 0; i < n; ++i) {
+        stack.push_back(g_stack_memory.TakeElement());
+        valtype &vch = stack.back();
+        if (!script.GetOp(pc, opcode, vch) || opcode > OP_PUSHDATA4 ||
+            vch.size() > MAX_SCRIPT_ELEMENT_SIZE) {
+            return false;
+        }
+        if ((flags & SCRIPT_VERIFY_MINIMALDATA) &&
+            !CheckMinimalPush(vch, opcode)) {
+            return false;
+        }
+    }
+    return pc == script.end();
+}
+
+/**
+ * The OP_CHECKSIG ending a pay-to-pubkey(-hash) locking script, followed by
+ * the checks VerifyScript does on the resulting single element stack.
+ */
+bool VerifyTemplateCheckSig(const valtype &vchSig, const valtype &vchPubKey,
+                            const CScript &scriptPubKey, uint32_t flags,
+                            const BaseSignatureChecker &checker,
+                            ScriptExecutionMetrics &metricsOut,
+                            ScriptError *serror) {
+    if (!CheckTransactionSignatureEncoding(vchSig, flags, serror) ||
+        !CheckPubKeyEncoding(vchPubKey, flags, serror)) {
+        // serror is set
+        return false;
+    }
+
+    // An empty signature leaves false on the stack.
+    if (vchSig.empty()) {
+        return set_error(serror, ScriptError::EVAL_FALSE);
+    }
+
+    // These templates have no OP_CODESEPARATOR, so the script code is the
+    // whole locking script.
+    CScript scriptCode(scriptPubKey);
+    CleanupScriptCode(scriptCode, vchSig, flags);
+    if (!checker.CheckSig(vchSig, vchPubKey, scriptCode, flags)) {
+        return set_error(serror, (flags & SCRIPT_VERIFY_NULLFAIL)
+                                     ? ScriptError::SIG_NULLFAIL
+                                     : ScriptError::EVAL_FALSE);
+    }
+
+    // A single SigCheck never trips SCRIPT_VERIFY_INPUT_SIGCHECKS, which
+    // only applies from 2 SigChecks per 26 bytes of scriptSig.
+    ScriptExecutionMetrics metrics = {};
+    metrics.nSigChecks = 1;
+    metricsOut = metrics;
+    return set_success(serror);
+}
+
+/**
+ * Verify spends of the pay-to-pubkey-hash and pay-to-pubkey templates
+ * without going through the opcode loop. Returns false if the scripts are
+ * not such a spend, or are shaped in a way the generic interpreter should
+ * judge (e.g. non-minimal pushes); otherwise the verification result and
+ * error are stored in result and serror, and are identical to what the
+ * generic interpreter produces.
+ */
+bool VerifyTemplateScript(const CScript &scriptSig,
+                          const CScript &scriptPubKey, uint32_t flags,
+                          const BaseSignatureChecker &checker,
+                          ScriptExecutionMetrics &metricsOut,
+                          ScriptError *serror, bool &result) {
+    const size_t size = scriptPubKey.size();
+    CachedStack cached_stack;
+    std::vector<valtype> &stack = cached_stack.get();
+
+    // OP_DUP OP_HASH160 <20 bytes> OP_EQUALVERIFY OP_CHECKSIG
+    if (size == 25 && scriptPubKey[0] == OP_DUP &&
+        scriptPubKey[1] == OP_HASH160 && scriptPubKey[2] == 20 &&
+        scriptPubKey[23] == OP_EQUALVERIFY && scriptPubKey[24] == OP_CHECKSIG) {
+        // <sig> <pubkey>
+        if (!ParsePushOnlyScript(scriptSig, 2, flags, stack)) {
+            return false;
+        }
+        const valtype &vchSig = stack[0];
+        const valtype &vchPubKey = stack[1];
+
+        uint8_t hash[20];
+        CHash160()
+            .Write(vchPubKey.data(), vchPubKey.size())
+            .Finalize(hash);
+        if (memcmp(hash, &scriptPubKey[3], sizeof(hash)) != 0) {
+            result = set_error(serror, ScriptError::EQUALVERIFY);
+            return true;
+        }
+
+        result = VerifyTemplateCheckSig(vchSig, vchPubKey, scriptPubKey, flags,
+                                        checker, metricsOut, serror);
+        return true;
+    }
+
+    // <33 or 65 bytes pubkey> OP_CHECKSIG
+    if ((size == 35 || size == 67) && scriptPubKey[0] == size - 2 &&
+        scriptPubKey[size - 1] == OP_CHECKSIG) {
+        // <sig>
+        if (!ParsePushOnlyScript(scriptSig, 1, flags, stack)) {
+            return false;
+        }
+        const valtype vchPubKey(scriptPubKey.begin() + 1,
+                                scriptPubKey.end() - 1);
+        result = VerifyTemplateCheckSig(stack[0], vchPubKey, scriptPubKey,
+                                        flags, checker, metricsOut, serror);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Whether evaluating a P2SH locking script on this stack succeeds. It hashes
+ * the top element and compares it to the commitment, so on success the
+ * stack is unchanged apart from the true left on top.
+ */
+bool IsMatchingP2SHCommitment(const std::vector<valtype> &stack,
+                              const CScript &scriptPubKey) {
+    // Pushing the commitment temporarily grows the stack by one element.
+    if (stack.empty() || stack.size() + 1 > MAX_STACK_SIZE) {
+        return false;
+    }
+    const valtype &vch = stack.back();
+    uint8_t hash[20];
+    CHash160().Write(vch.data(), vch.size()).Finalize(hash);
+    return memcmp(hash, &scriptPubKey[2], sizeof(hash)) == 0;
+}
+
+bool VerifyScriptImpl(const CScript &scriptSig, const CScript &scriptPubKey,
+                      uint32_t flags, const BaseSignatureChecker &checker,
+                      ScriptExecutionMetrics &metricsOut, ScriptError *serror,
+                      bool fTemplateFastPaths) {
     set_error(serror, ScriptError::UNKNOWN);
 
     // If FORKID is enabled, we also ensure strict encoding.
@@ -1707,36 +1954,58 @@ bool VerifyScript(const CScript &scriptSig, const CScript &scriptPubKey,
         return set_error(serror, ScriptError::SIG_PUSHONLY);
     }
 
+    bool fTemplateResult;
+    if (fTemplateFastPaths &&
+        VerifyTemplateScript(scriptSig, scriptPubKey, flags, checker,
+                             metricsOut, serror, fTemplateResult)) {
+        return fTemplateResult;
+    }
+
     ScriptExecutionMetrics metrics = {};
 
-    std::vector<valtype> stack, stackCopy;
+    CachedStack cached_stack, cached_stack_copy;
+    std::vector<valtype> &stack = cached_stack.get();
+    std::vector<valtype> &stackCopy = cached_stack_copy.get();
     if (!EvalScript(stack, scriptSig, flags, checker, metrics, serror)) {
         // serror is set
         return false;
     }
-    if (flags & SCRIPT_VERIFY_P2SH) {
-        stackCopy = stack;
-    }
-    if (!EvalScript(stack, scriptPubKey, flags, checker, metrics, serror)) {
-        // serror is set
-        return false;
-    }
-    if (stack.empty()) {
-        return set_error(serror, ScriptError::EVAL_FALSE);
-    }
-    if (CastToBool(stack.back()) == false) {
-        return set_error(serror, ScriptError::EVAL_FALSE);
+
+    const bool fP2SH =
+        (flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash();
+    // When the P2SH commitment matches, evaluating the locking script would
+    // not change the stack we restore below, so skip both the evaluation and
+    // the copy.
+    const bool fP2SHMatched = fTemplateFastPaths && fP2SH &&
+                              IsMatchingP2SHCommitment(stack, scriptPubKey);
+    if (!fP2SHMatched) {
+        if (flags & SCRIPT_VERIFY_P2SH) {
+            stackCopy = stack;
+        }
+        if (!EvalScript(stack, scriptPubKey, flags, checker, metrics,
+                        serror)) {
+            // serror is set
+            return false;
+        }
+        if (stack.empty()) {
+            return set_error(serror, ScriptError::EVAL_FALSE);
+        }
+        if (CastToBool(stack.back()) == false) {
+            return set_error(serror, ScriptError::EVAL_FALSE);
+        }
     }
 
     // Additional validation for spend-to-script-hash transactions:
-    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash()) {
+    if (fP2SH) {
         // scriptSig must be literals-only or validation fails
         if (!scriptSig.IsPushOnly()) {
             return set_error(serror, ScriptError::SIG_PUSHONLY);
         }
 
         // Restore stack.
-        swap(stack, stackCopy);
+        if (!fP2SHMatched) {
+            swap(stack, stackCopy);
+        }
 
         // stack cannot be empty here, because if it was the P2SH  HASH <> EQUAL
         // scriptPubKey would be evaluated with an empty stack and the
@@ -1810,3 +2079,20 @@ bool VerifyScript(const CScript &scriptSig, const CScript &scriptPubKey,
     metricsOut = metrics;
     return set_success(serror);
 }
+
+} // namespace
+
+bool VerifyScript(const CScript &scriptSig, const CScript &scriptPubKey,
+                  uint32_t flags, const BaseSignatureChecker &checker,
+                  ScriptExecutionMetrics &metricsOut, ScriptError *serror) {
+    return VerifyScriptImpl(scriptSig, scriptPubKey, flags, checker,
+                            metricsOut, serror, true);
+}
+
+bool VerifyScriptGeneric(const CScript &scriptSig, const CScript &scriptPubKey,
+                         uint32_t flags, const BaseSignatureChecker &checker,
+                         ScriptExecutionMetrics &metricsOut,
+                         ScriptError *serror) {
+    return VerifyScriptImpl(scriptSig, scriptPubKey, flags, checker,
+                            metricsOut, serror, false);
+}
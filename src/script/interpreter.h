@@ -113,6 +113,16 @@ static inline bool VerifyScript(const CScript &scriptSig,
                         serror);
 }
 
+/**
+ * VerifyScript without the shortcuts for standard templates (P2PKH, P2PK and
+ * the P2SH commitment check), i.e. always running the opcode interpreter.
+ * Results are identical; this exists to test that they are.
+ */
+bool VerifyScriptGeneric(const CScript &scriptSig, const CScript &scriptPubKey,
+                         uint32_t flags, const BaseSignatureChecker &checker,
+                         ScriptExecutionMetrics &metricsOut,
+                         ScriptError *serror = nullptr);
+
 int FindAndDelete(CScript &script, const CScript &b);
 
 #endif // BITCOIN_SCRIPT_INTERPRETER_H
@@ -359,12 +359,23 @@ public:
 
     std::vector<uint8_t> getvch() const { return serialize(m_value); }
 
+    /** Serialize into result, reusing its existing capacity. */
+    void getvch(std::vector<uint8_t> &result) const {
+        serialize(m_value, result);
+    }
+
     static std::vector<uint8_t> serialize(const int64_t &value) {
+        std::vector<uint8_t> result;
+        serialize(value, result);
+        return result;
+    }
+
+    static void serialize(const int64_t &value, std::vector<uint8_t> &result) {
+        result.clear();
         if (value == 0) {
-            return {};
+            return;
         }
 
-        std::vector<uint8_t> result;
         const bool neg = value < 0;
         uint64_t absvalue = neg ? -value : value;
 
@@ -386,8 +397,6 @@ public:
         } else if (neg) {
             result.back() |= 0x80;
         }
-
-        return result;
     }
 
 private:
@@ -86,14 +86,14 @@ void SetupExpiryHooks(CScheduler &scheduler) {
     };
     const auto InstallTask = [&scheduler] {
         // print to log in 1 second
-        scheduler.scheduleFromNow(Task, WARN_LOG_IMMEDIATE_TIME * 1000);
+        scheduler.scheduleFromNow(Task, WARN_LOG_IMMEDIATE_TIME * 1000, "softwareoutdated");
         // print to log every hour
-        scheduler.scheduleEvery([]{Task(); return true;}, WARN_LOG_INTERVAL * 1000);
+        scheduler.scheduleEvery([]{Task(); return true;}, WARN_LOG_INTERVAL * 1000, "softwareoutdated");
         const auto secondsFromNowExpiry = nTime - GetTime();
         if (secondsFromNowExpiry > WARN_LOG_IMMEDIATE_TIME && secondsFromNowExpiry != WARN_LOG_INTERVAL) {
             // schedule the task to also fire exactly 500ms after we expire
             // (if it's in the future)
-            scheduler.scheduleFromNow(Task, secondsFromNowExpiry * 1000 + 500);
+            scheduler.scheduleFromNow(Task, secondsFromNowExpiry * 1000 + 500, "softwareoutdated");
         }
     };
     if (IsOutdated()) {
@@ -106,7 +106,7 @@ void SetupExpiryHooks(CScheduler &scheduler) {
         // when we will become IsOutdated() in the futre.
         // ensure this is a future time.
         const auto millisFromNow = std::max(secondsFromNow * 1000, int64_t(100));
-        scheduler.scheduleFromNow(InstallTask, millisFromNow);
+        scheduler.scheduleFromNow(InstallTask, millisFromNow, "softwareoutdated");
     }
 }
 
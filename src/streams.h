@@ -7,6 +7,7 @@
 #define BITCOIN_STREAMS_H
 
 #include <serialize.h>
+#include <span.h>
 #include <support/allocators/zeroafterfree.h>
 
 #include <algorithm>
@@ -162,7 +163,7 @@ public:
         ::UnserializeMany(*this, std::forward<Args>(args)...);
     }
 
-    template <typename T> VectorReader &operator>>(T &obj) {
+    template <typename T> VectorReader &operator>>(T &&obj) {
         // Unserialize from this stream
         ::Unserialize(*this, obj);
         return (*this);
@@ -189,6 +190,56 @@ public:
     }
 };
 
+/**
+ * Minimal stream for reading from an existing byte span without copying it.
+ * The referenced memory must outlive the reader.
+ */
+class SpanReader {
+private:
+    const int m_type;
+    const int m_version;
+    Span<const uint8_t> m_data;
+
+public:
+    /**
+     * @param[in]  type Serialization Type
+     * @param[in]  version Serialization Version (including any flags)
+     * @param[in]  data Referenced byte span to read from
+     */
+    SpanReader(int type, int version, Span<const uint8_t> data)
+        : m_type(type), m_version(version), m_data(data) {}
+
+    template <typename T> SpanReader &operator>>(T &obj) {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    size_t size() const { return m_data.size(); }
+    bool empty() const { return m_data.size() == 0; }
+
+    void read(char *dst, size_t n) {
+        if (n == 0) {
+            return;
+        }
+        if (n > m_data.size()) {
+            throw std::ios_base::failure("SpanReader::read(): end of data");
+        }
+        memcpy(dst, m_data.data(), n);
+        m_data = m_data.subspan(n);
+    }
+
+    void ignore(size_t n) {
+        if (n > m_data.size()) {
+            throw std::ios_base::failure("SpanReader::ignore(): end of data");
+        }
+        m_data = m_data.subspan(n);
+    }
+};
+
 /**
  * Double ended buffer combining vector and stream-like interfaces.
  *
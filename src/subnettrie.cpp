@@ -0,0 +1,63 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <subnettrie.h>
+
+#include <netaddress.h>
+
+static inline int AddressBit(const uint8_t *bytes, int n) {
+    return (bytes[n >> 3] >> (7 - (n & 7))) & 1;
+}
+
+bool SubNetTrie::Insert(const CSubNet &sub_net, int64_t until) {
+    const int prefix = sub_net.GetPrefixLength();
+    if (!sub_net.IsValid() || prefix < 0) {
+        return false;
+    }
+
+    const uint8_t *bytes = sub_net.Network().GetAddressBytes();
+    uint32_t node = 0;
+    for (int n = 0; n < prefix; ++n) {
+        const int bit = AddressBit(bytes, n);
+        if (m_nodes[node].children[bit] == 0) {
+            m_nodes[node].children[bit] = m_nodes.size();
+            m_nodes.emplace_back();
+        }
+        node = m_nodes[node].children[bit];
+    }
+
+    if (m_nodes[node].until == NOT_SET) {
+        ++m_size;
+    }
+    m_nodes[node].until = until;
+    return true;
+}
+
+bool SubNetTrie::Match(const CNetAddr &addr, int64_t now) const {
+    // Same as CSubNet::Match
+    if (!addr.IsValid()) {
+        return false;
+    }
+
+    const uint8_t *bytes = addr.GetAddressBytes();
+    const int nbits = CNetAddr::GetAddressLen() * 8;
+    uint32_t node = 0;
+    for (int n = 0;; ++n) {
+        if (now < m_nodes[node].until) {
+            return true;
+        }
+        if (n == nbits) {
+            return false;
+        }
+        node = m_nodes[node].children[AddressBit(bytes, n)];
+        if (node == 0) {
+            return false;
+        }
+    }
+}
+
+void SubNetTrie::clear() {
+    m_nodes.assign(1, Node());
+    m_size = 0;
+}
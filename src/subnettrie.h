@@ -0,0 +1,56 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUBNETTRIE_H
+#define BITCOIN_SUBNETTRIE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+class CNetAddr;
+class CSubNet;
+
+/**
+ * Binary trie over the 128 bits of a CNetAddr holding CIDR subnets, each with
+ * a time until which it applies. A lookup follows the address bits from the
+ * root and checks every prefix stored on the way, so its cost depends on the
+ * address length only and not on the number of subnets.
+ *
+ * IPv4 addresses are mapped into IPv6, so all IPv4 subnets share the first 96
+ * levels. Tor addresses are matched like any other address.
+ */
+class SubNetTrie {
+public:
+    SubNetTrie() { clear(); }
+
+    /**
+     * Add sub_net, or change the time until which it applies. Returns false
+     * and does nothing if sub_net is invalid or its netmask is not a
+     * contiguous prefix.
+     */
+    bool Insert(const CSubNet &sub_net, int64_t until);
+
+    //! Return whether a subnet containing addr applies until after now
+    bool Match(const CNetAddr &addr, int64_t now) const;
+
+    void clear();
+    //! Number of subnets held
+    size_t size() const { return m_size; }
+
+private:
+    static constexpr int64_t NOT_SET = std::numeric_limits<int64_t>::min();
+
+    struct Node {
+        //! Indexes into m_nodes; 0 (the root) means there is no child
+        uint32_t children[2] = {0, 0};
+        int64_t until = NOT_SET;
+    };
+
+    std::vector<Node> m_nodes;
+    size_t m_size;
+};
+
+#endif // BITCOIN_SUBNETTRIE_H
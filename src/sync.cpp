@@ -9,10 +9,47 @@
 #include <util/strencodings.h>
 #include <util/threadnames.h>
 
+#include <chrono>
 #include <cstdio>
 #include <map>
 #include <set>
 
+#ifdef ENABLE_LOCK_HOLD_STATS
+thread_local LockHoldTimer *LockHoldTimer::g_active = nullptr;
+
+static int64_t SteadyMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+LockHoldTimer::LockHoldTimer(const void *mutex)
+    : m_mutex(mutex), m_prev(g_active) {
+    g_active = this;
+}
+
+LockHoldTimer::~LockHoldTimer() {
+    g_active = m_prev;
+}
+
+int64_t LockHoldTimer::GetHeldMicros() const {
+    return m_held + (m_depth > 0 ? SteadyMicros() - m_start : 0);
+}
+
+void LockHoldTimer::OnLocked(const void *mutex) {
+    if (mutex == m_mutex && m_depth++ == 0) {
+        m_start = SteadyMicros();
+    }
+}
+
+void LockHoldTimer::OnUnlocked(const void *mutex) {
+    // Locks taken before the timer was created are not counted.
+    if (mutex == m_mutex && m_depth > 0 && --m_depth == 0) {
+        m_held += SteadyMicros() - m_start;
+    }
+}
+#endif // ENABLE_LOCK_HOLD_STATS
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char *pszName, const char *pszFile, int nLine) {
     LogPrintf("LOCKCONTENTION: %s\n", pszName);
@@ -9,6 +9,7 @@
 #include <threadsafety.h>
 
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <thread>
 
@@ -110,6 +111,67 @@ typedef AnnotatedMixin<std::mutex> Mutex;
 void PrintLockContention(const char *pszName, const char *pszFile, int nLine);
 #endif
 
+#ifdef ENABLE_LOCK_HOLD_STATS
+/**
+ * Measures how long the current thread holds one mutex through the lock
+ * wrappers below, counting nested locks of a recursive mutex once. The most
+ * recently created timer of a thread is the one that measures.
+ */
+class LockHoldTimer {
+public:
+    template <typename Mutex>
+    explicit LockHoldTimer(Mutex &mutex)
+        : LockHoldTimer(static_cast<const void *>(
+              static_cast<typename Mutex::UniqueLock::mutex_type *>(&mutex))) {}
+    ~LockHoldTimer();
+
+    LockHoldTimer(const LockHoldTimer &) = delete;
+    LockHoldTimer &operator=(const LockHoldTimer &) = delete;
+
+    //! Time the mutex was held since the timer was created, in microseconds.
+    int64_t GetHeldMicros() const;
+
+    //! Called by the lock wrappers, if a timer is active on this thread.
+    static void Locked(const void *mutex) {
+        if (g_active) {
+            g_active->OnLocked(mutex);
+        }
+    }
+    static void Unlocked(const void *mutex) {
+        if (g_active) {
+            g_active->OnUnlocked(mutex);
+        }
+    }
+
+private:
+    static thread_local LockHoldTimer *g_active;
+
+    const void *const m_mutex;
+    LockHoldTimer *const m_prev;
+    int m_depth{0};
+    int64_t m_start{0};
+    int64_t m_held{0};
+
+    explicit LockHoldTimer(const void *mutex);
+    void OnLocked(const void *mutex);
+    void OnUnlocked(const void *mutex);
+};
+#else
+/**
+ * Lock hold times are only measured when built with ENABLE_LOCK_HOLD_STATS,
+ * so that the lock wrappers cost nothing otherwise.
+ */
+class LockHoldTimer {
+public:
+    template <typename Mutex> explicit LockHoldTimer(Mutex &mutex) {}
+
+    int64_t GetHeldMicros() const { return 0; }
+
+    static void Locked(const void *mutex) {}
+    static void Unlocked(const void *mutex) {}
+};
+#endif
+
 /** Wrapper around std::unique_lock style lock for Mutex. */
 template <typename Mutex, typename Base = typename Mutex::UniqueLock>
 class SCOPED_LOCKABLE UniqueLock : public Base {
@@ -124,6 +186,7 @@ private:
 #ifdef DEBUG_LOCKCONTENTION
         }
 #endif
+        LockHoldTimer::Locked(Base::mutex());
     }
 
     bool TryEnter(const char *pszName, const char *pszFile, int nLine) {
@@ -131,6 +194,8 @@ private:
         Base::try_lock();
         if (!Base::owns_lock()) {
             LeaveCritical();
+        } else {
+            LockHoldTimer::Locked(Base::mutex());
         }
         return Base::owns_lock();
     }
@@ -162,11 +227,23 @@ public:
 
     ~UniqueLock() UNLOCK_FUNCTION() {
         if (Base::owns_lock()) {
+            LockHoldTimer::Unlocked(Base::mutex());
             LeaveCritical();
         }
     }
 
     operator bool() { return Base::owns_lock(); }
+
+    // Temporarily releasing the lock must be seen by LockHoldTimer.
+    void unlock() UNLOCK_FUNCTION() {
+        LockHoldTimer::Unlocked(Base::mutex());
+        Base::unlock();
+    }
+
+    void lock() EXCLUSIVE_LOCK_FUNCTION() {
+        Base::lock();
+        LockHoldTimer::Locked(Base::mutex());
+    }
 };
 
 template <typename MutexArg>
@@ -191,10 +268,12 @@ using DebugLock = UniqueLock<typename std::remove_reference<
     {                                                                          \
         EnterCritical(#cs, __FILE__, __LINE__, (void *)(&cs));                 \
         (cs).lock();                                                           \
+        LockHoldTimer::Locked(&(cs));                                          \
     }
 
 #define LEAVE_CRITICAL_SECTION(cs)                                             \
     {                                                                          \
+        LockHoldTimer::Unlocked(&(cs));                                        \
         (cs).unlock();                                                         \
         LeaveCritical();                                                       \
     }
@@ -3,9 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include <addrman.h>
 
+#include <clientversion.h>
 #include <hash.h>
 #include <netbase.h>
 #include <random.h>
+#include <streams.h>
 
 #include <test/setup_common.h>
 
@@ -648,4 +650,74 @@ BOOST_AUTO_TEST_CASE(addrman_evictionworks) {
     BOOST_CHECK(addrman.SelectTriedCollision().ToString() == "[::]:0");
 }
 
+BOOST_AUTO_TEST_CASE(addrman_add_many_matches_add_one) {
+    // Add(vector) hashes the bucket positions before taking the lock; the
+    // resulting tables must be identical to adding one address at a time.
+    CAddrManTest batched;
+    CAddrManTest single;
+
+    std::vector<CAddress> vAddr;
+    for (unsigned int i = 1; i < 4 * 256; ++i) {
+        const std::string ip = strprintf("250.%i.%i.%i", 1 + (i >> 8) % 8,
+                                         (i * 7) % 256, i % 256);
+        vAddr.push_back(CAddress(ResolveService(ip, 8333), NODE_NONE));
+        if (i % 5 == 0) {
+            // Same IP on another port hits the existing entry, whose port
+            // differs from the precomputed one.
+            vAddr.push_back(
+                CAddress(ResolveService(ip, 8334 + i % 3), NODE_NONE));
+        }
+    }
+    // Unroutable addresses are rejected either way.
+    vAddr.push_back(CAddress(ResolveService("10.0.0.1", 8333), NODE_NONE));
+
+    for (int round = 0; round < 3; ++round) {
+        const CNetAddr source =
+            ResolveIP(strprintf("252.%i.%i.1", round + 1, round * 3));
+        batched.Add(vAddr, source);
+        for (const CAddress &addr : vAddr) {
+            single.Add(addr, source);
+        }
+        BOOST_CHECK_EQUAL(batched.size(), single.size());
+    }
+    BOOST_CHECK(batched.size() > 0);
+
+    CDataStream ssBatched(SER_DISK, CLIENT_VERSION);
+    CDataStream ssSingle(SER_DISK, CLIENT_VERSION);
+    ssBatched << batched;
+    ssSingle << single;
+    BOOST_CHECK(ssBatched.str() == ssSingle.str());
+}
+
+BOOST_AUTO_TEST_CASE(addrman_size_tracking) {
+    CAddrManTest addrman;
+    CNetAddr source = ResolveIP("252.2.2.2");
+
+    size_t nAdded = 0;
+    for (unsigned int i = 1; i < 20; ++i) {
+        // One address per group, so none of them collide in the new table.
+        CService addr = ResolveService("250." + std::to_string(i) + ".1.1");
+        nAdded += addrman.Add(CAddress(addr, NODE_NONE), source) ? 1 : 0;
+    }
+    BOOST_CHECK_EQUAL(addrman.size(), nAdded);
+
+    // The count survives a round trip through peers.dat.
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << addrman;
+    CAddrManTest restored(false);
+    ss >> restored;
+    BOOST_CHECK_EQUAL(restored.size(), nAdded);
+
+    // Delete goes through the same bookkeeping as Create.
+    int nId;
+    addrman.Create(CAddress(ResolveService("250.99.9.9"), NODE_NONE), source,
+                   &nId);
+    BOOST_CHECK_EQUAL(addrman.size(), nAdded + 1);
+    addrman.Delete(nId);
+    BOOST_CHECK_EQUAL(addrman.size(), nAdded);
+
+    addrman.Clear();
+    BOOST_CHECK_EQUAL(addrman.size(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,173 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcompressor.h>
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <consensus/merkle.h>
+#include <key.h>
+#include <primitives/block.h>
+#include <script/script.h>
+#include <streams.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcompressor_tests, BasicTestingSetup)
+
+static std::vector<uint8_t> RandomBytes(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (uint8_t &byte : data) {
+        byte = InsecureRandBits(8);
+    }
+    return data;
+}
+
+static CScript RandomScript() {
+    CScript script;
+    switch (InsecureRandRange(5)) {
+        case 0:
+            return script << OP_DUP << OP_HASH160 << RandomBytes(20)
+                          << OP_EQUALVERIFY << OP_CHECKSIG;
+        case 1:
+            return script << OP_HASH160 << RandomBytes(20) << OP_EQUAL;
+        case 2: {
+            CKey key;
+            key.MakeNewKey(InsecureRandBool());
+            return script << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+        }
+        case 3:
+            return script << OP_RETURN << RandomBytes(32);
+        default: {
+            std::vector<uint8_t> data = RandomBytes(InsecureRandRange(100));
+            return CScript(data.begin(), data.end());
+        }
+    }
+}
+
+static CBlock RandomBlock(size_t nTx) {
+    CBlock block;
+    block.nVersion = InsecureRand32();
+    block.hashPrevBlock = BlockHash(InsecureRand256());
+    block.nTime = InsecureRand32();
+    block.nBits = InsecureRand32();
+    block.nNonce = InsecureRand32();
+
+    for (size_t i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.nVersion = InsecureRandBool() ? 1 : InsecureRand32();
+        tx.nLockTime = InsecureRandBool() ? 0 : InsecureRand32();
+        tx.vin.resize(1 + InsecureRandRange(3));
+        for (CTxIn &txin : tx.vin) {
+            // Spend outputs of earlier transactions of the block now and then.
+            TxId txid = i > 0 && InsecureRandBool()
+                            ? block.vtx[InsecureRandRange(i)]->GetId()
+                            : TxId(InsecureRand256());
+            txin.prevout = COutPoint(txid, InsecureRandRange(4));
+            txin.scriptSig = RandomScript();
+            txin.nSequence =
+                InsecureRandBool() ? CTxIn::SEQUENCE_FINAL : InsecureRand32();
+        }
+        tx.vout.resize(1 + InsecureRandRange(3));
+        for (CTxOut &txout : tx.vout) {
+            txout.nValue =
+                int64_t(InsecureRandRange(MAX_MONEY / FIXOSHI)) * FIXOSHI;
+            txout.scriptPubKey = RandomScript();
+        }
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static std::vector<uint8_t> Serialize(const CBlock &block) {
+    std::vector<uint8_t> data;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0, block);
+    return data;
+}
+
+static void CheckRoundTrip(const CBlock &block) {
+    std::vector<uint8_t> compressed;
+    BOOST_CHECK(BlockCompression::Compress(block, compressed));
+
+    CBlock decompressed;
+    BlockCompression::Decompress(compressed, decompressed);
+    BOOST_CHECK(decompressed.GetHash() == block.GetHash());
+    BOOST_CHECK(Serialize(decompressed) == Serialize(block));
+}
+
+BOOST_AUTO_TEST_CASE(blockcompressor_roundtrip) {
+    CheckRoundTrip(Params().GenesisBlock());
+    CheckRoundTrip(CBlock());
+    for (int i = 0; i < 20; i++) {
+        CheckRoundTrip(RandomBlock(InsecureRandRange(50)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockcompressor_smaller) {
+    CBlock block = RandomBlock(200);
+    std::vector<uint8_t> compressed;
+    BOOST_CHECK(BlockCompression::Compress(block, compressed));
+    BOOST_CHECK_LT(compressed.size(), Serialize(block).size());
+}
+
+BOOST_AUTO_TEST_CASE(blockcompressor_large_script) {
+    // Scripts above MAX_SCRIPT_SIZE are replaced by CScriptCompressor, but
+    // have to be kept as they are in blocks.
+    CBlock block = RandomBlock(1);
+    CMutableTransaction tx(*block.vtx[0]);
+    std::vector<uint8_t> nops(MAX_SCRIPT_SIZE + 1, OP_NOP);
+    tx.vout[0].scriptPubKey = CScript(nops.begin(), nops.end());
+    block.vtx[0] = MakeTransactionRef(std::move(tx));
+    CheckRoundTrip(block);
+}
+
+BOOST_AUTO_TEST_CASE(blockcompressor_out_of_range) {
+    CBlock block = RandomBlock(2);
+    CMutableTransaction tx(*block.vtx[1]);
+    tx.vout[0].nValue = -FIXOSHI;
+    block.vtx[1] = MakeTransactionRef(std::move(tx));
+    std::vector<uint8_t> compressed;
+    BOOST_CHECK(!BlockCompression::Compress(block, compressed));
+}
+
+BOOST_AUTO_TEST_CASE(blockcompressor_malformed) {
+    CBlock block = RandomBlock(10);
+    std::vector<uint8_t> compressed;
+    BOOST_CHECK(BlockCompression::Compress(block, compressed));
+
+    CBlock decompressed;
+    // Truncated payloads.
+    for (size_t size = 0; size < compressed.size(); size += 7) {
+        std::vector<uint8_t> truncated(compressed.begin(),
+                                       compressed.begin() + size);
+        BOOST_CHECK_THROW(BlockCompression::Decompress(truncated, decompressed),
+                          std::ios_base::failure);
+    }
+
+    // Trailing data.
+    std::vector<uint8_t> extended = compressed;
+    extended.push_back(0);
+    BOOST_CHECK_THROW(BlockCompression::Decompress(extended, decompressed),
+                      std::ios_base::failure);
+
+    // Unknown version.
+    std::vector<uint8_t> versioned = compressed;
+    versioned[0] = BlockCompression::FORMAT_VERSION + 1;
+    BOOST_CHECK_THROW(BlockCompression::Decompress(versioned, decompressed),
+                      std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockcompressor_magic) {
+    const CMessageHeader::MessageMagic &magic = Params().DiskMagic();
+    const CMessageHeader::MessageMagic compressed =
+        BlockCompression::CompressedDiskMagic(magic);
+    BOOST_CHECK(compressed != magic);
+    // -reindex looks for the first byte of the magic.
+    BOOST_CHECK_EQUAL(compressed[0], magic[0]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
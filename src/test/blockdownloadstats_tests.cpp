@@ -0,0 +1,69 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockdownloadstats.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockdownloadstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockdownloadstats_unmeasured) {
+    BlockDownloadStats stats;
+    BOOST_CHECK(!stats.HasLatency());
+    BOOST_CHECK(!stats.HasInterval());
+    BOOST_CHECK_EQUAL(stats.GetLatency(), 0);
+    BOOST_CHECK_EQUAL(stats.GetInterval(), 0);
+    BOOST_CHECK_EQUAL(stats.GetWindow(16), 16);
+    BOOST_CHECK_EQUAL(stats.GetExpectedArrival(3), -1);
+
+    // Both are needed to size the window.
+    stats.AddLatency(1000);
+    BOOST_CHECK_EQUAL(stats.GetWindow(16), 16);
+    BOOST_CHECK_EQUAL(stats.GetExpectedArrival(0), 1000);
+}
+
+BOOST_AUTO_TEST_CASE(blockdownloadstats_smoothing) {
+    BlockDownloadStats stats;
+    stats.AddInterval(8000, 8000);
+    BOOST_CHECK_EQUAL(stats.GetInterval(), 8000);
+    BOOST_CHECK_EQUAL(stats.GetBytesPerSecond(), 1e6);
+
+    // Each sample moves the average by an eighth of the difference.
+    stats.AddInterval(16000, 8000);
+    BOOST_CHECK_EQUAL(stats.GetInterval(), 9000);
+    BOOST_CHECK_EQUAL(stats.GetBytesPerSecond(), 1e6 - 0.5e6 / 8);
+
+    stats.AddLatency(0);
+    BOOST_CHECK_EQUAL(stats.GetLatency(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(blockdownloadstats_window) {
+    // A fast peer far away: the round trip covers many blocks.
+    BlockDownloadStats fast;
+    fast.AddLatency(200000);
+    fast.AddInterval(10000, 1000000);
+    BOOST_CHECK_EQUAL(fast.GetWindow(16), 21);
+    BOOST_CHECK_EQUAL(fast.GetExpectedArrival(5), 250000);
+
+    // A slow peer nearby: few blocks in flight are enough.
+    BlockDownloadStats slow;
+    slow.AddLatency(1100000);
+    slow.AddInterval(1000000, 1000000);
+    BOOST_CHECK_EQUAL(slow.GetWindow(16), 3);
+
+    BlockDownloadStats slowest;
+    slowest.AddLatency(1000);
+    slowest.AddInterval(1000000, 1000000);
+    BOOST_CHECK_EQUAL(slowest.GetWindow(16), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    BlockDownloadStats fastest;
+    fastest.AddLatency(1000000);
+    fastest.AddInterval(1, 1000000);
+    BOOST_CHECK_EQUAL(fastest.GetWindow(16),
+                      MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
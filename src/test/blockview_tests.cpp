@@ -0,0 +1,81 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/blockview.h>
+
+#include <blockencodings.h>
+#include <consensus/merkle.h>
+#include <streams.h>
+#include <version.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockview_tests, BasicTestingSetup)
+
+static std::vector<uint8_t> SerializeBlock(const CBlock &block) {
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block;
+    return std::vector<uint8_t>(stream.begin(), stream.end());
+}
+
+BOOST_AUTO_TEST_CASE(blockview_matches_block) {
+    const CBlock block = getBlock13b8a();
+    const std::vector<uint8_t> data = SerializeBlock(block);
+    const CBlockView view(MakeSpan(data));
+
+    BOOST_CHECK(view.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(view.GetData().size(), data.size());
+    BOOST_REQUIRE_EQUAL(view.GetTxCount(), block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK_EQUAL(view.GetTxData(i).size(),
+                          ::GetSerializeSize(*block.vtx[i], PROTOCOL_VERSION));
+        BOOST_CHECK(view.GetTxId(i) == block.vtx[i]->GetId());
+        BOOST_CHECK(*view.GetTransaction(i) == *block.vtx[i]);
+    }
+
+    bool mutated = true;
+    BOOST_CHECK(view.ComputeMerkleRoot(&mutated) == block.hashMerkleRoot);
+    BOOST_CHECK(!mutated);
+
+    CBlock copy;
+    view.ToBlock(copy);
+    BOOST_CHECK(SerializeBlock(copy) == data);
+
+    const CBlockHeaderAndShortTxIDs cmpctblock(view);
+    BOOST_CHECK(cmpctblock.header.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+}
+
+BOOST_AUTO_TEST_CASE(blockview_mutated_merkle) {
+    CBlock block = getBlock13b8a();
+    // Duplicating the last transaction keeps the merkle root but is detected
+    // as a mutation, exactly as with BlockMerkleRoot.
+    block.vtx.push_back(block.vtx.back());
+    const std::vector<uint8_t> data = SerializeBlock(block);
+    const CBlockView view(MakeSpan(data));
+
+    bool mutated = false;
+    bool block_mutated = false;
+    BOOST_CHECK(view.ComputeMerkleRoot(&mutated) ==
+                BlockMerkleRoot(block, &block_mutated));
+    BOOST_CHECK_EQUAL(mutated, block_mutated);
+}
+
+BOOST_AUTO_TEST_CASE(blockview_malformed) {
+    std::vector<uint8_t> data = SerializeBlock(getBlock13b8a());
+
+    // Truncated anywhere, including within the header.
+    for (size_t size : {size_t(0), size_t(40), size_t(80), data.size() - 1}) {
+        BOOST_CHECK_THROW(CBlockView(MakeSpan(data).first(size)),
+                          std::ios_base::failure);
+    }
+
+    // Trailing garbage.
+    data.push_back(0);
+    BOOST_CHECK_THROW(CBlockView(MakeSpan(data)), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
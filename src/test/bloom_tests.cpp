@@ -6,6 +6,7 @@
 
 #include <clientversion.h>
 #include <consensus/merkle.h>
+#include <filteredblockserver.h>
 #include <key.h>
 #include <key_io.h>
 #include <merkleblock.h>
@@ -22,6 +23,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <vector>
 
 BOOST_FIXTURE_TEST_SUITE(bloom_tests, BasicTestingSetup)
@@ -275,6 +277,30 @@ BOOST_AUTO_TEST_CASE(bloom_match) {
                         "we didn't care about");
 }
 
+/**
+ * Check that matching a block through the elements extracted from its
+ * transactions gives the same merkle block and updates the filter the same
+ * way as matching the transactions directly.
+ */
+static void CheckMatchWithElements(const CBlock &block,
+                                   const CBloomFilter &filter) {
+    CBloomFilter filterDirect = filter;
+    CBloomFilter filterElements = filter;
+    std::vector<CBloomTxElements> elements;
+    for (const CTransactionRef &tx : block.vtx) {
+        elements.emplace_back(*tx);
+    }
+    CMerkleBlock direct(block, filterDirect);
+    CMerkleBlock fromElements(block, elements, filterElements);
+
+    CDataStream ssDirect(SER_NETWORK, PROTOCOL_VERSION);
+    CDataStream ssElements(SER_NETWORK, PROTOCOL_VERSION);
+    ssDirect << direct << filterDirect;
+    ssElements << fromElements << filterElements;
+    BOOST_CHECK(ssDirect.str() == ssElements.str());
+    BOOST_CHECK(direct.vMatchedTxn == fromElements.vMatchedTxn);
+}
+
 BOOST_AUTO_TEST_CASE(merkle_block_1) {
     CBlock block = getBlock13b8a();
     CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
@@ -282,6 +308,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_1) {
     filter.insert(uint256S(
         "0x74d681e0e03bafa802c8aa084379aa98d9fcd632ddc2ed9782b586ec87451f20"));
 
+    CheckMatchWithElements(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK_EQUAL(merkleBlock.header.GetHash().GetHex(),
                       block.GetHash().GetHex());
@@ -383,6 +410,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_2) {
     filter.insert(uint256S(
         "0xe980fe9f792d014e73b95203dc1335c5f9ce19ac537a419e6df5b47aecb93b70"));
 
+    CheckMatchWithElements(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -507,6 +535,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_2_reversed) {
     filter.insert(uint256S(
         "0xe980fe9f792d014e73b95203dc1335c5f9ce19ac537a419e6df5b47aecb93b70"));
 
+    CheckMatchWithElements(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -623,6 +652,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_2_with_update_none) {
     filter.insert(uint256S(
         "0xe980fe9f792d014e73b95203dc1335c5f9ce19ac537a419e6df5b47aecb93b70"));
 
+    CheckMatchWithElements(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -700,6 +730,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_3_and_serialize) {
     filter.insert(uint256S(
         "0x63194f18be0af63f2c6bc9dc0f777cbefed3d9415c4af83f3ee3a3d669c00cb5"));
 
+    CheckMatchWithElements(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -830,6 +861,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_4) {
     filter.insert(uint256S(
         "0x0a2a92f0bda4727d0a13eaddf4dd9ac6b5c61a1429e6b2b818f19b15df0ac154"));
 
+    CheckMatchWithElements(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -969,6 +1001,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_p2pubkey_only) {
     // ...and the output address of the 4th transaction
     filter.insert(ParseHex("b6efd80d99179f4f4ff6f4dd0a007d018c385d21"));
 
+    CheckMatchWithElements(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -1078,6 +1111,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_update_none) {
     // ...and the output address of the 4th transaction
     filter.insert(ParseHex("b6efd80d99179f4f4ff6f4dd0a007d018c385d21"));
 
+    CheckMatchWithElements(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -1090,6 +1124,54 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_update_none) {
     BOOST_CHECK(!filter.contains(COutPoint(txid2, 0)));
 }
 
+BOOST_AUTO_TEST_CASE(filtered_block_server) {
+    CBlock block;
+    for (int i = 0; i < 3; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(TxId(InsecureRand256()), i);
+        mtx.vin[0].scriptSig = CScript() << std::vector<uint8_t>(20, i);
+        mtx.vout.resize(1);
+        mtx.vout[0].scriptPubKey = CScript() << OP_RETURN << i;
+        block.vtx.push_back(MakeTransactionRef(mtx));
+    }
+    auto pblock = std::make_shared<const CBlock>(block);
+
+    const int nJobs = 50;
+    std::atomic<int> nDone{0};
+    std::atomic<const FilteredBlockServer::BlockElements *> first{nullptr};
+    std::atomic<bool> shared{true};
+    std::atomic<bool> complete{true};
+    {
+        FilteredBlockServer server(2);
+        for (int i = 0; i < nJobs; i++) {
+            server.Submit(pblock,
+                          [&](const CBlock &b,
+                              const FilteredBlockServer::BlockElements
+                                  &elements) {
+                              // Checked from the test thread, as Boost.Test
+                              // assertions are not thread safe.
+                              if (elements.size() != b.vtx.size()) {
+                                  complete = false;
+                              }
+                              // Elements are extracted once for the block.
+                              const FilteredBlockServer::BlockElements
+                                  *expected = nullptr;
+                              if (!first.compare_exchange_strong(expected,
+                                                                 &elements) &&
+                                  expected != &elements) {
+                                  shared = false;
+                              }
+                              nDone++;
+                          });
+        }
+        // Queued jobs still run when the server goes away.
+    }
+    BOOST_CHECK_EQUAL(nDone, nJobs);
+    BOOST_CHECK(shared);
+    BOOST_CHECK(complete);
+}
+
 static std::vector<uint8_t> RandomData() {
     uint256 r = InsecureRand256();
     return std::vector<uint8_t>(r.begin(), r.end());
@@ -12,6 +12,7 @@
 #include <keystore.h>
 #include <net.h>
 #include <net_processing.h>
+#include <netbase.h>
 #include <pow.h>
 #include <script/sign.h>
 #include <serialize.h>
@@ -411,6 +412,69 @@ static CNetAddr GenAddress() {
     return ip6(lo, hi);
 }
 
+static CNetAddr ResolveIP(const std::string &ip) {
+    CNetAddr addr;
+    LookupHost(ip.c_str(), addr, false);
+    return addr;
+}
+
+static CSubNet ResolveSubNet(const std::string &subnet) {
+    CSubNet ret;
+    LookupSubNet(subnet.c_str(), ret);
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(DoS_subnetbans) {
+    const Config &config = GetConfig();
+    auto banman = std::make_unique<BanMan>(GetDataDir() / "banlist.dat",
+                                           config.GetChainParams(), nullptr,
+                                           DEFAULT_MANUAL_BANTIME);
+    banman->ClearBanned();
+    int64_t nStartTime = GetTime();
+    // Overrides future calls to GetTime()
+    SetMockTime(nStartTime);
+
+    std::vector<CSubNet> subnets;
+    for (int i = 0; i < 1000; ++i) {
+        subnets.push_back(
+            ResolveSubNet(strprintf("10.%d.%d.0/24", i >> 8, i & 0xff)));
+    }
+    subnets.push_back(ResolveSubNet("11.0.0.1"));
+    subnets.push_back(ResolveSubNet("12.0.0.0/255.255.0.255"));
+    subnets.push_back(CSubNet());
+    BOOST_CHECK_EQUAL(banman->BanMany(subnets, 60 * 60), 1002U);
+    // Nothing is extended by banning again for the same time.
+    BOOST_CHECK_EQUAL(banman->BanMany(subnets, 60 * 60), 0U);
+
+    BOOST_CHECK(banman->IsBanned(ResolveIP("10.3.231.7")));
+    BOOST_CHECK(banman->IsBanned(ResolveIP("10.0.0.255")));
+    BOOST_CHECK(!banman->IsBanned(ResolveIP("10.3.232.7")));
+    BOOST_CHECK(banman->IsBanned(ResolveIP("11.0.0.1")));
+    BOOST_CHECK(!banman->IsBanned(ResolveIP("11.0.0.2")));
+    BOOST_CHECK(banman->IsBanned(ResolveIP("12.0.42.0")));
+    BOOST_CHECK(!banman->IsBanned(ResolveIP("12.0.42.1")));
+
+    BOOST_CHECK(banman->Unban(subnets[3]));
+    BOOST_CHECK(!banman->IsBanned(ResolveIP("10.0.3.1")));
+    BOOST_CHECK(banman->IsBanned(ResolveIP("10.0.4.1")));
+    BOOST_CHECK(banman->Unban(subnets[1001]));
+    BOOST_CHECK(!banman->IsBanned(ResolveIP("12.0.42.0")));
+
+    // A longer ban on part of a subnet outlives the subnet's own ban.
+    banman->Ban(ResolveSubNet("10.0.4.0/28"), 2 * 60 * 60);
+    SetMockTime(nStartTime + 60 * 60 + 1);
+    BOOST_CHECK(!banman->IsBanned(ResolveIP("10.0.5.1")));
+    BOOST_CHECK(banman->IsBanned(ResolveIP("10.0.4.1")));
+    BOOST_CHECK(!banman->IsBanned(ResolveIP("10.0.4.17")));
+
+    // Expired bans are swept from the tables, not just ignored.
+    BanTables banmap;
+    banman->GetBanned(banmap);
+    BOOST_CHECK_EQUAL(banmap.size(), 1U);
+
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_CASE(DoS_DiscourageRolling) {
     const Config &config = GetConfig();
     auto banman = std::make_unique<BanMan>(GetDataDir() / "banlist.dat",
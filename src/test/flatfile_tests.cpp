@@ -2,7 +2,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <fileremover.h>
 #include <flatfile.h>
+#include <flatfilewriter.h>
 
 #include <clientversion.h>
 #include <streams.h>
@@ -130,4 +132,103 @@ BOOST_AUTO_TEST_CASE(flatfile_flush) {
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1);
 }
 
+BOOST_AUTO_TEST_CASE(flatfile_writer) {
+    auto data_dir = SetDataDir("flatfile_test");
+    FlatFileSeq seq(data_dir, "w", 100);
+
+    std::vector<uint8_t> data1{1, 2, 3, 4};
+    std::vector<uint8_t> data2{5, 6, 7};
+    std::vector<uint8_t> data3{8, 9};
+    const fs::path path0 = seq.FileName(FlatFilePos(0, 0));
+    const fs::path path1 = seq.FileName(FlatFilePos(1, 0));
+
+    auto read = [&](const FlatFilePos &pos, size_t size) {
+        std::vector<uint8_t> data(size);
+        FILE *file = seq.Open(pos, true);
+        BOOST_REQUIRE(file);
+        BOOST_CHECK_EQUAL(fread(data.data(), 1, size, file), size);
+        fclose(file);
+        return data;
+    };
+
+    {
+        FlatFileWriter writer(seq, "test");
+        bool out_of_space;
+        BOOST_CHECK_EQUAL(
+            writer.Allocate(FlatFilePos(0, 0), data1.size(), out_of_space),
+            100);
+        BOOST_CHECK(!out_of_space);
+        writer.Write(FlatFilePos(0, 0), data1);
+        writer.Write(FlatFilePos(0, 4), data2);
+        // Out of order positions are written where they were reserved.
+        writer.Write(FlatFilePos(1, 10), data3);
+        writer.Write(FlatFilePos(1, 0), data1);
+
+        // Queued data is visible to readers once waited for.
+        writer.WaitForFile(0);
+        BOOST_CHECK(read(FlatFilePos(0, 0), 4) == data1);
+        BOOST_CHECK(read(FlatFilePos(0, 4), 3) == data2);
+        BOOST_CHECK_EQUAL(fs::file_size(path0), 100);
+
+        // Finalizing truncates the pre-allocated space.
+        writer.Flush(FlatFilePos(0, 7), true);
+        writer.Flush(FlatFilePos(1, 12));
+        BOOST_CHECK(writer.Sync());
+        BOOST_CHECK_EQUAL(fs::file_size(path0), 7);
+        BOOST_CHECK(read(FlatFilePos(1, 0), 4) == data1);
+        BOOST_CHECK(read(FlatFilePos(1, 10), 2) == data3);
+
+        // A finalized file is reopened for late writes.
+        writer.Write(FlatFilePos(0, 7), data3);
+        BOOST_CHECK(!writer.HasFailed());
+    }
+    // The destructor runs what is still queued.
+    BOOST_CHECK_EQUAL(fs::file_size(path0), 9);
+    BOOST_CHECK(read(FlatFilePos(0, 7), 2) == data3);
+    BOOST_CHECK_EQUAL(fs::file_size(path1), 12);
+
+    // Writes wait for room in a full queue, and data larger than the limit
+    // still gets written.
+    {
+        FlatFileWriter writer(seq, "test", 4);
+        writer.Write(FlatFilePos(2, 0), data1);
+        writer.Write(FlatFilePos(2, 4), data2);
+        writer.Write(FlatFilePos(2, 7), data3);
+        writer.Write(FlatFilePos(2, 9), std::vector<uint8_t>(10, 0xaa));
+        BOOST_CHECK(writer.Sync());
+    }
+    BOOST_CHECK(read(FlatFilePos(2, 0), 4) == data1);
+    BOOST_CHECK(read(FlatFilePos(2, 4), 3) == data2);
+    BOOST_CHECK(read(FlatFilePos(2, 7), 2) == data3);
+    BOOST_CHECK(read(FlatFilePos(2, 9), 10) == std::vector<uint8_t>(10, 0xaa));
+}
+
+BOOST_AUTO_TEST_CASE(flatfile_remover) {
+    auto data_dir = SetDataDir("flatfile_test");
+    FlatFileSeq seq(data_dir, "r", 100);
+
+    std::vector<fs::path> paths;
+    for (int i = 0; i < 3; i++) {
+        FlatFilePos pos(i, 0);
+        FILE *file = seq.Open(pos);
+        BOOST_REQUIRE(file);
+        fclose(file);
+        paths.push_back(seq.FileName(pos));
+    }
+
+    {
+        FileRemover remover("test");
+        // Missing files are skipped.
+        remover.Remove({paths[0], seq.FileName(FlatFilePos(9, 0))});
+        remover.Sync();
+        BOOST_CHECK(!fs::exists(paths[0]));
+        BOOST_CHECK(fs::exists(paths[1]));
+
+        remover.Remove({paths[1], paths[2]});
+    }
+    // The destructor removes what is still queued.
+    BOOST_CHECK(!fs::exists(paths[1]));
+    BOOST_CHECK(!fs::exists(paths[2]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
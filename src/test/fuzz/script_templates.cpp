@@ -0,0 +1,109 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <hash.h>
+#include <pubkey.h>
+#include <script/interpreter.h>
+#include <script/script.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <version.h>
+
+#include <test/fuzz/fuzz.h>
+
+#include <cassert>
+
+/**
+ * Signature checker whose verdict depends only on the signature bytes, so
+ * that fuzzed inputs reach both outcomes of every signature check.
+ */
+class FuzzedSignatureChecker : public BaseSignatureChecker {
+public:
+    bool VerifySignature(const std::vector<uint8_t> &vchSig,
+                         const CPubKey &vchPubKey,
+                         const uint256 &sighash) const final {
+        return !vchSig.empty() && (vchSig[0] & 1);
+    }
+
+    bool CheckSig(const std::vector<uint8_t> &vchSigIn,
+                  const std::vector<uint8_t> &vchPubKey,
+                  const CScript &scriptCode, uint32_t flags) const final {
+        return !vchSigIn.empty() && (vchSigIn[0] & 1);
+    }
+};
+
+/** Flags that are not forbidden by an assert */
+static bool IsValidFlagCombination(uint32_t flags) {
+    // If the CLEANSTACK flag is set, then P2SH should also be set
+    return (~flags & SCRIPT_VERIFY_CLEANSTACK) || (flags & SCRIPT_VERIFY_P2SH);
+}
+
+/**
+ * Check that the standard template shortcuts in VerifyScript agree with the
+ * generic interpreter on scripts shaped like, or almost like, P2PKH, P2PK and
+ * P2SH spends.
+ */
+void test_one_input(std::vector<uint8_t> buffer) {
+    CDataStream ds(buffer, SER_NETWORK, INIT_PROTO_VERSION);
+    try {
+        uint32_t flags;
+        uint8_t shape;
+        std::vector<uint8_t> sig, pubkey, extra;
+        ds >> flags >> shape >> sig >> pubkey >> extra;
+
+        if (!IsValidFlagCombination(flags)) {
+            return;
+        }
+
+        CScript scriptPubKey;
+        switch (shape % 4) {
+            case 0:
+                scriptPubKey =
+                    GetScriptForDestination(CKeyID(Hash160(pubkey)));
+                break;
+            case 1:
+                scriptPubKey = CScript() << pubkey << OP_CHECKSIG;
+                break;
+            case 2:
+                // P2SH with the redeem script as the last push.
+                scriptPubKey =
+                    GetScriptForDestination(CScriptID(CScript(extra.begin(),
+                                                              extra.end())));
+                break;
+            default:
+                scriptPubKey = CScript(extra.begin(), extra.end());
+                break;
+        }
+
+        CScript scriptSig;
+        if (shape & 0x10) {
+            // Arbitrary unlocking script.
+            scriptSig = CScript(sig.begin(), sig.end());
+        } else {
+            scriptSig << sig;
+            if (shape & 0x20) {
+                scriptSig << pubkey;
+            }
+            if (shape & 0x40) {
+                scriptSig << extra;
+            }
+        }
+
+        const FuzzedSignatureChecker checker;
+        ScriptExecutionMetrics metrics, metrics_generic;
+        ScriptError serror, serror_generic;
+        const bool ret = VerifyScript(scriptSig, scriptPubKey, flags, checker,
+                                      metrics, &serror);
+        const bool ret_generic =
+            VerifyScriptGeneric(scriptSig, scriptPubKey, flags, checker,
+                                metrics_generic, &serror_generic);
+        assert(ret == ret_generic);
+        assert(serror == serror_generic);
+        if (ret) {
+            assert(metrics.nSigChecks == metrics_generic.nSigChecks);
+        }
+    } catch (const std::ios_base::failure &) {
+        return;
+    }
+}
@@ -6,7 +6,9 @@
 
 #include <chain.h>
 #include <core_io.h>
+#include <hash.h>
 #include <gbtlight.h>
+#include <gbtlightstore.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <rpc/mining.h>
@@ -74,6 +76,7 @@ GBTLightSetup::GBTLightSetup() {
 }
 
 GBTLightSetup::~GBTLightSetup() {
+    gbtl::Shutdown();
     gArgs.ClearArg("-gbtstoretime");
     gArgs.ClearArg("-gbtcachesize");
 }
@@ -119,6 +122,7 @@ BOOST_AUTO_TEST_CASE(StoreDir_Cache_Works_Test) {
             // below requires cs_main
             gbtl::CacheAndSaveTxsToFile(jobId, &back);
         }
+        BOOST_CHECK(gbtl::GetJobStore().Sync());
         jobs.emplace_back(jobId);
         jobSet.insert(jobId); // ensure uniqueness
         // check that the file was created where we expect
@@ -144,6 +148,134 @@ BOOST_AUTO_TEST_CASE(StoreDir_Cache_Works_Test) {
                             "Loading txs from file or cache should yield identical txs");
     }
     BOOST_CHECK_MESSAGE(found == jobs.size(), "All should be found");
+
+    // a job still in the in-memory cache whose file was removed (expired) is written again when it is reused
+    const JobId &lastJob = jobs.back();
+    BOOST_REQUIRE(fs::remove(gbtl::GetJobDataDir() / lastJob.GetHex()));
+    {
+        LOCK(cs_main);
+        gbtl::CacheAndSaveTxsToFile(lastJob, &jobTxs.back());
+    }
+    BOOST_CHECK(gbtl::GetJobStore().Sync());
+    BOOST_CHECK(fs::exists(gbtl::GetJobDataDir() / lastJob.GetHex()));
+    CBlock fakeBlock;
+    BOOST_CHECK_NO_THROW(gbtl::LoadTxsFromFile(lastJob, fakeBlock));
+    BOOST_CHECK_MESSAGE(CompareVTX(fakeBlock.vtx, jobTxs.back()), "Loading txs from file should yield identical txs");
+}
+
+/// Job store tests:
+/// 1. Jobs are readable before they are written out
+/// 2. Each tx is written once, no matter how many jobs refer to it
+/// 3. Job files written by older versions, holding the txs themselves, are still readable
+/// 4. Tx files are only cleaned up once no job may refer to them
+BOOST_AUTO_TEST_CASE(JobStoreTest) {
+    const fs::path jobDir = GetDataDir() / "jobstore";
+    const fs::path txDir = jobDir / "txs";
+    TryCreateDirectories(txDir);
+    gbtl::JobStore store(jobDir, txDir, 3600, "gbtstoretest");
+    const auto CountTxFiles = [&txDir] {
+        return std::distance(fs::directory_iterator(txDir), fs::directory_iterator());
+    };
+
+    gbtl::JobId jobA, jobB;
+    GetRandBytes(jobA.begin(), jobA.size());
+    GetRandBytes(jobB.begin(), jobB.size());
+    std::vector<CTransactionRef> txsA = txs, txsB{txs[2], txs[0]};
+    store.Store(jobA, txsA);
+    std::vector<CTransactionRef> loaded;
+    // either still queued, or already written out
+    BOOST_CHECK(store.GetQueued(jobA, loaded) || store.ReadJobFile(jobDir / jobA.GetHex(), loaded, nullptr));
+    BOOST_CHECK(CompareVTX(loaded, txsA));
+    store.Store(jobB, txsB);
+    BOOST_CHECK(store.Sync());
+    BOOST_CHECK(!store.GetQueued(jobA, loaded));
+
+    BOOST_CHECK_EQUAL(CountTxFiles(), txs.size());
+    // job files only hold txids
+    BOOST_CHECK_EQUAL(fs::file_size(jobDir / jobB.GetHex()), 3 + 4 + 2 * 32 + 3);
+    loaded.clear();
+    BOOST_CHECK(store.ReadJobFile(jobDir / jobB.GetHex(), loaded, nullptr));
+    BOOST_CHECK(CompareVTX(loaded, txsB));
+
+    // a corrupt tx file is detected
+    {
+        fs::ofstream file(txDir / txs[0]->GetId().GetHex(), std::ios_base::binary | std::ios_base::trunc);
+        file << "junk";
+    }
+    loaded.clear();
+    BOOST_CHECK_THROW(store.ReadJobFile(jobDir / jobB.GetHex(), loaded, nullptr), std::exception);
+
+    // legacy format: "GBT", the number of txs, the txs, "GBT"
+    gbtl::JobId jobC;
+    GetRandBytes(jobC.begin(), jobC.size());
+    {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream.write("GBT", 3);
+        stream << uint32_t(txsB.size()) << *txsB[0] << *txsB[1];
+        stream.write("GBT", 3);
+        fs::ofstream file(jobDir / jobC.GetHex(), std::ios_base::binary);
+        file.write(stream.data(), stream.size());
+    }
+    loaded.clear();
+    BOOST_CHECK(store.ReadJobFile(jobDir / jobC.GetHex(), loaded, nullptr));
+    BOOST_CHECK(CompareVTX(loaded, txsB));
+
+    // too short to hold a job
+    {
+        fs::ofstream file(jobDir / "short", std::ios_base::binary);
+        file << "GBIGBI";
+    }
+    BOOST_CHECK(!store.ReadJobFile(jobDir / "short", loaded, nullptr));
+
+    const int64_t now = GetSystemTimeInSeconds();
+    BOOST_CHECK_EQUAL(store.CleanTxDir(now - 60), 0);
+    BOOST_CHECK_EQUAL(CountTxFiles(), txs.size());
+    BOOST_CHECK_EQUAL(store.CleanTxDir(now + 60), txs.size());
+    BOOST_CHECK_EQUAL(CountTxFiles(), 0);
+
+    // tx files are written again for new jobs after being cleaned up
+    store.Store(jobB, txsB);
+    BOOST_CHECK(store.Sync());
+    BOOST_CHECK_EQUAL(CountTxFiles(), 0); // jobB is already on disk
+    fs::remove(jobDir / jobB.GetHex());
+    store.Store(jobB, txsB);
+    BOOST_CHECK(store.Sync());
+    BOOST_CHECK_EQUAL(CountTxFiles(), txsB.size());
+    loaded.clear();
+    BOOST_CHECK(store.ReadJobFile(jobDir / jobB.GetHex(), loaded, nullptr));
+    BOOST_CHECK(CompareVTX(loaded, txsB));
+}
+
+/// The job id only depends on the parent and the non-coinbase txs, which is what lets submitblock recognize blocks
+/// solving a template whatever their coinbase.
+BOOST_AUTO_TEST_CASE(GetJobIdTest) {
+    BlockHash prev;
+    GetRandBytes(prev.begin(), prev.size());
+    std::vector<uint256> steps;
+    const gbtl::JobId jobId = gbtl::GetJobId(prev, txs, &steps);
+
+    std::vector<uint256> txids;
+    for (const auto &tx : txs) {
+        txids.push_back(tx->GetId());
+    }
+    BOOST_CHECK(steps == gbtl::MakeMerkleBranch(txids));
+    std::vector<uint8_t> hashSource(prev.begin(), prev.end());
+    for (const auto &h : steps) {
+        hashSource.insert(hashSource.end(), h.begin(), h.end());
+    }
+    BOOST_CHECK(jobId == Hash160(hashSource.begin(), hashSource.end()));
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout = COutPoint();
+    coinbase.vout.resize(1);
+    std::vector<CTransactionRef> vtx{MakeTransactionRef(coinbase)};
+    vtx.insert(vtx.end(), txs.begin(), txs.end());
+    BOOST_CHECK(gbtl::GetJobId(prev, vtx) == jobId);
+
+    BlockHash otherPrev;
+    GetRandBytes(otherPrev.begin(), otherPrev.size());
+    BOOST_CHECK(gbtl::GetJobId(otherPrev, txs) != jobId);
 }
 
 /// GBTLight in-memory cache tests:
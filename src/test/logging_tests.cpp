@@ -0,0 +1,138 @@
+// Copyright (c) 2019 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <logging.h>
+#include <util/time.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(logging_tests, BasicTestingSetup)
+
+static std::vector<std::string> ReadLogLines(const fs::path &path) {
+    std::vector<std::string> lines;
+    std::ifstream file(path.string());
+    std::string line;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+static void SetupFileLogger(BCLog::Logger &logger, const fs::path &path) {
+    logger.m_print_to_file = true;
+    logger.m_log_timestamps = false;
+    logger.m_file_path = path;
+    BOOST_REQUIRE(logger.OpenDebugLog());
+}
+
+BOOST_AUTO_TEST_CASE(logging_async_preserves_thread_order) {
+    const fs::path path = SetDataDir("logging_async_order") / "debug.log";
+    BCLog::Logger logger;
+    SetupFileLogger(logger, path);
+
+    logger.LogPrintStr("sync\n");
+    logger.StartAsyncWriter(1024);
+    BOOST_CHECK(logger.IsAsync());
+
+    const int num_threads = 4;
+    const int num_msgs = 200;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&logger, t] {
+            for (int i = 0; i < num_msgs; ++i) {
+                logger.LogPrintStr(strprintf("%d %d\n", t, i));
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    logger.StopAsyncWriter();
+    BOOST_CHECK(!logger.IsAsync());
+    logger.LogPrintStr("sync again\n");
+
+    const std::vector<std::string> lines = ReadLogLines(path);
+    const uint64_t dropped = logger.GetAsyncDroppedCount();
+    std::vector<int> next(num_threads, 0);
+    size_t received = 0;
+    for (size_t i = 1; i + 1 < lines.size(); ++i) {
+        int t, n;
+        if (sscanf(lines[i].c_str(), "%d %d", &t, &n) != 2) {
+            // Drop notices are the only other kind of line.
+            BOOST_CHECK(dropped > 0);
+            continue;
+        }
+        // Each thread's messages are in order, possibly with gaps for drops.
+        BOOST_CHECK(n >= next[t]);
+        next[t] = n + 1;
+        ++received;
+    }
+    BOOST_CHECK_EQUAL(received + dropped, num_threads * num_msgs);
+    BOOST_CHECK_EQUAL(lines.front(), "sync");
+    BOOST_CHECK_EQUAL(lines.back(), "sync again");
+}
+
+BOOST_AUTO_TEST_CASE(logging_async_stop_while_logging) {
+    const fs::path path = SetDataDir("logging_async_stop") / "debug.log";
+    BCLog::Logger logger;
+    SetupFileLogger(logger, path);
+
+    logger.StartAsyncWriter(1024);
+    const int num_threads = 4;
+    const int num_msgs = 2000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&logger, t] {
+            for (int i = 0; i < num_msgs; ++i) {
+                logger.LogPrintStr(strprintf("%d %d\n", t, i));
+            }
+        });
+    }
+    // Messages queued around the switch to synchronous writes are not lost.
+    logger.StopAsyncWriter();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    size_t received = 0;
+    for (const std::string &line : ReadLogLines(path)) {
+        int t, n;
+        if (sscanf(line.c_str(), "%d %d", &t, &n) == 2) {
+            ++received;
+        }
+    }
+    BOOST_CHECK_EQUAL(received + logger.GetAsyncDroppedCount(),
+                      num_threads * num_msgs);
+}
+
+BOOST_AUTO_TEST_CASE(logging_async_continued_lines) {
+    const fs::path path = SetDataDir("logging_async_continued") / "debug.log";
+    // Earlier tests may leave a mock time, which extends the timestamp.
+    SetMockTime(0);
+    BCLog::Logger logger;
+    SetupFileLogger(logger, path);
+    logger.m_log_timestamps = true;
+
+    logger.StartAsyncWriter();
+    logger.LogPrintStr("first part, ");
+    logger.LogPrintStr("second part\n");
+    logger.StopAsyncWriter();
+
+    const std::vector<std::string> lines = ReadLogLines(path);
+    BOOST_REQUIRE_EQUAL(lines.size(), 1U);
+    // Only the start of the line gets a timestamp.
+    const std::string suffix = "Z first part, second part";
+    BOOST_CHECK(lines[0].size() > suffix.size());
+    BOOST_CHECK_EQUAL(lines[0].substr(lines[0].size() - suffix.size()),
+                      suffix);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
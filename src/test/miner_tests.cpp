@@ -908,4 +908,53 @@ BOOST_AUTO_TEST_CASE(TestCBlockTemplateEntry) {
     BOOST_CHECK_EQUAL(txEntry.sigOpCount, 10);
 }
 
+BOOST_AUTO_TEST_CASE(SolveBlockHeader_threads) {
+    const auto chainparams = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params &params = chainparams->GetConsensus();
+
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.hashPrevBlock = chainparams->GenesisBlock().GetHash();
+    header.hashMerkleRoot = uint256S("0x1234");
+    header.nTime = chainparams->GenesisBlock().nTime + 1;
+    // One hash in 2^16 meets the target: more than the nonces tried before
+    // starting threads.
+    header.nBits = 0x1f00ffff;
+
+    for (unsigned int nThreads : {1, 4}) {
+        CBlockHeader solved = header;
+        uint64_t nMaxTries = 0x100000;
+        BOOST_CHECK(
+            SolveBlockHeader(&solved, params, 0x100000, nMaxTries, nThreads));
+        BOOST_CHECK(CheckProofOfWork(solved.GetHash(), solved.nBits, params));
+        BOOST_CHECK_LE(nMaxTries, 0x100000);
+        BOOST_CHECK_GT(nMaxTries, 0);
+
+        // No nonce below the one found by a single thread solves the header.
+        if (nThreads == 1) {
+            BOOST_CHECK_EQUAL(0x100000 - nMaxTries, solved.nNonce);
+            for (uint32_t n = 0; n < solved.nNonce; ++n) {
+                CBlockHeader other = solved;
+                other.nNonce = n;
+                BOOST_CHECK(
+                    !CheckProofOfWork(other.GetHash(), other.nBits, params));
+            }
+        }
+    }
+
+    // Unsolvable in the range: every nonce is tried.
+    header.nBits = 0x1b00ffff;
+    for (unsigned int nThreads : {1, 4}) {
+        CBlockHeader unsolved = header;
+        uint64_t nMaxTries = 0x10000;
+        BOOST_CHECK(!SolveBlockHeader(&unsolved, params, 0x8000, nMaxTries,
+                                      nThreads));
+        BOOST_CHECK_EQUAL(nMaxTries, 0x8000);
+        // And not more than nMaxTries of them.
+        BOOST_CHECK(!SolveBlockHeader(&unsolved, params, 0x100000, nMaxTries,
+                                      nThreads));
+        BOOST_CHECK_EQUAL(nMaxTries, 0);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include <config.h>
 #include <hash.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
 #include <serialize.h>
 #include <streams.h>
 
@@ -17,8 +18,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 
 class CAddrManSerializationMock : public CAddrMan {
 public:
@@ -340,4 +343,262 @@ BOOST_AUTO_TEST_CASE(ipv4_peer_with_ipv6_addrMe_test) {
     BOOST_CHECK(1);
 }
 
+BOOST_AUTO_TEST_CASE(tx_announcement_log) {
+    TxAnnouncementLog log;
+    std::vector<TxId> txids;
+    for (int i = 0; i < 6; ++i) {
+        txids.emplace_back(InsecureRand256());
+    }
+    auto reverse = [](std::vector<TxId> &batch) {
+        std::reverse(batch.begin(), batch.end());
+    };
+    auto collect = [&log, &reverse](NodeId id, size_t max) {
+        std::vector<TxId> visited;
+        log.ForEachUnannounced(id, reverse,
+                               [&visited, max](const TxId &txid) {
+                                   if (visited.size() == max) {
+                                       return false;
+                                   }
+                                   visited.push_back(txid);
+                                   return true;
+                               });
+        return visited;
+    };
+
+    // Nothing is kept without peers.
+    log.Append(txids[0]);
+    BOOST_CHECK_EQUAL(log.size(), 0U);
+
+    log.AddPeer(1);
+    log.Append(txids[0]);
+    log.Append(txids[1]);
+    log.AddPeer(2);
+    log.Append(txids[2]);
+    BOOST_CHECK_EQUAL(log.size(), 3U);
+
+    // Each batch is reordered once, and a peer that joined later skips what
+    // was appended before, wherever it was ordered.
+    BOOST_CHECK(collect(1, 2) == std::vector<TxId>({txids[2], txids[1]}));
+    BOOST_CHECK(collect(2, 10) == std::vector<TxId>({txids[2]}));
+    BOOST_CHECK(collect(2, 10).empty());
+
+    // Peer 1 resumes where it stopped.
+    log.Append(txids[3]);
+    log.Append(txids[4]);
+    BOOST_CHECK(collect(1, 10) ==
+                std::vector<TxId>({txids[0], txids[4], txids[3]}));
+    BOOST_CHECK_EQUAL(log.size(), 3U);
+
+    log.SkipAll(2);
+    BOOST_CHECK(collect(2, 10).empty());
+    log.Append(txids[5]);
+    BOOST_CHECK(collect(2, 10) == std::vector<TxId>({txids[5]}));
+    // Everything both peers went past was dropped with the new batch.
+    BOOST_CHECK_EQUAL(log.size(), 1U);
+
+    // Unknown peers get nothing.
+    BOOST_CHECK(collect(3, 10).empty());
+
+    // The log is not locked while visiting.
+    log.Append(txids[0]);
+    size_t size_while_visiting = 0;
+    log.ForEachUnannounced(2, reverse, [&](const TxId &txid) {
+        size_while_visiting = log.size();
+        return true;
+    });
+    BOOST_CHECK_EQUAL(size_while_visiting, 2U);
+
+    log.RemovePeer(1);
+    log.RemovePeer(2);
+    BOOST_CHECK_EQUAL(log.size(), 0U);
+
+    // A stalled peer does not keep more than the limit, and skips what was
+    // dropped.
+    TxAnnouncementLog small(3);
+    small.AddPeer(1);
+    small.AddPeer(2);
+    for (const TxId &txid : txids) {
+        small.Append(txid);
+    }
+    BOOST_CHECK_EQUAL(small.size(), 3U);
+    std::vector<TxId> visited;
+    small.ForEachUnannounced(1, reverse, [&visited](const TxId &txid) {
+        visited.push_back(txid);
+        return true;
+    });
+    BOOST_CHECK(visited == std::vector<TxId>({txids[5], txids[4], txids[3]}));
+    small.Append(txids[0]);
+    small.Append(txids[1]);
+    BOOST_CHECK_EQUAL(small.size(), 3U);
+}
+
+// Feed a large message partly through the copying path and partly straight
+// into the message buffer, as SocketHandler does.
+BOOST_AUTO_TEST_CASE(receive_msg_bytes_direct) {
+    const Config &config = GetConfig();
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(),
+               std::string{}, false);
+
+    std::vector<uint8_t> payload(3 * CNetMessage::MAX_PREALLOCATED_SIZE + 17);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = i * 7;
+    }
+    CMessageHeader hdr(config.GetChainParams().NetMagic(), NetMsgType::BLOCK,
+                       payload.size());
+    const uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream wire(SER_NETWORK, PROTOCOL_VERSION);
+    wire << hdr;
+    wire.write(reinterpret_cast<const char *>(payload.data()), payload.size());
+
+    const CNetRecvBufferStats &stats = GetNetRecvBufferStats();
+    const uint64_t nAllocations = stats.nAllocations;
+    const uint64_t nAllocatedBytes = stats.nAllocatedBytes;
+    const uint64_t nDirectBytes = stats.nDirectBytes;
+    const uint64_t nCopiedBytes = stats.nCopiedBytes;
+
+    // Nothing to read in place until the header is known.
+    BOOST_CHECK(node.GetDirectRecvBuffer(0).empty());
+    bool complete = false;
+    const size_t nFirst = CMessageHeader::HEADER_SIZE + 1000;
+    BOOST_CHECK(node.ReceiveMsgBytes(config, wire.data(), nFirst, complete));
+    BOOST_CHECK(!complete);
+
+    const size_t nMinDirect = 0x10000;
+    size_t nPos = nFirst;
+    while (true) {
+        Span<uint8_t> direct = node.GetDirectRecvBuffer(nMinDirect);
+        if (direct.empty()) {
+            break;
+        }
+        BOOST_REQUIRE(direct.size() <= wire.size() - nPos);
+        memcpy(direct.data(), wire.data() + nPos, direct.size());
+        nPos += direct.size();
+        node.ReceivedDirect(direct.size(), complete);
+        if (complete) {
+            break;
+        }
+    }
+    if (!complete) {
+        BOOST_CHECK(wire.size() - nPos < nMinDirect);
+        BOOST_CHECK(node.ReceiveMsgBytes(config, wire.data() + nPos,
+                                         wire.size() - nPos, complete));
+    }
+    BOOST_CHECK(complete);
+    BOOST_CHECK(node.GetDirectRecvBuffer(0).empty());
+
+    BOOST_CHECK_EQUAL(stats.nDirectBytes - nDirectBytes +
+                          stats.nCopiedBytes - nCopiedBytes,
+                      payload.size());
+    BOOST_CHECK(stats.nDirectBytes - nDirectBytes > payload.size() / 2);
+    // Geometric growth: a handful of allocations for the whole payload.
+    BOOST_CHECK(stats.nAllocations - nAllocations <= 4);
+    BOOST_CHECK(stats.nAllocatedBytes - nAllocatedBytes >= payload.size());
+}
+
+#ifndef WIN32
+// Check that queued messages, including payloads shared between several
+// sends, reach the socket with valid headers and in order.
+BOOST_AUTO_TEST_CASE(push_message_wire_format) {
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    const Config &config = GetConfig();
+    CConnman connman(config, 0x1337, 0x1337);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    // The node owns fds[0] and closes it.
+    auto pnode = std::make_unique<CNode>(0, NODE_NETWORK, 0, fds[0], addr, 0,
+                                         0, CAddress(), std::string{}, false);
+
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    connman.PushMessage(pnode.get(),
+                        msgMaker.Make(NetMsgType::PING, uint64_t(42)));
+    // The payload went back to the pool once sent.
+    BOOST_CHECK(GetNetMsgBufferPool().GetIdleCount() > 0);
+    connman.PushMessage(pnode.get(), msgMaker.Make(NetMsgType::VERACK));
+    const CSharedNetMsg shared(msgMaker.Make(
+        NetMsgType::INV, std::vector<CInv>(3, CInv(MSG_TX, uint256S("ab")))));
+    connman.PushMessage(pnode.get(), shared);
+    connman.PushMessage(pnode.get(), shared);
+    {
+        LOCK(pnode->cs_vSend);
+        BOOST_CHECK(pnode->vSendMsg.empty());
+        BOOST_CHECK_EQUAL(pnode->nSendSize, 0U);
+    }
+    // Sent messages don't keep a reference to the shared payload.
+    BOOST_CHECK_EQUAL(shared.data.use_count(), 1);
+
+    const std::vector<std::pair<std::string, size_t>> expected = {
+        {NetMsgType::PING, 8},
+        {NetMsgType::VERACK, 0},
+        {NetMsgType::INV, shared.data->size()},
+        {NetMsgType::INV, shared.data->size()}};
+    size_t total = 0;
+    for (const auto &msg : expected) {
+        total += CMessageHeader::HEADER_SIZE + msg.second;
+    }
+    std::vector<char> received(total);
+    size_t nRead = 0;
+    while (nRead < total) {
+        ssize_t n = recv(fds[1], received.data() + nRead, total - nRead, 0);
+        BOOST_REQUIRE(n > 0);
+        nRead += n;
+    }
+    close(fds[1]);
+
+    CDataStream stream(received.data(), received.data() + received.size(),
+                       SER_NETWORK, PROTOCOL_VERSION);
+    for (const auto &msg : expected) {
+        CMessageHeader hdr(config.GetChainParams().NetMagic());
+        stream >> hdr;
+        BOOST_CHECK(hdr.IsValid(config));
+        BOOST_CHECK_EQUAL(hdr.GetCommand(), msg.first);
+        BOOST_REQUIRE_EQUAL(hdr.nMessageSize, msg.second);
+        std::vector<uint8_t> payload(hdr.nMessageSize);
+        stream.read(reinterpret_cast<char *>(payload.data()), payload.size());
+        const uint256 hash = Hash(payload.begin(), payload.end());
+        BOOST_CHECK_EQUAL(
+            memcmp(hash.begin(), hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE),
+            0);
+    }
+    BOOST_CHECK(stream.empty());
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(msg_processing_stats) {
+    MsgProcessingStats stats;
+    stats.Add(0, 0, 5, 0);
+    stats.Add(1, 1, 10, 0);
+    stats.Add(3, 2, 1, 2);
+    stats.Add(4, 3, 0, 4);
+    stats.Add(int64_t(1) << 40, 4, 0, 0);
+    BOOST_CHECK_EQUAL(stats.nCount, 5);
+    BOOST_CHECK_EQUAL(stats.nTime, 8 + (int64_t(1) << 40));
+    BOOST_CHECK_EQUAL(stats.nMaxTime, int64_t(1) << 40);
+    BOOST_CHECK_EQUAL(stats.nCPUTime, 10);
+    BOOST_CHECK_EQUAL(stats.nQueueTime, 16);
+    BOOST_CHECK_EQUAL(stats.nMaxQueueTime, 10);
+    BOOST_CHECK_EQUAL(stats.nCsMainTime, 6);
+
+    // Bucket i counts times below 2^i us, the last one everything above.
+    BOOST_CHECK_EQUAL(stats.histogram[0], 1);
+    BOOST_CHECK_EQUAL(stats.histogram[1], 1);
+    BOOST_CHECK_EQUAL(stats.histogram[2], 1);
+    BOOST_CHECK_EQUAL(stats.histogram[3], 1);
+    BOOST_CHECK_EQUAL(stats.histogram.back(), 1);
+
+    MsgProcessingStats total;
+    total.Add(2, 0, 20, 0);
+    total += stats;
+    BOOST_CHECK_EQUAL(total.nCount, 6);
+    BOOST_CHECK_EQUAL(total.nMaxQueueTime, 20);
+    BOOST_CHECK_EQUAL(total.nCsMainTime, 6);
+    BOOST_CHECK_EQUAL(total.histogram[2], 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,12 +5,14 @@
 #include <netbase.h>
 
 #include <net_permissions.h>
+#include <subnettrie.h>
 #include <util/strencodings.h>
 
 #include <test/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
 
+#include <map>
 #include <string>
 
 BOOST_FIXTURE_TEST_SUITE(netbase_tests, BasicTestingSetup)
@@ -291,6 +293,83 @@ BOOST_AUTO_TEST_CASE(subnet_test) {
         "1:2:3:4:5:6:7:8/ffff:ffff:ffff:fffe:ffff:ffff:ffff:ff0f");
 }
 
+BOOST_AUTO_TEST_CASE(subnet_prefix_length) {
+    BOOST_CHECK_EQUAL(ResolveSubNet("1.2.3.0/24").GetPrefixLength(), 120);
+    BOOST_CHECK_EQUAL(ResolveSubNet("1.2.3.4").GetPrefixLength(), 128);
+    BOOST_CHECK_EQUAL(ResolveSubNet("0.0.0.0/0").GetPrefixLength(), 96);
+    BOOST_CHECK_EQUAL(ResolveSubNet("::/0").GetPrefixLength(), 0);
+    BOOST_CHECK_EQUAL(ResolveSubNet("2001:db8::/33").GetPrefixLength(), 33);
+    BOOST_CHECK_EQUAL(
+        ResolveSubNet("1.2.3.4/255.255.232.0").GetPrefixLength(), -1);
+    BOOST_CHECK_EQUAL(
+        ResolveSubNet("1:2:3:4:5:6:7:8/ffff:ffff:ffff:fffe:ffff:ffff:ffff:ff0f")
+            .GetPrefixLength(),
+        -1);
+}
+
+BOOST_AUTO_TEST_CASE(subnet_trie_test) {
+    SubNetTrie trie;
+    BOOST_CHECK(trie.Insert(ResolveSubNet("1.2.3.0/24"), 100));
+    BOOST_CHECK(trie.Insert(ResolveSubNet("10.0.0.0/8"), 50));
+    BOOST_CHECK(trie.Insert(ResolveSubNet("2001:470::/32"), 100));
+    BOOST_CHECK(!trie.Insert(ResolveSubNet("1.2.3.4/255.255.232.0"), 100));
+    BOOST_CHECK(!trie.Insert(CSubNet(), 100));
+    BOOST_CHECK_EQUAL(trie.size(), 3U);
+
+    // Subnets only apply before their expiry time.
+    BOOST_CHECK(trie.Match(ResolveIP("1.2.3.4"), 99));
+    BOOST_CHECK(!trie.Match(ResolveIP("1.2.3.4"), 100));
+    BOOST_CHECK(trie.Match(ResolveIP("10.20.30.40"), 49));
+    BOOST_CHECK(!trie.Match(ResolveIP("10.20.30.40"), 50));
+    BOOST_CHECK(!trie.Match(ResolveIP("1.2.4.1"), 0));
+    BOOST_CHECK(trie.Match(ResolveIP("2001:470::1"), 0));
+    BOOST_CHECK(!trie.Match(ResolveIP("2001:471::1"), 0));
+    BOOST_CHECK(!trie.Match(ResolveIP("257.0.0.1"), 0));
+
+    // Updating a subnet doesn't add another one, and a longer prefix can
+    // outlive a shorter one.
+    BOOST_CHECK(trie.Insert(ResolveSubNet("10.0.0.0/8"), 200));
+    BOOST_CHECK(trie.Insert(ResolveSubNet("10.1.0.0/16"), 300));
+    BOOST_CHECK_EQUAL(trie.size(), 4U);
+    BOOST_CHECK(trie.Match(ResolveIP("10.2.0.1"), 150));
+    BOOST_CHECK(!trie.Match(ResolveIP("10.2.0.1"), 250));
+    BOOST_CHECK(trie.Match(ResolveIP("10.1.0.1"), 250));
+
+    // IPv4 subnets never match IPv6 addresses, but ::/0 matches everything.
+    BOOST_CHECK(trie.Insert(ResolveSubNet("0.0.0.0/0"), 400));
+    BOOST_CHECK(!trie.Match(ResolveIP("2001:471::1"), 350));
+    BOOST_CHECK(trie.Match(ResolveIP("8.8.8.8"), 350));
+    BOOST_CHECK(trie.Insert(ResolveSubNet("::/0"), 500));
+    BOOST_CHECK(trie.Match(ResolveIP("2001:471::1"), 450));
+
+    trie.clear();
+    BOOST_CHECK_EQUAL(trie.size(), 0U);
+    BOOST_CHECK(!trie.Match(ResolveIP("8.8.8.8"), 0));
+
+    // Compare against CSubNet::Match on random subnets within 10.0.0.0/7.
+    // Like the ban tables, keep a single expiry time per subnet.
+    std::map<CSubNet, int64_t> subnets;
+    for (int i = 0; i < 200; ++i) {
+        struct in_addr in;
+        in.s_addr = htonl(0x0a000000 | InsecureRandBits(25));
+        const CSubNet subnet(CNetAddr(in), 7 + InsecureRandRange(26));
+        const int64_t until = InsecureRandRange(100);
+        trie.Insert(subnet, until);
+        subnets[subnet] = until;
+    }
+    for (int i = 0; i < 2000; ++i) {
+        struct in_addr in;
+        in.s_addr = htonl(0x0a000000 | InsecureRandBits(25));
+        const CNetAddr addr(in);
+        const int64_t now = InsecureRandRange(100);
+        bool expected = false;
+        for (const auto &entry : subnets) {
+            expected |= now < entry.second && entry.first.Match(addr);
+        }
+        BOOST_CHECK_EQUAL(trie.Match(addr, now), expected);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(netbase_getgroup) {
     typedef std::vector<uint8_t> Vec8;
     // Local -> !Routable()
@@ -451,6 +530,13 @@ BOOST_AUTO_TEST_CASE(netpermissions_test) {
     BOOST_CHECK(NetWhitelistPermissions::TryParse(
         "bloom,forcerelay,noban,relay,mempool@1.2.3.4/32", whitelistPermissions,
         error));
+    BOOST_CHECK(NetWhitelistPermissions::TryParse(
+        "fastblockrelay@1.2.3.4/32", whitelistPermissions, error));
+    BOOST_CHECK_EQUAL(whitelistPermissions.m_flags, PF_FASTBLOCKRELAY);
+    BOOST_CHECK(NetWhitelistPermissions::TryParse(
+        "all@1.2.3.4/32", whitelistPermissions, error));
+    BOOST_CHECK(!NetPermissions::HasFlag(whitelistPermissions.m_flags,
+                                         PF_FASTBLOCKRELAY));
 
     const auto strings = NetPermissions::ToStrings(PF_ALL);
     BOOST_CHECK_EQUAL(strings.size(), 5);
@@ -464,6 +550,8 @@ BOOST_AUTO_TEST_CASE(netpermissions_test) {
                 strings.end());
     BOOST_CHECK(std::find(strings.begin(), strings.end(), "mempool") !=
                 strings.end());
+    BOOST_CHECK(std::find(strings.begin(), strings.end(), "fastblockrelay") ==
+                strings.end());
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -228,6 +228,79 @@ BOOST_AUTO_TEST_CASE(singlethreadedscheduler_ordered) {
     BOOST_CHECK_EQUAL(counter2, 100);
 }
 
+BOOST_AUTO_TEST_CASE(scheduler_priority_order) {
+    CScheduler scheduler;
+    std::vector<int> order;
+
+    // Of the tasks due, high priority ones start first.
+    const boost::chrono::system_clock::time_point past =
+        boost::chrono::system_clock::now() - boost::chrono::seconds(1);
+    scheduler.schedule([&order] { order.push_back(1); }, past);
+    scheduler.schedule([&order] { order.push_back(2); },
+                       past + boost::chrono::milliseconds(1), "",
+                       CScheduler::Priority::HIGH);
+    scheduler.schedule([&order] { order.push_back(3); }, past);
+
+    std::thread scheduler_thread([&]() { scheduler.serviceQueue(); });
+    scheduler.stop(true);
+    scheduler_thread.join();
+
+    BOOST_CHECK(order == std::vector<int>({2, 1, 3}));
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_priority_lanes) {
+    CScheduler scheduler;
+    std::atomic<bool> slowStarted{false};
+    std::atomic<bool> slowRelease{false};
+    std::atomic<bool> fastRan{false};
+    std::atomic<bool> lowRan{false};
+
+    scheduler.schedule(
+        [&] {
+            slowStarted = true;
+            while (!slowRelease) {
+                MicroSleep(1000);
+            }
+        },
+        boost::chrono::system_clock::now(), "slow");
+    std::thread scheduler_thread([&]() { scheduler.serviceQueue(); });
+    while (!slowStarted) {
+        MicroSleep(1000);
+    }
+
+    // While the maintenance task runs, the thread reserved for high priority
+    // tasks runs them, but nothing else.
+    std::thread high_thread(
+        [&]() { scheduler.serviceHighPriorityQueue(); });
+    scheduler.schedule([&] { lowRan = true; });
+    scheduler.schedule([&] { fastRan = true; },
+                       boost::chrono::system_clock::now(), "fast",
+                       CScheduler::Priority::HIGH);
+    for (int i = 0; i < 1000 && !fastRan; i++) {
+        MicroSleep(1000);
+    }
+    BOOST_CHECK(fastRan);
+    MicroSleep(20000);
+    BOOST_CHECK(!lowRan);
+
+    slowRelease = true;
+    scheduler.stop(true);
+    scheduler_thread.join();
+    high_thread.join();
+    BOOST_CHECK(lowRan);
+
+    const std::map<std::string, CScheduler::TaskStats> stats =
+        scheduler.GetTaskStats();
+    BOOST_CHECK_EQUAL(stats.size(), 3);
+    BOOST_CHECK_EQUAL(stats.at("slow").nRuns, 1);
+    BOOST_CHECK_GE(stats.at("slow").nMaxTime, 20000);
+    BOOST_CHECK_EQUAL(stats.at("slow").nMaxTime, stats.at("slow").nTotalTime);
+    BOOST_CHECK_EQUAL(stats.at("fast").nRuns, 1);
+    // The unnamed task waited for the slow one.
+    BOOST_CHECK_EQUAL(stats.at("unnamed").nRuns, 1);
+    BOOST_CHECK_GE(stats.at("unnamed").nMaxDelay, 20000);
+}
+
 BOOST_AUTO_TEST_CASE(mockforward)
 {
     CScheduler scheduler;
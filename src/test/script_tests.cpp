@@ -144,6 +144,25 @@ static void DoTest(const CScript &scriptPubKey, const CScript &scriptSig,
                             std::string(FormatScriptError(scriptError)) +
                             " expected: " + message);
 
+    // The standard template shortcuts must agree with the generic
+    // interpreter, including on the error and the SigChecks count.
+    {
+        const MutableTransactionSignatureChecker checker(
+            &tx, 0, txCredit.vout[0].nValue);
+        ScriptExecutionMetrics metrics, metrics_generic;
+        ScriptError err_generic;
+        const bool ret = VerifyScript(scriptSig, scriptPubKey, flags, checker,
+                                      metrics, &err);
+        const bool ret_generic =
+            VerifyScriptGeneric(scriptSig, scriptPubKey, flags, checker,
+                                metrics_generic, &err_generic);
+        BOOST_CHECK_MESSAGE(ret == ret_generic && err == err_generic,
+                            "template shortcut mismatch: " + message);
+        if (ret) {
+            BOOST_CHECK_EQUAL(metrics.nSigChecks, metrics_generic.nSigChecks);
+        }
+    }
+
     // Verify that removing flags from a passing test or adding flags to a
     // failing test does not change the result, except for some special flags.
     for (int i = 0; i < 16; ++i) {
@@ -4,6 +4,7 @@
 
 #include <sync.h>
 #include <test/setup_common.h>
+#include <util/time.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -45,4 +46,57 @@ BOOST_AUTO_TEST_CASE(potential_deadlock_detected) {
 #endif
 }
 
+#ifdef ENABLE_LOCK_HOLD_STATS
+BOOST_AUTO_TEST_CASE(lock_hold_timer) {
+    RecursiveMutex rmutex;
+    Mutex other;
+    LockHoldTimer timer(rmutex);
+    BOOST_CHECK_EQUAL(timer.GetHeldMicros(), 0);
+
+    {
+        LOCK(other);
+        UninterruptibleSleep(std::chrono::milliseconds{10});
+    }
+    BOOST_CHECK_EQUAL(timer.GetHeldMicros(), 0);
+
+    {
+        LOCK(rmutex);
+        // A recursive lock does not restart the measurement.
+        {
+            LOCK(rmutex);
+        }
+        UninterruptibleSleep(std::chrono::milliseconds{10});
+        // The time it is held so far is included.
+        BOOST_CHECK_GE(timer.GetHeldMicros(), 10000);
+    }
+    const int64_t held = timer.GetHeldMicros();
+    BOOST_CHECK_GE(held, 10000);
+
+    UninterruptibleSleep(std::chrono::milliseconds{10});
+    BOOST_CHECK_EQUAL(timer.GetHeldMicros(), held);
+
+    {
+        // Only the most recent timer of the thread measures.
+        LockHoldTimer inner(other);
+        LOCK(rmutex);
+    }
+    BOOST_CHECK_EQUAL(timer.GetHeldMicros(), held);
+
+    {
+        // Time spent with the lock temporarily released is not counted.
+        WAIT_LOCK(rmutex, lock);
+        lock.unlock();
+        UninterruptibleSleep(std::chrono::milliseconds{10});
+        lock.lock();
+    }
+    BOOST_CHECK_LT(timer.GetHeldMicros(), held + 10000);
+
+    const int64_t held_before_enter = timer.GetHeldMicros();
+    ENTER_CRITICAL_SECTION(rmutex);
+    UninterruptibleSleep(std::chrono::milliseconds{10});
+    LEAVE_CRITICAL_SECTION(rmutex);
+    BOOST_CHECK_GE(timer.GetHeldMicros(), held_before_enter + 10000);
+}
+#endif // ENABLE_LOCK_HOLD_STATS
+
 BOOST_AUTO_TEST_SUITE_END()
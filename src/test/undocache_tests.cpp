@@ -0,0 +1,89 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <undocache.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(undocache_tests, BasicTestingSetup)
+
+static CBlockUndo MakeUndo(size_t nInputs) {
+    CBlockUndo undo;
+    undo.vtxundo.resize(1);
+    for (size_t i = 0; i < nInputs; i++) {
+        CTxOut out(int64_t(i) * FIXOSHI, CScript() << OP_TRUE);
+        undo.vtxundo[0].vprevout.emplace_back(std::move(out), i, false);
+    }
+    return undo;
+}
+
+BOOST_AUTO_TEST_CASE(undocache_add_get) {
+    UndoCache cache(1 << 20);
+    const BlockHash hash(InsecureRand256());
+    BOOST_CHECK(!cache.Get(hash));
+
+    cache.Add(hash, MakeUndo(3));
+    auto undo = cache.Get(hash);
+    BOOST_REQUIRE(undo);
+    BOOST_CHECK_EQUAL(undo->vtxundo[0].vprevout.size(), 3);
+    BOOST_CHECK(undo->vtxundo[0].vprevout[2].GetTxOut().nValue ==
+                2 * FIXOSHI);
+    BOOST_CHECK_EQUAL(cache.Size(), 1);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(),
+                      UndoCache::EntryUsage(MakeUndo(3)));
+
+    // Adding the same block again keeps a single entry.
+    cache.Add(hash, MakeUndo(3));
+    BOOST_CHECK_EQUAL(cache.Size(), 1);
+
+    cache.Clear();
+    BOOST_CHECK(!cache.Get(hash));
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(undocache_eviction) {
+    const size_t entry_usage = UndoCache::EntryUsage(MakeUndo(10));
+    UndoCache cache(3 * entry_usage);
+
+    std::vector<BlockHash> hashes;
+    for (int i = 0; i < 3; i++) {
+        hashes.emplace_back(InsecureRand256());
+        cache.Add(hashes.back(), MakeUndo(10));
+    }
+    BOOST_CHECK_EQUAL(cache.Size(), 3);
+
+    // Using the oldest entry makes the second one the least recently used.
+    BOOST_CHECK(cache.Get(hashes[0]));
+    hashes.emplace_back(InsecureRand256());
+    cache.Add(hashes.back(), MakeUndo(10));
+    BOOST_CHECK_EQUAL(cache.Size(), 3);
+    BOOST_CHECK(cache.Get(hashes[0]));
+    BOOST_CHECK(!cache.Get(hashes[1]));
+    BOOST_CHECK(cache.Get(hashes[2]));
+    BOOST_CHECK(cache.Get(hashes[3]));
+    BOOST_CHECK_LE(cache.DynamicMemoryUsage(), 3 * entry_usage);
+
+    // Shrinking the cache evicts the least recently used entries.
+    cache.SetMaxUsage(entry_usage);
+    BOOST_CHECK_EQUAL(cache.Size(), 1);
+    BOOST_CHECK(cache.Get(hashes[3]));
+
+    // Entries larger than the cache are not kept.
+    const BlockHash large(InsecureRand256());
+    cache.Add(large, MakeUndo(1000));
+    BOOST_CHECK(!cache.Get(large));
+    BOOST_CHECK(cache.Get(hashes[3]));
+}
+
+BOOST_AUTO_TEST_CASE(undocache_disabled) {
+    UndoCache cache;
+    const BlockHash hash(InsecureRand256());
+    cache.Add(hash, MakeUndo(1));
+    BOOST_CHECK(!cache.Get(hash));
+    BOOST_CHECK_EQUAL(cache.Size(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -852,6 +852,29 @@ CTxMemPool::GetSortedDepthAndScore() const {
     return iters;
 }
 
+void CTxMemPool::SortByDepthAndScore(std::vector<TxId> &txids) const {
+    LOCK(cs);
+    std::vector<indexed_transaction_set::const_iterator> iters;
+    std::vector<TxId> missing;
+    iters.reserve(txids.size());
+    for (const TxId &txid : txids) {
+        auto it = mapTx.find(txid);
+        if (it == mapTx.end()) {
+            missing.push_back(txid);
+        } else {
+            iters.push_back(it);
+        }
+    }
+
+    std::stable_sort(iters.begin(), iters.end(), DepthAndScoreComparator());
+
+    txids.clear();
+    for (auto it : iters) {
+        txids.push_back(it->GetTx().GetId());
+    }
+    txids.insert(txids.end(), missing.begin(), missing.end());
+}
+
 void CTxMemPool::queryHashes(std::vector<uint256> &vtxid) const {
     LOCK(cs);
     auto iters = GetSortedDepthAndScore();
@@ -645,6 +645,11 @@ public:
     // lock free
     void _clear() EXCLUSIVE_LOCKS_REQUIRED(cs);
     bool CompareDepthAndScore(const TxId &txida, const TxId &txidb);
+    /**
+     * Sort by ancestor count and score, as CompareDepthAndScore does, with a
+     * single lookup per transaction. Those not in the mempool go last.
+     */
+    void SortByDepthAndScore(std::vector<TxId> &txids) const;
     void queryHashes(std::vector<uint256> &vtxid) const;
     bool isSpent(const COutPoint &outpoint) const;
     unsigned int GetTransactionsUpdated() const;
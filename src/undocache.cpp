@@ -0,0 +1,84 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <undocache.h>
+
+#include <memusage.h>
+
+size_t UndoCache::EntryUsage(const CBlockUndo &undo) {
+    size_t usage = memusage::MallocUsage(sizeof(CBlockUndo)) +
+                   memusage::MallocUsage(sizeof(memusage::stl_shared_counter)) +
+                   memusage::DynamicUsage(undo.vtxundo);
+    for (const CTxUndo &txundo : undo.vtxundo) {
+        usage += memusage::DynamicUsage(txundo.vprevout);
+        for (const Coin &coin : txundo.vprevout) {
+            usage += coin.DynamicMemoryUsage();
+        }
+    }
+    // The list and index nodes.
+    usage += memusage::MallocUsage(sizeof(Entry) + 2 * sizeof(void *)) +
+             memusage::MallocUsage(sizeof(
+                 memusage::unordered_node<
+                     std::pair<const BlockHash, EntryList::iterator>>));
+    return usage;
+}
+
+void UndoCache::SetMaxUsage(size_t max_usage) {
+    LOCK(m_mutex);
+    m_max_usage = max_usage;
+    Evict(m_max_usage);
+}
+
+void UndoCache::Add(const BlockHash &hash, CBlockUndo &&undo) {
+    const size_t usage = EntryUsage(undo);
+
+    LOCK(m_mutex);
+    if (usage > m_max_usage) {
+        return;
+    }
+    auto it = m_index.find(hash);
+    if (it != m_index.end()) {
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return;
+    }
+    Evict(m_max_usage - usage);
+    m_entries.push_front(
+        {hash, std::make_shared<const CBlockUndo>(std::move(undo)), usage});
+    m_index.emplace(hash, m_entries.begin());
+    m_usage += usage;
+}
+
+std::shared_ptr<const CBlockUndo> UndoCache::Get(const BlockHash &hash) {
+    LOCK(m_mutex);
+    auto it = m_index.find(hash);
+    if (it == m_index.end()) {
+        return nullptr;
+    }
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->undo;
+}
+
+void UndoCache::Clear() {
+    LOCK(m_mutex);
+    Evict(0);
+}
+
+size_t UndoCache::Size() {
+    LOCK(m_mutex);
+    return m_entries.size();
+}
+
+size_t UndoCache::DynamicMemoryUsage() {
+    LOCK(m_mutex);
+    return m_usage;
+}
+
+void UndoCache::Evict(size_t max_usage) {
+    while (m_usage > max_usage) {
+        const Entry &entry = m_entries.back();
+        m_usage -= entry.usage;
+        m_index.erase(entry.hash);
+        m_entries.pop_back();
+    }
+}
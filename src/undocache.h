@@ -0,0 +1,69 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UNDOCACHE_H
+#define BITCOIN_UNDOCACHE_H
+
+#include <chain.h>
+#include <primitives/blockhash.h>
+#include <sync.h>
+#include <undo.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+/** Default for -undocache, in MiB */
+static constexpr int64_t DEFAULT_UNDO_CACHE_SIZE = 32;
+
+/**
+ * Least recently used cache of the undo data of blocks, keyed by block hash.
+ *
+ * The undo data of a block only depends on the block and its ancestors, so
+ * entries never go stale. It is filled when blocks are connected, which lets
+ * short reorgs and queries about recent blocks skip reading and checksumming
+ * rev?????.dat.
+ */
+class UndoCache {
+public:
+    explicit UndoCache(size_t max_usage = 0) : m_max_usage(max_usage) {}
+
+    //! Limit the memory used by the entries, evicting some if needed.
+    void SetMaxUsage(size_t max_usage);
+
+    //! Add the undo data of a block. Does nothing if it does not fit.
+    void Add(const BlockHash &hash, CBlockUndo &&undo);
+
+    //! Return the undo data of a block, or nullptr if it is not cached.
+    std::shared_ptr<const CBlockUndo> Get(const BlockHash &hash);
+
+    void Clear();
+
+    size_t Size();
+    size_t DynamicMemoryUsage();
+
+    //! Memory used by an entry holding undo.
+    static size_t EntryUsage(const CBlockUndo &undo);
+
+private:
+    struct Entry {
+        BlockHash hash;
+        std::shared_ptr<const CBlockUndo> undo;
+        size_t usage;
+    };
+    using EntryList = std::list<Entry>;
+
+    Mutex m_mutex;
+    size_t m_max_usage GUARDED_BY(m_mutex);
+    size_t m_usage GUARDED_BY(m_mutex){0};
+    //! Most recently used entries first.
+    EntryList m_entries GUARDED_BY(m_mutex);
+    std::unordered_map<BlockHash, EntryList::iterator, BlockHasher>
+        m_index GUARDED_BY(m_mutex);
+
+    void Evict(size_t max_usage) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+#endif // BITCOIN_UNDOCACHE_H
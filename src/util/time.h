@@ -22,6 +22,11 @@ int64_t GetTime();
 int64_t GetTimeMillis();
 /** Returns the system time (not mockable) */
 int64_t GetTimeMicros();
+/**
+ * CPU time used by the calling thread, in microseconds, or 0 where it can't
+ * be measured.
+ */
+int64_t GetThreadCPUTimeMicros();
 /** Returns the system time (not mockable) */
 // Like GetTime(), but not mockable
 int64_t GetSystemTimeInSeconds();
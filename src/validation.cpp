@@ -7,6 +7,7 @@
 #include <validation.h>
 
 #include <arith_uint256.h>
+#include <blockcompressor.h>
 #include <blockindexworkcomparator.h>
 #include <blockvalidity.h>
 #include <chainparams.h>
@@ -20,6 +21,8 @@
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
 #include <flatfile.h>
+#include <fileremover.h>
+#include <flatfilewriter.h>
 #include <fs.h>
 #include <hash.h>
 #include <index/txindex.h>
@@ -42,6 +45,7 @@
 #include <txmempool.h>
 #include <ui_interface.h>
 #include <undo.h>
+#include <undocache.h>
 #include <util/moneystr.h>
 #include <util/strencodings.h>
 #include <util/system.h>
@@ -53,6 +57,7 @@
 
 #include <atomic>
 #include <future>
+#include <set>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -150,7 +155,8 @@ public:
     bool AcceptBlock(const Config &config,
                      const std::shared_ptr<const CBlock> &pblock,
                      CValidationState &state, bool fRequested,
-                     const FlatFilePos *dbp, bool *fNewBlock)
+                     const FlatFilePos *dbp, bool *fNewBlock,
+                     const std::vector<uint8_t> *compressed = nullptr)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block (dis)connection on a given view:
@@ -263,6 +269,7 @@ bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fBlockCompression = DEFAULT_BLOCK_COMPRESSION;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -270,6 +277,16 @@ int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 BlockHash hashAssumeValid;
 arith_uint256 nMinimumChainWork;
 
+namespace {
+/**
+ * Blocks whose transactions, apart from the coinbase, were checked by
+ * TestBlockValidity() on top of their parent. Submitted blocks rarely fail to
+ * connect, so a small bound is enough.
+ */
+std::set<BlockHash> setBlocksScriptsChecked GUARDED_BY(cs_main);
+constexpr size_t MAX_BLOCKS_SCRIPTS_CHECKED = 16;
+} // namespace
+
 CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE_PER_KB);
 Amount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 
@@ -313,6 +330,16 @@ std::set<const CBlockIndex *> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 std::set<int> setDirtyFileInfo;
+
+/**
+ * Block files whose blocks were all moved by ThreadMigrateBlockFiles() during
+ * a previous run. They are emptied once the block index on disk no longer
+ * refers to them. Files migrated during this run are kept until the next
+ * start, as a reader may still have looked up a block position in them.
+ */
+std::set<int> setMigratedFiles GUARDED_BY(cs_LastBlockFile);
+/** Whether blocks were moved since the block index was last written. */
+bool fMigratedBlocksDirty GUARDED_BY(cs_LastBlockFile) = false;
 } // namespace
 
 BlockValidationOptions::BlockValidationOptions(const Config &config)
@@ -350,11 +377,24 @@ static bool FlushStateToDisk(const CChainParams &chainParams,
                              int nManualPruneHeight = 0);
 static void FindFilesToPruneManual(std::set<int> &setFilesToPrune,
                                    int nManualPruneHeight);
+static void EmptyMigratedFiles(const std::set<int> &files);
 static void FindFilesToPrune(std::set<int> &setFilesToPrune,
-                             uint64_t nPruneAfterHeight);
+                             uint64_t nPruneAfterHeight,
+                             bool &fFlushChainstate);
 static FILE *OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
+
+UndoCache g_undo_cache;
+
+/**
+ * Writers for the block and undo files, if -asyncblockwrites is set. Set up
+ * before and torn down after the threads that read or write blocks.
+ */
+static std::unique_ptr<FlatFileWriter> g_block_writer;
+static std::unique_ptr<FlatFileWriter> g_undo_writer;
+/** Deletes pruned block and undo files, if -asyncprune is set. */
+static std::unique_ptr<FileRemover> g_file_remover;
 static uint32_t GetNextBlockScriptFlags(const Consensus::Params &params,
                                         const CBlockIndex *pindex);
 
@@ -862,6 +902,21 @@ bool GetTransaction(const TxId &txid, CTransactionRef &txOut,
 
 static bool WriteBlockToDisk(const CBlock &block, FlatFilePos &pos,
                              const CMessageHeader::MessageMagic &messageStart) {
+    if (g_block_writer) {
+        if (g_block_writer->HasFailed()) {
+            return error("WriteBlockToDisk: block file writer failed");
+        }
+        // Serialize the record the same way as below and leave the disk
+        // write to the writer thread.
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        unsigned int nSize = GetSerializeSize(block, ss.GetVersion());
+        ss.reserve(nSize + 8);
+        ss << messageStart << nSize << block;
+        g_block_writer->Write(pos, std::vector<uint8_t>(ss.begin(), ss.end()));
+        pos.nPos += 8;
+        return true;
+    }
+
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull()) {
@@ -884,12 +939,73 @@ static bool WriteBlockToDisk(const CBlock &block, FlatFilePos &pos,
     return true;
 }
 
+/**
+ * Write a block compressed by BlockCompression::Compress() as a compressed
+ * record. Same contract as WriteBlockToDisk().
+ */
+static bool
+WriteCompressedBlockToDisk(const std::vector<uint8_t> &payload,
+                           FlatFilePos &pos,
+                           const CMessageHeader::MessageMagic &messageStart) {
+    const CMessageHeader::MessageMagic magic =
+        BlockCompression::CompressedDiskMagic(messageStart);
+    const unsigned int nSize = payload.size();
+
+    if (g_block_writer) {
+        if (g_block_writer->HasFailed()) {
+            return error("%s: block file writer failed", __func__);
+        }
+        std::vector<uint8_t> record;
+        record.reserve(nSize + 8);
+        CVectorWriter(SER_DISK, CLIENT_VERSION, record, 0, magic, nSize);
+        record.insert(record.end(), payload.begin(), payload.end());
+        g_block_writer->Write(pos, std::move(record));
+        pos.nPos += 8;
+        return true;
+    }
+
+    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        return error("%s: OpenBlockFile failed", __func__);
+    }
+    fileout << magic << nSize;
+    long fileOutPos = ftell(fileout.Get());
+    if (fileOutPos < 0) {
+        return error("%s: ftell failed", __func__);
+    }
+    pos.nPos = (unsigned int)fileOutPos;
+    fileout << MakeSpan(payload);
+
+    return true;
+}
+
+/**
+ * Read the payload of a compressed record of the given size and decompress
+ * it into block.
+ */
+template <typename Stream>
+static void ReadCompressedBlock(Stream &s, unsigned int nSize, CBlock &block) {
+    if (nSize > MAX_BLOCKFILE_SIZE) {
+        throw std::ios_base::failure("compressed block size out of range");
+    }
+    std::vector<uint8_t> payload(nSize);
+    s >> MakeSpan(payload);
+    BlockCompression::Decompress(payload, block);
+}
+
 bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
                        const Consensus::Params &params) {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (pos.nPos < 8) {
+        return error("ReadBlockFromDisk: Invalid block position %s",
+                     pos.ToString());
+    }
+
+    // Open history file to read, at the record header written by
+    // WriteBlockToDisk, which tells whether the block is compressed.
+    CAutoFile filein(OpenBlockFile(FlatFilePos(pos.nFile, pos.nPos - 8), true),
+                     SER_DISK, CLIENT_VERSION);
     if (filein.IsNull()) {
         return error("ReadBlockFromDisk: OpenBlockFile failed for %s",
                      pos.ToString());
@@ -897,7 +1013,15 @@ bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
 
     // Read block
     try {
-        filein >> block;
+        CMessageHeader::MessageMagic blk_start;
+        unsigned int blk_size;
+        filein >> blk_start >> blk_size;
+        if (blk_start ==
+            BlockCompression::CompressedDiskMagic(Params().DiskMagic())) {
+            ReadCompressedBlock(filein, blk_size, block);
+        } else {
+            filein >> block;
+        }
     } catch (const std::exception &e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__,
                      e.what(), pos.ToString());
@@ -933,6 +1057,92 @@ bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block,
+                          const CBlockIndex *pindex,
+                          const Consensus::Params &params,
+                          const CMessageHeader::MessageMagic &messageStart) {
+    block.clear();
+
+    FlatFilePos blockPos;
+    {
+        LOCK(cs_main);
+        blockPos = pindex->GetBlockPos();
+    }
+    if (blockPos.nPos < 8) {
+        return error("%s: Invalid block position %s", __func__,
+                     blockPos.ToString());
+    }
+
+    // Open history file to read, starting at the index header written by
+    // WriteBlockToDisk.
+    FlatFilePos hpos(blockPos.nFile, blockPos.nPos - 8);
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return error("%s: OpenBlockFile failed for %s", __func__,
+                     blockPos.ToString());
+    }
+
+    try {
+        CMessageHeader::MessageMagic blk_start;
+        unsigned int blk_size;
+        filein >> blk_start >> blk_size;
+        if (blk_start == BlockCompression::CompressedDiskMagic(messageStart)) {
+            // There are no raw bytes to hand out, so serialize the block. The
+            // header is checked below like that of a raw record.
+            CBlock decompressed;
+            ReadCompressedBlock(filein, blk_size, decompressed);
+            CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, block, 0,
+                          decompressed);
+        } else if (memcmp(blk_start.data(), messageStart.data(),
+                   CMessageHeader::MESSAGE_START_SIZE)) {
+            return error("%s: Block magic mismatch for %s", __func__,
+                         blockPos.ToString());
+        } else {
+            // Don't trust the size blindly, it has to fit in the file.
+            FILE *file = filein.Get();
+            if (fseek(file, 0, SEEK_END) != 0) {
+                return error("%s: fseek failed for %s", __func__,
+                             blockPos.ToString());
+            }
+            const long file_size = ftell(file);
+            if (file_size < 0 ||
+                uint64_t(blockPos.nPos) + blk_size > uint64_t(file_size)) {
+                return error("%s: Block size %u out of range for %s", __func__,
+                             blk_size, blockPos.ToString());
+            }
+            if (fseek(file, blockPos.nPos, SEEK_SET) != 0) {
+                return error("%s: fseek failed for %s", __func__,
+                             blockPos.ToString());
+            }
+
+            block.resize(blk_size);
+            filein.read(reinterpret_cast<char *>(block.data()), blk_size);
+        }
+    } catch (const std::exception &e) {
+        return error("%s: Read error - %s at %s", __func__, e.what(),
+                     blockPos.ToString());
+    }
+
+    // Check the header, without deserializing the rest of the block.
+    CBlockHeader header;
+    try {
+        SpanReader(SER_DISK, CLIENT_VERSION, MakeSpan(block)) >> header;
+    } catch (const std::exception &e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(),
+                     blockPos.ToString());
+    }
+    if (!CheckProofOfWork(header.GetHash(), header.nBits, params)) {
+        return error("%s: Errors in block header at %s", __func__,
+                     blockPos.ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash()) {
+        return error("%s: GetHash() doesn't match index for %s at %s",
+                     __func__, pindex->ToString(), blockPos.ToString());
+    }
+
+    return true;
+}
+
 Amount GetBlockSubsidy(CBlockIndex *pindexPrev, uint32_t nBits, int nHeight,
                        const Consensus::Params &consensusParams) {
     //calculate work based on nBits like in GetBlockProof from chain.cpp
@@ -1329,6 +1539,25 @@ bool CheckInputs(const CTransaction &tx, CValidationState &state,
 static bool UndoWriteToDisk(const CBlockUndo &blockundo, FlatFilePos &pos,
                             const BlockHash &hashBlock,
                             const CMessageHeader::MessageMagic &messageStart) {
+    if (g_undo_writer) {
+        if (g_undo_writer->HasFailed()) {
+            return error("%s: undo file writer failed", __func__);
+        }
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        unsigned int nSize = GetSerializeSize(blockundo, ss.GetVersion());
+        ss.reserve(nSize + 40);
+        ss << messageStart << nSize << blockundo;
+
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << hashBlock;
+        hasher << blockundo;
+        ss << hasher.GetHash();
+
+        g_undo_writer->Write(pos, std::vector<uint8_t>(ss.begin(), ss.end()));
+        pos.nPos += 8;
+        return true;
+    }
+
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull()) {
@@ -1356,11 +1585,8 @@ static bool UndoWriteToDisk(const CBlockUndo &blockundo, FlatFilePos &pos,
     return true;
 }
 
-bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
-    FlatFilePos pos = pindex->GetUndoPos();
-    if (pos.IsNull()) {
-        return error("%s: no undo data available", __func__);
-    }
+static bool UndoReadFromDisk(CBlockUndo &blockundo, const FlatFilePos &pos,
+                             const BlockHash &hashBlock) {
 
     // Open history file to read
     CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
@@ -1373,7 +1599,7 @@ bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
     // We need a CHashVerifier as reserializing may lose data
     CHashVerifier<CAutoFile> verifier(&filein);
     try {
-        verifier << pindex->pprev->GetBlockHash();
+        verifier << hashBlock;
         verifier >> blockundo;
         filein >> hashChecksum;
     } catch (const std::exception &e) {
@@ -1388,6 +1614,20 @@ bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
     return true;
 }
 
+bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
+    if (std::shared_ptr<const CBlockUndo> cached =
+            g_undo_cache.Get(pindex->GetBlockHash())) {
+        blockundo = *cached;
+        return true;
+    }
+
+    FlatFilePos pos = pindex->GetUndoPos();
+    if (pos.IsNull()) {
+        return error("%s: no undo data available", __func__);
+    }
+    return UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
 /** Abort with a message */
 static bool AbortNode(const std::string &strMessage,
                       const std::string &userMessage = "") {
@@ -1452,6 +1692,11 @@ DisconnectResult UndoCoinSpend(const Coin &undo, CCoinsViewCache &view,
 DisconnectResult CChainState::DisconnectBlock(const CBlock &block,
                                               const CBlockIndex *pindex,
                                               CCoinsViewCache &view) {
+    if (std::shared_ptr<const CBlockUndo> cached =
+            g_undo_cache.Get(pindex->GetBlockHash())) {
+        return ApplyBlockUndo(*cached, block, pindex, view);
+    }
+
     CBlockUndo blockUndo;
     if (!UndoReadFromDisk(blockUndo, pindex)) {
         error("DisconnectBlock(): failure reading undo data");
@@ -1522,6 +1767,11 @@ DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
+/**
+ * Commit the last block and undo files to disk. With the asynchronous writers
+ * the commit of a finalized file is only queued, and otherwise this waits for
+ * everything queued before.
+ */
 static void FlushBlockFile(bool fFinalize = false) {
     LOCK(cs_LastBlockFile);
 
@@ -1531,8 +1781,17 @@ static void FlushBlockFile(bool fFinalize = false) {
                              vinfoBlockFile[nLastBlockFile].nUndoSize);
 
     bool status = true;
-    status &= BlockFileSeq().Flush(block_pos_old, fFinalize);
-    status &= UndoFileSeq().Flush(undo_pos_old, fFinalize);
+    if (g_block_writer) {
+        g_block_writer->Flush(block_pos_old, fFinalize);
+        g_undo_writer->Flush(undo_pos_old, fFinalize);
+        if (!fFinalize) {
+            status &= g_block_writer->Sync();
+            status &= g_undo_writer->Sync();
+        }
+    } else {
+        status &= BlockFileSeq().Flush(block_pos_old, fFinalize);
+        status &= UndoFileSeq().Flush(undo_pos_old, fFinalize);
+    }
     if (!status) {
         AbortNode("Flushing block file to disk failed. This is likely the "
                   "result of an I/O error.");
@@ -1745,6 +2004,14 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
         }
     }
 
+    if (!fJustCheck && setBlocksScriptsChecked.erase(block.GetHash())) {
+        // Built from a block template whose transactions were checked on top
+        // of the same parent, which determines the script flags.
+        LogPrint(BCLog::BENCH, "    - Skipping script checks of template block %s\n",
+                 block.GetHash().ToString());
+        fScriptChecks = false;
+    }
+
     int64_t nTime1 = GetTimeMicros();
     nTimeCheck += nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n",
@@ -1985,6 +2252,7 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
     if (!WriteUndoDataForBlock(blockundo, state, pindex, params)) {
         return false;
     }
+    g_undo_cache.Add(pindex->GetBlockHash(), std::move(blockundo));
 
     if (!pindex->IsValid(BlockValidity::SCRIPTS)) {
         pindex->RaiseValidity(BlockValidity::SCRIPTS);
@@ -2031,6 +2299,9 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
     try {
         {
             bool fFlushForPrune = false;
+            // Whether the chainstate has to be flushed before pruning, as the
+            // blocks needed to replay it could be deleted otherwise.
+            bool fPruneFlushChainstate = true;
             bool fDoFullFlush = false;
             LOCK(cs_LastBlockFile);
             if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) &&
@@ -2039,7 +2310,8 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
                     FindFilesToPruneManual(setFilesToPrune, nManualPruneHeight);
                 } else {
                     FindFilesToPrune(setFilesToPrune,
-                                     chainparams.PruneAfterHeight());
+                                     chainparams.PruneAfterHeight(),
+                                     fPruneFlushChainstate);
                     fCheckForPruning = false;
                 }
                 if (!setFilesToPrune.empty()) {
@@ -2086,9 +2358,17 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
                 nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
             // Combine all conditions that result in a full cache flush.
             fDoFullFlush = (mode == FlushStateMode::ALWAYS) || fCacheLarge ||
-                           fCacheCritical || fPeriodicFlush || fFlushForPrune;
+                           fCacheCritical || fPeriodicFlush ||
+                           (fFlushForPrune && fPruneFlushChainstate);
+            // Write where the block migration moved blocks to soon, and only
+            // empty the files they came from after the block index stops
+            // pointing to them.
+            bool fMigratedWrite =
+                mode != FlushStateMode::NONE &&
+                (fMigratedBlocksDirty || !setMigratedFiles.empty());
             // Write blocks and block index to disk.
-            if (fDoFullFlush || fPeriodicWrite) {
+            if (fDoFullFlush || fPeriodicWrite || fMigratedWrite ||
+                fFlushForPrune) {
                 // Depend on nMinDiskSpace to ensure we can write block index
                 if (!CheckDiskSpace(GetBlocksDir())) {
                     return AbortNode(state, "Disk space is low!",
@@ -2127,6 +2407,11 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
                 if (fFlushForPrune) {
                     UnlinkPrunedFiles(setFilesToPrune);
                 }
+                fMigratedBlocksDirty = false;
+                if (!setMigratedFiles.empty()) {
+                    EmptyMigratedFiles(setMigratedFiles);
+                    setMigratedFiles.clear();
+                }
                 nLastWrite = nNow;
             }
             // Flush best chain related state. This can only be done if the
@@ -3516,7 +3801,9 @@ static bool FindBlockPos(FlatFilePos &pos, unsigned int nAddSize,
     if (!fKnown) {
         bool out_of_space;
         size_t bytes_allocated =
-            BlockFileSeq().Allocate(pos, nAddSize, out_of_space);
+            g_block_writer
+                ? g_block_writer->Allocate(pos, nAddSize, out_of_space)
+                : BlockFileSeq().Allocate(pos, nAddSize, out_of_space);
         if (out_of_space) {
             return AbortNode("Disk space is low!",
                              _("Error: Disk space is low!"));
@@ -3542,7 +3829,8 @@ static bool FindUndoPos(CValidationState &state, int nFile, FlatFilePos &pos,
 
     bool out_of_space;
     size_t bytes_allocated =
-        UndoFileSeq().Allocate(pos, nAddSize, out_of_space);
+        g_undo_writer ? g_undo_writer->Allocate(pos, nAddSize, out_of_space)
+                      : UndoFileSeq().Allocate(pos, nAddSize, out_of_space);
     if (out_of_space) {
         return AbortNode(state, "Disk space is low!",
                          _("Error: Disk space is low!"));
@@ -4052,12 +4340,26 @@ bool ProcessNewBlockHeaders(const Config &config,
 
 /**
  * Store block on disk. If dbp is non-nullptr, the file is known to already
- * reside on disk.
+ * reside on disk. With -blockcompression, pcompressed is the block already
+ * compressed by BlockCompression::Compress(), or nullptr to compress it here.
  */
 static FlatFilePos SaveBlockToDisk(const CBlock &block, int nHeight,
                                    const CChainParams &chainparams,
-                                   const FlatFilePos *dbp) {
-    unsigned int nBlockSize = ::GetSerializeSize(block, CLIENT_VERSION);
+                                   const FlatFilePos *dbp,
+                                   const std::vector<uint8_t> *pcompressed =
+                                       nullptr) {
+    // A block found by -reindex is accounted for with its raw size even if
+    // it is stored compressed, which only overestimates the file size.
+    std::vector<uint8_t> ownCompressed;
+    const bool fCompressed =
+        dbp == nullptr && fBlockCompression &&
+        (pcompressed != nullptr ||
+         BlockCompression::Compress(block, ownCompressed));
+    const std::vector<uint8_t> &compressed =
+        pcompressed != nullptr ? *pcompressed : ownCompressed;
+    unsigned int nBlockSize = fCompressed
+                                  ? compressed.size()
+                                  : ::GetSerializeSize(block, CLIENT_VERSION);
     FlatFilePos blockPos;
     if (dbp != nullptr) {
         blockPos = *dbp;
@@ -4068,7 +4370,10 @@ static FlatFilePos SaveBlockToDisk(const CBlock &block, int nHeight,
         return FlatFilePos();
     }
     if (dbp == nullptr) {
-        if (!WriteBlockToDisk(block, blockPos, chainparams.DiskMagic())) {
+        if (!(fCompressed ? WriteCompressedBlockToDisk(compressed, blockPos,
+                                                       chainparams.DiskMagic())
+                          : WriteBlockToDisk(block, blockPos,
+                                             chainparams.DiskMagic()))) {
             AbortNode("Failed to write block");
             return FlatFilePos();
         }
@@ -4085,12 +4390,15 @@ static FlatFilePos SaveBlockToDisk(const CBlock &block, int nHeight,
  *                           from our peers.
  * @param[in]     dbp        If non-null, the disk position of the block.
  * @param[in-out] fNewBlock  True if block was first received via this call.
+ * @param[in]     compressed If non-null, the block compressed beforehand for
+ *                           -blockcompression.
  * @return True if the block is accepted as a valid block and written to disk.
  */
 bool CChainState::AcceptBlock(const Config &config,
                               const std::shared_ptr<const CBlock> &pblock,
                               CValidationState &state, bool fRequested,
-                              const FlatFilePos *dbp, bool *fNewBlock) {
+                              const FlatFilePos *dbp, bool *fNewBlock,
+                              const std::vector<uint8_t> *compressed) {
     AssertLockHeld(cs_main);
 
     const CBlock &block = *pblock;
@@ -4220,7 +4528,8 @@ bool CChainState::AcceptBlock(const Config &config,
     }
     try {
         FlatFilePos blockPos =
-            SaveBlockToDisk(block, pindex->nHeight, chainparams, dbp);
+            SaveBlockToDisk(block, pindex->nHeight, chainparams, dbp,
+                            compressed);
         if (blockPos.IsNull()) {
             state.Error(strprintf(
                 "%s: Failed to find position to write new block to disk",
@@ -4251,6 +4560,12 @@ bool ProcessNewBlock(const Config &config,
 
         CValidationState state;
 
+        // Compress the block before taking cs_main, the result is only used
+        // if the block gets stored.
+        std::vector<uint8_t> compressed;
+        const bool fCompressed =
+            fBlockCompression && BlockCompression::Compress(*pblock, compressed);
+
         // CheckBlock() does not support multi-threaded block validation
         // because CBlock::fChecked can cause data race.
         // Therefore, the following critical section must include the
@@ -4265,7 +4580,8 @@ bool ProcessNewBlock(const Config &config,
         if (ret) {
             // Store to disk
             ret = g_chainstate.AcceptBlock(
-                config, pblock, state, fForceProcessing, nullptr, fNewBlock);
+                config, pblock, state, fForceProcessing, nullptr, fNewBlock,
+                fCompressed ? &compressed : nullptr);
         }
 
         if (!ret) {
@@ -4326,6 +4642,14 @@ bool TestBlockValidity(CValidationState &state, const CChainParams &params,
     return true;
 }
 
+void MarkBlockScriptsChecked(const BlockHash &hash) {
+    AssertLockHeld(cs_main);
+    if (setBlocksScriptsChecked.size() >= MAX_BLOCKS_SCRIPTS_CHECKED) {
+        setBlocksScriptsChecked.clear();
+    }
+    setBlocksScriptsChecked.insert(hash);
+}
+
 /**
  * BLOCK PRUNING CODE
  */
@@ -4345,14 +4669,20 @@ uint64_t CalculateCurrentUsage() {
 }
 
 /**
- * Prune a block file (modify associated database entries)
+ * Prune block files (modify associated database entries). Looks at each block
+ * index entry once, however many files are pruned.
  */
-void PruneOneBlockFile(const int fileNumber) {
+static void PruneBlockFiles(const std::set<int> &fileNumbers)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    if (fileNumbers.empty()) {
+        return;
+    }
+
     LOCK(cs_LastBlockFile);
 
     for (const auto &entry : mapBlockIndex) {
         CBlockIndex *pindex = entry.second;
-        if (pindex->nFile == fileNumber) {
+        if (fileNumbers.count(pindex->nFile)) {
             pindex->nStatus = pindex->nStatus.withData(false).withUndo(false);
             pindex->nFile = 0;
             pindex->nDataPos = 0;
@@ -4377,11 +4707,34 @@ void PruneOneBlockFile(const int fileNumber) {
         }
     }
 
-    vinfoBlockFile[fileNumber].SetNull();
-    setDirtyFileInfo.insert(fileNumber);
+    for (const int fileNumber : fileNumbers) {
+        vinfoBlockFile[fileNumber].SetNull();
+        setDirtyFileInfo.insert(fileNumber);
+    }
+}
+
+void PruneOneBlockFile(const int fileNumber) {
+    PruneBlockFiles({fileNumber});
 }
 
 void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune) {
+    if (g_block_writer) {
+        // The writers may still have some of these files open.
+        g_block_writer->CloseFiles();
+        g_undo_writer->CloseFiles();
+    }
+    if (g_file_remover) {
+        std::vector<fs::path> paths;
+        for (const int i : setFilesToPrune) {
+            FlatFilePos pos(i, 0);
+            paths.push_back(BlockFileSeq().FileName(pos));
+            paths.push_back(UndoFileSeq().FileName(pos));
+        }
+        g_file_remover->Remove(std::move(paths));
+        LogPrintf("Prune: %s queued the deletion of %d blk/rev pairs\n",
+                  __func__, setFilesToPrune.size());
+        return;
+    }
     for (const int i : setFilesToPrune) {
         FlatFilePos pos(i, 0);
         fs::remove(BlockFileSeq().FileName(pos));
@@ -4390,6 +4743,250 @@ void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune) {
     }
 }
 
+/**
+ * Empty block and undo files whose blocks were moved elsewhere. They are kept
+ * with a size of 0, as -reindex stops at the first missing block file.
+ */
+static void EmptyMigratedFiles(const std::set<int> &files) {
+    if (g_block_writer) {
+        g_block_writer->CloseFiles();
+        g_undo_writer->CloseFiles();
+    }
+    for (const int i : files) {
+        FlatFilePos pos(i, 0);
+        for (FlatFileSeq seq : {BlockFileSeq(), UndoFileSeq()}) {
+            if (!fs::exists(seq.FileName(pos))) {
+                continue;
+            }
+            FILE *file = seq.Open(pos);
+            if (!file || !TruncateFile(file, 0) || !FileCommit(file)) {
+                error("%s: failed to empty %s", __func__,
+                      seq.FileName(pos).string());
+            }
+            if (file) {
+                fclose(file);
+            }
+        }
+        LogPrintf("%s: emptied blk/rev (%05u)\n", __func__, i);
+    }
+}
+
+/**
+ * Read the magic of the record at pos, which tells whether the block is
+ * compressed.
+ */
+static bool ReadBlockRecordMagic(const FlatFilePos &pos,
+                                 CMessageHeader::MessageMagic &magic) {
+    if (pos.nPos < 8) {
+        return false;
+    }
+    CAutoFile filein(OpenBlockFile(FlatFilePos(pos.nFile, pos.nPos - 8), true),
+                     SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return false;
+    }
+    try {
+        filein >> magic;
+    } catch (const std::exception &e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
+/**
+ * Move the blocks of block file nFile, and their undo data, to the end of the
+ * current block file as compressed records.
+ * @return false if the migration has to stop.
+ */
+static bool MigrateBlockFile(const CChainParams &chainparams, int nFile) {
+    std::vector<CBlockIndex *> blocks;
+    {
+        LOCK(cs_main);
+        for (const auto &entry : mapBlockIndex) {
+            CBlockIndex *pindex = entry.second;
+            if (pindex->nStatus.hasData() && pindex->nFile == nFile) {
+                blocks.push_back(pindex);
+            }
+        }
+    }
+    if (blocks.empty()) {
+        return true;
+    }
+    // Read the file front to back.
+    std::sort(blocks.begin(), blocks.end(),
+              [](const CBlockIndex *a, const CBlockIndex *b) {
+                  return a->nDataPos < b->nDataPos;
+              });
+
+    // Leave files alone that are mostly compressed already, such as the one
+    // that was being written to when compression was turned on.
+    const CMessageHeader::MessageMagic compressedMagic =
+        BlockCompression::CompressedDiskMagic(chainparams.DiskMagic());
+    size_t nRaw = 0;
+    for (const CBlockIndex *pindex : blocks) {
+        CMessageHeader::MessageMagic magic;
+        if (ReadBlockRecordMagic(pindex->GetBlockPos(), magic) &&
+            magic != compressedMagic) {
+            nRaw++;
+        }
+    }
+    if (2 * nRaw <= blocks.size()) {
+        return true;
+    }
+
+    LogPrintf("Compressing the %u blocks of blk%05u.dat\n", blocks.size(),
+              nFile);
+    for (CBlockIndex *pindex : blocks) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            return false;
+        }
+
+        FlatFilePos blockPos;
+        FlatFilePos undoPos;
+        {
+            LOCK(cs_main);
+            blockPos = pindex->GetBlockPos();
+            undoPos = pindex->GetUndoPos();
+        }
+        if (blockPos.IsNull() || blockPos.nFile != nFile) {
+            continue;
+        }
+
+        // Do the reading and encoding without holding cs_main.
+        CBlock block;
+        if (!ReadBlockFromDisk(block, blockPos, chainparams.GetConsensus())) {
+            continue;
+        }
+        CBlockUndo blockundo;
+        if (!undoPos.IsNull() &&
+            !UndoReadFromDisk(blockundo, undoPos,
+                              pindex->pprev->GetBlockHash())) {
+            continue;
+        }
+        std::vector<uint8_t> compressed;
+        const bool fCompressed = BlockCompression::Compress(block, compressed);
+
+        LOCK(cs_main);
+        if (pindex->GetBlockPos() != blockPos ||
+            pindex->GetUndoPos() != undoPos) {
+            // Undo data was written in the meantime, try again next time.
+            continue;
+        }
+
+        FlatFilePos newBlockPos;
+        const unsigned int nBlockSize =
+            fCompressed ? compressed.size()
+                        : ::GetSerializeSize(block, CLIENT_VERSION);
+        if (!FindBlockPos(newBlockPos, nBlockSize + 8, pindex->nHeight,
+                          block.GetBlockTime())) {
+            return error("%s: FindBlockPos failed", __func__);
+        }
+        if (!(fCompressed
+                  ? WriteCompressedBlockToDisk(compressed, newBlockPos,
+                                               chainparams.DiskMagic())
+                  : WriteBlockToDisk(block, newBlockPos,
+                                     chainparams.DiskMagic()))) {
+            return AbortNode("Failed to write block");
+        }
+        if (!undoPos.IsNull()) {
+            CValidationState state;
+            FlatFilePos newUndoPos;
+            if (!FindUndoPos(
+                    state, newBlockPos.nFile, newUndoPos,
+                    ::GetSerializeSize(blockundo, CLIENT_VERSION) + 40)) {
+                return error("%s: FindUndoPos failed", __func__);
+            }
+            if (!UndoWriteToDisk(blockundo, newUndoPos,
+                                 pindex->pprev->GetBlockHash(),
+                                 chainparams.DiskMagic())) {
+                return AbortNode(state, "Failed to write undo data");
+            }
+            pindex->nUndoPos = newUndoPos.nPos;
+        }
+        pindex->nFile = newBlockPos.nFile;
+        pindex->nDataPos = newBlockPos.nPos;
+        setDirtyBlockIndex.insert(pindex);
+    }
+
+    {
+        LOCK2(cs_main, cs_LastBlockFile);
+        for (const auto &entry : mapBlockIndex) {
+            const CBlockIndex *pindex = entry.second;
+            if (pindex->nFile == nFile &&
+                (pindex->nStatus.hasData() || pindex->nStatus.hasUndo())) {
+                LogPrintf("Some blocks of blk%05u.dat were not moved\n",
+                          nFile);
+                return true;
+            }
+        }
+        vinfoBlockFile[nFile].SetNull();
+        setDirtyFileInfo.insert(nFile);
+        // The file is emptied on the next start.
+        fMigratedBlocksDirty = true;
+    }
+
+    CValidationState state;
+    if (!FlushStateToDisk(chainparams, state, FlushStateMode::PERIODIC)) {
+        return error("%s: failed to flush state (%s)", __func__,
+                     FormatStateMessage(state));
+    }
+    return true;
+}
+
+void ThreadMigrateBlockFiles(const CChainParams &chainparams) {
+    if (fPruneMode || fHavePruned || g_txindex) {
+        // Pruning accounts for the blocks of each file by height and the
+        // transaction index stores positions inside of raw blocks, so only
+        // new blocks are compressed.
+        LogPrintf("Block compression: not converting existing block files "
+                  "because pruning or -txindex is enabled\n");
+        return;
+    }
+    if (fs::exists(GetDataDir() / "indexes" / "txindex")) {
+        // A transaction index built earlier would point into the emptied
+        // files once -txindex is enabled again.
+        LogPrintf("Block compression: not converting existing block files "
+                  "because a transaction index exists on disk, remove %s "
+                  "to convert them\n",
+                  (GetDataDir() / "indexes" / "txindex").string());
+        return;
+    }
+
+    // Stay out of the way of the initial block download and of imports.
+    while (fImporting || fReindex || IsInitialBlockDownload()) {
+        MilliSleep(10000);
+    }
+
+    int nLastFile;
+    {
+        LOCK(cs_LastBlockFile);
+        nLastFile = nLastBlockFile;
+        // Files left behind by a previous run, once the block index stopped
+        // referring to them. No reader can know their old positions now.
+        for (int i = 0; i < nLastFile && i < int(vinfoBlockFile.size());
+             i++) {
+            if (vinfoBlockFile[i].nBlocks == 0 &&
+                fs::exists(GetBlockPosFilename(FlatFilePos(i, 0))) &&
+                fs::file_size(GetBlockPosFilename(FlatFilePos(i, 0))) > 0) {
+                setMigratedFiles.insert(i);
+            }
+        }
+    }
+
+    // The file being written to is left alone.
+    for (int nFile = 0; nFile < nLastFile; nFile++) {
+        if (!MigrateBlockFile(chainparams, nFile)) {
+            LogPrintf("Block compression: stopped at blk%05u.dat\n", nFile);
+            return;
+        }
+    }
+
+    CValidationState state;
+    FlushStateToDisk(chainparams, state, FlushStateMode::PERIODIC);
+    LogPrintf("Block compression: existing block files converted\n");
+}
+
 /**
  * Calculate the block/rev files to delete based on height specified by user
  * with RPC command pruneblockchain
@@ -4414,10 +5011,10 @@ static void FindFilesToPruneManual(std::set<int> &setFilesToPrune,
             vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune) {
             continue;
         }
-        PruneOneBlockFile(fileNumber);
         setFilesToPrune.insert(fileNumber);
         count++;
     }
+    PruneBlockFiles(setFilesToPrune);
     LogPrintf("Prune (Manual): prune_height=%d removed %d blk/rev pairs\n",
               nLastBlockWeCanPrune, count);
 }
@@ -4451,12 +5048,23 @@ void PruneBlockFilesManual(int nManualPruneHeight) {
  * that were stored in the deleted files. A db flag records the fact that at
  * least some block files have been pruned.
  *
+ * With -asyncprune, files are pruned once the usage comes within 10% of the
+ * target, and only if all their blocks are below the chainstate on disk. Such
+ * blocks are never needed to replay the chainstate, so the chainstate does not
+ * have to be flushed first; only the block index is written, and the files
+ * are deleted in the background. The regular rules apply if that is not
+ * enough to stay below the target.
+ *
  * @param[out]   setFilesToPrune   The set of file indices that can be unlinked
  * will be returned
+ * @param[out]   fFlushChainstate  Whether the chainstate must be flushed before
+ * the files are unlinked
  */
 static void FindFilesToPrune(std::set<int> &setFilesToPrune,
-                             uint64_t nPruneAfterHeight) {
+                             uint64_t nPruneAfterHeight,
+                             bool &fFlushChainstate) {
     LOCK2(cs_main, cs_LastBlockFile);
+    fFlushChainstate = true;
     if (::ChainActive().Tip() == nullptr || nPruneTarget == 0) {
         return;
     }
@@ -4471,47 +5079,66 @@ static void FindFilesToPrune(std::set<int> &setFilesToPrune,
     // so we should leave a buffer under our target to account for another
     // allocation before the next pruning.
     uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
-    uint64_t nBytesToPrune;
     int count = 0;
 
-    if (nCurrentUsage + nBuffer >= nPruneTarget) {
-        // On a prune event, the chainstate DB is flushed.
-        // To avoid excessive prune events negating the benefit of high dbcache
-        // values, we should not prune too rapidly.
-        // So when pruning in IBD, increase the buffer a bit to avoid a re-prune
-        // too soon.
-        if (IsInitialBlockDownload()) {
-            // Since this is only relevant during IBD, we use a fixed 10%
-            nBuffer += nPruneTarget / 10;
-        }
-
+    // Select files from the oldest on until the usage is below nTarget,
+    // skipping those with blocks above nMaxHeight.
+    auto selectFiles = [&](uint64_t nTarget, unsigned int nMaxHeight) {
         for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
-            nBytesToPrune = vinfoBlockFile[fileNumber].nSize +
-                            vinfoBlockFile[fileNumber].nUndoSize;
+            uint64_t nBytesToPrune = vinfoBlockFile[fileNumber].nSize +
+                                     vinfoBlockFile[fileNumber].nUndoSize;
 
-            if (vinfoBlockFile[fileNumber].nSize == 0) {
+            if (vinfoBlockFile[fileNumber].nSize == 0 ||
+                setFilesToPrune.count(fileNumber)) {
                 continue;
             }
 
             // are we below our target?
-            if (nCurrentUsage + nBuffer < nPruneTarget) {
+            if (nCurrentUsage + nBuffer < nTarget) {
                 break;
             }
 
             // don't prune files that could have a block within
             // MIN_BLOCKS_TO_KEEP of the main chain's tip but keep scanning
-            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune) {
+            if (vinfoBlockFile[fileNumber].nHeightLast > nMaxHeight) {
                 continue;
             }
 
-            PruneOneBlockFile(fileNumber);
             // Queue up the files for removal
             setFilesToPrune.insert(fileNumber);
             nCurrentUsage -= nBytesToPrune;
             count++;
         }
+    };
+
+    if (g_file_remover) {
+        const CBlockIndex *pindexFlushed =
+            LookupBlockIndex(pcoinsdbview->GetBestBlock());
+        if (pindexFlushed != nullptr) {
+            selectFiles(nPruneTarget - nPruneTarget / 10,
+                        std::min<unsigned int>(nLastBlockWeCanPrune,
+                                               pindexFlushed->nHeight));
+            fFlushChainstate = false;
+        }
+    }
+
+    if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        // On a prune event, the chainstate DB is flushed.
+        // To avoid excessive prune events negating the benefit of high dbcache
+        // values, we should not prune too rapidly.
+        // So when pruning in IBD, increase the buffer a bit to avoid a re-prune
+        // too soon.
+        if (IsInitialBlockDownload()) {
+            // Since this is only relevant during IBD, we use a fixed 10%
+            nBuffer += nPruneTarget / 10;
+        }
+
+        selectFiles(nPruneTarget, nLastBlockWeCanPrune);
+        fFlushChainstate = true;
     }
 
+    PruneBlockFiles(setFilesToPrune);
+
     LogPrint(BCLog::PRUNE,
              "Prune: target=%dMiB actual=%dMiB diff=%dMiB "
              "max_prune_height=%d removed %d blk/rev pairs\n",
@@ -4529,14 +5156,47 @@ static FlatFileSeq UndoFileSeq() {
 }
 
 FILE *OpenBlockFile(const FlatFilePos &pos, bool fReadOnly) {
+    if (fReadOnly && g_block_writer) {
+        g_block_writer->WaitForFile(pos.nFile);
+    }
     return BlockFileSeq().Open(pos, fReadOnly);
 }
 
 /** Open an undo file (rev?????.dat) */
 static FILE *OpenUndoFile(const FlatFilePos &pos, bool fReadOnly) {
+    if (fReadOnly && g_undo_writer) {
+        g_undo_writer->WaitForFile(pos.nFile);
+    }
     return UndoFileSeq().Open(pos, fReadOnly);
 }
 
+void StartBlockFileWriters() {
+    assert(!g_block_writer && !g_undo_writer);
+    g_block_writer =
+        std::make_unique<FlatFileWriter>(BlockFileSeq(), "blkwrite");
+    g_undo_writer =
+        std::make_unique<FlatFileWriter>(UndoFileSeq(), "revwrite");
+}
+
+void StopBlockFileWriters() {
+    if (!g_block_writer) {
+        return;
+    }
+    // Everything referenced by the block index on disk was committed when it
+    // was written; what is left still reaches the OS before the files close.
+    g_block_writer.reset();
+    g_undo_writer.reset();
+}
+
+void StartBackgroundPruning() {
+    assert(!g_file_remover);
+    g_file_remover = std::make_unique<FileRemover>("prune");
+}
+
+void StopBackgroundPruning() {
+    g_file_remover.reset();
+}
+
 fs::path GetBlockPosFilename(const FlatFilePos &pos) {
     return BlockFileSeq().FileName(pos);
 }
@@ -5142,6 +5802,8 @@ bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
         CBufferedFile blkdat(fileIn, 2 * MAX_TX_SIZE, MAX_TX_SIZE + 8, SER_DISK,
                              CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
+        const CMessageHeader::MessageMagic compressedMagic =
+            BlockCompression::CompressedDiskMagic(chainparams.DiskMagic());
         while (!blkdat.eof()) {
             boost::this_thread::interruption_point();
 
@@ -5151,14 +5813,15 @@ bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
             // Remove former limit.
             blkdat.SetLimit();
             unsigned int nSize = 0;
+            bool fCompressed = false;
             try {
                 // Locate a header.
-                uint8_t buf[CMessageHeader::MESSAGE_START_SIZE];
+                CMessageHeader::MessageMagic buf;
                 blkdat.FindByte(chainparams.DiskMagic()[0]);
                 nRewind = blkdat.GetPos() + 1;
                 blkdat >> buf;
-                if (memcmp(buf, chainparams.DiskMagic().data(),
-                           CMessageHeader::MESSAGE_START_SIZE)) {
+                fCompressed = buf == compressedMagic;
+                if (!fCompressed && buf != chainparams.DiskMagic()) {
                     continue;
                 }
 
@@ -5182,7 +5845,11 @@ bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
                 CBlock &block = *pblock;
-                blkdat >> block;
+                if (fCompressed) {
+                    ReadCompressedBlock(blkdat, nSize, block);
+                } else {
+                    blkdat >> block;
+                }
                 nRewind = blkdat.GetPos();
 
                 const BlockHash hash = block.GetHash();
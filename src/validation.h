@@ -50,6 +50,7 @@ class CScriptCheck;
 class CTxMemPool;
 class CTxUndo;
 class CValidationState;
+class UndoCache;
 
 struct FlatFilePos;
 struct ChainTxData;
@@ -152,6 +153,12 @@ static constexpr int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static constexpr bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static constexpr bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static constexpr bool DEFAULT_TXINDEX = false;
+/** Default for -asyncblockwrites */
+static constexpr bool DEFAULT_ASYNC_BLOCK_WRITES = false;
+/** Default for -asyncprune */
+static constexpr bool DEFAULT_ASYNC_PRUNE = false;
+/** Default for -blockcompression */
+static constexpr bool DEFAULT_BLOCK_COMPRESSION = false;
 static constexpr unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -persistmempool */
@@ -206,6 +213,10 @@ extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Store new blocks as compressed records (-blockcompression). */
+extern bool fBlockCompression;
+/** Undo data of recently connected blocks (-undocache). */
+extern UndoCache g_undo_cache;
 extern size_t nCoinCacheUsage;
 
 /**
@@ -353,10 +364,38 @@ bool ProcessNewBlockHeaders(const Config &config,
     LOCKS_EXCLUDED(cs_main);
 
 /**
- * Open a block file (blk?????.dat).
+ * Open a block file (blk?????.dat). Opening it read-only waits for the data
+ * queued for it by the block file writer.
  */
 FILE *OpenBlockFile(const FlatFilePos &pos, bool fReadOnly = false);
 
+/**
+ * Write block and undo files on dedicated I/O threads (-asyncblockwrites).
+ * Must be called before any block is written or read.
+ */
+void StartBlockFileWriters();
+
+/**
+ * Stop the block and undo file writers after the queued writes are done.
+ * The files are only committed to disk by FlushStateToDisk().
+ */
+void StopBlockFileWriters();
+
+/**
+ * Rewrite the blocks of the existing block files as compressed records, then
+ * empty the files. Runs once, after the initial block download.
+ */
+void ThreadMigrateBlockFiles(const CChainParams &chainparams);
+
+/**
+ * Prune ahead of the target without flushing the chainstate, and delete the
+ * pruned files on a background thread (-asyncprune).
+ */
+void StartBackgroundPruning();
+
+/** Stop the background pruning thread after the queued files are deleted. */
+void StopBackgroundPruning();
+
 /**
  * Translation to a filesystem path.
  */
@@ -655,6 +694,14 @@ bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
                        const Consensus::Params &params);
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
                        const Consensus::Params &params);
+/**
+ * Read the serialized block without deserializing it, for callers that only
+ * relay, hash or inspect it. Only the header is checked.
+ */
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block,
+                          const CBlockIndex *pindex,
+                          const Consensus::Params &params,
+                          const CMessageHeader::MessageMagic &messageStart);
 
 bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex);
 
@@ -690,6 +737,15 @@ bool TestBlockValidity(CValidationState &state, const CChainParams &params,
                        BlockValidationOptions validationOptions)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * Skip the script checks of a block when it gets connected. Only for blocks
+ * whose transactions, apart from the coinbase, passed TestBlockValidity() on
+ * top of the same parent, such as blocks solved from a block template: the
+ * coinbase has no inputs, and the parent determines the script flags.
+ */
+void MarkBlockScriptsChecked(const BlockHash &hash)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /**
  * RAII wrapper for VerifyDB: Verify consistency of the block and coin
  * databases.
@@ -61,7 +61,7 @@ struct MainSignalsInstance {
         m_connMainSignals;
 
     explicit MainSignalsInstance(CScheduler *pscheduler)
-        : m_schedulerClient(pscheduler) {}
+        : m_schedulerClient(pscheduler, "validationinterface") {}
 };
 
 static CMainSignals g_signals;
@@ -348,7 +348,7 @@ void StartWallets(CScheduler &scheduler) {
             MaybeCompactWalletDB();
             return true;
         },
-        500);
+        500, "compactwallet");
 }
 
 void FlushWallets() {
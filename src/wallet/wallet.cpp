@@ -2005,9 +2005,7 @@ bool CWalletTx::RelayWalletTransaction(interfaces::Chain::Lock &locked_chain,
     if (InMempool() || AcceptToMemoryPool(locked_chain, maxTxFee, state)) {
         pwallet->WalletLogPrintf("Relaying wtx %s\n", GetId().ToString());
         if (connman) {
-            CInv inv(MSG_TX, GetId());
-            connman->ForEachNode(
-                [&inv](CNode *pnode) { pnode->PushInventory(inv); });
+            connman->RelayTransaction(GetId());
             return true;
         }
     }
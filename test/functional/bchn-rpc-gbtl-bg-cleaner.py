@@ -108,6 +108,8 @@ class GBTLightBGCleanerTest(BitcoinTestFramework):
             for _ in range(n_iters):
                 gbtl.append(node.getblocktemplatelight({}, txs_tmp))
                 txs_tmp += txs
+            # job data is written in the background, wait for all of it to show up
+            wait_until(lambda: {x['job_id'] for x in gbtl} <= seen_jobs_in_gbt_dir, timeout=self._store_time)
         finally:
             # Ensure subordinate poller thread is stopped, joined
             stop_flag.set()
@@ -17,7 +17,8 @@ import time
 from decimal import Decimal
 
 from test_framework.test_framework import BitcoinTestFramework
-from test_framework.util import assert_equal, assert_raises_rpc_error, assert_blocktemplate_equal
+from test_framework.authproxy import JSONRPCException
+from test_framework.util import assert_equal, assert_raises_rpc_error, assert_blocktemplate_equal, wait_until
 from test_framework import messages, script, util, blocktools
 
 
@@ -290,6 +291,11 @@ class GBTLightTest(BitcoinTestFramework):
         assert_blocktemplate_equal(gbtl0, gbtl1)
         self.check_merkle(gbtl0, txids)
 
+        # identical requests for the same template are answered from the shared result cache
+        with self.nodes[0].assert_debug_log(["getblocktemplatecommon: using cached result"]):
+            assert_blocktemplate_equal(self.nodes[0].getblocktemplatelight(), gbtl0)
+            assert_blocktemplate_equal(self.nodes[0].getblocktemplate(), gbt0)
+
         # Test RPC errors
 
         # bad txn hex (decode failure) at index 1
@@ -387,10 +393,17 @@ class GBTLightTest(BitcoinTestFramework):
                 # Set chmod of data directory to read-only to simulate an error writing to the job data file.
                 # This should cause the anticipated error on the C++ side.
                 os.chmod(self._custom_gbt_dir, new_mode)
-                assert_raises_rpc_error(-32603,  # RPC_INTERNAL_ERROR
-                                        "failed to save job tx data to disk",
-                                        self.nodes[1].getblocktemplatelight,
-                                        {}, extratxs)
+                # Job data is written in the background, so the error is reported by the call following the failed
+                # write.
+                def save_failed():
+                    try:
+                        self.nodes[1].getblocktemplatelight({}, extratxs)
+                        return False
+                    except JSONRPCException as e:
+                        assert_equal(e.error['code'], -32603)  # RPC_INTERNAL_ERROR
+                        assert_equal(e.error['message'], "failed to save job tx data to disk")
+                        return True
+                wait_until(save_failed, timeout=10)
             finally:
                 if orig_mode is not None:
                     # undo the damage to the directory's mode from above
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test that long-poll RPCs do not hold the HTTP worker threads while waiting."""
+
+import http.client
+from threading import Thread
+import urllib.parse
+
+from test_framework.authproxy import AuthServiceProxy
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, wait_until
+
+NUM_WAITERS = 8
+
+
+class LongPoller(Thread):
+    def __init__(self, node, method, *args):
+        super().__init__()
+        # Each waiter needs a connection of its own, closed once done so that
+        # it does not delay the shutdown of the node.
+        url = urllib.parse.urlparse(node.url)
+        self.conn = http.client.HTTPConnection(url.hostname, url.port, timeout=600)
+        self.call = getattr(AuthServiceProxy(node.url, connection=self.conn), method)
+        self.args = args
+        self.result = None
+
+    def run(self):
+        self.result = self.call(*self.args)
+        self.conn.close()
+
+
+class RPCLongPollTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        # getblocktemplate needs a connected peer
+        self.num_nodes = 2
+        self.extra_args = [["-rpcthreads=1"], []]
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generatetoaddress(1, node.get_deterministic_priv_key().address)
+        self.sync_all()
+        tip = node.getbestblockhash()
+        longpollid = node.getblocktemplate()["longpollid"]
+
+        self.log.info("Park more long polls than there are worker threads")
+        pollers = [LongPoller(node, "waitfornewblock")
+                   for _ in range(NUM_WAITERS)]
+        pollers.append(LongPoller(node, "waitforblockheight", 2))
+        pollers.append(LongPoller(
+            node, "getblocktemplate", {"longpollid": longpollid}))
+        for poller in pollers:
+            poller.start()
+        # Parked requests are still listed, along with getrpcinfo itself.
+        wait_until(lambda: len(
+            node.getrpcinfo()["active_commands"]) == len(pollers) + 1)
+
+        self.log.info("Other requests are answered meanwhile")
+        assert_equal(node.getblockcount(), 1)
+        assert_equal(node.waitfornewblock(100), {"hash": tip, "height": 1})
+        assert_equal(node.waitforblockheight(1)["hash"], tip)
+        assert all(poller.is_alive() for poller in pollers)
+
+        self.log.info("A new block answers the parked requests")
+        self.nodes[1].generatetoaddress(
+            1, node.get_deterministic_priv_key().address)
+        self.sync_all()
+        tip = node.getbestblockhash()
+        for poller in pollers:
+            poller.join(10)
+            assert not poller.is_alive()
+        for poller in pollers[:-1]:
+            assert_equal(poller.result, {"hash": tip, "height": 2})
+        assert_equal(pollers[-1].result["previousblockhash"], tip)
+        assert_equal(len(node.getrpcinfo()["active_commands"]), 1)
+
+        self.log.info("Parked requests are answered on shutdown")
+        poller = LongPoller(node, "waitfornewblock")
+        poller.start()
+        wait_until(lambda: len(node.getrpcinfo()["active_commands"]) == 2)
+        self.stop_node(0)
+        poller.join(10)
+        assert_equal(poller.result, {"hash": tip, "height": 2})
+
+
+if __name__ == '__main__':
+    RPCLongPollTest().main()
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test that blocks solving a recent block template skip the script checks."""
+
+import os
+
+from test_framework.blocktools import create_coinbase
+from test_framework.messages import CBlock
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+
+class SubmitBlockTemplateTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        # getblocktemplate needs a connected peer
+        self.num_nodes = 2
+
+    def solve(self, tmpl):
+        coinbase = create_coinbase(height=tmpl["height"])
+        coinbase.vout[0].nValue = tmpl["coinbasevalue"]
+        coinbase.rehash()
+        block = CBlock()
+        block.nVersion = tmpl["version"]
+        block.hashPrevBlock = int(tmpl["previousblockhash"], 16)
+        block.nTime = tmpl["curtime"]
+        block.nBits = int(tmpl["bits"], 16)
+        block.vtx = [coinbase]
+        block.hashMerkleRoot = block.calc_merkle_root()
+        block.solve()
+        return block
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generatetoaddress(1, node.get_deterministic_priv_key().address)
+        self.sync_all()
+
+        self.log.info("submitblock: block solving a template")
+        block = self.solve(node.getblocktemplate())
+        with node.assert_debug_log(["solves template job_id", "Skipping script checks of template block"]):
+            assert_equal(node.submitblock(block.serialize().hex()), None)
+        assert_equal(node.getbestblockhash(), block.hash)
+
+        self.log.info("submitblocklight: block solving a template")
+        tmpl = node.getblocktemplatelight()
+        block = self.solve(tmpl)
+        with node.assert_debug_log(["solves template job_id", "Skipping script checks of template block"]):
+            assert_equal(node.submitblocklight(block.serialize().hex(), tmpl["job_id"]), None)
+        assert_equal(node.getbestblockhash(), block.hash)
+        self.sync_all()
+
+        self.log.info("submitblock: block not solving a template")
+        tmpl = node.getblocktemplate()
+        node.generatetoaddress(1, node.get_deterministic_priv_key().address)
+        tmpl["previousblockhash"] = node.getbestblockhash()
+        tmpl["height"] += 1
+        tmpl["curtime"] += 1
+        block = self.solve(tmpl)
+        debug_log = os.path.join(node.datadir, "regtest", "debug.log")
+        with open(debug_log, encoding="utf-8") as log:
+            log.seek(0, os.SEEK_END)
+            assert_equal(node.submitblock(block.serialize().hex()), None)
+            assert_equal(node.getbestblockhash(), block.hash)
+            assert "Skipping script checks" not in log.read()
+        self.sync_all()
+
+
+if __name__ == '__main__':
+    SubmitBlockTemplateTest().main()
@@ -88,6 +88,17 @@ class DisconnectBanTest(BitcoinTestFramework):
 
         # Clear ban lists
         self.nodes[1].clearbanned()
+
+        self.log.info("importbanlist: ban many IPs/subnets at once")
+        result = self.nodes[1].importbanlist(
+            ["10.0.0.0/8", "192.168.1.1", "2001:4d48::/32", "127.0.0.1/42",
+             "junk"], 1000)
+        assert_equal(result['banned'], 3)
+        assert_equal(result['invalid'], ["127.0.0.1/42", "junk"])
+        assert_equal(len(self.nodes[1].listbanned()), 3)
+        assert_equal(self.nodes[1].importbanlist(
+            ["10.0.0.0/8"], 1000)['banned'], 0)
+        self.nodes[1].clearbanned()
         connect_nodes_bi(self.nodes[0], self.nodes[1])
 
         self.log.info("Test disconnectnode RPCs")
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the fastblockrelay permission.
+
+Peers with the permission get new blocks, in full or as compact blocks, as soon
+as they pass the header and block checks, before they are connected. This is
+shown with blocks that pass these checks but fail to connect. Only peers known
+to have the parent block get them.
+"""
+
+from test_framework.blocktools import create_block, create_coinbase
+from test_framework.messages import (
+    CInv,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxOut,
+    MSG_BLOCK,
+    msg_inv,
+    msg_sendcmpct,
+)
+from test_framework.mininode import P2PInterface, mininode_lock
+from test_framework.script import CScript, OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.txtools import pad_tx
+from test_framework.util import assert_equal, connect_nodes, wait_until
+
+INVALID_CB_NO_BAN_VERSION = 70015
+
+
+class CompactBlockPeer(P2PInterface):
+    def peer_connect(self, *args, **kwargs):
+        create_conn = super().peer_connect(*args, **kwargs)
+        # Compact blocks are only pushed to peers that do not ban for invalid
+        # ones.
+        self.on_connection_send_msg.nVersion = INVALID_CB_NO_BAN_VERSION
+        return create_conn
+
+
+class FastBlockRelayTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-whitelist=fastblockrelay@127.0.0.1"], []]
+
+    def setup_network(self):
+        # The nodes are tested separately
+        self.setup_nodes()
+
+    def make_unconnectable_block(self, node):
+        """A block that passes CheckBlock, spending an unknown output."""
+        tmpl = node.getblocktemplate()
+        block = create_block(int(tmpl["previousblockhash"], 16),
+                             create_coinbase(tmpl["height"]), tmpl["curtime"])
+        block.nBits = int(tmpl["bits"], 16)
+        tx = CTransaction()
+        tx.vin.append(CTxIn(COutPoint(0xdead, 0)))
+        tx.vout.append(CTxOut(1000, CScript([OP_TRUE])))
+        pad_tx(tx)
+        block.vtx.append(tx)
+        block.hashMerkleRoot = block.calc_merkle_root()
+        block.solve()
+        return block
+
+    def run_test(self):
+        node, other = self.nodes
+        for n in self.nodes:
+            # Leave initial block download
+            n.generatetoaddress(1, n.get_deterministic_priv_key().address)
+
+        full = node.add_p2p_connection(P2PInterface())
+        compact = node.add_p2p_connection(CompactBlockPeer())
+        without = other.add_p2p_connection(P2PInterface())
+        assert "fastblockrelay" in node.getpeerinfo()[0]["permissions"]
+        assert "fastblockrelay" not in other.getpeerinfo()[0]["permissions"]
+
+        # Compact blocks without asking for high-bandwidth announcements
+        compact.send_message(msg_sendcmpct())
+        # Blocks are only sent early to peers known to have their parent
+        for n, p in ((node, full), (node, compact), (other, without)):
+            p.send_message(msg_inv(
+                [CInv(MSG_BLOCK, int(n.getbestblockhash(), 16))]))
+            p.sync_with_ping()
+
+        self.log.info("Blocks are sent before they are connected")
+        tip = int(node.generatetoaddress(
+            1, node.get_deterministic_priv_key().address)[0], 16)
+        full.wait_for_block(tip)
+        wait_until(lambda: "cmpctblock" in compact.last_message and
+                   compact.last_message["cmpctblock"].header_and_shortids
+                   .header.rehash() == tip, lock=mininode_lock)
+
+        block = self.make_unconnectable_block(node)
+        assert node.submitblock(block.serialize().hex()) is not None
+        assert_equal(int(node.getbestblockhash(), 16), tip)
+        full.wait_for_block(block.sha256)
+        wait_until(lambda: "cmpctblock" in compact.last_message and
+                   compact.last_message["cmpctblock"].header_and_shortids
+                   .header.rehash() == block.sha256, lock=mininode_lock)
+
+        self.log.info("Peers without the permission are not sent them")
+        block = self.make_unconnectable_block(other)
+        assert other.submitblock(block.serialize().hex()) is not None
+        without.sync_with_ping()
+        assert "block" not in without.last_message
+        assert "cmpctblock" not in without.last_message
+
+        self.log.info("The permission applies to outbound connections too")
+        self.restart_node(1, ["-whitelist=fastblockrelay@127.0.0.1"])
+        connect_nodes(other, node)
+        peer = [p for p in other.getpeerinfo() if not p["inbound"]][0]
+        assert_equal(peer["permissions"], ["fastblockrelay"])
+
+
+if __name__ == '__main__':
+    FastBlockRelayTest().main()
@@ -81,6 +81,13 @@ class P2PPermissionsTests(BitcoinTestFramework):
             ["forcerelay", "noban", "mempool", "bloomfilter", "relay"],
             False)
 
+        self.checkpermission(
+            # fastblockrelay is not part of all and must be named explicitly
+            ["-whitelist=all,fastblockrelay@127.0.0.1"],
+            ["forcerelay", "noban", "mempool", "bloomfilter", "relay",
+             "fastblockrelay"],
+            False)
+
         self.stop_node(1)
         self.nodes[1].assert_start_raises_init_error(
             ["-whitelist=oopsie@127.0.0.1"],
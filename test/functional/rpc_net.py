@@ -36,6 +36,8 @@ class NetTest(BitcoinTestFramework):
         self._test_getnetworkinginfo()
         self._test_getaddednodeinfo()
         self._test_getpeerinfo()
+        self._test_getmessagestats()
+        self._test_getblockdownloadinfo()
         self._test_getnodeaddresses()
 
     def _test_connection_count(self):
@@ -83,6 +85,19 @@ class NetTest(BitcoinTestFramework):
                 after['bytessent_per_msg'].get(
                     'ping', 0), before['bytessent_per_msg'].get(
                     'ping', 0) + 32)
+            assert_greater_than_or_equal(
+                after['processing_per_msg']['pong']['count'], 1)
+
+    def _test_getmessagestats(self):
+        stats = self.nodes[0].getmessagestats()
+        pong = stats['messages']['pong']
+        assert_greater_than_or_equal(pong['count'], 1)
+        assert_equal(sum(pong['histogram']), pong['count'])
+        assert_greater_than_or_equal(pong['time_us'], pong['max_time_us'])
+        assert_greater_than_or_equal(pong['queue_us'], pong['max_queue_us'])
+        assert_equal(len(stats['peers']), 2)
+        times = [peer['time_us'] for peer in stats['peers']]
+        assert_equal(times, sorted(times, reverse=True))
 
     def _test_getnetworkinginfo(self):
         assert_equal(self.nodes[0].getnetworkinfo()['networkactive'], True)
@@ -122,6 +137,17 @@ class NetTest(BitcoinTestFramework):
         assert_equal(peer_info[0][0]['minfeefilter'], Decimal("0.00000500"))
         assert_equal(peer_info[1][0]['minfeefilter'], Decimal("0.00001000"))
 
+    def _test_getblockdownloadinfo(self):
+        info = self.nodes[0].getblockdownloadinfo()
+        assert_equal(info['adaptive'], True)
+        assert_equal(info['inflight'], 0)
+        assert_equal(info['duplicates_inflight'], 0)
+        assert_equal(len(info['peers']), 2)
+        for peer in info['peers']:
+            assert_equal(peer['inflight'], 0)
+            assert_equal(peer['stalling'], False)
+            assert_greater_than_or_equal(peer['window'], 2)
+
     def _test_getnodeaddresses(self):
         self.nodes[0].add_p2p_connection(P2PInterface())
 